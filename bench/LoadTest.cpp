@@ -0,0 +1,433 @@
+// Synthetic load on a scene host. Serves a generated scene to client
+// processes forked from this one: players each own a token and play a
+// script of edits to it in a loop, predicted as the app does, and spectators
+// only watch. The host applies the edits and moves a share of the other
+// tokens every frame, for a fixed time once everyone has connected.
+// Reports the host's CPU time, split between the main thread and the network
+// thread, what it sent and the edit latency players saw, as percentiles.
+//
+//   ./build/load_test [--players 6] [--spectators 12] [--duration 5] [--script edits.txt]
+//                     [--tokens 1000] [--frame-ms 16] [--in-flight 8]
+//
+// A script has one step per line, blank lines and # comments are skipped:
+//
+//   move 0.5 0      moves the token by an offset
+//   rotate 15       turns it by degrees
+//   opacity 0.8     sets its opacity, outside 0-1 the host rejects it
+//   wait 100        sleeps for milliseconds before the next step
+//
+// Exits non-zero if the script can't be read or a client fails.
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Actions.hpp>
+#include <Resources.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <net/Protocol.h>
+#include <net/SceneClient.h>
+#include <net/SceneHost.h>
+
+#include "SceneGenerator.h"
+
+
+struct LoadTestOptions
+{
+    size_t numPlayers = 6;
+    size_t numSpectators = 12;
+    double durationSeconds = 5.0;
+    std::string scriptPath;
+    size_t numTokens = 1000;
+    int frameMs = 16;
+    // Edits a player has waiting on the host at once, it pauses the script
+    // beyond this
+    size_t inFlight = 8;
+    // Share of the host's tokens moved each frame
+    float movedFraction = 0.01f;
+};
+
+// About 40 edits a second from each player, one of them rejected
+const char* DEFAULT_SCRIPT = R"(
+move 0.5 0
+wait 25
+move 0 0.5
+wait 25
+rotate 15
+wait 25
+move -0.5 0
+wait 25
+move 0 -0.5
+wait 25
+opacity 0.5
+wait 25
+opacity 1
+wait 25
+opacity 2
+wait 25
+)";
+
+struct ScriptStep
+{
+    enum Kind
+    {
+        Wait,
+        Move,
+        Rotate,
+        Opacity
+    } kind;
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+static bool ParseScript(std::istream& stream, std::vector<ScriptStep>& steps)
+{
+    std::string line;
+    size_t number = 0;
+    while (std::getline(stream, line))
+    {
+        number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command))
+            continue;
+        ScriptStep step;
+        bool valid;
+        if (command == "wait")
+        {
+            step.kind = ScriptStep::Wait;
+            valid = bool(words >> step.x) && step.x >= 0.0f;
+        }
+        else if (command == "move")
+        {
+            step.kind = ScriptStep::Move;
+            valid = bool(words >> step.x >> step.y);
+        }
+        else if (command == "rotate")
+        {
+            step.kind = ScriptStep::Rotate;
+            valid = bool(words >> step.x);
+        }
+        else if (command == "opacity")
+        {
+            step.kind = ScriptStep::Opacity;
+            valid = bool(words >> step.x);
+        }
+        else
+            valid = false;
+        if (!valid)
+        {
+            std::cerr << "Invalid script step on line " << number << ": " << line << std::endl;
+            return false;
+        }
+        steps.push_back(step);
+    }
+    // Without a wait a player would only ever be held back by its in-flight edits
+    bool waits = std::any_of(steps.begin(), steps.end(), [](const ScriptStep& step) { return step.kind == ScriptStep::Wait && step.x > 0.0f; });
+    if (!waits)
+    {
+        std::cerr << "Script needs at least one wait" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// What a client sends back over its pipe once the host has gone
+struct ClientReport
+{
+    SyncStats stats;
+    uint64_t editsSent;
+};
+
+static double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double CPUMs(int who)
+{
+    rusage usage;
+    if (getrusage(who, &usage) != 0)
+        return 0.0;
+    auto ms = [](const timeval& time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+    return ms(usage.ru_utime) + ms(usage.ru_stime);
+}
+
+// Runs in the forked process, never returns
+static void RunClient(uint16_t port, const LoadTestOptions& options, const std::vector<ScriptStep>& script, bool player, int reportFd)
+{
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(resources);
+    SceneClient client(resources);
+    if (!client.Connect("127.0.0.1", port))
+        _exit(2);
+
+    ClientReport report{};
+    size_t step = 0;
+    double resumeMs = 0.0;
+    while (client.IsConnected())
+    {
+        client.Update(scene);
+        // Steps up to the next wait are sent together
+        while (player && client.HasScene() && NowMs() >= resumeMs && client.NumPendingEdits() < options.inFlight)
+        {
+            std::shared_ptr<Token> token;
+            for (const auto& candidate: scene->tokens)
+            {
+                if (client.Owns(candidate->GetID()))
+                {
+                    token = candidate;
+                    break;
+                }
+            }
+            if (!token)
+                break;
+
+            const ScriptStep& current = script[step];
+            step = (step + 1) % script.size();
+            if (current.kind == ScriptStep::Wait)
+            {
+                resumeMs = NowMs() + current.x;
+                continue;
+            }
+            ShapeState state = CaptureToken(*token);
+            SyncField fields = SyncField::Position;
+            if (current.kind == ScriptStep::Move)
+                state.position = QuantizePosition(token->GetModel()->GetPos() + glm::vec2(current.x, current.y));
+            else if (current.kind == ScriptStep::Rotate)
+            {
+                fields = SyncField::Rotation;
+                state.rotation = token->GetModel()->GetRotation() + current.x;
+            }
+            else
+            {
+                fields = SyncField::Opacity;
+                state.opacity = current.x;
+            }
+            ApplyToken(state, fields, *token, *resources);
+            client.RequestEdit(token->GetID(), fields, state);
+            report.editsSent++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    report.stats = client.Stats();
+    bool sent = write(reportFd, &report, sizeof(report)) == sizeof(report);
+    _exit(sent ? 0 : 3);
+}
+
+static bool ReadAll(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    LoadTestOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--players" && i + 1 < argc)
+            options.numPlayers = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--spectators" && i + 1 < argc)
+            options.numSpectators = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--duration" && i + 1 < argc)
+            options.durationSeconds = std::atof(argv[++i]);
+        else if (arg == "--script" && i + 1 < argc)
+            options.scriptPath = argv[++i];
+        else if (arg == "--tokens" && i + 1 < argc)
+            options.numTokens = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--frame-ms" && i + 1 < argc)
+            options.frameMs = std::atoi(argv[++i]);
+        else if (arg == "--in-flight" && i + 1 < argc)
+            options.inFlight = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    // One per player and at least one moved at random
+    options.numTokens = std::max(options.numTokens, options.numPlayers + 1);
+
+    std::vector<ScriptStep> script;
+    if (options.scriptPath.empty())
+    {
+        std::istringstream stream(DEFAULT_SCRIPT);
+        ParseScript(stream, script);
+    }
+    else
+    {
+        std::ifstream stream(options.scriptPath);
+        if (!stream)
+        {
+            std::cerr << "Unable to read " << options.scriptPath << std::endl;
+            return 2;
+        }
+        if (!ParseScript(stream, script))
+            return 2;
+    }
+
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    SceneGeneratorOptions sceneOptions;
+    sceneOptions.numTokens = options.numTokens;
+    std::shared_ptr<Scene> scene = GenerateScene(resources, sceneOptions);
+
+    SceneHost host(resources);
+    if (!host.Listen(0))
+        return 2;
+    // Players start editing as soon as they're connected
+    auto applyEdits = [&]() {
+        ActionEffects effects;
+        for (const SceneHost::Edit& edit: host.TakeEdits())
+        {
+            ApplyToken(edit.state, edit.fields, *scene->GetToken(edit.id), *resources);
+            effects.shapes.push_back(edit.id);
+        }
+        return effects;
+    };
+
+    struct Child
+    {
+        pid_t pid;
+        int fd;
+    };
+    // Connected one at a time, so the i'th player owns the i'th token
+    size_t numClients = options.numPlayers + options.numSpectators;
+    std::vector<Child> children;
+    for (size_t i = 0; i < numClients; i++)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return 2;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            RunClient(host.Port(), options, script, i < options.numPlayers, fds[1]);
+        }
+        close(fds[1]);
+        children.push_back({pid, fds[0]});
+        while (host.NumClients() <= i)
+        {
+            int status;
+            if (waitpid(pid, &status, WNOHANG) == pid)
+            {
+                std::cerr << "Client " << pid << " failed to connect" << std::endl;
+                return 2;
+            }
+            host.Record(applyEdits());
+            host.Update(scene);
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.frameMs));
+        }
+        if (i < options.numPlayers)
+            host.SetOwner(scene->tokens[i]->GetID(), host.Clients().back());
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(options.numPlayers, scene->tokens.size() - 1);
+    size_t movedPerFrame = std::max<size_t>(1, options.numTokens * options.movedFraction);
+
+    // Only what happens under load is counted
+    SyncStats before = host.Stats();
+    double processStartMs = CPUMs(RUSAGE_SELF);
+    double mainStartMs = CPUMs(RUSAGE_THREAD);
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.durationSeconds));
+    size_t numFrames = 0;
+    double maxFrameMs = 0.0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        ActionEffects effects = applyEdits();
+        for (size_t i = 0; i < movedPerFrame; i++)
+        {
+            const auto& token = scene->tokens[pick(rng)];
+            token->GetModel()->SetPos(token->GetModel()->GetPos() + glm::vec2(0.25f, -0.25f));
+            effects.shapes.push_back(token->GetID());
+        }
+        host.Record(effects);
+        host.Update(scene);
+        numFrames++;
+        maxFrameMs = std::max(maxFrameMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(options.frameMs));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mainMs = CPUMs(RUSAGE_THREAD) - mainStartMs;
+    double processMs = CPUMs(RUSAGE_SELF) - processStartMs;
+    SyncStats after = host.Stats();
+
+    // A few more frames so the last edits are acknowledged before closing
+    for (int i = 0; i < 10; i++)
+    {
+        host.Record(applyEdits());
+        host.Update(scene);
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.frameMs));
+    }
+    host.Stop();
+
+    bool failed = false;
+    LatencyHistogram latencies;
+    uint64_t editsSent = 0;
+    double maxLatency = 0.0;
+    for (Child& child: children)
+    {
+        ClientReport report;
+        int status = 0;
+        bool received = ReadAll(child.fd, &report, sizeof(report));
+        close(child.fd);
+        waitpid(child.pid, &status, 0);
+        if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "Client " << child.pid << " failed" << std::endl;
+            failed = true;
+            continue;
+        }
+        latencies.Merge(report.stats.latencies);
+        editsSent += report.editsSent;
+        maxLatency = std::max(maxLatency, report.stats.maxLatencyMs);
+    }
+
+    uint64_t bytes = after.bytesSent - before.bytesSent;
+    uint64_t messages = after.messagesSent - before.messagesSent;
+    uint64_t accepted = after.editsAccepted - before.editsAccepted;
+    uint64_t rejected = after.editsRejected - before.editsRejected;
+    std::cout << options.numPlayers << " players, " << options.numSpectators << " spectators, " << options.numTokens << " tokens, "
+              << numFrames << " frames of " << options.frameMs << " ms in " << seconds << " s" << std::endl;
+    std::cout << "host cpu      " << 100.0 * processMs / (seconds * 1000.0) << "% of a core, " << mainMs << " ms main thread, "
+              << processMs - mainMs << " ms network thread, " << maxFrameMs << " ms slowest frame" << std::endl;
+    std::cout << "host sent     " << bytes / 1024.0 / seconds << " KB/s in " << messages / seconds << " messages/s" << std::endl;
+    std::cout << "edits         " << (accepted + rejected) / seconds << " /s, " << accepted << " accepted, " << rejected << " rejected, "
+              << editsSent << " sent in all" << std::endl;
+    std::cout << "edit latency  " << latencies.Percentile(0.5) << " ms p50, " << latencies.Percentile(0.9) << " ms p90, "
+              << latencies.Percentile(0.99) << " ms p99, " << maxLatency << " ms max, over " << latencies.Total() << " edits" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,356 @@
+// Two process benchmark for the shared memory scene mirror. This process
+// writes a generated scene every frame while a forked display process reads
+// it the way `mapmaker --display` does, minus the drawing. Each frame the
+// writer moves a share of the tokens and adds more, so the region has to
+// grow under the reader, and now and then removes one or hides an image so
+// the reader's lists are rebuilt. Reports how long writing, reading and
+// applying frames took and how often a read caught a frame half written,
+// then checks the display ended with exactly the writer's scene. With --fog
+// the fog of war is lifted around a few of the moving tokens among walls, and
+// the display must end with only the tokens they see and the same mask. With
+// --deselect as well the viewers are deselected halfway, which lifts the fog
+// for the host alone, and the display must end with nothing but the mask.
+//
+//   ./build/mirror_bench [--tokens 1000] [--frames 300] [--added 50] [--frame-ms 16] [--fog [--deselect]]
+//
+// Exits non-zero if the display's scene differs.
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <BinarySerializer.h>
+#include <Resources.h>
+#include <SceneMirror.h>
+#include <glutil/Camera.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include "SceneGenerator.h"
+
+
+struct MirrorBenchOptions
+{
+    size_t numTokens = 1000;
+    size_t numFrames = 300;
+    // Tokens added each frame
+    size_t numAdded = 50;
+    int frameMs = 16;
+    // Share of the tokens moved each frame
+    float movedFraction = 0.05f;
+    bool fog = false;
+    // Clears the host's selection halfway, fog only
+    bool deselect = false;
+};
+
+// Every this many frames a token is removed and an image hidden or shown
+const size_t SHUFFLE_INTERVAL = 25;
+// Tokens the fog is lifted around with --fog
+const size_t NUM_FOG_VIEWERS = 4;
+
+// What the display sends back over its pipe once the writer has gone
+struct DisplayReport
+{
+    uint64_t digest;
+    size_t numTokens;
+    uint64_t framesRead;
+    uint64_t retries;
+    double readMs;
+    double applyMs;
+    double maxFrameMs;
+};
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Tokens the scene's fog doesn't hide from the players
+static size_t NumVisibleTokens(Scene& scene)
+{
+    return std::count_if(scene.tokens.begin(), scene.tokens.end(), [&scene](const auto& token) {
+        return SceneMirrorWriter::IsShown(*scene.fog, token->GetModel()->GetPos());
+    });
+}
+
+// Hashes everything the mirror carries, in draw order
+static uint64_t SceneDigest(Scene& scene, const Camera& camera)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    auto mixShape = [&mix](Shape2D& shape, const std::string& texture) {
+        ShapeID id = shape.GetID();
+        glm::vec2 position = shape.GetModel()->GetPos();
+        glm::vec2 scale = shape.GetModel()->GetScale();
+        float rotation = shape.GetModel()->GetRotation();
+        mix(&id, sizeof(id));
+        mix(&position, sizeof(position));
+        mix(&scale, sizeof(scale));
+        mix(&rotation, sizeof(rotation));
+        mix(texture.data(), texture.size());
+    };
+    for (const auto& token: scene.tokens)
+    {
+        if (!SceneMirrorWriter::IsShown(*scene.fog, token->GetModel()->GetPos()))
+            continue;
+        mixShape(*token, token->GetIcon()->filename);
+        float opacity = token->GetOpacity();
+        glm::vec4 border = token->GetBorderColor();
+        unsigned long statuses = token->GetStatuses().to_ulong();
+        bool xStatus = token->GetXStatus();
+        mix(&opacity, sizeof(opacity));
+        mix(&border, sizeof(border));
+        mix(&statuses, sizeof(statuses));
+        mix(&xStatus, sizeof(xStatus));
+    }
+    for (const auto& image: scene.images)
+    {
+        if (!image->IsVisible())
+            continue;
+        mixShape(*image, image->GetImage()->filename);
+        glm::vec4 tint = image->GetTint();
+        mix(&tint, sizeof(tint));
+    }
+    // The players' mask, which the host may have lifted for itself
+    bool enabled = scene.fog->IsEnabled();
+    mix(&enabled, sizeof(enabled));
+    if (scene.fog->IsMasking())
+    {
+        for (const VisionPolygon* polygon: scene.fog->Polygons())
+        {
+            mix(&polygon->origin, sizeof(polygon->origin));
+            mix(&polygon->range, sizeof(polygon->range));
+            mix(polygon->points.data(), polygon->points.size() * sizeof(glm::vec2));
+            mix(polygon->triangles.data(), polygon->triangles.size() * sizeof(glm::vec2));
+        }
+    }
+    float gridScale = scene.grid->GetScale();
+    mix(&gridScale, sizeof(gridScale));
+    mix(&camera.Position, sizeof(camera.Position));
+    mix(&camera.Focal, sizeof(camera.Focal));
+    return hash;
+}
+
+// Runs in the forked process, never returns
+static void RunDisplay(const std::string& name, int reportFd)
+{
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(resources);
+    Camera camera;
+    std::unique_ptr<SceneMirrorReader> mirror = SceneMirrorReader::Open(name);
+    if (!mirror)
+        _exit(2);
+
+    DisplayReport report{};
+    bool closed = false;
+    while (!closed)
+    {
+        // The last frame is published before the region is closed, so one
+        // more read after seeing it gets everything
+        closed = mirror->IsClosed();
+        auto start = std::chrono::steady_clock::now();
+        if (mirror->Read())
+        {
+            double readMs = ElapsedMs(start);
+            auto applyStart = std::chrono::steady_clock::now();
+            mirror->Apply(*scene, *resources);
+            mirror->ApplyCamera(camera);
+            double applyMs = ElapsedMs(applyStart);
+            report.readMs += readMs;
+            report.applyMs += applyMs;
+            report.maxFrameMs = std::max(report.maxFrameMs, readMs + applyMs);
+            report.framesRead++;
+        }
+        else if (!closed)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    report.digest = SceneDigest(*scene, camera);
+    report.numTokens = scene->tokens.size();
+    report.retries = mirror->Retries();
+    bool sent = write(reportFd, &report, sizeof(report)) == sizeof(report);
+    _exit(sent ? 0 : 3);
+}
+
+static bool ReadAll(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    MirrorBenchOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tokens" && i + 1 < argc)
+            options.numTokens = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--frames" && i + 1 < argc)
+            options.numFrames = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--added" && i + 1 < argc)
+            options.numAdded = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--frame-ms" && i + 1 < argc)
+            options.frameMs = std::atoi(argv[++i]);
+        else if (arg == "--fog")
+            options.fog = true;
+        else if (arg == "--deselect")
+            options.fog = options.deselect = true;
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    SceneGeneratorOptions sceneOptions;
+    sceneOptions.numTokens = options.numTokens;
+    if (options.fog)
+        sceneOptions.numWalls = 2000;
+    std::shared_ptr<Scene> scene = GenerateScene(resources, sceneOptions);
+    std::shared_ptr<Camera> camera = scene->GetViewCamera(PRIMARY);
+    scene->fog->SetEnabled(options.fog);
+    // Viewers among the moved tokens, so their fog changes as it goes
+    auto updateFog = [&scene, &options](bool selected) {
+        if (!options.fog)
+            return;
+        // As Controller::UpdateFog does for a host with nothing selected
+        if (!selected)
+        {
+            scene->fog->Reveal();
+            return;
+        }
+        std::vector<FogViewer> viewers;
+        for (size_t i = 0; i < std::min(NUM_FOG_VIEWERS, scene->tokens.size()); i++)
+            viewers.push_back({scene->tokens[i]->GetID(), scene->tokens[i]->GetModel()->GetPos()});
+        scene->fog->SetTerrain(scene->images);
+        scene->fog->Update(viewers);
+    };
+    updateFog(true);
+
+    // Named for this run so it can't meet an app's
+    std::string name = "/battlematt_mirror_bench_" + std::to_string(getpid());
+    std::unique_ptr<SceneMirrorWriter> mirror = SceneMirrorWriter::Create(name);
+    if (!mirror || !mirror->Write(*scene))
+        return 2;
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 2;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        mirror.release();
+        RunDisplay(name, fds[1]);
+    }
+    close(fds[1]);
+
+    std::mt19937 rng(42);
+    double writeMs = 0.0;
+    double maxWriteMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < options.numFrames; frame++)
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        std::uniform_int_distribution<size_t> pick(0, scene->tokens.size() - 1);
+        size_t moved = std::max<size_t>(1, scene->tokens.size() * options.movedFraction);
+        for (size_t i = 0; i < moved; i++)
+        {
+            auto model = scene->tokens[i < NUM_FOG_VIEWERS && options.fog ? i : pick(rng)]->GetModel();
+            model->SetPos(model->GetPos() + glm::vec2(0.25f, -0.25f));
+            model->SetRotation(model->GetRotation() + 5.0f);
+        }
+        for (size_t i = 0; i < options.numAdded; i++)
+        {
+            // A copy keeps the ID, the scene gives it a new one
+            auto token = std::make_shared<Token>(*scene->tokens[pick(rng)]);
+            token->GetModel()->SetPos(token->GetModel()->GetPos() + glm::vec2(1.0f));
+            scene->AddToken(token);
+        }
+        if (frame % SHUFFLE_INTERVAL == SHUFFLE_INTERVAL - 1)
+        {
+            scene->RemoveTokens({scene->tokens[pick(rng) % scene->tokens.size()]->GetID()});
+            auto& image = scene->images[frame / SHUFFLE_INTERVAL % scene->images.size()];
+            image->SetVisible(!image->IsVisible());
+            camera->Position += glm::vec3(1.0f, 0.5f, 0.0f);
+            camera->Focal *= 1.01f;
+            scene->grid->SetScale(scene->grid->GetScale() + 0.1f);
+        }
+        updateFog(!options.deselect || frame < options.numFrames / 2);
+
+        auto writeStart = std::chrono::steady_clock::now();
+        if (!mirror->Write(*scene))
+        {
+            std::cerr << "Unable to write frame " << frame << std::endl;
+            return 2;
+        }
+        double ms = ElapsedMs(writeStart);
+        writeMs += ms;
+        maxWriteMs = std::max(maxWriteMs, ms);
+        std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(options.frameMs));
+    }
+    double seconds = ElapsedMs(start) / 1000.0;
+    uint64_t digest = SceneDigest(*scene, *camera);
+    size_t numTokens = scene->tokens.size();
+    size_t numVisible = NumVisibleTokens(*scene);
+    // Closes the region, the display reads what's left and reports
+    mirror.reset();
+
+    // For scale, what sending the same scene as a message would cost
+    BinarySerializer serializer(resources);
+    auto encodeStart = std::chrono::steady_clock::now();
+    size_t encodedBytes = serializer.Encode(scene).size();
+    double encodeMs = ElapsedMs(encodeStart);
+
+    DisplayReport report{};
+    int status = 0;
+    bool received = ReadAll(fds[0], &report, sizeof(report));
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    bool matched = received && WIFEXITED(status) && WEXITSTATUS(status) == 0 && report.digest == digest && report.numTokens == numVisible;
+
+    size_t frames = std::max<size_t>(1, options.numFrames);
+    size_t framesRead = std::max<uint64_t>(1, report.framesRead);
+    std::cout << options.numFrames << " frames of " << options.frameMs << " ms in " << seconds << " s, " << options.numTokens
+              << " tokens growing to " << numTokens;
+    if (options.deselect)
+        std::cout << ", " << numVisible << " shown with nothing selected";
+    else if (options.fog)
+        std::cout << ", " << numVisible << " seen through the fog";
+    std::cout << std::endl;
+    std::cout << "write         " << writeMs / frames << " ms average, " << maxWriteMs << " ms max" << std::endl;
+    std::cout << "display       " << report.framesRead << " frames read, " << report.readMs / framesRead << " ms copying and "
+              << report.applyMs / framesRead << " ms applying on average, " << report.maxFrameMs << " ms max, "
+              << report.retries << " reads retried" << std::endl;
+    std::cout << "for scale     binary encoding the final scene takes " << encodeMs << " ms for " << encodedBytes / 1024.0 << " KB"
+              << std::endl;
+    std::cout << "scenes " << (matched ? "match" : "DIFFER") << std::endl;
+    return matched ? 0 : 1;
+}
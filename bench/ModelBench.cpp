@@ -0,0 +1,837 @@
+// CPU benchmarks for the model layer. Runs without a GL context.
+//
+//   ./build/model_bench [--json out.json] [--compare bench/baselines/model_bench.json] [--tolerance 0.25] [--quick]
+//   ./build/model_bench --verify
+//
+// --compare exits non-zero if any benchmark is slower than the baseline by more
+// than the tolerance. --verify only runs the format checks in ModelVerify.cpp
+// and exits non-zero if any fail.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <json.hpp>
+
+#include <Actions.hpp>
+#include <BinarySerializer.h>
+#include <Clipboard.h>
+#include <Constants.h>
+#include <JSONSerializer.h>
+#include <JSONWriter.h>
+#include <Journal.h>
+#include <Resources.h>
+#include <SceneSnapshot.h>
+#include <UndoHistory.h>
+#include <model/Bounds.h>
+#include <model/FogOfWar.h>
+#include <model/Grid.h>
+#include <model/HeightField.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Visibility.h>
+#include <model/Walls.h>
+#include <glutil/TransformStore.h>
+
+#include "ModelVerify.h"
+#include "SceneGenerator.h"
+
+
+struct BenchResult
+{
+    std::string name;
+    size_t items;
+    unsigned int iterations;
+    double nsPerItem;
+};
+
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+// Volatile sink so the optimiser can't discard benchmark bodies
+static volatile float g_sink = 0.0f;
+
+// Heap usage, counted by the replacement operator new/delete below. Each block
+// is prefixed with its size so delete can subtract it.
+static std::atomic<size_t> g_heapBytes{0};
+static std::atomic<size_t> g_heapPeak{0};
+static const size_t HEAP_HEADER_SIZE = alignof(std::max_align_t);
+
+void* operator new(size_t size)
+{
+    char* block = static_cast<char*>(std::malloc(size + HEAP_HEADER_SIZE));
+    if (!block)
+        throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(block) = size;
+    size_t bytes = g_heapBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = g_heapPeak.load(std::memory_order_relaxed);
+    while (bytes > peak && !g_heapPeak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+    return block + HEAP_HEADER_SIZE;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+    char* block = static_cast<char*>(ptr) - HEAP_HEADER_SIZE;
+    g_heapBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+// Prints the most heap func had allocated at once on top of what was already
+// allocated, relative to the size of the scene's text
+template <typename Func>
+void ReportPeakHeap(const std::string& name, size_t textSize, Func&& func)
+{
+    size_t base = g_heapBytes.load();
+    g_heapPeak.store(base);
+    func();
+    double peak = double(g_heapPeak.load() - base);
+    std::cout << std::left;
+    std::cout.width(40);
+    std::cout << name << peak / (1024.0 * 1024.0) << " MB peak heap (" << peak / textSize << "x text size)" << std::endl;
+}
+
+// Runs func until minTime has elapsed (and at least minIterations), returning
+// the median time per item.
+template <typename Func>
+BenchResult RunBenchmark(const std::string& name, size_t items, Func&& func, double minTime, unsigned int minIterations = 3)
+{
+    using clock = std::chrono::steady_clock;
+    func();  // Warmup
+
+    std::vector<double> samples;
+    auto start = clock::now();
+    while (samples.size() < minIterations || std::chrono::duration<double>(clock::now() - start).count() < minTime)
+    {
+        auto iterStart = clock::now();
+        func();
+        samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - iterStart).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double median = samples[samples.size() / 2];
+    BenchResult result{name, items, (unsigned int)samples.size(), median / std::max<size_t>(items, 1)};
+    std::cout << std::left;
+    std::cout.width(40);
+    std::cout << name << result.nsPerItem << " ns/item (" << items << " items, " << result.iterations << " iterations)" << std::endl;
+    return result;
+}
+
+std::vector<std::shared_ptr<Shape2D>> AsShapes(const std::shared_ptr<Scene>& scene)
+{
+    std::vector<std::shared_ptr<Shape2D>> shapes;
+    shapes.reserve(scene->tokens.size() + scene->images.size());
+    for (const auto& token: scene->tokens)
+        shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(token));
+    for (const auto& image: scene->images)
+        shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(image));
+    return shapes;
+}
+
+std::vector<glm::vec2> RandomPoints(size_t count, float extent, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-extent * 0.5f, extent * 0.5f);
+    std::vector<glm::vec2> points(count);
+    for (auto& pt: points)
+        pt = glm::vec2(dist(rng), dist(rng));
+    return points;
+}
+
+void BenchGrid(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    auto scene = GenerateScene(resources, options);
+    auto shapes = AsShapes(scene);
+    auto points = RandomPoints(shapes.size(), options.extent, 1);
+    scene->grid->SetScale(1.0f);
+
+    results.push_back(RunBenchmark("grid/ShapeSnapPosition", shapes.size(), [&]()
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < shapes.size(); i++)
+            sum += scene->grid->ShapeSnapPosition(shapes[i], points[i]).x;
+        g_sink = sum;
+    }, minTime));
+
+    results.push_back(RunBenchmark("grid/NearestCenter", points.size(), [&]()
+    {
+        float sum = 0.0f;
+        for (const auto& pt: points)
+            sum += scene->grid->NearestCenter(1.0f, pt).x;
+        g_sink = sum;
+    }, minTime));
+}
+
+void BenchHitTests(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    options.numImages = 1000;
+    auto scene = GenerateScene(resources, options);
+    auto points = RandomPoints(64, options.extent, 2);
+
+    // Mirrors the per mouse-move highlight scan in the Controller
+    results.push_back(RunBenchmark("hittest/Token::Contains", scene->tokens.size() * points.size(), [&]()
+    {
+        int hits = 0;
+        for (const auto& pt: points)
+            for (const auto& token: scene->tokens)
+                hits += token->Contains(pt);
+        g_sink = hits;
+    }, minTime));
+
+    results.push_back(RunBenchmark("hittest/Rect::Contains", scene->images.size() * points.size(), [&]()
+    {
+        int hits = 0;
+        for (const auto& pt: points)
+            for (const auto& image: scene->images)
+                hits += image->Contains(pt);
+        g_sink = hits;
+    }, minTime));
+}
+
+void BenchSceneQueries(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    auto scene = GenerateScene(resources, options);
+    auto shapes = AsShapes(scene);
+
+    // Controller::ShapesInScreenRect is a screen->world conversion followed by
+    // this query, the conversion needs a Viewport so only the query is timed.
+    results.push_back(RunBenchmark("scene/ShapesInRect", scene->tokens.size() + scene->images.size(), [&]()
+    {
+        auto covered = scene->ShapesInRect(glm::vec2(-100.0f), glm::vec2(100.0f));
+        g_sink = covered.size();
+    }, minTime));
+
+    results.push_back(RunBenchmark("bounds/BoundsForShapes", shapes.size(), [&]()
+    {
+        g_sink = Bounds2D::BoundsForShapes(shapes).max.x;
+    }, minTime));
+}
+
+// Deleting a large selection and undoing it
+void BenchRemoveShapes(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 5000;
+    options.selectedFraction = 0.4f;
+    auto scene = GenerateScene(resources, options);
+    std::vector<ShapeID> selected = scene->GetTokenSelection().Members();
+
+    results.push_back(RunBenchmark("scene/RemoveTokens+Insert(5000 tokens)", scene->tokens.size(), [&]()
+    {
+        auto removed = scene->RemoveTokens(selected);
+        scene->InsertTokens(removed);
+        g_sink = removed.size();
+    }, minTime));
+
+    results.push_back(RunBenchmark("scene/GetShape", selected.size(), [&]()
+    {
+        size_t found = 0;
+        for (ShapeID id: selected)
+            found += static_cast<bool>(scene->GetShape(id));
+        g_sink = found;
+    }, minTime));
+}
+
+void BenchSelection(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    options.selectedFraction = 0.1f;
+    auto scene = GenerateScene(resources, options);
+
+    results.push_back(RunBenchmark("selection/Invert", scene->tokens.size(), [&]()
+    {
+        scene->InvertSelection();
+        g_sink = scene->NumSelected();
+    }, minTime));
+
+    results.push_back(RunBenchmark("selection/ForEachIndex", scene->tokens.size(), [&]()
+    {
+        size_t sum = 0;
+        scene->GetTokenSelection().ForEachIndex([&sum](size_t index) { sum += index; });
+        g_sink = sum;
+    }, minTime));
+}
+
+// Replicates Controller::OnViewportMouseMove during a drag: a new ActionGroup per
+// cursor event which is merged into the previous one.
+void BenchDragMerge(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 300;
+    auto scene = GenerateScene(resources, options);
+    auto shapes = AsShapes(scene);
+    const unsigned int numEvents = 100;
+
+    results.push_back(RunBenchmark("actions/DragMerge(300 shapes)", shapes.size() * numEvents, [&]()
+    {
+        std::shared_ptr<Action> previous;
+        glm::vec2 offset(0.01f, 0.0f);
+        for (unsigned int event = 0; event < numEvents; event++)
+        {
+            auto actionGroup = std::make_shared<ActionGroup>();
+            for (const auto& shape: shapes)
+                actionGroup->Add(std::make_shared<ModifyMatrix2DVec2>(shape->GetModel(), &Matrix2D::SetPos, shape->GetModel()->GetPos(), shape->GetModel()->GetPos() + offset));
+            actionGroup->Redo();
+            if (previous && previous->CanMerge(actionGroup))
+                previous->Merge(actionGroup);
+            else
+                previous = actionGroup;
+        }
+        g_sink = shapes[0]->GetModel()->GetPos().x;
+    }, minTime));
+}
+
+// A drag updates positions many times between frames, the matrices are only
+// rebuilt once when the frame is drawn.
+void BenchTransforms(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    auto scene = GenerateScene(resources, options);
+    auto shapes = AsShapes(scene);
+    TransformStore& store = TransformStore::Global();
+    store.RebuildDirty();
+
+    results.push_back(RunBenchmark("transform/Offset", shapes.size(), [&]()
+    {
+        for (const auto& shape: shapes)
+            shape->GetModel()->Offset(glm::vec2(0.01f, 0.0f));
+        g_sink = shapes[0]->GetModel()->GetPos().x;
+    }, minTime));
+
+    results.push_back(RunBenchmark("transform/RebuildDirty", shapes.size(), [&]()
+    {
+        for (const auto& shape: shapes)
+            shape->GetModel()->Offset(glm::vec2(0.01f, 0.0f));
+        store.RebuildDirty();
+        g_sink = (*shapes[0]->GetModel()->Value())[3].x;
+    }, minTime));
+}
+
+// The same drag as BenchDragMerge using a move transaction: positions are set
+// directly from the start positions and one MoveShapesAction is built at the end.
+void BenchDragTransaction(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 300;
+    auto scene = GenerateScene(resources, options);
+    auto shapes = AsShapes(scene);
+    const unsigned int numEvents = 100;
+
+    results.push_back(RunBenchmark("actions/DragTransaction(300 shapes)", shapes.size() * numEvents, [&]()
+    {
+        std::vector<ShapeID> ids;
+        std::vector<std::shared_ptr<Matrix2D>> models;
+        std::vector<glm::vec2> startPositions;
+        for (const auto& shape: shapes)
+        {
+            ids.push_back(shape->GetID());
+            models.push_back(shape->GetModel());
+            startPositions.push_back(shape->GetModel()->GetPos());
+        }
+
+        glm::vec2 offset(0.0f);
+        for (unsigned int event = 0; event < numEvents; event++)
+        {
+            offset += glm::vec2(0.01f, 0.0f);
+            for (size_t i = 0; i < models.size(); i++)
+                models[i]->SetPos(startPositions[i] + offset);
+        }
+        auto action = std::make_shared<MoveShapesAction>(scene, std::move(ids), std::move(startPositions), offset);
+        g_sink = shapes[0]->GetModel()->GetPos().x;
+    }, minTime));
+}
+
+// Dragging the opacity slider with 1000 tokens selected, each UI event builds a
+// batch action which is merged into the previous one.
+void BenchBatchProperty(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 1000;
+    auto scene = GenerateScene(resources, options);
+    const unsigned int numEvents = 30;
+
+    results.push_back(RunBenchmark("actions/BatchPropertyMerge(1000 tokens)", scene->tokens.size() * numEvents, [&]()
+    {
+        std::shared_ptr<Action> previous;
+        for (unsigned int event = 0; event < numEvents; event++)
+        {
+            float opacity = float(event) / numEvents;
+            auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Opacity>>(scene, scene->tokens, [opacity](float) { return opacity; });
+            action->Redo();
+            if (previous && previous->CanMerge(action))
+                previous->Merge(action);
+            else
+                previous = action;
+        }
+        previous->Undo();
+        g_sink = scene->tokens[0]->GetOpacity();
+    }, minTime));
+
+    // No hot actions so every removal is compacted on push and expanded on undo
+    JSONSerializer serializer(resources);
+    const size_t numRemoves = 10;
+    const size_t removeSize = scene->tokens.size() / numRemoves;
+    results.push_back(RunBenchmark("history/RemoveCompactUndo(1000 tokens)", removeSize * numRemoves, [&]()
+    {
+        UndoHistory history(serializer, UndoHistory::DEFAULT_BYTE_BUDGET, 0, false);
+        for (size_t i = 0; i < numRemoves; i++)
+        {
+            std::vector<std::shared_ptr<Token>> tokens(scene->tokens.begin(), scene->tokens.begin() + removeSize);
+            auto action = std::make_shared<RemoveTokensAction>(scene, tokens);
+            action->Redo();
+            history.Push(action);
+        }
+        g_sink = history.ByteSize();
+        while (history.Undo()) {}
+    }, minTime));
+}
+
+// Main thread cost of journaling a committed drag, the write happens on the
+// journal's writer thread
+void BenchJournal(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 1000;
+    auto scene = GenerateScene(resources, options);
+    JSONSerializer serializer(resources);
+    std::string path = (std::filesystem::temp_directory_path() / "model_bench.journal").string();
+
+    ActionEffects effects;
+    for (size_t i = 0; i < 100; i++)
+        effects.shapes.push_back(scene->tokens[i * 10]->GetID());
+
+    SceneSnapshotter snapshotter(serializer);
+    Journal journal(serializer, snapshotter);
+    journal.Start(path);
+    results.push_back(RunBenchmark("journal/RecordMove(100 shapes)", effects.shapes.size(), [&]()
+    {
+        journal.Record(scene, effects);
+    }, minTime));
+    journal.Discard();
+}
+
+// Main thread cost of taking a save snapshot after a few tokens moved,
+// unchanged tokens reuse their text from the previous snapshot
+void BenchSnapshot(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 10000;
+    auto scene = GenerateScene(resources, options);
+    JSONSerializer serializer(resources);
+    SceneSnapshotter snapshotter(serializer);
+    snapshotter.Take(scene);
+
+    size_t frame = 0;
+    results.push_back(RunBenchmark("snapshot/Take(10000 tokens, 1% changed)", scene->tokens.size(), [&]()
+    {
+        for (size_t i = frame++ % 100; i < scene->tokens.size(); i += 100)
+            scene->tokens[i]->GetModel()->Offset(glm::vec2(1, 0));
+        g_sink = snapshotter.Take(scene)->tokens.size();
+    }, minTime));
+}
+
+void BenchDuplicate(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 500;
+    auto scene = GenerateScene(resources, options);
+    JSONSerializer serializer(resources);
+
+    // Previous duplicate, a round trip through the clipboard text
+    results.push_back(RunBenchmark("duplicate/Text(500 tokens)", scene->tokens.size(), [&]()
+    {
+        std::string text = serializer.WriteScene(scene, SerializeFlag::Token);
+        g_sink = serializer.ReadScene(text)->tokens.size();
+    }, minTime));
+
+    results.push_back(RunBenchmark("duplicate/Clone(500 tokens)", scene->tokens.size(), [&]()
+    {
+        g_sink = Clipboard::Clone(resources, scene->tokens, {})->tokens.size();
+    }, minTime));
+}
+
+// Line of sight for a party of player tokens on a map with thousands of walls
+void BenchVisibility(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    SceneGeneratorOptions options;
+    options.numTokens = 20;
+    options.numImages = 0;
+    options.numWalls = 5000;
+    auto scene = GenerateScene(resources, options);
+    FogOfWar& fog = *scene->fog;
+    fog.SetEnabled(true);
+
+    std::vector<FogViewer> viewers;
+    for (const auto& token: scene->tokens)
+        viewers.push_back({token->GetID(), token->GetModel()->GetPos()});
+
+    VisibilitySweep sweep;
+    std::vector<glm::vec2> polygon;
+    results.push_back(RunBenchmark("fog/Sweep(5000 walls)", viewers.size(), [&]()
+    {
+        size_t points = 0;
+        for (const auto& viewer: viewers)
+        {
+            sweep.Compute(fog.walls, viewer.origin, fog.GetRange(), polygon);
+            points += polygon.size();
+        }
+        g_sink = points;
+    }, minTime));
+
+    // Nothing moved, every viewer is cached
+    fog.Update(viewers);
+    results.push_back(RunBenchmark("fog/UpdateCached(20 viewers)", viewers.size(), [&]()
+    {
+        fog.Update(viewers);
+        g_sink = fog.NumComputed();
+    }, minTime));
+
+    // One token dragged a little each frame, only it is swept again
+    size_t frame = 0;
+    results.push_back(RunBenchmark("fog/UpdateDrag(20 viewers)", viewers.size(), [&]()
+    {
+        viewers[0].origin.x += (frame++ % 200 < 100) ? 0.1f : -0.1f;
+        fog.Update(viewers);
+        g_sink = fog.NumComputed();
+    }, minTime));
+
+    // Drawing a wall next to one viewer, only those within range of it are
+    // swept again
+    glm::vec2 near = viewers[1].origin + glm::vec2(1.0f);
+    results.push_back(RunBenchmark("fog/UpdateWallEdit(20 viewers)", viewers.size(), [&]()
+    {
+        WallID id = fog.walls.Add(near, near + glm::vec2(0.5f, 0.0f));
+        fog.Update(viewers);
+        fog.walls.Remove(id);
+        fog.Update(viewers);
+        g_sink = fog.NumComputed();
+    }, minTime));
+}
+
+// Rolling hills with ridges between them, in place of a decoded heightmap
+std::shared_ptr<Texture> SyntheticHeightmap(int size, std::vector<uint8_t>& pixels)
+{
+    pixels.resize(size_t(size) * size);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            float u = float(x) / size, v = float(y) / size;
+            float height = 0.5f + 0.25f * std::sin(u * 23.0f) * std::cos(v * 19.0f) + 0.15f * std::sin(u * 71.0f + v * 53.0f) +
+                           0.1f * std::abs(std::sin(u * 149.0f - v * 131.0f));
+            pixels[size_t(y) * size + x] = uint8_t(glm::clamp(height, 0.0f, 1.0f) * 255.0f);
+        }
+    }
+    auto data = std::make_shared<TextureData>();
+    data->mips.push_back({size, size, pixels.data()});
+    auto texture = std::make_shared<Texture>();
+    texture->filename = "bench/missing/heightmap.png";
+    texture->width = texture->height = size;
+    texture->numChannels = 1;
+    texture->data = data;
+    return texture;
+}
+
+void BenchTerrainVisibility(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime)
+{
+    // 4096 texels across 100 units, so a range of 30 spans over a thousand
+    SceneGeneratorOptions options;
+    options.numTokens = 20;
+    options.numImages = 1;
+    options.extent = 100.0f;
+    options.numWalls = 500;
+    auto scene = GenerateScene(resources, options);
+    FogOfWar& fog = *scene->fog;
+    fog.SetEnabled(true);
+
+    std::vector<uint8_t> pixels;
+    std::shared_ptr<Texture> heightmap = SyntheticHeightmap(4096, pixels);
+    std::shared_ptr<BGImage> image = scene->images[0];
+    image->GetModel()->SetPos(glm::vec2(0.0f));
+    image->GetModel()->SetScale(glm::vec2(options.extent));
+    image->SetHeightmap(heightmap);
+
+    results.push_back(RunBenchmark("terrain/BuildPyramid(4096^2)", 1, [&]()
+    {
+        g_sink = HeightField::Decode(*heightmap)->NumLevels();
+    }, minTime, 1));
+
+    std::vector<FogViewer> viewers;
+    for (const auto& token: scene->tokens)
+        viewers.push_back({token->GetID(), token->GetModel()->GetPos()});
+    fog.SetTerrain(scene->images);
+
+    // Marching only, against the polygon the walls leave
+    TerrainLayer layer(HeightField::Decode(*heightmap), *image->GetModel()->Value(), image->GetHeightScale());
+    VisibilitySweep sweep;
+    TerrainViewshed viewshed;
+    std::vector<std::vector<glm::vec2>> polygons(viewers.size());
+    for (size_t i = 0; i < viewers.size(); i++)
+        sweep.Compute(fog.walls, viewers[i].origin, fog.GetRange(), polygons[i]);
+    std::vector<glm::vec2> triangles;
+    results.push_back(RunBenchmark("terrain/Viewshed(4096^2)", viewers.size(), [&]()
+    {
+        size_t points = 0;
+        for (size_t i = 0; i < viewers.size(); i++)
+        {
+            float eyeHeight = layer.HeightAt(viewers[i].origin) + EYE_LEVEL;
+            viewshed.Compute(layer, viewers[i].origin, eyeHeight, fog.GetRange(), polygons[i], triangles);
+            points += triangles.size();
+        }
+        g_sink = points;
+    }, minTime));
+
+    // Every viewer raised a little each frame, all are recomputed on the pool
+    size_t frame = 0;
+    results.push_back(RunBenchmark("terrain/UpdateAll(20 viewers)", viewers.size(), [&]()
+    {
+        for (FogViewer& viewer: viewers)
+            viewer.height = float(frame % 2);
+        frame++;
+        fog.SetTerrain(scene->images);
+        fog.Update(viewers);
+        g_sink = fog.NumComputed();
+    }, minTime));
+
+    // One token dragged a little each frame, what a player moving sees
+    results.push_back(RunBenchmark("terrain/UpdateDrag(20 viewers)", 1, [&]()
+    {
+        viewers[0].origin.x += (frame++ % 200 < 100) ? 0.1f : -0.1f;
+        fog.SetTerrain(scene->images);
+        fog.Update(viewers);
+        g_sink = fog.NumComputed();
+    }, minTime));
+}
+
+void BenchSerializer(const std::shared_ptr<Resources>& resources, std::vector<BenchResult>& results, double minTime, bool quick)
+{
+    JSONSerializer serializer(resources);
+    std::vector<size_t> sizes = quick ? std::vector<size_t>{1000, 10000} : std::vector<size_t>{1000, 10000, 100000};
+    for (size_t numTokens: sizes)
+    {
+        SceneGeneratorOptions options;
+        options.numTokens = numTokens;
+        auto scene = GenerateScene(resources, options);
+        std::string suffix = "(" + std::to_string(numTokens) + " tokens)";
+
+        std::string text;
+        results.push_back(RunBenchmark("json/Serialize" + suffix, numTokens, [&]()
+        {
+            text = serializer.SerializeScene(scene).dump();
+        }, minTime, 1));
+
+        results.push_back(RunBenchmark("json/Deserialize" + suffix, numTokens, [&]()
+        {
+            auto loaded = serializer.DeserializeScene(text);
+            g_sink = loaded->tokens.size();
+        }, minTime, 1));
+
+        // Streaming equivalents, the text is identical
+        std::string written;
+        results.push_back(RunBenchmark("json/Write" + suffix, numTokens, [&]()
+        {
+            written = serializer.WriteScene(scene);
+        }, minTime, 1));
+
+        results.push_back(RunBenchmark("json/Read" + suffix, numTokens, [&]()
+        {
+            auto loaded = serializer.ReadScene(text);
+            g_sink = loaded->tokens.size();
+        }, minTime, 1));
+
+        BinarySerializer binarySerializer(resources);
+        std::string data;
+        results.push_back(RunBenchmark("binary/Encode" + suffix, numTokens, [&]()
+        {
+            data = binarySerializer.Encode(scene);
+        }, minTime, 1));
+
+        results.push_back(RunBenchmark("binary/Decode" + suffix, numTokens, [&]()
+        {
+            auto loaded = std::make_shared<Scene>(resources);
+            binarySerializer.Decode(data.data(), data.size(), *loaded);
+            g_sink = loaded->tokens.size();
+        }, minTime, 1));
+
+        if (numTokens != sizes.back())
+            continue;
+        std::cout << "binary" << suffix << " is " << data.size() << " bytes, json is " << text.size() << std::endl;
+
+        // Saving to a file, the DOM is built and dumped whole while the writer
+        // only buffers
+        std::string path = (std::filesystem::temp_directory_path() / "model_bench.json").string();
+        ReportPeakHeap("heap/Serialize" + suffix, text.size(), [&]()
+        {
+            std::ofstream file(path);
+            file << serializer.SerializeScene(scene);
+        });
+        ReportPeakHeap("heap/Write" + suffix, text.size(), [&]()
+        {
+            std::ofstream file(path);
+            JSONWriter writer(file);
+            serializer.WriteScene(writer, scene);
+        });
+        // Loading a file, both include the scene that's built
+        ReportPeakHeap("heap/Deserialize" + suffix, text.size(), [&]()
+        {
+            std::ifstream file(path);
+            nlohmann::json json;
+            file >> json;
+            g_sink = serializer.DeserializeScene(json)->tokens.size();
+        });
+        ReportPeakHeap("heap/Read" + suffix, text.size(), [&]()
+        {
+            std::ifstream file(path);
+            auto loaded = std::make_shared<Scene>(resources);
+            serializer.ReadScene(file, *loaded);
+            g_sink = loaded->tokens.size();
+        });
+        std::filesystem::remove(path);
+    }
+}
+
+nlohmann::json ToJSON(const std::vector<BenchResult>& results)
+{
+    nlohmann::json json;
+    nlohmann::json jbenchmarks = nlohmann::json::array();
+    for (const auto& result: results)
+        jbenchmarks.push_back({{"name", result.name}, {"items", result.items}, {"iterations", result.iterations}, {"ns_per_item", result.nsPerItem}});
+    json["benchmarks"] = jbenchmarks;
+    return json;
+}
+
+// Returns the number of regressions
+int CompareToBaseline(const std::vector<BenchResult>& results, const std::string& path, double tolerance)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Unable to open baseline " << path << std::endl;
+        return 1;
+    }
+    nlohmann::json baseline;
+    file >> baseline;
+
+    std::unordered_map<std::string, double> baselineTimes;
+    for (const auto& jbench: baseline["benchmarks"])
+        baselineTimes[jbench["name"]] = jbench["ns_per_item"];
+
+    int regressions = 0;
+    std::cout << std::endl << "Compared to " << path << ":" << std::endl;
+    for (const auto& result: results)
+    {
+        auto it = baselineTimes.find(result.name);
+        if (it == baselineTimes.end())
+            continue;
+
+        double ratio = result.nsPerItem / it->second;
+        bool regressed = ratio > 1.0 + tolerance;
+        regressions += regressed;
+        std::cout << std::left;
+        std::cout.width(40);
+        std::cout << result.name << ratio << "x" << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
+
+int main(int numArgs, char* args[])
+{
+    std::string jsonPath, baselinePath;
+    double tolerance = 0.25;
+    bool quick = false;
+    bool verify = false;
+    for (int i = 1; i < numArgs; i++)
+    {
+        std::string arg = args[i];
+        if (arg == "--json" && i + 1 < numArgs)
+            jsonPath = args[++i];
+        else if (arg == "--compare" && i + 1 < numArgs)
+            baselinePath = args[++i];
+        else if (arg == "--tolerance" && i + 1 < numArgs)
+            tolerance = std::stod(args[++i]);
+        else if (arg == "--quick")
+            quick = true;
+        else if (arg == "--verify")
+            verify = true;
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+    double minTime = quick ? 0.05 : 0.5;
+
+    // Texture loading logs every lookup, silence it so it doesn't drown the results
+    NullBuffer nullBuffer;
+    std::streambuf* cerrBuffer = std::cerr.rdbuf(&nullBuffer);
+
+    auto resources = std::make_shared<Resources>();
+    if (verify)
+    {
+        int numFailed = VerifyModel(resources);
+        std::cerr.rdbuf(cerrBuffer);
+        return numFailed > 0 ? 1 : 0;
+    }
+
+    std::vector<BenchResult> results;
+    BenchGrid(resources, results, minTime);
+    BenchHitTests(resources, results, minTime);
+    BenchSceneQueries(resources, results, minTime);
+    BenchRemoveShapes(resources, results, minTime);
+    BenchSelection(resources, results, minTime);
+    BenchDragMerge(resources, results, minTime);
+    BenchDragTransaction(resources, results, minTime);
+    BenchBatchProperty(resources, results, minTime);
+    BenchTransforms(resources, results, minTime);
+    BenchJournal(resources, results, minTime);
+    BenchSnapshot(resources, results, minTime);
+    BenchDuplicate(resources, results, minTime);
+    BenchVisibility(resources, results, minTime);
+    BenchTerrainVisibility(resources, results, minTime);
+    BenchSerializer(resources, results, minTime, quick);
+
+    std::cerr.rdbuf(cerrBuffer);
+
+    if (!jsonPath.empty())
+    {
+        std::ofstream file(jsonPath);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open file " << jsonPath << std::endl;
+            return 1;
+        }
+        file << ToJSON(results).dump(4) << std::endl;
+    }
+
+    if (!baselinePath.empty())
+        return CompareToBaseline(results, baselinePath, tolerance) > 0 ? 1 : 0;
+
+    return 0;
+}
@@ -0,0 +1,713 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <json.hpp>
+
+#include <Actions.hpp>
+#include <BinarySerializer.h>
+#include <Clipboard.h>
+#include <ContentHash.h>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <SceneBundle.h>
+#include <glutil/Matrix2D.h>
+#include <glutil/Texture.h>
+#include <glutil/TransformStore.h>
+#include <model/BGImage.h>
+#include <model/Bounds.h>
+#include <model/FogOfWar.h>
+#include <model/HeightField.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Walls.h>
+#include <net/Protocol.h>
+
+#include "ModelVerify.h"
+#include "SceneGenerator.h"
+
+
+struct Verifier
+{
+    int numChecks = 0;
+    int numFailed = 0;
+
+    void Check(bool ok, const std::string& what)
+    {
+        numChecks++;
+        if (!ok)
+        {
+            numFailed++;
+            std::cout << "FAIL " << what << std::endl;
+        }
+    }
+};
+
+// Tokens and images read without an ID are given a random one
+static nlohmann::json WithoutIDs(nlohmann::json json)
+{
+    for (const char* key: {"tokens", "images"})
+    {
+        if (json.contains(key))
+        {
+            for (nlohmann::json& shape: json[key])
+                shape.erase("id");
+        }
+    }
+    return json;
+}
+
+// Names needing escapes and floats at the edges of what's representable
+static std::shared_ptr<Scene> EdgeCaseScene(const std::shared_ptr<Resources>& resources, bool finite)
+{
+    const std::vector<std::string> names = {
+        "", "quote \" backslash \\ slash /", "tab\tnewline\nreturn\rback\bfeed\f", std::string("control \x01\x1f nul ") + '\0' + "after",
+        "unicode \xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x8e\xb2", "path\\like\\C:\\name.png"
+    };
+    std::vector<float> values = {
+        0.0f, -0.0f, 0.1f, -1.5f, 1e7f, 123456.789f, 1e-45f, std::numeric_limits<float>::min(),
+        std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 3.4028234e38f, 16777217.0f
+    };
+    if (!finite)
+    {
+        values.push_back(std::numeric_limits<float>::quiet_NaN());
+        values.push_back(std::numeric_limits<float>::infinity());
+        values.push_back(-std::numeric_limits<float>::infinity());
+    }
+
+    auto scene = std::make_shared<Scene>(resources);
+    scene->AddDefaultCamera();
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        float value = values[i];
+        auto token = std::make_shared<Token>(resources->GetTexture(SyntheticTexturePath(i) + names[i % names.size()]), names[i % names.size()]);
+        token->GetModel()->SetPos(glm::vec2(value, -value));
+        token->GetModel()->SetScale(glm::vec2(value, 1.0f));
+        token->GetModel()->SetRotation(value);
+        token->SetBorderWidth(value);
+        token->SetBorderColor(glm::vec4(value, 0.5f, 1.0f, value));
+        token->SetStatusEnabled(int(i % 8), true);
+        token->SetXStatus(i % 2);
+        token->SetNameHidden(i % 3 == 0);
+        token->SetOpacity(value);
+        scene->AddToken(token);
+
+        auto image = std::make_shared<BGImage>(resources->GetTexture(SyntheticTexturePath(i)));
+        image->GetModel()->SetPos(glm::vec2(-value, value));
+        image->GetModel()->SetRotation(value);
+        scene->AddImage(image);
+    }
+    scene->SetTokensLocked(true);
+    return scene;
+}
+
+static void VerifyJSONScene(Verifier& verifier, JSONSerializer& serializer, const std::shared_ptr<Scene>& scene, const std::string& name, bool readable)
+{
+    std::string text = serializer.WriteScene(scene);
+    verifier.Check(text == serializer.SerializeScene(scene).dump(), name + ": WriteScene matches SerializeScene().dump()");
+    if (!readable)
+        return;
+
+    std::shared_ptr<Scene> read = serializer.ReadScene(text);
+    std::shared_ptr<Scene> deserialized = serializer.DeserializeScene(text);
+    verifier.Check(read != nullptr, name + ": ReadScene parses");
+    if (!read)
+        return;
+    verifier.Check(read->tokens.size() == scene->tokens.size() && read->images.size() == scene->images.size(), name + ": ReadScene reads every shape");
+    verifier.Check(serializer.WriteScene(read) == text, name + ": ReadScene round trips");
+    verifier.Check(serializer.WriteScene(read) == serializer.WriteScene(deserialized), name + ": ReadScene matches DeserializeScene");
+}
+
+// Both readers on text that isn't written by the serializer
+static void VerifyJSONText(Verifier& verifier, JSONSerializer& serializer, const std::string& text, const std::string& name)
+{
+    std::shared_ptr<Scene> read = serializer.ReadScene(text);
+    std::shared_ptr<Scene> deserialized = serializer.DeserializeScene(text);
+    verifier.Check(read != nullptr, name + ": ReadScene parses");
+    if (!read)
+        return;
+    verifier.Check(WithoutIDs(serializer.SerializeScene(read)) == WithoutIDs(serializer.SerializeScene(deserialized)),
+                   name + ": ReadScene matches DeserializeScene");
+}
+
+static void VerifyJSON(Verifier& verifier, const std::shared_ptr<Resources>& resources)
+{
+    JSONSerializer serializer(resources);
+
+    VerifyJSONScene(verifier, serializer, std::make_shared<Scene>(resources), "json/empty", true);
+
+    SceneGeneratorOptions options;
+    options.numTokens = 2000;
+    options.numWalls = 200;
+    options.selectedFraction = 0.25f;
+    VerifyJSONScene(verifier, serializer, GenerateScene(resources, options), "json/generated", true);
+    VerifyJSONScene(verifier, serializer, EdgeCaseScene(resources, true), "json/edge cases", true);
+    // Non-finite floats are written as null, which neither reader takes back
+    VerifyJSONScene(verifier, serializer, EdgeCaseScene(resources, false), "json/non-finite", false);
+
+    // Files from before ids, statuses, opacity, visibility and locks were saved
+    VerifyJSONText(verifier, serializer, R"({
+        "camera": {"name": "Camera", "pos": [0.0, 0.0, 1.0], "focal": 10.0},
+        "grid": {"scale": 2.0},
+        "images": [{"texture": "old/map.png", "matrix2D": {"pos": [1.0, 2.0], "scale": [3.0, 4.0], "rotation": 5.0}}],
+        "tokens": [{"texture": "old/token.png", "name": "Old", "matrix2D": {"pos": [1.0, 2.0], "scale": [1.0, 1.0], "rotation": 0.0},
+                    "borderWidth": 0.1, "borderColour": [1.0, 0.0, 0.0, 1.0]}]
+    })", "json/legacy");
+    VerifyJSONText(verifier, serializer, "{}", "json/no keys");
+    VerifyJSONText(verifier, serializer, R"({"tokens": [], "images": [], "cameras": []})", "json/empty arrays");
+
+    std::string text = serializer.WriteScene(GenerateScene(resources, options));
+    verifier.Check(serializer.ReadScene(text.substr(0, text.size() / 2)) == nullptr, "json/truncated: ReadScene fails");
+    verifier.Check(serializer.ReadScene("not json") == nullptr, "json/garbage: ReadScene fails");
+    verifier.Check(serializer.ReadScene("") == nullptr, "json/nothing: ReadScene fails");
+}
+
+// Decode needs 8 byte aligned data
+struct AlignedBuffer
+{
+    std::vector<uint64_t> words;
+    size_t size;
+
+    AlignedBuffer(const std::string& bytes) : words((bytes.size() + 7) / 8), size(bytes.size())
+    {
+        std::memcpy(words.data(), bytes.data(), bytes.size());
+    }
+    char* Data() { return reinterpret_cast<char*>(words.data()); }
+};
+
+static size_t SceneSize(const Scene& scene)
+{
+    return scene.tokens.size() + scene.images.size() + scene.cameras.size() + scene.fog->walls.Size();
+}
+
+// Decoding must fail without touching the scene
+static void VerifyBinaryRejects(Verifier& verifier, BinarySerializer& binary, const std::shared_ptr<Resources>& resources,
+                                AlignedBuffer& buffer, size_t size, const std::string& name)
+{
+    Scene scene(resources);
+    verifier.Check(!binary.Decode(buffer.Data(), size, scene) && SceneSize(scene) == 0, name + ": rejected");
+}
+
+static void VerifyBinaryScene(Verifier& verifier, JSONSerializer& serializer, BinarySerializer& binary, const std::shared_ptr<Scene>& scene, const std::string& name)
+{
+    std::string text = serializer.WriteScene(scene);
+    AlignedBuffer buffer(binary.Encode(scene));
+    auto decoded = std::make_shared<Scene>(serializer.GetResources());
+    verifier.Check(binary.Decode(buffer.Data(), buffer.size, *decoded), name + ": decodes");
+    verifier.Check(serializer.WriteScene(decoded) == text, name + ": round trips through JSON");
+}
+
+static void VerifyBinary(Verifier& verifier, const std::shared_ptr<Resources>& resources)
+{
+    JSONSerializer serializer(resources);
+    BinarySerializer binary(resources);
+
+    SceneGeneratorOptions options;
+    options.numTokens = 2000;
+    options.numWalls = 200;
+    std::shared_ptr<Scene> generated = GenerateScene(resources, options);
+    generated->AddDefaultCamera();
+    VerifyBinaryScene(verifier, serializer, binary, std::make_shared<Scene>(resources), "binary/empty");
+    VerifyBinaryScene(verifier, serializer, binary, generated, "binary/generated");
+    VerifyBinaryScene(verifier, serializer, binary, EdgeCaseScene(resources, true), "binary/edge cases");
+    // Stored as is, unlike JSON
+    VerifyBinaryScene(verifier, serializer, binary, EdgeCaseScene(resources, false), "binary/non-finite");
+
+    // Through a mapped file, as Controller::Load reads it
+    std::string path = (std::filesystem::temp_directory_path() / "battlematt_verify.bmscene").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << binary.Encode(generated);
+    }
+    auto read = std::make_shared<Scene>(resources);
+    verifier.Check(binary.Read(path, *read) && serializer.WriteScene(read) == serializer.WriteScene(generated), "binary/file: round trips");
+    std::remove(path.c_str());
+    verifier.Check(!binary.Read(path, *read), "binary/missing file: rejected");
+
+    // Decoded shapes only take the slots AllocateRange hands out. The free
+    // slots are filled first so any other allocation shows as growth.
+    {
+        AlignedBuffer buffer(binary.Encode(generated));
+        auto decoded = std::make_shared<Scene>(resources);
+        TransformStore& store = TransformStore::Global();
+        std::vector<Matrix2D> filler(store.NumSlots() - store.NumAllocated());
+        size_t slots = store.NumSlots();
+        verifier.Check(binary.Decode(buffer.Data(), buffer.size, *decoded) &&
+                       store.NumSlots() - slots == decoded->tokens.size() + decoded->images.size(), "binary/transforms: one slot per shape");
+    }
+
+    // Corrupt input. Offsets are those of the header and section table, see
+    // BinarySerializer.h.
+    const std::string encoded = binary.Encode(EdgeCaseScene(resources, true));
+    const size_t SECTIONS = 16, SECTION_SIZE = 24;
+    uint32_t numSections;
+    std::memcpy(&numSections, encoded.data() + 12, sizeof(numSections));
+    auto corrupt = [&](size_t offset, const void* value, size_t size)
+    {
+        AlignedBuffer buffer(encoded);
+        std::memcpy(buffer.Data() + offset, value, size);
+        return buffer;
+    };
+    auto sectionOffset = [&](uint32_t type)
+    {
+        for (uint32_t i = 0; i < numSections; i++)
+        {
+            uint32_t sectionType;
+            std::memcpy(&sectionType, encoded.data() + SECTIONS + i * SECTION_SIZE, sizeof(sectionType));
+            if (sectionType == type)
+                return SECTIONS + i * SECTION_SIZE;
+        }
+        return size_t(0);
+    };
+    const uint32_t STRINGS = 1, TOKENS = 6, TRANSFORMS = 7;
+    const uint32_t zero = 0, huge = 0xffffffff, newer = BinarySerializer::VERSION + 1;
+    const uint64_t misaligned = 4, outside = encoded.size() + 8;
+
+    AlignedBuffer whole(encoded);
+    for (size_t size = 0; size < encoded.size(); size += size < 256 ? 1 : 97)
+        VerifyBinaryRejects(verifier, binary, resources, whole, size, "binary/truncated to " + std::to_string(size));
+    AlignedBuffer magic = corrupt(0, "JSON", 4);
+    VerifyBinaryRejects(verifier, binary, resources, magic, encoded.size(), "binary/magic");
+    AlignedBuffer version = corrupt(4, &newer, 4);
+    VerifyBinaryRejects(verifier, binary, resources, version, encoded.size(), "binary/newer version");
+    AlignedBuffer byteOrder = corrupt(8, "\x01\x02\x03\x04", 4);
+    VerifyBinaryRejects(verifier, binary, resources, byteOrder, encoded.size(), "binary/byte order");
+    AlignedBuffer sectionCount = corrupt(12, &huge, 4);
+    VerifyBinaryRejects(verifier, binary, resources, sectionCount, encoded.size(), "binary/section count");
+    AlignedBuffer noStrings = corrupt(sectionOffset(STRINGS) + 4, &zero, 4);
+    VerifyBinaryRejects(verifier, binary, resources, noStrings, encoded.size(), "binary/string index out of bounds");
+    AlignedBuffer tokenCount = corrupt(sectionOffset(TOKENS) + 4, &huge, 4);
+    VerifyBinaryRejects(verifier, binary, resources, tokenCount, encoded.size(), "binary/token count");
+    AlignedBuffer transformCount = corrupt(sectionOffset(TRANSFORMS) + 4, &zero, 4);
+    VerifyBinaryRejects(verifier, binary, resources, transformCount, encoded.size(), "binary/transform count");
+    AlignedBuffer sectionAlignment = corrupt(sectionOffset(TOKENS) + 8, &misaligned, 8);
+    VerifyBinaryRejects(verifier, binary, resources, sectionAlignment, encoded.size(), "binary/misaligned section");
+    AlignedBuffer sectionBounds = corrupt(sectionOffset(TOKENS) + 8, &outside, 8);
+    VerifyBinaryRejects(verifier, binary, resources, sectionBounds, encoded.size(), "binary/section out of bounds");
+    VerifyBinaryRejects(verifier, binary, resources, whole, 0, "binary/empty");
+    {
+        std::vector<uint64_t> offset(whole.words.size() + 1);
+        std::memcpy(reinterpret_cast<char*>(offset.data()) + 1, encoded.data(), encoded.size());
+        Scene scene(resources);
+        verifier.Check(!binary.Decode(reinterpret_cast<char*>(offset.data()) + 1, encoded.size(), scene), "binary/misaligned data: rejected");
+    }
+
+    // Flipped bytes may still decode, but mustn't crash or read out of bounds
+    std::mt19937 random(1234);
+    for (int i = 0; i < 2000; i++)
+    {
+        AlignedBuffer flipped(encoded);
+        flipped.Data()[random() % encoded.size()] ^= char(1 << (random() % 8));
+        Scene scene(resources);
+        binary.Decode(flipped.Data(), flipped.size, scene);
+    }
+}
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string& path, const std::string& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << bytes;
+}
+
+// Reads the bundle as a fresh session would, with nothing cached
+static std::shared_ptr<Scene> ReadBundle(const std::string& path, std::shared_ptr<Resources>& resources)
+{
+    resources = std::make_shared<Resources>();
+    auto scene = std::make_shared<Scene>(resources);
+    return SceneBundle(resources).Read(path, *scene) ? scene : nullptr;
+}
+
+static bool WriteBundle(const std::shared_ptr<Resources>& resources, const std::shared_ptr<Scene>& scene, const std::string& path)
+{
+    SceneBundle bundle(resources);
+    return SceneBundle::Write(*bundle.Gather(scene), path);
+}
+
+static void VerifyBundleRejects(Verifier& verifier, const std::string& bytes, const std::string& path, const std::string& name)
+{
+    WriteFile(path, bytes);
+    std::shared_ptr<Resources> resources;
+    verifier.Check(ReadBundle(path, resources) == nullptr, name + ": rejected");
+}
+
+static void VerifyBundle(Verifier& verifier)
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "battlematt_verify_bundle";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    // Two paths to the same image, which the bundle should store once
+    std::string first = (dir / "first.jpg").string(), same = (dir / "same.jpg").string();
+    std::string dot = (dir / "dot.png").string(), cross = (dir / "cross.png").string();
+    std::string missing = (dir / "missing.png").string(), path = (dir / "scene.bmbundle").string();
+    std::filesystem::copy_file("resources/images/QuestionMark.jpg", first);
+    std::filesystem::copy_file("resources/images/QuestionMark.jpg", same);
+    std::filesystem::copy_file("resources/images/StatusDot.png", dot);
+    std::filesystem::copy_file("resources/images/XStatus.png", cross);
+
+    auto resources = std::make_shared<Resources>();
+    auto scene = std::make_shared<Scene>(resources);
+    scene->AddDefaultCamera();
+    for (const std::string& texture: {first, same, dot, missing})
+        scene->AddToken(std::make_shared<Token>(resources->GetTexture(texture), texture));
+    scene->AddImage(std::make_shared<BGImage>(resources->GetTexture(cross)));
+    JSONSerializer serializer(resources);
+    std::string text = serializer.WriteScene(scene);
+
+    verifier.Check(WriteBundle(resources, scene, path), "bundle/write: written");
+    std::string written = ReadFile(path);
+    std::shared_ptr<Resources> readResources;
+    std::shared_ptr<Scene> read = ReadBundle(path, readResources);
+    verifier.Check(read && JSONSerializer(readResources).WriteScene(read) == text, "bundle/read: round trips");
+    if (!read)
+        return;
+    for (const std::string& texture: {first, same, dot, cross})
+    {
+        std::shared_ptr<const TextureData> data = readResources->GetTexture(texture)->data;
+        std::string bytes = ReadFile(texture);
+        verifier.Check(data && data->size == bytes.size() && std::memcmp(data->bytes, bytes.data(), bytes.size()) == 0 &&
+                       data->hash == HashContent(bytes.data(), bytes.size()), "bundle/read: " + texture + " is embedded");
+        verifier.Check(data && !data->mips.empty() && data->mips[0].width == readResources->GetTexture(texture)->width,
+                       "bundle/read: " + texture + " has mips");
+    }
+    verifier.Check(readResources->GetTexture(first)->data->bytes == readResources->GetTexture(same)->data->bytes, "bundle/read: same contents stored once");
+    verifier.Check(!readResources->GetTexture(missing)->data, "bundle/read: missing image falls back to its path");
+
+    // Resaving a bundle's own scene reuses its pre-decoded data
+    std::string copy = (dir / "copy.bmbundle").string();
+    verifier.Check(WriteBundle(readResources, read, copy), "bundle/copy: written");
+    std::shared_ptr<Resources> copyResources;
+    std::shared_ptr<Scene> copied = ReadBundle(copy, copyResources);
+    verifier.Check(copied && JSONSerializer(copyResources).WriteScene(copied) == text && ReadFile(copy).size() == written.size(),
+                   "bundle/copy: round trips");
+
+    // A small change appends the scene and index, leaving the images in place
+    scene->tokens[0]->GetModel()->SetPos(glm::vec2(5.0f, 6.0f));
+    text = serializer.WriteScene(scene);
+    verifier.Check(WriteBundle(resources, scene, path), "bundle/append: written");
+    size_t appended = ReadFile(path).size();
+    verifier.Check(appended > written.size() && appended - written.size() < written.size() / 4, "bundle/append: only the scene is added");
+    read = ReadBundle(path, readResources);
+    verifier.Check(read && JSONSerializer(readResources).WriteScene(read) == text, "bundle/append: round trips");
+
+    // Once most of the file is unused it's rewritten without the rest
+    auto small = std::make_shared<Scene>(resources);
+    small->AddToken(std::make_shared<Token>(resources->GetTexture(dot), dot));
+    text = serializer.WriteScene(small);
+    verifier.Check(WriteBundle(resources, small, path), "bundle/compact: written");
+    verifier.Check(ReadFile(path).size() < written.size() / 2, "bundle/compact: unused images dropped");
+    read = ReadBundle(path, readResources);
+    verifier.Check(read && JSONSerializer(readResources).WriteScene(read) == text, "bundle/compact: round trips");
+    verifier.Check(read && readResources->GetTexture(dot)->data && !readResources->GetTexture(dot)->data->mips.empty(), "bundle/compact: image kept");
+
+    // Corrupt input. Offsets are those of the structures in SceneBundle.cpp:
+    // header (32 bytes), index header (32), blob entries (80), path entries (16).
+    std::string corruptPath = (dir / "corrupt.bmbundle").string();
+    uint64_t indexOffset;
+    std::memcpy(&indexOffset, written.data() + 16, sizeof(indexOffset));
+    uint32_t numBlobs;
+    std::memcpy(&numBlobs, written.data() + indexOffset + 16, sizeof(numBlobs));
+    const size_t BLOBS = indexOffset + 32, PATHS = BLOBS + numBlobs * 80;
+    auto corrupt = [&](size_t offset, uint64_t value, size_t size)
+    {
+        std::string bytes = written;
+        std::memcpy(&bytes[offset], &value, size);
+        return bytes;
+    };
+    verifier.Check(numBlobs == 3, "bundle/write: one blob per unique image");
+
+    for (size_t size: {size_t(0), size_t(16), size_t(31), size_t(32), size_t(indexOffset), size_t(indexOffset + 31), written.size() - 1})
+        VerifyBundleRejects(verifier, written.substr(0, size), corruptPath, "bundle/truncated to " + std::to_string(size));
+    VerifyBundleRejects(verifier, corrupt(0, 0, 4), corruptPath, "bundle/magic");
+    VerifyBundleRejects(verifier, corrupt(4, SceneBundle::VERSION + 1, 4), corruptPath, "bundle/newer version");
+    VerifyBundleRejects(verifier, corrupt(8, 0x04030201, 4), corruptPath, "bundle/byte order");
+    VerifyBundleRejects(verifier, corrupt(16, indexOffset + 4, 8), corruptPath, "bundle/misaligned index");
+    VerifyBundleRejects(verifier, corrupt(16, written.size() + 8, 8), corruptPath, "bundle/index out of bounds");
+    VerifyBundleRejects(verifier, corrupt(indexOffset, written.size() + 8, 8), corruptPath, "bundle/scene out of bounds");
+    VerifyBundleRejects(verifier, corrupt(indexOffset + 16, 0xffffffff, 4), corruptPath, "bundle/blob count");
+    VerifyBundleRejects(verifier, corrupt(indexOffset + 20, 0xffffffff, 4), corruptPath, "bundle/path count");
+    VerifyBundleRejects(verifier, corrupt(BLOBS + 32, written.size() + 8, 8), corruptPath, "bundle/blob out of bounds");
+    VerifyBundleRejects(verifier, corrupt(BLOBS + 56, 1, 8), corruptPath, "bundle/mip size");
+    VerifyBundleRejects(verifier, corrupt(BLOBS + 76, 40, 4), corruptPath, "bundle/mip count");
+    VerifyBundleRejects(verifier, corrupt(PATHS, numBlobs, 4), corruptPath, "bundle/path blob out of bounds");
+    VerifyBundleRejects(verifier, corrupt(PATHS + 4, 0xffffff, 4), corruptPath, "bundle/path out of bounds");
+    uint64_t sceneOffset;
+    std::memcpy(&sceneOffset, written.data() + indexOffset, sizeof(sceneOffset));
+    VerifyBundleRejects(verifier, corrupt(sceneOffset, 0, 4), corruptPath, "bundle/scene magic");
+
+    // Flipped bits in the header and index may still read, but mustn't crash
+    std::mt19937 random(1234);
+    size_t indexSize = written.size() - indexOffset;
+    for (int i = 0; i < 300; i++)
+    {
+        std::string flipped = written;
+        size_t offset = random() % (32 + indexSize);
+        flipped[offset < 32 ? offset : indexOffset + offset - 32] ^= char(1 << (random() % 8));
+        WriteFile(corruptPath, flipped);
+        std::shared_ptr<Resources> flippedResources;
+        ReadBundle(corruptPath, flippedResources);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+// A raised token, an image with a heightmap and one without
+static std::shared_ptr<Scene> HeightScene(const std::shared_ptr<Resources>& resources, const std::string& heightmap)
+{
+    auto scene = std::make_shared<Scene>(resources);
+    scene->AddDefaultCamera();
+    auto token = std::make_shared<Token>(resources->GetTexture(SyntheticTexturePath(0)), "Flying");
+    token->SetHeight(2.5f);
+    scene->AddToken(token);
+    auto terrain = std::make_shared<BGImage>(resources->GetTexture(SyntheticTexturePath(1)));
+    terrain->SetHeightmap(resources->GetTexture(heightmap));
+    terrain->SetHeightScale(7.0f);
+    scene->AddImage(terrain);
+    scene->AddImage(std::make_shared<BGImage>(resources->GetTexture(SyntheticTexturePath(2))));
+    return scene;
+}
+
+static bool HasHeights(Scene& scene, const std::string& heightmap)
+{
+    return scene.tokens.size() == 1 && scene.tokens[0]->GetHeight() == 2.5f && scene.images.size() == 2 &&
+           scene.images[0]->GetHeightmap() && scene.images[0]->GetHeightmap()->filename == heightmap &&
+           scene.images[0]->GetHeightScale() == 7.0f && !scene.images[1]->GetHeightmap();
+}
+
+// Every coarser texel holds the highest of the 2x2 below it
+static bool IsMaxPyramid(const HeightField& field)
+{
+    int width = field.Width(), height = field.Height();
+    for (int level = 1; level < field.NumLevels(); level++)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint8_t highest = std::max(std::max(field.Max(level - 1, x * 2, y * 2), field.Max(level - 1, x * 2 + 1, y * 2)),
+                                           std::max(field.Max(level - 1, x * 2, y * 2 + 1), field.Max(level - 1, x * 2 + 1, y * 2 + 1)));
+                if (field.Max(level, x, y) != highest)
+                    return false;
+            }
+        }
+    }
+    return width == 1 && height == 1;
+}
+
+static void VerifyHeightfields(Verifier& verifier, const std::shared_ptr<Resources>& resources)
+{
+    const std::string heightmap = "resources/images/QuestionMark.jpg";
+    JSONSerializer serializer(resources);
+    BinarySerializer binary(resources);
+    std::shared_ptr<Scene> scene = HeightScene(resources, heightmap);
+    std::string text = serializer.WriteScene(scene);
+
+    std::shared_ptr<Scene> read = serializer.ReadScene(text);
+    verifier.Check(read && HasHeights(*read, heightmap), "heights/json: round trips");
+    const std::string encoded = binary.Encode(scene);
+    AlignedBuffer buffer(encoded);
+    auto decoded = std::make_shared<Scene>(resources);
+    verifier.Check(binary.Decode(buffer.Data(), buffer.size, *decoded) && HasHeights(*decoded, heightmap), "heights/binary: round trips");
+
+    // Corrupt heightmap records, see the section table in VerifyBinary
+    const size_t SECTIONS = 16, SECTION_SIZE = 24;
+    const uint32_t IMAGES = 5, HEIGHTMAPS = 10;
+    uint32_t numSections;
+    std::memcpy(&numSections, encoded.data() + 12, sizeof(numSections));
+    size_t images = 0, heightmaps = 0;
+    for (uint32_t i = 0; i < numSections; i++)
+    {
+        uint32_t sectionType;
+        std::memcpy(&sectionType, encoded.data() + SECTIONS + i * SECTION_SIZE, sizeof(sectionType));
+        if (sectionType == IMAGES)
+            images = SECTIONS + i * SECTION_SIZE;
+        else if (sectionType == HEIGHTMAPS)
+            heightmaps = SECTIONS + i * SECTION_SIZE;
+    }
+    verifier.Check(images != 0 && heightmaps != 0, "heights/binary: heightmap section written");
+    if (images == 0 || heightmaps == 0)
+        return;
+    uint32_t numImages;
+    std::memcpy(&numImages, encoded.data() + images + 4, sizeof(numImages));
+    uint64_t records;
+    std::memcpy(&records, encoded.data() + heightmaps + 8, sizeof(records));
+    auto corrupt = [&](size_t offset, uint32_t value)
+    {
+        AlignedBuffer buffer(encoded);
+        std::memcpy(buffer.Data() + offset, &value, sizeof(value));
+        return buffer;
+    };
+    AlignedBuffer heightmapCount = corrupt(heightmaps + 4, 0xffffffff);
+    VerifyBinaryRejects(verifier, binary, resources, heightmapCount, encoded.size(), "heights/binary: heightmap count");
+    AlignedBuffer heightmapImage = corrupt(records, numImages);
+    VerifyBinaryRejects(verifier, binary, resources, heightmapImage, encoded.size(), "heights/binary: heightmap image out of bounds");
+    AlignedBuffer heightmapTexture = corrupt(records + 4, 0xffffff);
+    VerifyBinaryRejects(verifier, binary, resources, heightmapTexture, encoded.size(), "heights/binary: heightmap texture out of bounds");
+
+    // Bundles embed the heightmap like any other image
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "battlematt_verify_heights";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string copied = (dir / "heights.jpg").string(), path = (dir / "scene.bmbundle").string();
+    std::filesystem::copy_file(heightmap, copied);
+    verifier.Check(WriteBundle(resources, HeightScene(resources, copied), path), "heights/bundle: written");
+    std::shared_ptr<Resources> readResources;
+    read = ReadBundle(path, readResources);
+    verifier.Check(read && HasHeights(*read, copied), "heights/bundle: round trips");
+    std::filesystem::remove_all(dir);
+    if (!read)
+        return;
+    std::string bytes = ReadFile(heightmap);
+    std::shared_ptr<const TextureData> data = read->images[0]->GetHeightmap()->data;
+    verifier.Check(data && data->size == bytes.size() && std::memcmp(data->bytes, bytes.data(), bytes.size()) == 0, "heights/bundle: heightmap is embedded");
+
+    // Decoded from the bundle's data and from the file alike
+    std::shared_ptr<const HeightField> fromBundle = HeightField::Decode(*read->images[0]->GetHeightmap());
+    std::shared_ptr<const HeightField> fromFile = HeightField::Decode(*resources->GetTexture(heightmap));
+    verifier.Check(fromBundle && fromFile && fromBundle->Width() == fromFile->Width() && fromBundle->Height() == fromFile->Height(),
+                   "heights/field: decodes");
+    if (fromBundle && fromFile)
+    {
+        bool same = true;
+        for (int y = 0; y < fromFile->Height(); y++)
+        {
+            for (int x = 0; x < fromFile->Width(); x++)
+                same = same && fromBundle->Max(0, x, y) == fromFile->Max(0, x, y);
+        }
+        verifier.Check(same, "heights/field: bundle and file decode alike");
+        verifier.Check(IsMaxPyramid(*fromFile), "heights/field: levels hold the highest below them");
+    }
+    // Odd sizes keep their edge texels
+    HeightField field(3, 1, {1, 2, 9});
+    verifier.Check(field.NumLevels() == 3 && field.Max(1, 1, 0) == 9 && field.Max(2, 0, 0) == 9 && IsMaxPyramid(field), "heights/field: odd sizes");
+    verifier.Check(field.Max(0, -1, 0) == 0 && field.Max(0, 3, 0) == 0 && field.Max(0, 0, 1) == 0, "heights/field: nothing off the field");
+    verifier.Check(!HeightField::Decode(*resources->GetTexture(SyntheticTexturePath(0))), "heights/field: unreadable texture");
+
+    // Synced to clients
+    std::string message;
+    ByteWriter writer(message);
+    ShapeState token = CaptureToken(*scene->tokens[0]), terrain = CaptureImage(*scene->images[0]), flat = CaptureImage(*scene->images[1]);
+    writer.WriteShape(scene->tokens[0]->GetID(), SyncField::All, token);
+    writer.WriteShape(scene->images[0]->GetID(), SyncField::All, terrain);
+    writer.WriteShape(scene->images[1]->GetID(), SyncField::All, flat);
+    ByteReader reader(message);
+    ShapeID id;
+    SyncField fields;
+    ShapeState readToken, readTerrain, readFlat;
+    verifier.Check(reader.ReadShape(id, fields, readToken) && reader.ReadShape(id, fields, readTerrain) && reader.ReadShape(id, fields, readFlat) &&
+                   reader.AtEnd(), "heights/sync: reads");
+    Token syncedToken;
+    ApplyToken(readToken, SyncField::All, syncedToken, *resources);
+    // Made with their texture as SceneClient does, resizing to a missing one isn't what's checked
+    BGImage syncedTerrain(resources->GetTexture(readTerrain.texture)), syncedFlat(resources->GetTexture(readFlat.texture));
+    ApplyImage(readTerrain, SyncField::All & ~SyncField::Texture, syncedTerrain, *resources);
+    ApplyImage(readFlat, SyncField::All & ~SyncField::Texture, syncedFlat, *resources);
+    verifier.Check(DiffFields(CaptureToken(syncedToken), token) == SyncField::None && syncedToken.GetHeight() == 2.5f, "heights/sync: token round trips");
+    verifier.Check(DiffFields(CaptureImage(syncedTerrain), terrain) == SyncField::None && syncedTerrain.GetHeightmap() &&
+                   syncedTerrain.GetHeightmap()->filename == heightmap && syncedTerrain.GetHeightScale() == 7.0f, "heights/sync: image round trips");
+    verifier.Check(DiffFields(CaptureImage(syncedFlat), flat) == SyncField::None && !syncedFlat.GetHeightmap(), "heights/sync: flat image round trips");
+    ShapeState raised = token, remapped = terrain;
+    raised.height = 3.0f;
+    remapped.heightmap.clear();
+    verifier.Check(DiffFields(raised, token) == SyncField::Height && DiffFields(remapped, terrain) == SyncField::Height, "heights/sync: changes are sent");
+}
+
+// Pasted and duplicated shapes are selected in place of their originals
+static void VerifyClipboard(Verifier& verifier, const std::shared_ptr<Resources>& resources)
+{
+    JSONSerializer serializer(resources);
+    auto scene = std::make_shared<Scene>(resources);
+    auto token = std::make_shared<Token>(resources->GetTexture(SyntheticTexturePath(0)), "Original");
+    auto image = std::make_shared<BGImage>(resources->GetTexture(SyntheticTexturePath(1)));
+    scene->AddToken(token);
+    scene->AddImage(image);
+    scene->SetSelected(token->GetID(), true);
+    scene->SetSelected(image->GetID(), true);
+
+    auto paste = [&](const std::shared_ptr<Scene>& clones, const std::string& name)
+    {
+        std::vector<std::shared_ptr<Shape2D>> shapes = {clones->tokens[0], clones->images[0]};
+        ActionGroup group;
+        group.Add(std::make_shared<AddTokensAction>(scene, clones->tokens));
+        group.Add(std::make_shared<AddImagesAction>(scene, clones->images));
+        group.Add(std::make_shared<SelectShapesAction>(scene, shapes));
+        group.Redo();
+        verifier.Check(clones->tokens[0]->GetID() != token->GetID() && clones->images[0]->GetID() != image->GetID() &&
+                       scene->GetToken(clones->tokens[0]->GetID()) == clones->tokens[0] && scene->GetImage(clones->images[0]->GetID()) == clones->images[0],
+                       name + ": clones have their own IDs");
+        verifier.Check(scene->IsSelected(clones->tokens[0]->GetID()) && scene->IsSelected(clones->images[0]->GetID()) &&
+                       !scene->IsSelected(token->GetID()) && !scene->IsSelected(image->GetID()), name + ": clones are selected");
+        group.Undo();
+        verifier.Check(scene->tokens.size() == 1 && scene->images.size() == 1 && scene->IsSelected(token->GetID()) && scene->IsSelected(image->GetID()),
+                       name + ": undone");
+    };
+    paste(Clipboard::Clone(resources, {token}, {image}), "clipboard/duplicate");
+    Clipboard clipboard(serializer);
+    clipboard.Copy({token}, {image});
+    paste(clipboard.Paste(resources), "clipboard/paste");
+    // Text from the system clipboard keeps the copied shapes' IDs
+    std::shared_ptr<Scene> text = serializer.ReadScene(clipboard.Text(resources));
+    verifier.Check(text && text->tokens.size() == 1 && text->images.size() == 1, "clipboard/text: parses");
+    if (text && text->tokens.size() == 1 && text->images.size() == 1)
+        paste(Clipboard::Clone(resources, text->tokens, text->images), "clipboard/text");
+}
+
+// Caches keyed on the walls' or fog's address compare versions, which must
+// differ for a new instance. Walls also log the regions each change touched.
+static void VerifyVersions(Verifier& verifier)
+{
+    Walls walls, other;
+    verifier.Check(walls.Version() != other.Version(), "versions/walls: unique across instances");
+    FogOfWar fog, otherFog;
+    verifier.Check(fog.PolygonsVersion() != otherFog.PolygonsVersion(), "versions/fog: unique across instances");
+
+    uint64_t start = walls.Version();
+    other.Add(glm::vec2(0.0f), glm::vec2(1.0f));
+    walls.Add(glm::vec2(0.0f), glm::vec2(1.0f));
+    uint64_t middle = walls.Version();
+    walls.Add(glm::vec2(2.0f), glm::vec2(3.0f));
+    std::vector<Bounds2D> changed;
+    verifier.Check(walls.ChangedSince(start, changed) && changed.size() == 2, "versions/walls: changes since the start");
+    changed.clear();
+    verifier.Check(walls.ChangedSince(middle, changed) && changed.size() == 1 && changed[0].min.x == 2.0f, "versions/walls: changes since the middle");
+    changed.clear();
+    verifier.Check(walls.ChangedSince(walls.Version(), changed) && changed.empty(), "versions/walls: nothing since the latest");
+    for (size_t i = 0; i + 1 < Walls::MAX_LOGGED_CHANGES; i++)
+        walls.Add(glm::vec2(float(i)), glm::vec2(float(i) + 1.0f));
+    verifier.Check(!walls.ChangedSince(start, changed) && walls.ChangedSince(middle, changed), "versions/walls: oldest changes forgotten");
+    uint64_t cleared = walls.Version();
+    walls.Clear();
+    verifier.Check(!walls.ChangedSince(cleared, changed), "versions/walls: clearing forgets every change");
+}
+
+int VerifyModel(const std::shared_ptr<Resources>& resources)
+{
+    Verifier verifier;
+    VerifyJSON(verifier, resources);
+    VerifyBinary(verifier, resources);
+    VerifyBundle(verifier);
+    VerifyHeightfields(verifier, resources);
+    VerifyClipboard(verifier, resources);
+    VerifyVersions(verifier);
+
+    std::cout << verifier.numChecks << " checks, " << verifier.numFailed << " failed" << std::endl;
+    return verifier.numFailed;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <memory>
+
+#include <Resources.h>
+
+
+// Round trip and consistency checks for the scene formats, run by
+// model_bench --verify. Prints each failed check and returns how many failed.
+int VerifyModel(const std::shared_ptr<Resources>& resources);
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include "SceneGenerator.h"
+
+
+std::string SyntheticTexturePath(size_t index)
+{
+    return "bench/missing/token_" + std::to_string(index) + ".png";
+}
+
+std::shared_ptr<Scene> GenerateScene(const std::shared_ptr<Resources>& resources, const SceneGeneratorOptions& options)
+{
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<float> posDist(-options.extent * 0.5f, options.extent * 0.5f);
+    std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+    // Mostly medium tokens, with the odd large/huge one like a real encounter
+    std::discrete_distribution<int> sizeDist({70, 20, 8, 2});
+
+    auto scene = std::make_shared<Scene>(resources);
+    scene->AddDefaultCamera();
+
+    scene->tokens.reserve(options.numTokens);
+    for (size_t i = 0; i < options.numTokens; i++)
+    {
+        auto texture = resources->GetTexture(SyntheticTexturePath(i % std::max<size_t>(options.numTextures, 1)));
+        auto token = std::make_shared<Token>(texture, "Token " + std::to_string(i));
+        token->GetModel()->SetPos(glm::vec2(posDist(rng), posDist(rng)));
+        token->GetModel()->SetScalef(float(sizeDist(rng) + 1));
+        token->SetBorderColor(glm::vec4(unitDist(rng), unitDist(rng), unitDist(rng), 1.0f));
+        token->SetStatusEnabled(i % NUM_TOKEN_STATUSES, i % 3 == 0);
+        token->SetXStatus(i % 7 == 0);
+        scene->AddToken(token);
+        if (unitDist(rng) < options.selectedFraction)
+            scene->SetSelected(token->GetID(), true);
+    }
+
+    scene->images.reserve(options.numImages);
+    for (size_t i = 0; i < options.numImages; i++)
+    {
+        auto image = std::make_shared<BGImage>(resources->GetTexture("bench/missing/map_" + std::to_string(i) + ".png"));
+        image->GetModel()->SetPos(glm::vec2(posDist(rng), posDist(rng)));
+        image->GetModel()->SetScale(glm::vec2(options.extent * 0.25f));
+        scene->AddImage(image);
+    }
+
+    // Drawn after the shapes so scenes without walls are unchanged
+    int numCells = std::max(int(options.extent / options.wallSpacing), 1);
+    std::uniform_int_distribution<int> cellDist(-numCells / 2, numCells / 2 - 1);
+    for (size_t i = 0; i < options.numWalls; i++)
+    {
+        glm::vec2 start = glm::vec2(cellDist(rng), cellDist(rng)) * options.wallSpacing;
+        glm::vec2 direction = i % 2 ? glm::vec2(options.wallSpacing, 0.0f) : glm::vec2(0.0f, options.wallSpacing);
+        scene->fog->walls.Add(start, start + direction);
+    }
+
+    return scene;
+}
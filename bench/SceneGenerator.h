@@ -0,0 +1,28 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#include <Resources.h>
+#include <model/Scene.h>
+
+
+struct SceneGeneratorOptions
+{
+    size_t numTokens = 1000;
+    size_t numImages = 4;
+    // Number of unique texture paths shared between the tokens
+    size_t numTextures = 16;
+    // Tokens are scattered across a square of this size centered on the origin
+    float extent = 500.0f;
+    float selectedFraction = 0.0f;
+    // Walls are laid along the edges of a lattice of this spacing, like the
+    // rooms of a dungeon, so they only meet at their ends
+    size_t numWalls = 0;
+    float wallSpacing = 5.0f;
+    unsigned int seed = 1234;
+};
+
+// Builds a deterministic scene for benchmarking. Texture paths are synthetic and
+// never exist on disk so nothing is decoded or uploaded.
+std::shared_ptr<Scene> GenerateScene(const std::shared_ptr<Resources>& resources, const SceneGeneratorOptions& options);
+std::string SyntheticTexturePath(size_t index);
@@ -0,0 +1,630 @@
+// Loopback benchmark for scene sync. Serves a generated scene from this
+// process to client processes forked from it, each owning one token that it
+// moves through edit requests while the host moves a share of the rest every
+// frame. Clients predict their edits, with several waiting on the host at
+// once, and every 10th is one the host rejects so has to roll back. The host
+// also drags one token in a circle, previewed to clients over UDP with
+// optional simulated loss and jitter. --latency-ms delays the TCP stream too. With --images the scene
+// has that many background images, written where the clients can't see them
+// so they're streamed to each client's cache. With --view-size each client
+// only shows that much of the world around its token, and with --vision the
+// host limits how far clients' tokens see. Every 7th token's name is hidden.
+// Reports bandwidth, edit latency, how closely clients' previews follow the
+// drag and how long the images took, then checks every client ended with
+// what the host says it sees of the scene, and that what the host says
+// matches working it out from scratch.
+//
+//   ./build/sync_bench [--clients 8] [--edits 100] [--in-flight 4] [--tokens 1000] [--frame-ms 16]
+//                      [--loss 0.1] [--latency-ms 10] [--jitter-ms 30]
+//                      [--images 4] [--image-size 1024] [--view-size 50] [--vision 20]
+//
+// Exits non-zero if any client's scene differs from what it should see.
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Actions.hpp>
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/SpatialGrid.h>
+#include <net/Datagram.h>
+#include <net/InterestManager.h>
+#include <net/MotionInterpolator.h>
+#include <net/Protocol.h>
+#include <net/SceneClient.h>
+#include <net/SceneHost.h>
+
+#include "SceneGenerator.h"
+
+
+struct SyncBenchOptions
+{
+    size_t numClients = 8;
+    size_t numEdits = 100;
+    // Edits a client has waiting on the host at once
+    size_t inFlight = 4;
+    // Every this many edits is one the host rejects
+    size_t rejectInterval = 10;
+    size_t numTokens = 1000;
+    int frameMs = 16;
+    // Share of the host's tokens moved each frame
+    float movedFraction = 0.01f;
+    // Applied to every datagram sent, in both directions
+    NetworkConditions conditions;
+    // Background images of imageSize pixels square
+    size_t numImages = 0;
+    int imageSize = 1024;
+    // Side of the square each client shows around its token, 0 for all
+    float viewSize = 0.0f;
+    float visionRange = 0.0f;
+};
+
+const size_t HIDDEN_NAME_INTERVAL = 7;
+
+const char* IMAGE_DIRECTORY = "sync_bench_assets";
+
+// Drag previews are sent at this rate, as the controller does
+const double MOTION_INTERVAL_MS = 30.0;
+const float DRAG_RADIUS = 5.0f;
+const double DRAG_RADIANS_PER_MS = 3.14159265 / 1000.0;
+
+// Where the host's dragged token is at a time on the shared steady clock,
+// forked clients can work it out for themselves
+static glm::vec2 DragPath(glm::vec2 center, double timeMs)
+{
+    double angle = timeMs * DRAG_RADIANS_PER_MS;
+    return center + DRAG_RADIUS * glm::vec2(float(std::cos(angle)), float(std::sin(angle)));
+}
+
+static double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// What a client sends back over its pipe once the host has gone
+struct ClientReport
+{
+    ClientID id;
+    uint64_t digest;
+    size_t numTokens;
+    SyncStats stats;
+    MotionStats motion;
+    // Distance from the previewed drag to the true path, and frames where
+    // the preview didn't move
+    double meanDragError;
+    double maxDragError;
+    size_t dragFrames;
+    size_t stalledFrames;
+    // From connecting until every image had a preview, and until all were
+    // complete
+    AssetStats assets;
+    double previewMs;
+    double imagesMs;
+};
+
+// Binary PPM, which stb reads, different for each index
+static bool WriteImage(const std::string& path, int size, size_t index)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << size << " " << size << "\n255\n";
+    std::vector<unsigned char> row(size * 3);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            row[x * 3] = (x + index * 37) & 0xFF;
+            row[x * 3 + 1] = (y + index * 91) & 0xFF;
+            row[x * 3 + 2] = ((x ^ y) + index * 13) & 0xFF;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return file.good();
+}
+
+// Hashes what a client sees of the tokens, positions at the precision
+// they're sent. On the host, only the tokens the client is sent with its
+// hidden fields cleared.
+static uint64_t SceneDigest(Scene& scene, const SceneHost* host = nullptr, ClientID client = HOST_CLIENT_ID)
+{
+    std::vector<std::shared_ptr<Token>> tokens;
+    for (const auto& token: scene.tokens)
+    {
+        if (!host || host->IsVisible(client, token->GetID()))
+            tokens.push_back(token);
+    }
+    std::sort(tokens.begin(), tokens.end(), [](const auto& a, const auto& b) { return a->GetID() < b->GetID(); });
+
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    for (const auto& token: tokens)
+    {
+        ShapeState state = CaptureToken(*token);
+        ShapeID id = token->GetID();
+        if (host)
+        {
+            state.owner = host->GetOwner(id);
+            HideFields(state, client);
+        }
+        mix(&id, sizeof(id));
+        mix(&state.position, sizeof(state.position));
+        mix(&state.rotation, sizeof(state.rotation));
+        mix(&state.flags, sizeof(state.flags));
+        mix(&state.opacity, sizeof(state.opacity));
+        mix(state.name.data(), state.name.size());
+    }
+    return hash;
+}
+
+static double Elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Whether the client should see the token, worked out from scratch
+static bool ExpectVisible(Scene& scene, const SceneHost& host, ClientID client, const Bounds2D* region, float visionRange,
+                          const std::shared_ptr<Token>& token)
+{
+    if (host.GetOwner(token->GetID()) == client)
+        return true;
+    auto model = token->GetModel();
+    glm::vec2 pos = DequantizePosition(QuantizePosition(model->GetPos()));
+    Bounds2D bounds = SpatialGrid::ShapeBounds(pos, model->GetScale(), model->GetRotation());
+    if (region && !SpatialGrid::Overlaps(*region, bounds))
+        return false;
+    if (visionRange <= 0.0f)
+        return true;
+    for (const auto& own: scene.tokens)
+    {
+        if (host.GetOwner(own->GetID()) != client)
+            continue;
+        glm::vec2 ownPos = DequantizePosition(QuantizePosition(own->GetModel()->GetPos()));
+        if (glm::length(ownPos - pos) <= visionRange + glm::length(bounds.Size()) * 0.5f)
+            return true;
+    }
+    return false;
+}
+
+// Runs in the forked process, never returns
+static void RunClient(uint16_t port, const SyncBenchOptions& options, size_t index, ShapeID dragged, glm::vec2 center, glm::vec2 viewCenter,
+                      int reportFd)
+{
+    // A directory of its own, where the host's image paths don't exist
+    std::string directory = "client" + std::to_string(index);
+    std::error_code error;
+    std::filesystem::create_directory(directory, error);
+    std::filesystem::current_path(directory, error);
+    if (error)
+        _exit(2);
+
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(resources);
+    SceneClient client(resources);
+    client.SetNetworkConditions(options.conditions);
+    client.SetAssetDirectory("cache");
+    double connectMs = NowMs();
+    if (!client.Connect("127.0.0.1", port))
+        _exit(2);
+    if (options.viewSize > 0.0f)
+        client.SetViewRegion(Bounds2D(viewCenter - options.viewSize * 0.5f, viewCenter + options.viewSize * 0.5f));
+
+    // Previews are shown this far behind the path, the delay plus the
+    // fastest transit
+    MotionInterpolator motion;
+    double behindMs = motion.GetDelay() + options.conditions.latencyMs;
+    glm::vec2 lastPreview(0);
+    double totalError = 0.0;
+
+    // The report is sent once the host disconnects, having read everything it sent
+    ClientReport report{};
+    char done = 1;
+    size_t numEdits = 0;
+    bool signalled = false;
+    while (client.IsConnected())
+    {
+        motion.Restore(*scene);
+        if (client.Update(scene))
+            motion.Clear();
+        for (const MotionPacket& packet: client.TakeMotion())
+            motion.Add(packet);
+        motion.Apply(*scene);
+        if (motion.IsMoving(dragged))
+        {
+            glm::vec2 preview = scene->GetToken(dragged)->GetModel()->GetPos();
+            double error = glm::length(preview - DragPath(center, NowMs() - behindMs));
+            totalError += error;
+            report.maxDragError = std::max(report.maxDragError, error);
+            report.stalledFrames += (preview == lastPreview);
+            report.dragFrames++;
+            lastPreview = preview;
+        }
+
+        if (client.HasScene() && numEdits < options.numEdits && client.NumPendingEdits() < options.inFlight)
+        {
+            for (const auto& token: scene->tokens)
+            {
+                if (!client.Owns(token->GetID()))
+                    continue;
+                ShapeState state = CaptureToken(*token);
+                SyncField fields = SyncField::Position | SyncField::Rotation;
+                state.position = QuantizePosition(token->GetModel()->GetPos() + glm::vec2(1.0f, 0.5f));
+                state.rotation = token->GetModel()->GetRotation() + 1.0f;
+                // Out of range, so it's shown until the host says no
+                if (options.rejectInterval && (numEdits + 1) % options.rejectInterval == 0)
+                {
+                    fields = SyncField::Opacity;
+                    state.opacity = 2.0f;
+                }
+                ApplyToken(state, fields, *token, *resources);
+                client.RequestEdit(token->GetID(), fields, state);
+                numEdits++;
+                break;
+            }
+        }
+        // Only the images it sees are sent, in the delta after the snapshot
+        // along with its own token
+        const AssetStats& assets = client.Stats().assets;
+        bool hasShapes = client.HasScene() && !scene->tokens.empty();
+        size_t numImages = 0;
+        for (const auto& image: scene->images)
+            numImages += image->GetImage()->filename.rfind(IMAGE_DIRECTORY, 0) == 0;
+        if (report.previewMs == 0.0 && hasShapes && assets.previews + assets.cached >= numImages)
+            report.previewMs = NowMs() - connectMs;
+        bool imagesDone = hasShapes && client.NumDownloads() == 0 && assets.completed + assets.cached >= numImages;
+        if (report.imagesMs == 0.0 && imagesDone)
+            report.imagesMs = NowMs() - connectMs;
+        if (!signalled && imagesDone && numEdits == options.numEdits && client.NumPendingEdits() == 0)
+            signalled = (write(reportFd, &done, 1) == 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    motion.Restore(*scene);
+    report.id = client.ID();
+    report.digest = SceneDigest(*scene);
+    report.numTokens = scene->tokens.size();
+    report.stats = client.Stats();
+    report.motion = motion.Stats();
+    report.assets = report.stats.assets;
+    report.meanDragError = report.dragFrames ? totalError / report.dragFrames : 0.0;
+    bool sent = signalled && write(reportFd, &report, sizeof(report)) == sizeof(report);
+    _exit(sent ? 0 : 3);
+}
+
+static bool ReadAll(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    SyncBenchOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc)
+            options.numClients = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--edits" && i + 1 < argc)
+            options.numEdits = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--in-flight" && i + 1 < argc)
+            options.inFlight = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--tokens" && i + 1 < argc)
+            options.numTokens = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--frame-ms" && i + 1 < argc)
+            options.frameMs = std::atoi(argv[++i]);
+        else if (arg == "--loss" && i + 1 < argc)
+            options.conditions.lossRate = std::atof(argv[++i]);
+        else if (arg == "--latency-ms" && i + 1 < argc)
+            options.conditions.latencyMs = std::atof(argv[++i]);
+        else if (arg == "--jitter-ms" && i + 1 < argc)
+            options.conditions.jitterMs = std::atof(argv[++i]);
+        else if (arg == "--images" && i + 1 < argc)
+            options.numImages = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--image-size" && i + 1 < argc)
+            options.imageSize = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--view-size" && i + 1 < argc)
+            options.viewSize = std::atof(argv[++i]);
+        else if (arg == "--vision" && i + 1 < argc)
+            options.visionRange = std::atof(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    // One per client, the dragged one and at least one moved at random
+    options.numTokens = std::max(options.numTokens, options.numClients + 2);
+
+    std::shared_ptr<Resources> resources = std::make_shared<Resources>();
+    SceneGeneratorOptions sceneOptions;
+    sceneOptions.numTokens = options.numTokens;
+    std::shared_ptr<Scene> scene = GenerateScene(resources, sceneOptions);
+    for (size_t i = 0; i < scene->tokens.size(); i += HIDDEN_NAME_INTERVAL)
+        scene->tokens[i]->SetNameHidden(true);
+
+    // Clients work in subdirectories of a scratch directory
+    char scratch[] = "/tmp/sync_bench_XXXXXX";
+    std::error_code error;
+    if (!mkdtemp(scratch))
+        return 2;
+    std::filesystem::path originalDirectory = std::filesystem::current_path();
+    std::filesystem::current_path(scratch, error);
+    std::filesystem::create_directory(IMAGE_DIRECTORY, error);
+    for (size_t i = 0; i < options.numImages; i++)
+    {
+        std::string path = std::string(IMAGE_DIRECTORY) + "/image" + std::to_string(i) + ".ppm";
+        if (error || !WriteImage(path, options.imageSize, i))
+        {
+            std::cerr << "Unable to write " << path << " in " << scratch << std::endl;
+            return 2;
+        }
+        scene->AddImage(std::make_shared<BGImage>(resources->GetTexture(path)));
+    }
+
+    SceneHost host(resources);
+    host.SetNetworkConditions(options.conditions);
+    host.SetVisionRange(options.visionRange);
+    if (!host.Listen(0))
+        return 2;
+
+    // Each client gets the next unowned token, the one after is dragged and
+    // the rest are moved at random
+    std::shared_ptr<Token> dragged = scene->tokens[options.numClients];
+    glm::vec2 center = dragged->GetModel()->GetPos();
+
+    struct Child
+    {
+        pid_t pid;
+        int fd;
+        bool done = false;
+    };
+    // Connected one at a time, so the i'th client owns the i'th token and
+    // its view is centered on where that token starts
+    std::vector<Child> children;
+    for (size_t i = 0; i < options.numClients; i++)
+    {
+        glm::vec2 viewCenter = scene->tokens[i]->GetModel()->GetPos();
+        int fds[2];
+        if (pipe(fds) != 0)
+            return 2;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            RunClient(host.Port(), options, i, dragged->GetID(), center, viewCenter, fds[1]);
+        }
+        close(fds[1]);
+        children.push_back({pid, fds[0]});
+        while (host.NumClients() <= i)
+        {
+            int status;
+            if (waitpid(pid, &status, WNOHANG) == pid)
+            {
+                std::cerr << "Client " << pid << " failed to connect" << std::endl;
+                return 2;
+            }
+            host.Update(scene);
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.frameMs));
+        }
+    }
+
+    std::map<ClientID, ShapeID> owned;
+    // Where each client's view region is centered, its token's first position
+    std::map<ClientID, glm::vec2> viewCenters;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(options.numClients + 1, scene->tokens.size() - 1);
+    size_t movedPerFrame = std::max<size_t>(1, options.numTokens * options.movedFraction);
+    MotionSample dragSample{dragged->GetID(), QuantizePosition(center)};
+    double lastMotionMs = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t numFrames = 0;
+    size_t numDone = 0;
+    while (numDone < children.size())
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        ActionEffects effects;
+        for (const SceneHost::Edit& edit: host.TakeEdits())
+        {
+            std::shared_ptr<Token> token = scene->GetToken(edit.id);
+            ApplyToken(edit.state, edit.fields, *token, *resources);
+            effects.shapes.push_back(edit.id);
+        }
+        for (size_t i = 0; i < movedPerFrame; i++)
+        {
+            const auto& token = scene->tokens[pick(rng)];
+            token->GetModel()->SetPos(token->GetModel()->GetPos() + glm::vec2(0.25f, -0.25f));
+            effects.shapes.push_back(token->GetID());
+        }
+        if (NowMs() - lastMotionMs >= MOTION_INTERVAL_MS)
+        {
+            lastMotionMs = NowMs();
+            dragSample.position = QuantizePosition(DragPath(center, lastMotionMs));
+            host.StreamMotion({dragSample}, false);
+        }
+        host.Record(effects);
+        host.Update(scene);
+        numFrames++;
+
+        for (ClientID client: host.Clients())
+        {
+            if (owned.count(client))
+                continue;
+            const auto& token = scene->tokens[owned.size()];
+            ShapeID id = token->GetID();
+            owned[client] = id;
+            viewCenters[client] = token->GetModel()->GetPos();
+            host.SetOwner(id, client);
+        }
+
+        for (Child& child: children)
+        {
+            pollfd fd = {child.fd, POLLIN, 0};
+            char done;
+            if (!child.done && poll(&fd, 1, 0) > 0 && read(child.fd, &done, 1) == 1)
+            {
+                child.done = true;
+                numDone++;
+            }
+        }
+        std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(options.frameMs));
+    }
+    double seconds = Elapsed(start);
+
+    // The drag ends where it was last previewed, committed reliably
+    host.StreamMotion({dragSample}, true);
+    dragged->GetModel()->SetPos(DequantizePosition(dragSample.position));
+    host.Record(ActionEffects{{dragged->GetID()}});
+
+    // A few more frames so everything queued reaches the clients before closing
+    for (int i = 0; i < 10; i++)
+    {
+        host.Update(scene);
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.frameMs));
+    }
+    SyncStats hostStats = host.Stats();
+    std::filesystem::current_path(originalDirectory, error);
+
+    // What each client should have, from the host's sets, and whether those
+    // sets are right
+    std::map<ClientID, uint64_t> digests;
+    std::map<ClientID, size_t> numVisible;
+    bool matched = true;
+    for (const auto& [client, viewCenter]: viewCenters)
+    {
+        digests[client] = SceneDigest(*scene, &host, client);
+        Bounds2D padded;
+        if (options.viewSize > 0.0f)
+        {
+            float half = options.viewSize * (0.5f + VIEW_MARGIN);
+            padded = Bounds2D(viewCenter - half, viewCenter + half);
+        }
+        for (const auto& token: scene->tokens)
+        {
+            bool visible = host.IsVisible(client, token->GetID());
+            numVisible[client] += visible;
+            if (visible != ExpectVisible(*scene, host, client, options.viewSize > 0.0f ? &padded : nullptr, options.visionRange, token))
+            {
+                std::cerr << "Client " << client << " visibility of token " << token->GetID() << " is wrong" << std::endl;
+                matched = false;
+                break;
+            }
+        }
+    }
+    host.Stop();
+
+    double averageLatency = 0.0;
+    uint64_t rejected = 0;
+    uint64_t corrections = 0;
+    double maxLatency = 0.0;
+    uint64_t clientBytes = 0;
+    MotionStats motion;
+    double meanDragError = 0.0;
+    double maxDragError = 0.0;
+    size_t dragFrames = 0;
+    size_t stalledFrames = 0;
+    AssetStats assets;
+    double previewMs = 0.0;
+    double imagesMs = 0.0;
+    size_t visibleTokens = 0;
+    for (Child& child: children)
+    {
+        ClientReport report;
+        int status = 0;
+        bool received = ReadAll(child.fd, &report, sizeof(report));
+        close(child.fd);
+        waitpid(child.pid, &status, 0);
+        if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "Client " << child.pid << " failed" << std::endl;
+            matched = false;
+            continue;
+        }
+        if (!digests.count(report.id) || report.digest != digests[report.id] || report.numTokens != numVisible[report.id])
+        {
+            std::cerr << "Client " << child.pid << " scene differs from the host's" << std::endl;
+            matched = false;
+        }
+        visibleTokens += report.numTokens;
+        averageLatency += report.stats.averageLatencyMs / children.size();
+        rejected += report.stats.editsRejected;
+        corrections += report.stats.corrections;
+        // Only a rejected edit should move a predicted token
+        if (report.stats.corrections > report.stats.editsRejected)
+        {
+            std::cerr << "Client " << child.pid << " predictions were corrected " << report.stats.corrections << " times" << std::endl;
+            matched = false;
+        }
+        maxLatency = std::max(maxLatency, report.stats.maxLatencyMs);
+        clientBytes += report.stats.bytesReceived;
+        motion.packetsReceived += report.motion.packetsReceived;
+        motion.packetsMissed += report.motion.packetsMissed;
+        motion.packetsLate += report.motion.packetsLate;
+        meanDragError += report.meanDragError / children.size();
+        maxDragError = std::max(maxDragError, report.maxDragError);
+        dragFrames += report.dragFrames;
+        stalledFrames += report.stalledFrames;
+        assets.bytes += report.assets.bytes;
+        assets.completed += report.assets.completed;
+        assets.previews += report.assets.previews;
+        assets.cached += report.assets.cached;
+        previewMs = std::max(previewMs, report.previewMs);
+        imagesMs = std::max(imagesMs, report.imagesMs);
+    }
+    std::filesystem::remove_all(scratch, error);
+
+    std::cout << options.numClients << " clients, " << options.numTokens << " tokens, "
+              << numFrames << " frames of " << options.frameMs << " ms in " << seconds << " s" << std::endl;
+    std::cout << "host sent     " << hostStats.bytesSent / 1024.0 << " KB in " << hostStats.messagesSent << " messages, "
+              << hostStats.bytesSent / 1024.0 / seconds << " KB/s" << std::endl;
+    std::cout << "host received " << hostStats.bytesReceived / 1024.0 << " KB, "
+              << hostStats.editsAccepted << " edits accepted, " << hostStats.editsRejected << " rejected" << std::endl;
+    std::cout << "per client    " << clientBytes / 1024.0 / std::max<size_t>(1, children.size()) << " KB received, "
+              << visibleTokens / std::max<size_t>(1, children.size()) << " tokens seen" << std::endl;
+    std::cout << "edit latency  " << averageLatency << " ms average, " << maxLatency << " ms max, shown at once as predicted, "
+              << corrections << " corrections for " << rejected << " rejected" << std::endl;
+    std::cout << "drag preview  " << hostStats.datagramBytesSent / 1024.0 << " KB of datagrams, "
+              << motion.packetsReceived << " packets received, " << motion.packetsMissed << " missed, "
+              << motion.packetsLate << " late" << std::endl;
+    std::cout << "drag error    " << meanDragError << " average, " << maxDragError << " max, "
+              << 100.0 * stalledFrames / std::max<size_t>(1, dragFrames) << "% of frames stalled" << std::endl;
+    if (options.numImages)
+    {
+        std::cout << "images        " << hostStats.assets.bytes / 1024.0 << " KB sent, clients received " << assets.bytes / 1024.0 << " KB, "
+                  << assets.completed << " complete, " << assets.previews << " previews, " << assets.cached << " cached" << std::endl;
+        std::cout << "image time    " << previewMs << " ms to every preview, " << imagesMs << " ms to every image, slowest client" << std::endl;
+    }
+    std::cout << "scenes " << (matched ? "match" : "DIFFER") << std::endl;
+    return matched ? 0 : 1;
+}
@@ -1,15 +1,37 @@
 #pragma once
 #include <chrono>
 #include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <glm/glm.hpp>
+#include <json.hpp>
 
+#include <JSONSerializer.h>
 #include <glutil/Matrix2D.h>
 #include <glutil/Texture.h>
 #include <model/BGImage.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Scene.h>
+#include <model/Selection.h>
+#include <model/ShapeProperties.h>
 #include <model/Token.h>
+#include <model/Walls.h>
+
+
+// What an action changes, so its net effect can be journaled
+struct ActionEffects
+{
+    std::vector<ShapeID> shapes;
+    // Anything outside of the shape lists, eg, grid, cameras, locks
+    bool settings = false;
+    // Walls are kept apart from the settings as there can be thousands
+    bool walls = false;
+};
 
 
 class Action
@@ -20,8 +42,95 @@ public:
     // Merge tries to combine Actions of the same type.
     virtual bool CanMerge(const std::shared_ptr<Action>& action) { return false; }
     virtual void Merge(const std::shared_ptr<Action>& action) {}
+
+    // Approximate memory held by the action, used to budget the undo history
+    virtual size_t ByteSize() { return sizeof(Action); }
+    // Converts held shapes/textures into serialized payloads so cold history
+    // doesn't pin them. Compacted actions expand again when undone or redone.
+    virtual void Compact(JSONSerializer& serializer) {}
+    // Serialized payloads the history may spill to disk and restore before
+    // the action is next used
+    virtual void Payloads(std::vector<std::string*>& payloads) {}
+    // Adds what the action changes to effects, anything not a shape by default
+    virtual void Effects(ActionEffects& effects) { effects.settings = true; }
 };
 
+// Approximate sizes of values held by actions. Textures are counted by their
+// decoded size as that's what keeping them alive costs.
+inline size_t TextureBytes(const std::shared_ptr<Texture>& texture)
+{
+    return texture ? sizeof(Texture) + texture->filename.capacity() + texture->ByteSize() : 0;
+}
+
+// Shape, its Matrix2D handle and TransformStore slot
+template <typename T>
+constexpr size_t ShapeBytes() { return sizeof(T) + sizeof(Matrix2D) + sizeof(glm::mat4) + 2 * sizeof(glm::vec2) + sizeof(float); }
+
+inline std::shared_ptr<Texture> ShapeTexture(Token& token) { return token.GetIcon(); }
+inline std::shared_ptr<Texture> ShapeTexture(BGImage& image) { return image.GetImage(); }
+
+// Each distinct texture is only counted once
+template <typename T>
+size_t ShapesBytes(const std::vector<std::shared_ptr<T>>& shapes)
+{
+    std::unordered_set<Texture*> textures;
+    size_t bytes = shapes.capacity() * sizeof(std::shared_ptr<T>) + shapes.size() * ShapeBytes<T>();
+    for (const auto& shape: shapes)
+    {
+        std::shared_ptr<Texture> texture = ShapeTexture(*shape);
+        if (textures.insert(texture.get()).second)
+            bytes += TextureBytes(texture);
+    }
+    return bytes;
+}
+
+inline void SerializeShape(JSONSerializer& serializer, const std::shared_ptr<Token>& token, nlohmann::json& json) { serializer.SerializeToken(token, json); }
+inline void SerializeShape(JSONSerializer& serializer, const std::shared_ptr<BGImage>& image, nlohmann::json& json) { serializer.SerializeImage(image, json); }
+inline void DeserializeShape(JSONSerializer& serializer, nlohmann::json& json, std::shared_ptr<Token>& token) { token = serializer.DeserializeToken(json); }
+inline void DeserializeShape(JSONSerializer& serializer, nlohmann::json& json, std::shared_ptr<BGImage>& image) { image = serializer.DeserializeImage(json); }
+
+// Payloads are stored as MessagePack, much smaller than the objects they replace
+inline std::string PackPayload(const nlohmann::json& json)
+{
+    std::vector<std::uint8_t> bytes = nlohmann::json::to_msgpack(json);
+    return std::string(bytes.begin(), bytes.end());
+}
+inline nlohmann::json UnpackPayload(std::string& payload)
+{
+    nlohmann::json json = nlohmann::json::from_msgpack(payload);
+    std::string().swap(payload);
+    return json;
+}
+
+inline nlohmann::json TexturePaths(const std::vector<std::shared_ptr<Texture>>& textures)
+{
+    nlohmann::json paths = nlohmann::json::array();
+    for (const auto& texture: textures)
+        paths.push_back(texture ? nlohmann::json(texture->filename) : nlohmann::json());
+    return paths;
+}
+
+inline std::vector<std::shared_ptr<Texture>> ResolveTextures(Resources& resources, const nlohmann::json& paths)
+{
+    // Batches mostly share a few textures, only look each up once
+    std::unordered_map<std::string, std::shared_ptr<Texture>> lookup;
+    std::vector<std::shared_ptr<Texture>> textures;
+    textures.reserve(paths.size());
+    for (const auto& path: paths)
+    {
+        if (path.is_null())
+        {
+            textures.push_back(nullptr);
+            continue;
+        }
+        auto [it, inserted] = lookup.try_emplace(path.get<std::string>(), nullptr);
+        if (inserted)
+            it->second = resources.GetTexture(it->first);
+        textures.push_back(it->second);
+    }
+    return textures;
+}
+
 
 class ActionGroup: public Action
 {
@@ -66,6 +175,29 @@ public:
             m_actions[i]->Merge(actionGroup->m_actions[i]);
     }
 
+    virtual size_t ByteSize()
+    {
+        size_t bytes = sizeof(ActionGroup) + m_actions.capacity() * sizeof(std::shared_ptr<Action>);
+        for (auto& action: m_actions)
+            bytes += action->ByteSize();
+        return bytes;
+    }
+    virtual void Compact(JSONSerializer& serializer)
+    {
+        for (auto& action: m_actions)
+            action->Compact(serializer);
+    }
+    virtual void Payloads(std::vector<std::string*>& payloads)
+    {
+        for (auto& action: m_actions)
+            action->Payloads(payloads);
+    }
+    virtual void Effects(ActionEffects& effects)
+    {
+        for (auto& action: m_actions)
+            action->Effects(effects);
+    }
+
 private:
     std::vector<std::shared_ptr<Action>> m_actions;
 };
@@ -90,7 +222,7 @@ public:
     virtual bool CanMerge(const std::shared_ptr<Action>& action)
     {
         auto modifyAction = std::dynamic_pointer_cast<ModifyMemberAction>(action);
-        if (modifyAction && modifyAction->m_inst == m_inst && modifyAction->m_func == m_func && occurredAt - modifyAction->occurredAt < maxTimeBetweenUniqueActions)
+        if (modifyAction && modifyAction->m_inst == m_inst && modifyAction->m_func == m_func && modifyAction->occurredAt - occurredAt < maxTimeBetweenUniqueActions)
             return true;
 
         return false;
@@ -99,7 +231,9 @@ public:
     {
         auto modifyAction = std::dynamic_pointer_cast<ModifyMemberAction>(action);
         m_newVal = modifyAction->m_newVal;
+        occurredAt = modifyAction->occurredAt;
     }
+    virtual size_t ByteSize() { return sizeof(ModifyMemberAction); }
 
 private:
     std::shared_ptr<T> m_inst;
@@ -116,19 +250,12 @@ typedef ModifyMemberAction<Grid, bool> ModifyGridBool;  // snap
 typedef ModifyMemberAction<Grid, float> ModifyGridFloat;  // size
 typedef ModifyMemberAction<Grid, glm::vec3> ModifyGridVec3;  // colour
 
+typedef ModifyMemberAction<FogOfWar, bool> ModifyFogBool;  // enabled
+typedef ModifyMemberAction<FogOfWar, float> ModifyFogFloat;  // range
+
 typedef ModifyMemberAction<Matrix2D, glm::vec2> ModifyMatrix2DVec2;  // pos, scale
 typedef ModifyMemberAction<Matrix2D, float> ModifyMatrix2DFloat;  // rotation
 
-typedef ModifyMemberAction<BGImage, bool> ModifyImageBool;  // lockRatio
-typedef ModifyMemberAction<BGImage, std::shared_ptr<Texture>> ModifyImageTexture;  // image
-
-typedef ModifyMemberAction<Token, bool> ModifyTokenBool;  // xStatus
-typedef ModifyMemberAction<Token, float> ModifyTokenFloat;  // borderWidth
-typedef ModifyMemberAction<Token, glm::vec4> ModifyTokenVec4;  // borderColour
-typedef ModifyMemberAction<Token, std::shared_ptr<Texture>> ModifyTokenTexture;  // icon
-typedef ModifyMemberAction<Token, std::string> ModifyTokenString;  // name
-typedef ModifyMemberAction<Token, TokenStatuses> ModifyTokenStatuses;
-
 typedef ModifyMemberAction<Scene, bool> ModifySceneLocks;
 
 class SetViewCameraAction : public Action
@@ -145,6 +272,7 @@ public:
     {
         m_scene->SetViewCamera(m_viewID, m_newCamera);
     }
+    virtual size_t ByteSize() { return sizeof(SetViewCameraAction); }
 
 private:
     std::shared_ptr<Scene> m_scene;
@@ -153,176 +281,439 @@ private:
     std::shared_ptr<Camera> m_newCamera;
 };
 
-// Selection
-class SelectShapesAction : public Action
+// Sets one property on many shapes. IDs and values are stored in parallel
+// arrays so apply, undo and merge are single loops.
+template <ShapeProperty P>
+class BatchPropertyAction : public Action
 {
 public:
-    SelectShapesAction(std::vector<std::shared_ptr<Shape2D>> selected) : selectedShapes(selected) {}
-    SelectShapesAction(std::vector<std::shared_ptr<Shape2D>> selected, const std::shared_ptr<Shape2D>& token, bool add=false) : selectedShapes(selected), m_additive(add)
+    typedef ShapePropertyTraits<P> Traits;
+    typedef typename Traits::Owner Owner;
+    typedef typename Traits::Type Type;
+
+    BatchPropertyAction(const std::shared_ptr<Scene>& scene) : m_scene(scene) {}
+
+    // Builds the action from the shapes' current values, newValue maps each
+    // old value to its new one
+    template <typename S, typename Func>
+    BatchPropertyAction(const std::shared_ptr<Scene>& scene, const std::vector<std::shared_ptr<S>>& shapes, Func&& newValue) : m_scene(scene)
     {
-        shapesToSelect.push_back(token);
+        m_ids.reserve(shapes.size());
+        m_oldValues.reserve(shapes.size());
+        m_newValues.reserve(shapes.size());
+        for (const auto& shape: shapes)
+        {
+            Type oldValue = Traits::Get(*shape);
+            m_ids.push_back(shape->GetID());
+            m_newValues.push_back(newValue(oldValue));
+            m_oldValues.push_back(std::move(oldValue));
+        }
+    }
+
+    void Add(ShapeID id, Type oldValue, Type newValue)
+    {
+        m_ids.push_back(id);
+        m_oldValues.push_back(std::move(oldValue));
+        m_newValues.push_back(std::move(newValue));
     }
-    SelectShapesAction(std::vector<std::shared_ptr<Shape2D>> selected, std::vector<std::shared_ptr<Shape2D>> toSelect, bool add=false) : selectedShapes(selected), shapesToSelect(toSelect), m_additive(add) {}
+
+    ShapeProperty Property() const { return P; }
+    bool IsEmpty() const { return m_ids.empty(); }
 
     virtual void Undo()
     {
-        if (m_additive)
-            Select(shapesToSelect, false);
-        else
-        {
-            Select(shapesToSelect, false);
-            Select(selectedShapes, true);
-        }
+        Expand();
+        Apply(m_oldValues);
     }
     virtual void Redo()
     {
-        if (!m_additive)
-            Select(selectedShapes, false);
-        Select(shapesToSelect, true);
+        Expand();
+        Apply(m_newValues);
     }
 
-    // If selecting the same thing / selecting nothing, then the actions can be combined
+    // Consecutive edits to the same shapes within a short time, eg, dragging a
+    // slider, become a single undo step
     virtual bool CanMerge(const std::shared_ptr<Action>& action)
     {
-        auto selectionAction = std::dynamic_pointer_cast<SelectShapesAction>(action);
-        if (selectionAction && selectionAction->shapesToSelect == shapesToSelect)
-            return true;
+        auto batchAction = std::dynamic_pointer_cast<BatchPropertyAction>(action);
+        return batchAction && batchAction->occurredAt - occurredAt < maxTimeBetweenUniqueActions && batchAction->m_ids == m_ids;
+    }
+    virtual void Merge(const std::shared_ptr<Action>& action)
+    {
+        auto batchAction = std::static_pointer_cast<BatchPropertyAction>(action);
+        Expand();
+        m_newValues = batchAction->m_newValues;
+        occurredAt = batchAction->occurredAt;
+    }
 
-        return false;
+    virtual size_t ByteSize()
+    {
+        size_t bytes = sizeof(BatchPropertyAction) + m_ids.capacity() * sizeof(ShapeID) +
+                       (m_oldValues.capacity() + m_newValues.capacity()) * sizeof(Type) + m_payload.capacity();
+        if constexpr (std::is_same_v<Type, std::shared_ptr<Texture>>)
+        {
+            std::unordered_set<Texture*> textures;
+            for (const std::vector<Type>* values: {&m_oldValues, &m_newValues})
+                for (const Type& texture: *values)
+                    if (textures.insert(texture.get()).second)
+                        bytes += TextureBytes(texture);
+        }
+        else if constexpr (std::is_same_v<Type, std::string>)
+        {
+            for (const std::vector<Type>* values: {&m_oldValues, &m_newValues})
+                for (const Type& value: *values)
+                    bytes += value.capacity();
+        }
+        return bytes;
     }
-    virtual void Merge(const std::shared_ptr<Action>& action) {}
+    // Textures are replaced by their paths, other values are already compact
+    virtual void Compact(JSONSerializer& serializer)
+    {
+        if constexpr (std::is_same_v<Type, std::shared_ptr<Texture>>)
+        {
+            if (m_compacted)
+                return;
+            m_payload = PackPayload({{"old", TexturePaths(m_oldValues)}, {"new", TexturePaths(m_newValues)}});
+            std::vector<Type>().swap(m_oldValues);
+            std::vector<Type>().swap(m_newValues);
+            m_resources = serializer.GetResources();
+            m_compacted = true;
+        }
+    }
+    virtual void Payloads(std::vector<std::string*>& payloads)
+    {
+        if (m_compacted)
+            payloads.push_back(&m_payload);
+    }
+    virtual void Effects(ActionEffects& effects) { effects.shapes.insert(effects.shapes.end(), m_ids.begin(), m_ids.end()); }
 
 private:
-    std::vector<std::shared_ptr<Shape2D>> selectedShapes;
-    std::vector<std::shared_ptr<Shape2D>> shapesToSelect;
-    bool m_additive = false;
+    std::shared_ptr<Scene> m_scene;
+    std::vector<ShapeID> m_ids;
+    std::vector<Type> m_oldValues;
+    std::vector<Type> m_newValues;
+    // Values serialized by Compact
+    bool m_compacted = false;
+    std::string m_payload;
+    std::shared_ptr<Resources> m_resources;
+    const std::chrono::milliseconds maxTimeBetweenUniqueActions{500};
+    std::chrono::steady_clock::time_point occurredAt = std::chrono::steady_clock::now();
 
-    void Select(const std::vector<std::shared_ptr<Shape2D>>& shapes, bool select)
+    void Expand()
     {
-        for (const auto& shape: shapes)
-            shape->isSelected = select;
+        if (!m_compacted)
+            return;
+        if constexpr (std::is_same_v<Type, std::shared_ptr<Texture>>)
+        {
+            nlohmann::json json = UnpackPayload(m_payload);
+            m_oldValues = ResolveTextures(*m_resources, json["old"]);
+            m_newValues = ResolveTextures(*m_resources, json["new"]);
+        }
+        m_compacted = false;
+    }
+
+    void Apply(const std::vector<Type>& values)
+    {
+        Scene& scene = *m_scene;
+        for (size_t i = 0; i < m_ids.size(); i++)
+        {
+            std::shared_ptr<Owner> shape = FindShape<Owner>(scene, m_ids[i]);
+            if (shape)
+                Traits::Set(*shape, values[i]);
+        }
     }
 };
 
-// Add/Remove
-class AddTokensAction : public Action
+// Selection
+// Only the IDs whose state changes are stored, not the full selection
+class SelectShapesAction : public Action
 {
 public:
-    AddTokensAction(const std::shared_ptr<Scene>& scene) : m_scene(scene) {}
-    AddTokensAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<Token>& token) : m_scene(scene)
-    {
-        m_tokens.push_back(token);
-    }
-    AddTokensAction(const std::shared_ptr<Scene>& scene, std::vector<std::shared_ptr<Token>> tokens) : m_scene(scene), m_tokens(tokens) {}
+    // Clears the selection
+    SelectShapesAction(const std::shared_ptr<Scene>& scene) : SelectShapesAction(scene, std::vector<std::shared_ptr<Shape2D>>()) {}
+    SelectShapesAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<Shape2D>& shape, bool add=false) :
+        SelectShapesAction(scene, std::vector<std::shared_ptr<Shape2D>>{shape}, add) {}
+    SelectShapesAction(const std::shared_ptr<Scene>& scene, const std::vector<std::shared_ptr<Shape2D>>& toSelect, bool add=false) :
+        m_scene(scene)
+    {
+        std::unordered_set<ShapeID> selectIDs;
+        for (const auto& shape: toSelect)
+        {
+            if (selectIDs.insert(shape->GetID()).second && !scene->IsSelected(shape->GetID()))
+                m_selected.push_back(shape->GetID());
+        }
+        if (add)
+            return;
 
-    void Add(const std::shared_ptr<Token>& token)
-    {
-        m_tokens.push_back(token);
+        for (const Selection* selection: {&scene->GetTokenSelection(), &scene->GetImageSelection()})
+        {
+            for (ShapeID id: selection->Members())
+                if (!selectIDs.count(id))
+                    m_deselected.push_back(id);
+        }
     }
 
     virtual void Undo()
     {
-        m_scene->RemoveTokens(m_tokens);
+        for (ShapeID id: m_selected)
+            m_scene->SetSelected(id, false);
+        for (ShapeID id: m_deselected)
+            m_scene->SetSelected(id, true);
     }
     virtual void Redo()
     {
-        for (const auto& token: m_tokens)
-            m_scene->AddToken(token);
+        for (ShapeID id: m_deselected)
+            m_scene->SetSelected(id, false);
+        for (ShapeID id: m_selected)
+            m_scene->SetSelected(id, true);
+    }
+
+    bool IsEmpty() const { return m_selected.empty() && m_deselected.empty(); }
+
+    // Reselecting the same thing changes nothing, so it can be combined
+    virtual bool CanMerge(const std::shared_ptr<Action>& action)
+    {
+        auto selectionAction = std::dynamic_pointer_cast<SelectShapesAction>(action);
+        return selectionAction && selectionAction->IsEmpty();
     }
+    virtual void Merge(const std::shared_ptr<Action>& action) {}
+
+    virtual size_t ByteSize() { return sizeof(SelectShapesAction) + (m_selected.capacity() + m_deselected.capacity()) * sizeof(ShapeID); }
+    // Selection isn't saved with the scene
+    virtual void Effects(ActionEffects& effects) {}
 
 private:
     std::shared_ptr<Scene> m_scene;
-    std::vector<std::shared_ptr<Token>> m_tokens;
+    std::vector<ShapeID> m_selected;
+    std::vector<ShapeID> m_deselected;
 };
 
-class RemoveTokensAction : public Action
+// Moves a set of shapes by the same offset, eg, a committed drag. Both ends
+// are kept so undoing and redoing restores them exactly rather than adding up
+// float error.
+class MoveShapesAction : public Action
 {
 public:
-    RemoveTokensAction(const std::shared_ptr<Scene>& scene) : m_scene(scene) {}
-    RemoveTokensAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<Token>& token) : m_scene(scene)
+    MoveShapesAction(const std::shared_ptr<Scene>& scene, std::vector<ShapeID> ids, std::vector<glm::vec2> startPositions, glm::vec2 offset) :
+        m_scene(scene), m_ids(std::move(ids)), m_startPositions(std::move(startPositions))
     {
-        m_tokens.push_back(token);
+        m_endPositions.reserve(m_startPositions.size());
+        for (glm::vec2 pos: m_startPositions)
+            m_endPositions.push_back(pos + offset);
     }
-    RemoveTokensAction(const std::shared_ptr<Scene>& scene, std::vector<std::shared_ptr<Token>> tokens) : m_scene(scene), m_tokens(tokens) {}
 
-    void Add(const std::shared_ptr<Token>& token)
-    {
-        m_tokens.push_back(token);
-    }
+    virtual void Undo() { Move(m_startPositions); }
+    virtual void Redo() { Move(m_endPositions); }
 
-    virtual void Undo()
-    {
-        for (const auto& token: m_tokens)
-            m_scene->AddToken(token);
-    }
-    virtual void Redo()
+    virtual size_t ByteSize()
     {
-        m_scene->RemoveTokens(m_tokens);
+        return sizeof(MoveShapesAction) + m_ids.capacity() * sizeof(ShapeID) + (m_startPositions.capacity() + m_endPositions.capacity()) * sizeof(glm::vec2);
     }
+    virtual void Effects(ActionEffects& effects) { effects.shapes.insert(effects.shapes.end(), m_ids.begin(), m_ids.end()); }
 
 private:
     std::shared_ptr<Scene> m_scene;
-    std::vector<std::shared_ptr<Token>> m_tokens;
+    std::vector<ShapeID> m_ids;
+    std::vector<glm::vec2> m_startPositions;
+    std::vector<glm::vec2> m_endPositions;
+
+    void Move(const std::vector<glm::vec2>& positions)
+    {
+        for (size_t i = 0; i < m_ids.size(); i++)
+        {
+            auto shape = m_scene->GetShape(m_ids[i]);
+            if (shape)
+                shape->GetModel()->SetPos(positions[i]);
+        }
+    }
 };
 
-class AddImagesAction : public Action
+// Add/Remove
+// Added shapes are held until the first Redo gives them a unique ID in the
+// scene, after which they're only referenced by ID. The removed shapes are
+// held again while undone.
+template <typename T>
+class AddShapesAction : public Action
 {
 public:
-    AddImagesAction(const std::shared_ptr<Scene>& scene) : m_scene(scene) {}
-    AddImagesAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<BGImage>& image) : m_scene(scene)
-    {
-        m_images.push_back(image);
-    }
-    AddImagesAction(const std::shared_ptr<Scene>& scene, std::vector<std::shared_ptr<BGImage>> images) : m_scene(scene), m_images(images) {}
+    typedef std::vector<std::shared_ptr<T>> Shapes;
+    typedef void (Scene::*AddFunc)(const Shapes&);
+    typedef RemovedShapes<T> (Scene::*RemoveFunc)(const std::vector<ShapeID>&);
 
-    void Add(const std::shared_ptr<BGImage>& image)
+    AddShapesAction(const std::shared_ptr<Scene>& scene, Shapes shapes, AddFunc add, RemoveFunc remove) :
+        m_scene(scene), m_shapes(shapes), m_add(add), m_remove(remove) {}
+
+    void Add(const std::shared_ptr<T>& shape)
     {
-        m_images.push_back(image);
+        m_shapes.push_back(shape);
     }
 
     virtual void Undo()
     {
-        m_scene->RemoveImages(m_images);
+        RemovedShapes<T> removed = (m_scene.get()->*m_remove)(m_ids);
+        m_shapes.clear();
+        m_shapes.reserve(removed.size());
+        for (auto& entry: removed)
+            m_shapes.push_back(std::move(entry.shape));
     }
     virtual void Redo()
     {
-        for (const auto& image: m_images)
-            m_scene->AddImage(image);
+        (m_scene.get()->*m_add)(m_shapes);
+        m_ids.clear();
+        m_ids.reserve(m_shapes.size());
+        for (const auto& shape: m_shapes)
+            m_ids.push_back(shape->GetID());
+        m_applied = true;
     }
 
+    virtual size_t ByteSize() { return sizeof(AddShapesAction) + m_ids.capacity() * sizeof(ShapeID) + ShapesBytes(m_shapes); }
+    // The scene owns the shapes while applied, only the IDs are needed
+    virtual void Compact(JSONSerializer& serializer)
+    {
+        if (m_applied)
+            Shapes().swap(m_shapes);
+    }
+    virtual void Effects(ActionEffects& effects) { effects.shapes.insert(effects.shapes.end(), m_ids.begin(), m_ids.end()); }
+
 private:
     std::shared_ptr<Scene> m_scene;
-    std::vector<std::shared_ptr<BGImage>> m_images;
+    Shapes m_shapes;
+    std::vector<ShapeID> m_ids;
+    bool m_applied = false;
+    AddFunc m_add;
+    RemoveFunc m_remove;
 };
 
-class RemoveImagesAction : public Action
+template <typename T>
+class RemoveShapesAction : public Action
 {
 public:
-    RemoveImagesAction(const std::shared_ptr<Scene>& scene) : m_scene(scene) {}
-    RemoveImagesAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<BGImage>& image) : m_scene(scene)
+    typedef RemovedShapes<T> (Scene::*RemoveFunc)(const std::vector<ShapeID>&);
+    typedef void (Scene::*InsertFunc)(const RemovedShapes<T>&);
+
+    RemoveShapesAction(const std::shared_ptr<Scene>& scene, const std::vector<std::shared_ptr<T>>& shapes, RemoveFunc remove, InsertFunc insert) :
+        m_scene(scene), m_remove(remove), m_insert(insert)
     {
-        m_images.push_back(image);
+        m_ids.reserve(shapes.size());
+        for (const auto& shape: shapes)
+            m_ids.push_back(shape->GetID());
     }
-    RemoveImagesAction(const std::shared_ptr<Scene>& scene, std::vector<std::shared_ptr<BGImage>> images) : m_scene(scene), m_images(images) {}
 
-    void Add(const std::shared_ptr<BGImage>& image)
+    void Add(const std::shared_ptr<T>& shape)
     {
-        m_images.push_back(image);
+        m_ids.push_back(shape->GetID());
     }
 
+    // Reinserts at the original indices so draw order is restored
     virtual void Undo()
     {
-        for (const auto& image: m_images)
-            m_scene->AddImage(image);
+        Expand();
+        (m_scene.get()->*m_insert)(m_removed);
+        m_removed.clear();
     }
     virtual void Redo()
     {
-        m_scene->RemoveImages(m_images);
+        m_removed = (m_scene.get()->*m_remove)(m_ids);
+    }
+
+    virtual size_t ByteSize()
+    {
+        std::vector<std::shared_ptr<T>> shapes;
+        shapes.reserve(m_removed.size());
+        for (const auto& entry: m_removed)
+            shapes.push_back(entry.shape);
+        return sizeof(RemoveShapesAction) + m_ids.capacity() * sizeof(ShapeID) + m_payload.capacity() +
+               m_removed.capacity() * sizeof(RemovedShape<T>) + ShapesBytes(shapes);
     }
+    // Removed shapes are serialized along with where they were removed from
+    virtual void Compact(JSONSerializer& serializer)
+    {
+        if (m_compacted || m_removed.empty())
+            return;
+
+        nlohmann::json json = nlohmann::json::array();
+        for (const auto& entry: m_removed)
+        {
+            nlohmann::json jentry = {{"index", entry.index}, {"selected", entry.selected}};
+            SerializeShape(serializer, entry.shape, jentry["shape"]);
+            json.push_back(std::move(jentry));
+        }
+        m_payload = PackPayload(json);
+        RemovedShapes<T>().swap(m_removed);
+        m_serializer = &serializer;
+        m_compacted = true;
+    }
+    virtual void Payloads(std::vector<std::string*>& payloads)
+    {
+        if (m_compacted)
+            payloads.push_back(&m_payload);
+    }
+    virtual void Effects(ActionEffects& effects) { effects.shapes.insert(effects.shapes.end(), m_ids.begin(), m_ids.end()); }
 
 private:
     std::shared_ptr<Scene> m_scene;
-    std::vector<std::shared_ptr<BGImage>> m_images;
+    std::vector<ShapeID> m_ids;
+    RemovedShapes<T> m_removed;
+    RemoveFunc m_remove;
+    InsertFunc m_insert;
+    // Removed shapes serialized by Compact
+    bool m_compacted = false;
+    std::string m_payload;
+    JSONSerializer* m_serializer = nullptr;
+
+    void Expand()
+    {
+        if (!m_compacted)
+            return;
+
+        nlohmann::json json = UnpackPayload(m_payload);
+        m_removed.reserve(json.size());
+        for (auto& jentry: json)
+        {
+            RemovedShape<T> entry;
+            entry.index = jentry["index"];
+            entry.selected = jentry["selected"];
+            DeserializeShape(*m_serializer, jentry["shape"], entry.shape);
+            m_removed.push_back(std::move(entry));
+        }
+        m_compacted = false;
+    }
+};
+
+class AddTokensAction : public AddShapesAction<Token>
+{
+public:
+    AddTokensAction(const std::shared_ptr<Scene>& scene) : AddTokensAction(scene, Shapes()) {}
+    AddTokensAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<Token>& token) : AddTokensAction(scene, Shapes{token}) {}
+    AddTokensAction(const std::shared_ptr<Scene>& scene, Shapes tokens) :
+        AddShapesAction(scene, tokens, &Scene::AddTokens, &Scene::RemoveTokens) {}
+};
+
+class RemoveTokensAction : public RemoveShapesAction<Token>
+{
+public:
+    RemoveTokensAction(const std::shared_ptr<Scene>& scene) : RemoveTokensAction(scene, std::vector<std::shared_ptr<Token>>()) {}
+    RemoveTokensAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<Token>& token) : RemoveTokensAction(scene, std::vector<std::shared_ptr<Token>>{token}) {}
+    RemoveTokensAction(const std::shared_ptr<Scene>& scene, const std::vector<std::shared_ptr<Token>>& tokens) :
+        RemoveShapesAction(scene, tokens, &Scene::RemoveTokens, &Scene::InsertTokens) {}
+};
+
+class AddImagesAction : public AddShapesAction<BGImage>
+{
+public:
+    AddImagesAction(const std::shared_ptr<Scene>& scene) : AddImagesAction(scene, Shapes()) {}
+    AddImagesAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<BGImage>& image) : AddImagesAction(scene, Shapes{image}) {}
+    AddImagesAction(const std::shared_ptr<Scene>& scene, Shapes images) :
+        AddShapesAction(scene, images, &Scene::AddImages, &Scene::RemoveImages) {}
+};
+
+class RemoveImagesAction : public RemoveShapesAction<BGImage>
+{
+public:
+    RemoveImagesAction(const std::shared_ptr<Scene>& scene) : RemoveImagesAction(scene, std::vector<std::shared_ptr<BGImage>>()) {}
+    RemoveImagesAction(const std::shared_ptr<Scene>& scene, const std::shared_ptr<BGImage>& image) : RemoveImagesAction(scene, std::vector<std::shared_ptr<BGImage>>{image}) {}
+    RemoveImagesAction(const std::shared_ptr<Scene>& scene, const std::vector<std::shared_ptr<BGImage>>& images) :
+        RemoveShapesAction(scene, images, &Scene::RemoveImages, &Scene::InsertImages) {}
 };
 
 class AddCameraAction : public Action
@@ -339,6 +730,7 @@ public:
     {
         m_scene->AddCamera(m_camera);
     }
+    virtual size_t ByteSize() { return sizeof(AddCameraAction) + sizeof(Camera); }
 
 private:
     std::shared_ptr<Scene> m_scene;
@@ -359,8 +751,61 @@ public:
     {
         m_scene->RemoveCamera(m_camera);
     }
+    virtual size_t ByteSize() { return sizeof(RemoveCameraAction) + sizeof(Camera); }
 
 private:
     std::shared_ptr<Scene> m_scene;
     std::shared_ptr<Camera> m_camera;
 };
+
+// Walls keep their IDs when undone and redone, so later actions still find them
+class AddWallsAction : public Action
+{
+public:
+    AddWallsAction(const std::shared_ptr<FogOfWar>& fog, const std::vector<Wall>& walls) :
+        m_fog(fog), m_walls(walls) {}
+
+    virtual void Undo()
+    {
+        for (const Wall& wall: m_walls)
+            m_fog->walls.Remove(wall.id);
+    }
+    virtual void Redo()
+    {
+        for (Wall& wall: m_walls)
+        {
+            m_fog->walls.Add(wall);
+            wall.id = m_fog->walls.All().back().id;
+        }
+    }
+    virtual size_t ByteSize() { return sizeof(AddWallsAction) + m_walls.capacity() * sizeof(Wall); }
+    virtual void Effects(ActionEffects& effects) { effects.walls = true; }
+
+private:
+    std::shared_ptr<FogOfWar> m_fog;
+    std::vector<Wall> m_walls;
+};
+
+class RemoveWallsAction : public Action
+{
+public:
+    RemoveWallsAction(const std::shared_ptr<FogOfWar>& fog, const std::vector<Wall>& walls) :
+        m_fog(fog), m_walls(walls) {}
+
+    virtual void Undo()
+    {
+        for (const Wall& wall: m_walls)
+            m_fog->walls.Add(wall);
+    }
+    virtual void Redo()
+    {
+        for (const Wall& wall: m_walls)
+            m_fog->walls.Remove(wall.id);
+    }
+    virtual size_t ByteSize() { return sizeof(RemoveWallsAction) + m_walls.capacity() * sizeof(Wall); }
+    virtual void Effects(ActionEffects& effects) { effects.walls = true; }
+
+private:
+    std::shared_ptr<FogOfWar> m_fog;
+    std::vector<Wall> m_walls;
+};
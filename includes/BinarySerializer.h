@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#include <Resources.h>
+#include <model/Scene.h>
+
+
+// Versioned binary scene format, holding the same data as the JSON format so
+// files convert between the two without loss.
+//
+// File layout, all little endian and every section 8 byte aligned:
+//   header         magic "BMSB", u32 version, u32 byte order mark, u32 section count
+//   section table  per section: u32 type, u32 record count, u64 offset, u64 size
+//   sections       packed records, see BinarySerializer.cpp
+//
+// Names and texture paths are interned into a single string table that records
+// refer to by index. Shape transforms are stored as structure of arrays in the
+// TransformStore's layout so loading copies them into the store in bulk.
+// Files are loaded through mmap and records are read in place, nothing is
+// parsed field by field.
+class BinarySerializer
+{
+public:
+    static constexpr const char* EXTENSION = ".bmscene";
+    static const uint32_t VERSION = 1;
+
+    // Whether the path should be saved/loaded with this format rather than JSON
+    static bool IsBinaryPath(const std::string& path);
+
+    BinarySerializer(std::shared_ptr<Resources> resources);
+
+    std::string Encode(const std::shared_ptr<Scene>& scene);
+    // Adds the decoded shapes, cameras and views to the scene. Returns false,
+    // leaving the scene unchanged, if the data is truncated or malformed.
+    // The data must be 8 byte aligned.
+    bool Decode(const char* data, size_t size, Scene& scene);
+    // Maps the file and decodes it
+    bool Read(const std::string& path, Scene& scene);
+
+private:
+    std::shared_ptr<Resources> m_resources;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+
+// Shapes copied within the app, held as clones sharing the originals'
+// textures so pasting is a copy of properties rather than a round trip
+// through text and texture lookups. The JSON text other applications see is
+// only serialized once something asks for it.
+class Clipboard
+{
+public:
+    Clipboard(JSONSerializer& serializer) : m_serializer(serializer) {}
+
+    // Clones of the shapes with fresh IDs and transforms, in a scene ready to
+    // merge
+    static std::shared_ptr<Scene> Clone(const std::shared_ptr<Resources>& resources,
+                                        const std::vector<std::shared_ptr<Token>>& tokens,
+                                        const std::vector<std::shared_ptr<BGImage>>& images);
+
+    // Holds clones so later edits to the shapes don't change what's pasted
+    void Copy(const std::vector<std::shared_ptr<Token>>& tokens, const std::vector<std::shared_ptr<BGImage>>& images);
+    bool IsEmpty() const;
+    // New shapes on every call so repeated pastes are independent
+    std::shared_ptr<Scene> Paste(const std::shared_ptr<Resources>& resources) const;
+
+    // Text for the system clipboard, serialized on the first call after a copy
+    const std::string& Text(const std::shared_ptr<Resources>& resources);
+    // Whether the text has been handed to the system clipboard since the last
+    // copy. Until then the system clipboard can't hold anything newer.
+    bool IsExported() const { return m_exported; }
+    void SetExported() { m_exported = true; }
+
+private:
+    JSONSerializer& m_serializer;
+    std::vector<std::shared_ptr<Token>> m_tokens;
+    std::vector<std::shared_ptr<BGImage>> m_images;
+    std::string m_text;
+    bool m_hasText = false;
+    bool m_exported = false;
+};
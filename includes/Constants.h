@@ -1,3 +1,4 @@
+#pragma once
 #include <glm/glm.hpp>
 
 const float DEFAULT_PIXELS_PER_UNIT = 50.0f;
@@ -7,4 +8,9 @@ const glm::vec3 HIGHLIGHT_COLOR = SELECTION_COLOR * 0.5f;
 const glm::vec4 SELECTION_COLOR_ALPHA = glm::vec4(SELECTION_COLOR, 1.0f);
 const glm::vec4 HIGHLIGHT_COLOR_ALPHA = glm::vec4(HIGHLIGHT_COLOR, 1.0f);
 const float OVERLAY_OPACITY = 0.3f;
+const glm::vec3 FOG_COLOR = glm::vec3(0.0f);
+const glm::vec3 WALL_COLOR = glm::vec3(1.0f, 0.5f, 0.0f);
+// World height of a heightmap's white, and of a viewer's eyes above its feet
+const float DEFAULT_HEIGHT_SCALE = 5.0f;
+const float EYE_LEVEL = 1.0f;
 
@@ -0,0 +1,13 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// SHA-256 of a blob, used to identify assets by content so the same image is
+// only stored or sent once however many paths refer to it.
+typedef std::array<uint8_t, 32> ContentHash;
+
+ContentHash HashContent(const void* data, size_t size);
+std::string ToHex(const ContentHash& hash);
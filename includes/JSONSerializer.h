@@ -1,17 +1,22 @@
 #pragma once
 #include <algorithm>
+#include <istream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <json.hpp>
 
+#include <JSONWriter.h>
 #include <Resources.h>
 #include <glutil/Camera.h>
 #include <glutil/Matrix2D.h>
 #include <model/BGImage.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Overlays.h>
 #include <model/Scene.h>
+#include <model/Selection.h>
 #include <model/Token.h>
 
 
@@ -23,6 +28,8 @@ enum class SerializeFlag
     Camera   = 1 << 3,
     Grid     = 1 << 4,
     View     = 1 << 5,
+    Fog      = 1 << 6,
+    Walls    = 1 << 7,
     Selected = 1 << 8
 };
 
@@ -40,7 +47,10 @@ class JSONSerializer
 public:
     JSONSerializer(std::shared_ptr<Resources> resources);
 
+    const std::shared_ptr<Resources>& GetResources() const { return m_resources; }
+
     bool SerializeCamera(const std::shared_ptr<Camera>& camera, nlohmann::json& json);
+    bool SerializeFog(const std::shared_ptr<FogOfWar>& fog, nlohmann::json& json);
     bool SerializeGrid(const std::shared_ptr<Grid>& grid, nlohmann::json& json);
     bool SerializeImage(const std::shared_ptr<BGImage>& image, nlohmann::json& json);
     bool SerializeMatrix2D(const std::shared_ptr<Matrix2D>& matrix, nlohmann::json& json);
@@ -48,21 +58,50 @@ public:
     bool SerializeScene(const std::shared_ptr<Scene>& scene, nlohmann::json& json);
     bool SerializeToken(const std::shared_ptr<Token>& token, nlohmann::json& json);
 
-    nlohmann::json SerializeImages(const std::vector<std::shared_ptr<BGImage>>& images, bool selectedOnly=false);
-    nlohmann::json SerializeTokens(const std::vector<std::shared_ptr<Token>>& tokens, bool selectedOnly=false);
+    // Only the selected indices are serialized if a selection is given
+    nlohmann::json SerializeImages(const std::vector<std::shared_ptr<BGImage>>& images, const Selection* selection=nullptr);
+    nlohmann::json SerializeTokens(const std::vector<std::shared_ptr<Token>>& tokens, const Selection* selection=nullptr);
+    nlohmann::json SerializeWalls(const Walls& walls);
     nlohmann::json SerializeScene(const std::shared_ptr<Scene>& scene);
     nlohmann::json SerializeScene(const std::shared_ptr<Scene>& scene, SerializeFlag flags);
 
     std::shared_ptr<Camera> DeserializeCamera(nlohmann::json& json);
+    // Fog and walls are applied in place, the fog keeps its cached visibility
+    void DeserializeFog(nlohmann::json& json, FogOfWar& fog);
     std::shared_ptr<Grid> DeserializeGrid(nlohmann::json& json);
     std::shared_ptr<BGImage> DeserializeImage(nlohmann::json& json);
     std::shared_ptr<Matrix2D> DeserializeMatrix2D(nlohmann::json& json);
     std::shared_ptr<Token> DeserializeToken(nlohmann::json& json);
+    void DeserializeWalls(nlohmann::json& json, Walls& walls);
     // std::shared_ptr<Overlay> DeserializeOverlay(nlohmann::json& json);
     void DeserializeScene(nlohmann::json& json, Scene& scene);
     std::shared_ptr<Scene> DeserializeScene(nlohmann::json& json);
     std::shared_ptr<Scene> DeserializeScene(const std::string& text);
 
+    // Streaming versions of the above, these write and read the same JSON
+    // without building a nlohmann::json document for the whole scene
+    void WriteCamera(JSONWriter& writer, const std::shared_ptr<Camera>& camera);
+    void WriteCameras(JSONWriter& writer, const std::shared_ptr<Scene>& scene);
+    void WriteFog(JSONWriter& writer, const std::shared_ptr<FogOfWar>& fog);
+    void WriteGrid(JSONWriter& writer, const std::shared_ptr<Grid>& grid);
+    void WriteImage(JSONWriter& writer, const std::shared_ptr<BGImage>& image);
+    void WriteMatrix2D(JSONWriter& writer, const std::shared_ptr<Matrix2D>& matrix);
+    void WriteToken(JSONWriter& writer, const std::shared_ptr<Token>& token);
+    void WriteViews(JSONWriter& writer, const std::shared_ptr<Scene>& scene);
+    void WriteWalls(JSONWriter& writer, const Walls& walls);
+    void WriteScene(JSONWriter& writer, const std::shared_ptr<Scene>& scene);
+    void WriteScene(JSONWriter& writer, const std::shared_ptr<Scene>& scene, SerializeFlag flags);
+    std::string WriteScene(const std::shared_ptr<Scene>& scene);
+    std::string WriteScene(const std::shared_ptr<Scene>& scene, SerializeFlag flags);
+
+    // Shapes are added to the scene as they're parsed. Returns false if the
+    // text isn't valid JSON, leaving the scene with whatever was read before
+    // the error.
+    bool ReadScene(std::istream& stream, Scene& scene);
+    bool ReadScene(const std::string& text, Scene& scene);
+    // Returns nullptr if the text isn't valid JSON
+    std::shared_ptr<Scene> ReadScene(const std::string& text);
+
 private:
     std::shared_ptr<Resources> m_resources;
 };
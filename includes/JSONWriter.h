@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Writes JSON text directly without building a nlohmann::json document. Output
+// is buffered and matches nlohmann::json::dump() for the same values, provided
+// object keys are written in sorted order as nlohmann::json stores them.
+//
+// Commas are inserted automatically, so a value is written with Key() followed
+// by one of the value methods, or with just the value inside an array.
+class JSONWriter
+{
+public:
+    // Writes to the stream, flushing whenever the buffer fills
+    JSONWriter(std::ostream& stream);
+    // Appends to the string
+    JSONWriter(std::string& text);
+    ~JSONWriter();
+    JSONWriter(const JSONWriter&) = delete;
+    JSONWriter& operator=(const JSONWriter&) = delete;
+
+    void StartObject();
+    void EndObject();
+    void StartArray();
+    void EndArray();
+    void Key(const char* key);
+
+    void Bool(bool value);
+    void Int(int64_t value);
+    void UInt(uint64_t value);
+    void Float(double value);
+    void String(const std::string& value);
+    // Already serialized JSON, written as is
+    void Raw(const std::string& text);
+
+    void Flush();
+
+private:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    std::ostream* m_stream = nullptr;
+    std::string m_ownBuffer;
+    std::string& m_buffer;
+    // Whether each open container has had a value yet
+    std::vector<bool> m_hasValue;
+    bool m_afterKey = false;
+
+    void BeforeValue();
+    void Escape(const char* value, size_t size);
+    void FlushIfFull();
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <json.hpp>
+
+#include <Actions.hpp>
+#include <JSONSerializer.h>
+#include <SceneSnapshot.h>
+#include <model/Scene.h>
+
+
+// Append only log of the changes made since the scene was last saved, so a
+// crash loses at most the last action. Each record holds the net effect of an
+// action: the current state of every shape it touched, IDs of those no longer
+// in the scene, and the grid/cameras/locks if it changed anything else.
+//
+// Records are built on the calling thread but encoded and written by a
+// background thread. Everything queued between wakeups is written together and
+// synced once, so recording never waits on the disk.
+//
+// File layout: 8 byte header, then records of [u32 size][u32 crc32][msgpack].
+// Replay stops at the first record that's truncated or fails its checksum.
+class Journal
+{
+public:
+    static const size_t DEFAULT_COMPACT_SIZE = 16 * 1024 * 1024;
+    // Log used for scenes that haven't been saved to a file yet
+    static constexpr const char* UNTITLED_PATH = "untitled.journal";
+
+    typedef uint64_t CheckpointID;
+
+    Journal(JSONSerializer& serializer, SceneSnapshotter& snapshotter, size_t compactSize=DEFAULT_COMPACT_SIZE);
+    // Writes anything queued before returning
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    static std::string PathFor(const std::string& sceneFile);
+    // Applies the log at path to scene. A snapshot record replaces the scene.
+    // Returns the number of records applied.
+    static size_t Replay(const std::string& path, JSONSerializer& serializer, std::shared_ptr<Scene>& scene);
+
+    // Switches to the log at path, removing the current one if this session
+    // wrote it. Nothing is written until the first record, so an existing log
+    // can still be replayed first.
+    void Start(const std::string& path);
+    void Record(const std::shared_ptr<Scene>& scene, const ActionEffects& effects);
+    // Holds back records for an action that's still merging, eg, dragging a
+    // slider. Written by the next Record or by Update once it settles.
+    void Defer(const ActionEffects& effects);
+    void Update(const std::shared_ptr<Scene>& scene);
+    // Replaces the log with a single snapshot record of the scene. Only the
+    // snapshot is taken on the calling thread, it's serialized by the writer.
+    void Snapshot(const std::shared_ptr<Scene>& scene);
+    // Marks the current end of the log, eg, when a save snapshot is taken
+    CheckpointID Checkpoint();
+    // Drops everything before the checkpoint once the scene has been saved to
+    // sceneFile, keeping anything recorded while the save was in progress. The
+    // log moves next to sceneFile if it was saved somewhere new.
+    void Rebase(CheckpointID checkpoint, const std::string& sceneFile);
+    // Removes the log if this session wrote it, eg, on a clean exit
+    void Discard();
+    // Blocks until everything queued is on disk
+    void Flush();
+
+    const std::string& Path() const { return m_path; }
+    size_t LogSize() const { return m_logSize; }
+
+private:
+    struct Op
+    {
+        enum class Type { Append, Replace, Remove, Checkpoint, Rebase };
+        Type type;
+        std::string path;
+        nlohmann::json record;
+        // Replace with a snapshot, or an empty log if null
+        std::shared_ptr<const SceneSnapshot> snapshot;
+        CheckpointID checkpoint = 0;
+        std::string newPath;
+    };
+
+    // Where a checkpoint was in the file, only valid until the file is replaced
+    struct CheckpointPos
+    {
+        uint64_t generation;
+        size_t offset;
+    };
+
+    JSONSerializer& m_serializer;
+    SceneSnapshotter& m_snapshotter;
+    size_t m_compactSize;
+
+    // Main thread state
+    std::string m_path;
+    bool m_started = false;
+    // Op count to wait for before compacting again
+    size_t m_compactedAt = 0;
+    CheckpointID m_nextCheckpoint = 1;
+    ActionEffects m_deferred;
+    bool m_hasDeferred = false;
+    std::chrono::steady_clock::time_point m_deferredAt;
+
+    // Shared with the writer
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_flushed;
+    std::deque<Op> m_queue;
+    size_t m_numQueued = 0;
+    size_t m_numWritten = 0;
+    bool m_stop = false;
+    // Bytes in the current log, updated by the writer as records are encoded
+    std::atomic<size_t> m_logSize{0};
+
+    // Writer state
+    std::thread m_writer;
+    int m_fd = -1;
+    std::string m_fdPath;
+    uint64_t m_generation = 0;
+    std::unordered_map<CheckpointID, CheckpointPos> m_checkpoints;
+
+    void Queue(Op op);
+    void QueueAppend(nlohmann::json record);
+    nlohmann::json BuildRecord(const std::shared_ptr<Scene>& scene, const ActionEffects& effects);
+    void WriteDeferred(const std::shared_ptr<Scene>& scene);
+
+    void WriterLoop();
+    bool Append(const std::string& path, const std::string& bytes);
+    bool Replace(const std::string& path, const std::string& bytes);
+    void Remove(const std::string& path);
+    void RebaseFile(const Op& op);
+    void Sync();
+    void CloseFile();
+};
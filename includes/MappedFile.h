@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+// Read only memory mapping of a whole file. Held by shared_ptr so data that
+// points into the mapping (eg, bundled textures) can keep it alive.
+class MappedFile
+{
+public:
+    // Returns nullptr if the file can't be opened or is empty
+    static std::shared_ptr<MappedFile> Open(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Page aligned
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    MappedFile(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    const char* m_data;
+    size_t m_size;
+};
@@ -1,33 +1,61 @@
 #pragma once
+#include <map>
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <vector>
 
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
+#include <ContentHash.h>
 #include <glutil/Texture.h>
 
 
+// Texture cache shared by the model. GPU resources (meshes, shaders) are owned
+// by the Renderer so this can be used without a GL context.
+//
+// Textures are cached by path, then by canonical path and by a hash of the file
+// contents, so the same image reached through a relative path, a symlink or a
+// copy is decoded and uploaded once. Each path still gets its own Texture so it
+// saves as the path it was loaded from, with Texture::source pointing at the
+// one holding the GPU copy.
 class Resources
 {
 public:
-    enum class MeshType { Quad, Quad2 };
-    enum class ShaderType { Grid, Image, ScreenRect, Status, Token };
     enum class TextureType { Default, Status, XStatus };
 
+    struct TextureStats
+    {
+        // Distinct paths
+        size_t numTextures = 0;
+        // Distinct images the paths need uploading
+        size_t numUploads = 0;
+        // Decoded size of the uploads saved by sharing
+        size_t bytesAvoided = 0;
+    };
+
     Resources() {}
 
-    void CreateMesh(MeshType meshType, std::vector<Vertex> vertices, std::vector<uint> indices);
-    std::shared_ptr<Mesh> GetMesh(MeshType meshType);
-    void CreateShader(ShaderType shaderType, const char* vs, const char* fs);
-    std::shared_ptr<Shader> GetShader(ShaderType shaderType);
     void CreateTexture(TextureType textureType, std::string path);
     std::shared_ptr<Texture> GetTexture(TextureType textureType);
     std::shared_ptr<Texture> GetTexture(std::string path);
+    // Registers a texture under its filename, eg, one loaded from a bundle,
+    // replacing any cached for the same path
+    void AddTexture(const std::shared_ptr<Texture>& texture);
+    // Uploaded textures only held by the cache, eg, ones that were only
+    // referenced by compacted undo history. Safe to release from the GPU, they
+    // are uploaded again on next use.
+    std::vector<std::shared_ptr<Texture>> UnreferencedTextures();
+
+    // Sharing across the given textures, eg, those used by a scene
+    static TextureStats Stats(const std::vector<std::shared_ptr<Texture>>& textures);
 
 private:
-    std::unordered_map<MeshType, std::shared_ptr<Mesh>> m_meshes;
-    std::unordered_map<ShaderType, std::shared_ptr<Shader>> m_shaders;
     std::unordered_map<TextureType, std::shared_ptr<Texture>> m_textureTypes;
     std::unordered_map<std::string, std::shared_ptr<Texture>> m_textures;
+    // Textures that upload their own contents, looked up when a new path is
+    // requested. Weak so replacing a cached texture doesn't keep it alive.
+    std::unordered_map<std::string, std::weak_ptr<Texture>> m_canonicalPaths;
+    std::map<ContentHash, std::weak_ptr<Texture>> m_contentHashes;
+
+    std::shared_ptr<Texture> FindSource(const std::string& canonicalPath, const ContentHash* hash);
+    void AddSource(const std::shared_ptr<Texture>& texture, const std::string& canonicalPath, const ContentHash* hash);
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+
+// Unbounded lock-free queue for exactly one thread pushing and one thread
+// popping. A linked list whose head is always a spent node, so the two ends
+// never touch the same node's value: the producer only writes the tail's
+// next pointer and the consumer only follows it.
+template <typename T>
+class SPSCQueue
+{
+public:
+    SPSCQueue() : m_head(new Node()), m_tail(m_head) {}
+    ~SPSCQueue()
+    {
+        while (m_head)
+        {
+            Node* next = m_head->next.load(std::memory_order_relaxed);
+            delete m_head;
+            m_head = next;
+        }
+    }
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    // Producer only
+    void Push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        m_tail->next.store(node, std::memory_order_release);
+        m_tail = node;
+    }
+
+    // Consumer only, returns false if empty
+    bool Pop(T& value)
+    {
+        Node* next = m_head->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        delete m_head;
+        m_head = next;
+        return true;
+    }
+
+    // Consumer only
+    bool IsEmpty() const { return !m_head->next.load(std::memory_order_acquire); }
+
+private:
+    struct Node
+    {
+        T value;
+        std::atomic<Node*> next{nullptr};
+    };
+
+    // Consumer's end
+    Node* m_head;
+    // Producer's end
+    Node* m_tail;
+};
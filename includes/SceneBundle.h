@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <BinarySerializer.h>
+#include <Resources.h>
+#include <glutil/Texture.h>
+#include <model/Scene.h>
+
+
+// Single file holding a scene and every image it uses, so it can be moved
+// between machines. Each unique image is stored once, keyed by the SHA-256 of
+// its contents, alongside optional pre-decoded mip levels that upload without
+// decoding. The file is memory mapped when loaded and textures read straight
+// from the mapping.
+//
+// File layout, every part 8 byte aligned:
+//   header   magic "BMBD", u32 version, u32 byte order mark, u32 reserved,
+//            u64 index offset, u64 index size
+//   blobs    image file contents and their mip levels
+//   scene    binary scene, see BinarySerializer
+//   index    blob table (hash, offsets, dimensions), path table, path text
+//
+// Saving over an existing bundle appends only the images it doesn't already
+// hold plus a new scene and index, then points the header at the new index.
+// The file is rewritten from scratch instead once most of it is unreferenced.
+class SceneBundle
+{
+public:
+    static constexpr const char* EXTENSION = ".bmbundle";
+    static const uint32_t VERSION = 1;
+
+    struct Asset
+    {
+        std::string path;
+        // Set if the texture's contents are in memory, eg, loaded from a
+        // bundle, otherwise the file at path is read
+        std::shared_ptr<const TextureData> data;
+    };
+
+    // Everything a save needs, gathered on the main thread so Write can run on
+    // the saver's thread
+    struct Contents
+    {
+        std::string scene;
+        std::vector<Asset> assets;
+    };
+
+    static bool IsBundlePath(const std::string& path);
+
+    SceneBundle(std::shared_ptr<Resources> resources);
+
+    std::shared_ptr<const Contents> Gather(const std::shared_ptr<Scene>& scene);
+    static bool Write(const Contents& contents, const std::string& path, bool buildMips = true);
+    // Registers the bundled textures with resources, backed by the mapped file,
+    // then adds the scene's contents. Images missing from the bundle fall back
+    // to their original path.
+    bool Read(const std::string& path, Scene& scene);
+
+private:
+    std::shared_ptr<Resources> m_resources;
+    BinarySerializer m_serializer;
+};
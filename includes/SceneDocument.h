@@ -0,0 +1,87 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Actions.hpp>
+#include <BinarySerializer.h>
+#include <JSONSerializer.h>
+#include <Journal.h>
+#include <Resources.h>
+#include <SceneBundle.h>
+#include <SceneSaver.h>
+#include <SceneSnapshot.h>
+#include <model/Scene.h>
+#include <net/SceneHost.h>
+
+
+// The file a scene is loaded from and saved back to, and the changes made
+// since, shared by the app and the headless host. The format is picked by
+// extension. Every change is journaled until a save has made it to the file,
+// and clients' edits are turned into the same actions either way.
+class SceneDocument
+{
+public:
+    SceneDocument(std::shared_ptr<Resources> resources, JSONSerializer& serializer);
+
+    // Reads any of the formats into scene, returns false on failure
+    bool Read(const std::string& path, Scene& scene);
+    // Switches to a newly loaded scene, with nothing unsaved
+    void Start(const std::shared_ptr<Scene>& scene);
+    // Applies any journal a crash left for the scene's file, call after
+    // Start. A snapshot in it replaces the scene, which keeps its file.
+    bool Replay(std::shared_ptr<Scene>& scene);
+    // Starts a fresh log holding a recovered scene in case of another crash.
+    // It's saved with the next autosave.
+    void Recovered(const std::shared_ptr<Scene>& scene);
+
+    // Journals an action's effects, each is a change to be saved
+    void Record(const std::shared_ptr<Scene>& scene, const ActionEffects& effects);
+    // As Record, for an action that's still merging, see Journal::Defer
+    void Defer(const ActionEffects& effects);
+    // Called once per frame, writes settled deferred records and picks up
+    // finished saves
+    void Update(const std::shared_ptr<Scene>& scene);
+
+    // Snapshots the scene and writes it in the background. Once written the
+    // journal is rebased and the scene's file becomes path.
+    void Save(const std::shared_ptr<Scene>& scene, const std::string& path);
+    // Saves to the scene's file if it has unsaved changes, the last autosave
+    // was over interval ago and no save is running
+    void Autosave(const std::shared_ptr<Scene>& scene, std::chrono::steady_clock::duration interval);
+    bool IsUnsaved() const { return m_changeCount != m_savedChangeCount; }
+    // Blocks until every save has finished, eg, on exit
+    void Finish(const std::shared_ptr<Scene>& scene);
+    // Removes the journal, eg, on a clean exit
+    void Discard() { m_journal.Discard(); }
+
+    // The action making a client's edit to the scene, not yet applied.
+    // Returns nullptr if the token is gone or the edit has no fields.
+    std::shared_ptr<Action> EditAction(const std::shared_ptr<Scene>& scene, const SceneHost::Edit& edit);
+
+private:
+    struct PendingSave
+    {
+        SceneSaver::SaveID id;
+        std::weak_ptr<Scene> scene;
+        Journal::CheckpointID checkpoint;
+        size_t changeCount;
+    };
+
+    std::shared_ptr<Resources> m_resources;
+    JSONSerializer& m_serializer;
+    BinarySerializer m_binarySerializer;
+    SceneBundle m_bundle;
+    SceneSnapshotter m_snapshotter;
+    Journal m_journal;
+    SceneSaver m_saver;
+    std::vector<PendingSave> m_pendingSaves;
+    // Bumped by every journaled change, autosave runs while it's ahead of the
+    // count at the last successful save
+    size_t m_changeCount = 0;
+    size_t m_savedChangeCount = 0;
+    std::chrono::steady_clock::time_point m_lastAutosave;
+
+    void HandleSaveResults(const std::shared_ptr<Scene>& scene);
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Resources.h>
+#include <model/Scene.h>
+#include <model/Shape2D.h>
+
+
+// Shared memory region other processes on the machine read the scene from,
+// eg, a player facing display on a second screen. Holds only what's drawn:
+// the tokens the fog of war doesn't hide, the visible images, what the fog
+// lifts, the grid and the primary camera, as plain records copied in and out
+// as is. While the fog's on but the host sees everything, eg, with nothing
+// selected, the players see only the mask.
+//
+// Layout: MirrorHeader, holding a MirrorFrame, then numTokens MirrorTokens,
+// numImages MirrorImages, numFogPolygons MirrorFogPolygons, numFogPoints
+// vec2s and stringBytes of texture paths, each NUL terminated. The header's sequence is a seqlock, odd while a frame is being
+// written. The region grows when a frame doesn't fit and readers remap it
+// when they see size has.
+const char* const DEFAULT_MIRROR_NAME = "/battlematt_mirror";
+
+struct MirrorToken
+{
+    ShapeID id;
+    glm::vec2 position;
+    glm::vec2 scale;
+    float rotation;
+    float opacity;
+    glm::vec4 borderColor;
+    float borderWidth;
+    uint32_t statuses;
+    uint32_t xStatus;
+    // Offset of the icon's path in the string table
+    uint32_t texture;
+};
+
+struct MirrorImage
+{
+    ShapeID id;
+    glm::vec2 position;
+    glm::vec2 scale;
+    float rotation;
+    glm::vec4 tint;
+    uint32_t texture;
+};
+
+// Area the fog lifts, see VisionPolygon. Its points are followed by its
+// triangles in the frame's fog points.
+struct MirrorFogPolygon
+{
+    glm::vec2 origin;
+    float range;
+    uint32_t numPoints;
+    uint32_t numTriangleVertices;
+};
+
+// Only read between matching even sequences, as are the records after it
+struct MirrorFrame
+{
+    uint64_t frame;
+    glm::vec4 bgColor;
+    float gridScale;
+    glm::vec3 gridColour;
+    glm::vec3 cameraPosition;
+    float cameraFocal;
+    uint32_t numTokens;
+    uint32_t numImages;
+    // Unset if the fog's disabled
+    uint32_t fogMasking;
+    uint32_t numFogPolygons;
+    uint32_t numFogPoints;
+    uint32_t stringBytes;
+};
+
+struct MirrorHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> size;
+    std::atomic<uint32_t> sequence;
+    // Set once the writer has gone
+    std::atomic<uint32_t> closed;
+    MirrorFrame frame;
+};
+
+// Owns the region, removed again when destroyed
+class SceneMirrorWriter
+{
+public:
+    // Returns nullptr if the region can't be created
+    static std::unique_ptr<SceneMirrorWriter> Create(const std::string& name = DEFAULT_MIRROR_NAME);
+    ~SceneMirrorWriter();
+    SceneMirrorWriter(const SceneMirrorWriter&) = delete;
+    SceneMirrorWriter& operator=(const SceneMirrorWriter&) = delete;
+
+    // Publishes the scene as it is now, returns false if it didn't fit and
+    // the region couldn't grow
+    bool Write(Scene& scene);
+    const std::string& Name() const { return m_name; }
+    // Whether players are shown a point under the fog
+    static bool IsShown(const FogOfWar& fog, glm::vec2 point);
+
+private:
+    SceneMirrorWriter(const std::string& name, int fd, char* data, size_t size);
+
+    std::string m_name;
+    int m_fd;
+    char* m_data;
+    size_t m_size;
+    // Reused between frames
+    std::vector<MirrorToken> m_tokens;
+    std::vector<MirrorImage> m_images;
+    std::vector<MirrorFogPolygon> m_fogPolygons;
+    std::vector<glm::vec2> m_fogPoints;
+    std::string m_strings;
+    std::unordered_map<const Texture*, uint32_t> m_stringOffsets;
+
+    uint32_t AddString(const Texture& texture);
+    bool Reserve(size_t size);
+};
+
+// Maps a region another process writes and copies frames out of it
+class SceneMirrorReader
+{
+public:
+    // Returns nullptr if nothing is writing a region by that name
+    static std::unique_ptr<SceneMirrorReader> Open(const std::string& name = DEFAULT_MIRROR_NAME);
+    ~SceneMirrorReader();
+    SceneMirrorReader(const SceneMirrorReader&) = delete;
+    SceneMirrorReader& operator=(const SceneMirrorReader&) = delete;
+
+    // Copies the latest frame if it's newer than the last one read. Returns
+    // false if there wasn't one, or it couldn't be read consistently.
+    bool Read();
+    // Makes the scene match the last frame read, reusing its shapes by ID.
+    // The writer's fog is drawn opaque, it's a display for the players.
+    void Apply(Scene& scene, Resources& resources);
+    // Camera of the last frame read, to be applied to the viewer's own
+    void ApplyCamera(Camera& camera) const;
+
+    uint64_t Frame() const { return m_frame.frame; }
+    bool IsClosed() const;
+    // Reads retried because the writer was part way through a frame
+    uint64_t Retries() const { return m_retries; }
+
+private:
+    SceneMirrorReader(int fd, char* data, size_t size);
+
+    int m_fd;
+    char* m_data;
+    size_t m_size;
+    uint64_t m_retries = 0;
+    // Copied out of the region as of the last frame read
+    MirrorFrame m_frame{};
+    std::vector<MirrorToken> m_tokens;
+    std::vector<MirrorImage> m_images;
+    std::vector<MirrorFogPolygon> m_fogPolygons;
+    std::vector<glm::vec2> m_fogPoints;
+    std::string m_strings;
+    // Copied into first and swapped in once the copy is known not to be torn
+    std::vector<MirrorToken> m_nextTokens;
+    std::vector<MirrorImage> m_nextImages;
+    std::vector<MirrorFogPolygon> m_nextFogPolygons;
+    std::vector<glm::vec2> m_nextFogPoints;
+    std::string m_nextStrings;
+    // Set by a frame whose fog differs from the last applied, so the mask
+    // is only rebuilt when it changes
+    bool m_fogChanged = true;
+
+    bool Remap(size_t size);
+    std::shared_ptr<Texture> GetTexture(Resources& resources, uint32_t offset) const;
+};
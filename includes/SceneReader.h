@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <json.hpp>
+
+#include <Constants.h>
+#include <model/Scene.h>
+
+class JSONSerializer;
+
+
+// SAX handler for nlohmann::json::sax_parse that reads a scene without building
+// a document for it. Tokens and images are created and added to the scene as
+// each one's closing brace is parsed, so memory stays proportional to the scene
+// rather than the text. The remaining keys (cameras, grid, views, locks) are
+// small and are collected into a document that's applied once parsing is done.
+class SceneReader
+{
+public:
+    using json = nlohmann::json;
+
+    SceneReader(JSONSerializer& serializer, Scene& scene);
+
+    // Applies the collected settings, call once sax_parse succeeded
+    void Finish();
+    const std::string& GetError() const { return m_error; }
+
+    // nlohmann::json SAX interface
+    bool null();
+    bool boolean(bool value);
+    bool number_integer(json::number_integer_t value);
+    bool number_unsigned(json::number_unsigned_t value);
+    bool number_float(json::number_float_t value, const json::string_t& text);
+    bool string(json::string_t& value);
+    bool binary(json::binary_t& value);
+    bool start_object(std::size_t size);
+    bool key(json::string_t& key);
+    bool end_object();
+    bool start_array(std::size_t size);
+    bool end_array();
+    bool parse_error(std::size_t position, const std::string& token, const nlohmann::detail::exception& error);
+
+private:
+    enum class Section { None, Tokens, Images, Settings };
+
+    // Every field either shape type serializes
+    struct ShapeFields
+    {
+        bool hasID = false;
+        uint64_t id = 0;
+        std::string texture;
+        std::string name;
+        glm::vec2 pos{0.0f};
+        glm::vec2 scale{1.0f};
+        float rotation = 0.0f;
+        glm::vec4 borderColour{0.0f};
+        float borderWidth = 0.0f;
+        bool hasStatuses = false;
+        std::string statuses;
+        float opacity = 1.0f;
+        bool xstatus = false;
+        bool hideName = false;
+        float height = 0.0f;
+        bool hasLockRatio = false;
+        bool lockRatio = false;
+        bool hasVisible = false;
+        bool visible = true;
+        std::string heightmap;
+        float heightScale = DEFAULT_HEIGHT_SCALE;
+    };
+
+    JSONSerializer& m_serializer;
+    Scene& m_scene;
+    std::string m_error;
+
+    // Containers currently open, the root object is depth 1
+    unsigned int m_depth = 0;
+    Section m_section = Section::None;
+    std::string m_rootKey;
+
+    // Shape being read, fields are at depth 3 and matrix2D members at depth 4
+    ShapeFields m_shape;
+    std::string m_field;
+    std::string m_subField;
+    unsigned int m_index = 0;
+
+    // Settings applied by Finish, and the parser building the one being read
+    json m_settings;
+    std::unique_ptr<nlohmann::detail::json_sax_dom_parser<json>> m_settingsParser;
+
+    bool Number(double value, uint64_t integer);
+    void FinishShape();
+};
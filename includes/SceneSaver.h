@@ -0,0 +1,71 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SceneSnapshot.h>
+
+
+// Writes scene snapshots on a worker thread so saving never stalls the UI.
+// Each file is written to a temp file and renamed over the target, so a
+// failed or interrupted save leaves the previous file intact.
+class SceneSaver
+{
+public:
+    typedef uint64_t SaveID;
+
+    struct Result
+    {
+        SaveID id;
+        std::string path;
+        bool success;
+    };
+
+    SceneSaver();
+    // Finishes any queued saves before returning
+    ~SceneSaver();
+    SceneSaver(const SceneSaver&) = delete;
+    SceneSaver& operator=(const SceneSaver&) = delete;
+
+    SaveID Save(std::shared_ptr<const SceneSnapshot> snapshot, const std::string& path);
+    // Writes already encoded data, eg, a binary scene
+    SaveID Save(std::shared_ptr<const std::string> data, const std::string& path);
+    // Runs a save that writes the file itself, eg, a bundle updated in place.
+    // It's responsible for leaving the previous file intact on failure.
+    SaveID Save(std::function<bool()> write, const std::string& path);
+    // Saves finished since the last call
+    std::vector<Result> TakeResults();
+    bool IsBusy();
+    // Blocks until every queued save has finished
+    void Wait();
+
+private:
+    struct Request
+    {
+        SaveID id;
+        // One of these is set
+        std::shared_ptr<const SceneSnapshot> snapshot;
+        std::shared_ptr<const std::string> data;
+        std::function<bool()> write;
+        std::string path;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<Request> m_queue;
+    std::vector<Result> m_results;
+    SaveID m_nextID = 1;
+    bool m_writing = false;
+    bool m_stop = false;
+    std::thread m_worker;
+
+    void WorkerLoop();
+    static bool Write(const Request& request);
+};
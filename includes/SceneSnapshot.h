@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <JSONSerializer.h>
+#include <model/Scene.h>
+#include <model/Shape2D.h>
+#include <model/Walls.h>
+
+
+// Immutable serialized copy of a scene, safe to hand to another thread. Shapes
+// are held as their serialized JSON text, shared with earlier snapshots when
+// the shape hasn't changed in between.
+struct SceneSnapshot
+{
+    std::vector<std::shared_ptr<const std::string>> images;
+    std::vector<std::shared_ptr<const std::string>> tokens;
+    // Serialized camera list, fog settings, grid and view list
+    std::string cameras;
+    std::string fog;
+    std::string grid;
+    std::string views;
+    // Serialized wall list, shared with earlier snapshots until a wall changes
+    std::shared_ptr<const std::string> walls;
+    bool imagesLocked = false;
+    bool tokensLocked = false;
+    std::string sourceFile;
+
+    // Writes the same text as JSONSerializer::WriteScene
+    void Write(std::ostream& stream) const;
+    std::string ToString() const;
+};
+
+
+// Takes snapshots on the main thread. Each shape's serialized text is cached
+// against its version and transform version, so a snapshot only serializes the
+// shapes that changed since the last one and is otherwise a copy of pointers.
+class SceneSnapshotter
+{
+public:
+    SceneSnapshotter(JSONSerializer& serializer) : m_serializer(serializer) {}
+
+    std::shared_ptr<const SceneSnapshot> Take(const std::shared_ptr<Scene>& scene);
+    // Drops all cached text, eg, when switching scenes
+    void Clear();
+
+    // Shapes serialized by the last Take, the rest were reused
+    size_t NumSerialized() const { return m_numSerialized; }
+
+private:
+    struct CacheEntry
+    {
+        uint64_t version = 0;
+        uint64_t transformVersion = 0;
+        // Take that last saw the shape, to prune shapes no longer in the scene
+        uint64_t generation = 0;
+        std::shared_ptr<const std::string> text;
+    };
+
+    JSONSerializer& m_serializer;
+    std::unordered_map<ShapeID, CacheEntry> m_cache;
+    const Walls* m_walls = nullptr;
+    uint64_t m_wallsVersion = 0;
+    std::shared_ptr<const std::string> m_wallsText;
+    uint64_t m_generation = 0;
+    size_t m_numSerialized = 0;
+
+    template <typename T>
+    void SnapshotShapes(const std::vector<std::shared_ptr<T>>& shapes, std::vector<std::shared_ptr<const std::string>>& texts);
+};
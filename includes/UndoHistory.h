@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Actions.hpp>
+#include <JSONSerializer.h>
+
+
+// Undo/redo stacks limited by the approximate memory the actions hold rather
+// than a count. Actions older than the most recent few are compacted to a
+// serialized form so they stop pinning shapes and textures. If that's still
+// over budget their payloads are spilled to a temp file, and only then are the
+// oldest actions forgotten.
+class UndoHistory
+{
+public:
+    static const size_t DEFAULT_BYTE_BUDGET = 64 * 1024 * 1024;
+    static const size_t DEFAULT_HOT_ACTIONS = 8;
+
+    UndoHistory(JSONSerializer& serializer, size_t byteBudget=DEFAULT_BYTE_BUDGET, size_t hotActions=DEFAULT_HOT_ACTIONS, bool spillToDisk=true);
+    ~UndoHistory();
+    UndoHistory(const UndoHistory&) = delete;
+    UndoHistory& operator=(const UndoHistory&) = delete;
+
+    // Adds an action which has already been applied and clears the redo stack
+    void Push(const std::shared_ptr<Action>& action);
+    // Merges an applied action into the most recent one if they're compatible.
+    // Returns false if it couldn't be merged.
+    bool Merge(const std::shared_ptr<Action>& action);
+    // Return the action undone/redone, or null if there was nothing to do
+    std::shared_ptr<Action> Undo();
+    std::shared_ptr<Action> Redo();
+    void Clear();
+
+    void SetByteBudget(size_t byteBudget);
+    size_t ByteBudget() const { return m_byteBudget; }
+    size_t ByteSize() const { return m_bytes; }
+    size_t NumUndo() const { return m_undo.size(); }
+    size_t NumRedo() const { return m_redo.size(); }
+    size_t NumCompacted() const;
+    size_t NumSpilled() const { return m_numSpilled; }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<Action> action;
+        size_t bytes = 0;
+        bool compacted = false;
+        bool spilled = false;
+        // Offset and size in the spill file of each payload, in Payloads() order
+        std::vector<std::pair<long, size_t>> spans;
+    };
+
+    JSONSerializer& m_serializer;
+    size_t m_byteBudget;
+    size_t m_hotActions;
+    size_t m_bytes = 0;
+    std::deque<Entry> m_undo;
+    std::deque<Entry> m_redo;
+
+    bool m_spillToDisk;
+    std::FILE* m_spillFile = nullptr;
+    long m_spillEnd = 0;
+    size_t m_numSpilled = 0;
+
+    void Measure(Entry& entry);
+    void Enforce();
+    void Compact(Entry& entry);
+    bool Spill(Entry& entry);
+    void Restore(Entry& entry);
+    void Forget(Entry& entry);
+    void ClearRedo();
+};
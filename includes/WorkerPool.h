@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Persistent threads splitting a loop between them, for work that's repeated
+// every frame and too short to be worth starting threads for each time. The
+// calling thread takes part, so a pool without threads just runs the loop.
+class WorkerPool
+{
+public:
+    // Threads to use alongside the caller, one less than the cores
+    static size_t DefaultThreads();
+
+    explicit WorkerPool(size_t numThreads = DefaultThreads());
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Calls func(index, worker) for every index below count and returns once
+    // all have. Calls running at once have different workers, each below
+    // NumWorkers(), so they can index per worker scratch. Only one thread may
+    // call this at a time.
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& func);
+    // Including the caller
+    size_t NumWorkers() const { return m_threads.size() + 1; }
+
+private:
+    // More rarely helps, the work given is bound by memory
+    static constexpr size_t MAX_THREADS = 7;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::vector<std::thread> m_threads;
+    // The loop being run, set until every thread has finished with it
+    const std::function<void(size_t, size_t)>* m_func = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next{0};
+    uint64_t m_batch = 0;
+    size_t m_busy = 0;
+    bool m_stop = false;
+
+    void WorkerLoop(size_t worker);
+    void Run(size_t worker);
+};
@@ -1,9 +1,13 @@
 #pragma once
+#include <chrono>
 #include <memory>
+#include <string>
 
 #include <Resources.h>
+#include <SceneMirror.h>
 #include <controller/Controller.h>
 #include <model/Scene.h>
+#include <view/Renderer.h>
 #include <view/UIWindow.h>
 #include <view/Viewport.h>
 
@@ -15,6 +19,9 @@ public:
     std::shared_ptr<Controller> controller = nullptr;
 
     Application();
+    // Only a viewport, showing the scene another process on this machine
+    // shares under mirrorName, eg, on a screen facing the players
+    explicit Application(const std::string& mirrorName);
     ~Application();
 
     bool IsInitialised();
@@ -24,8 +31,17 @@ private:
     bool m_glfw_initialised = false;
 
     std::shared_ptr<Resources> m_resources = nullptr;
+    std::shared_ptr<Renderer> m_renderer = nullptr;
     std::shared_ptr<Viewport> m_viewport = nullptr;
     std::shared_ptr<UIWindow> m_uiWindow = nullptr;
 
+    // Display only
+    std::string m_mirrorName;
+    std::unique_ptr<SceneMirrorReader> m_mirror;
+    std::shared_ptr<Scene> m_mirrorScene = nullptr;
+    std::chrono::steady_clock::time_point m_lastMirrorFrame;
+
+    bool InitGLFW();
     void LoadDefaultResources();
+    void UpdateMirror();
 };
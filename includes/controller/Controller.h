@@ -1,14 +1,22 @@
 #pragma once
-#include <deque>
+#include <chrono>
 #include <memory>
 #include <vector>
 
 #include <Actions.hpp>
+#include <Clipboard.h>
 #include <JSONSerializer.h>
 #include <Resources.h>
+#include <SceneDocument.h>
+#include <SceneMirror.h>
+#include <UndoHistory.h>
+#include <model/FogOfWar.h>
 #include <model/Overlays.h>
 #include <model/Scene.h>
 #include <model/Token.h>
+#include <net/MotionInterpolator.h>
+#include <net/SceneClient.h>
+#include <net/SceneHost.h>
 #include <view/Properties.h>
 #include <view/UIWindow.h>
 #include <view/Viewport.h>
@@ -21,9 +29,14 @@ public:
     ~Controller();
 
     void SetScene(std::shared_ptr<Scene> scene);
+    // Snapshots the scene and writes it in the background
     void Save(std::string path);
     void Load(std::string path, bool merge = false);
     void Merge(const std::shared_ptr<Scene>& scene);
+    // Replays any journal left by a crash on top of the current scene
+    bool Recover();
+    // Called once per frame
+    void Update();
 
     void SetImagesLocked(bool locked);
     void SetTokensLocked(bool locked);
@@ -36,6 +49,8 @@ public:
     bool HasSelectedTokens();
     bool HasSelectedShapes();
     void ClearSelection();
+    void SelectAll();
+    void InvertSelection();
     void SelectShape(std::shared_ptr<Shape2D> shape, bool additive=false);
     // void SelectShape(const std::shared_ptr<Shape2D>& shape, bool additive=false);  // Clashes with signal.
     void SelectShapes(const std::vector<std::shared_ptr<Shape2D>>& shapes, bool additive=false);
@@ -62,6 +77,7 @@ public:
     void OnViewportMouseScroll(double xoffset, double yoffset);
     void OnViewportKey(int key, int scancode, int action, int mods);
     void OnViewportSizeChanged(int width, int height);
+    void OnViewportFocusChanged(bool focused);
     void OnCloseRequested();
 
     void OnUIAddTokenClicked();
@@ -70,14 +86,41 @@ public:
     void OnUIKeyChanged(int key, int scancode, int action, int mods);
     void PerformAction(const std::shared_ptr<Action>& action);
 
+    // Move transactions, the selected shapes are offset directly from their
+    // start positions and a single MoveShapesAction is committed at the end.
+    void BeginMoveTransaction();
+    void UpdateMoveTransaction(glm::vec2 offset);
+    void CommitMoveTransaction();
+    void CancelMoveTransaction();
+    bool InMoveTransaction();
+
     bool Undo();
     bool Redo();
 
     void OnTokenPropertyChanged(const std::shared_ptr<Token>& token, TokenProperty property, TokenPropertyValue value);
     void OnImagePropertyChanged(const std::shared_ptr<BGImage>& image, ImageProperty property, ImagePropertyValue value);
     void OnGridPropertyChanged(const std::shared_ptr<Grid>& grid, GridProperty property, GridPropertyValue value);
+    void OnFogPropertyChanged(const std::shared_ptr<FogOfWar>& fog, FogProperty property, FogPropertyValue value);
     void OnCameraPropertyChanged(const std::shared_ptr<Camera>& camera, CameraProperty property, CameraPropertyValue value);
 
+    // Network sessions, a scene is either served to clients or mirrored from
+    // a host, never both
+    void Host(int port);
+    void Join(std::string address, int port);
+    void Disconnect();
+    void AssignSelectedTokens(ClientID client);
+    void SetVisionRange(float range);
+    // Shares the scene with a display process on this machine, see SceneMirror
+    void SetMirrored(bool mirrored);
+
+    // Wall drawing, clicks in the viewport add points to a polyline of walls
+    // rather than selecting shapes while the tool is on
+    void SetWallTool(bool enabled);
+    void AddWallPoint(glm::vec2 worldPos);
+    void FinishWall();
+    void RemoveWallAt(glm::vec2 worldPos);
+    void ClearWalls();
+
 private:
     std::shared_ptr<Resources> m_resources = nullptr;
     std::shared_ptr<Scene> m_scene = nullptr;
@@ -90,13 +133,52 @@ private:
     bool middleMouseHeld = false;
     bool leftMouseHeld = false;
 
-    const size_t MAX_UNDO_SIZE = 10;
-    std::deque<std::shared_ptr<Action>> undoQueue;
-    std::deque<std::shared_ptr<Action>> redoQueue;
+    UndoHistory m_history;
+    SceneDocument m_document;
+    Clipboard m_clipboard;
+    SceneHost m_host;
+    SceneClient m_client;
+    MotionInterpolator m_motion;
+    std::unique_ptr<SceneMirrorWriter> m_mirror;
 
     std::shared_ptr<RectOverlay> dragSelectRect = nullptr;
     std::shared_ptr<Shape2D> shapeUnderCursor = nullptr;
 
+    struct MoveTransaction
+    {
+        bool active = false;
+        std::vector<ShapeID> ids;
+        std::vector<std::shared_ptr<Matrix2D>> models;
+        std::vector<glm::vec2> startPositions;
+        // Index of the shape under the cursor, which snapping follows
+        size_t anchor = NO_INDEX;
+        // Total offset applied since the transaction began
+        glm::vec2 offset = glm::vec2(0);
+        // Previewed to other users while connected, see StreamMoveTransaction
+        bool streamed = false;
+        glm::vec2 streamedOffset = glm::vec2(0);
+        std::chrono::steady_clock::time_point lastStreamed;
+    };
+    MoveTransaction moveTransaction;
+
+    // Adds an action which has already been applied to the undo history
+    void CommitAction(const std::shared_ptr<Action>& action);
+    void JournalAction(const std::shared_ptr<Action>& action);
+    // Applies a client's edit as an undoable action
+    void ApplyEdit(const SceneHost::Edit& edit);
+    // Applies an action to the client's own tokens straight away and asks the
+    // host to make the same change, see SceneClient
+    void PredictAction(const std::shared_ptr<Action>& action);
+    void UpdateSync();
+    // Lifts the fog around the tokens this user sees through
+    void UpdateFog();
+    // Resizes the selected shapes to the next grid size up or down
+    void StepSelectedGridSize(int step);
+    // Snaps to a nearby wall end so polylines join up
+    glm::vec2 SnapWallPoint(glm::vec2 worldPos);
+    // Sends the dragged tokens' positions if due, final ends the preview
+    void StreamMoveTransaction(bool final);
+
     bool IsDragSelecting();
     void StartDragSelection(float xpos, float ypos);
     void UpdateDragSelection(float xpos, float ypos);
@@ -0,0 +1,63 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <SceneDocument.h>
+#include <model/Scene.h>
+#include <net/SceneHost.h>
+
+
+struct HeadlessOptions
+{
+    std::string sceneFile;
+    uint16_t port = 0;
+    float visionRange = 0.0f;
+    std::chrono::seconds autosaveInterval{120};
+    // How often resource use is logged, 0 to never
+    std::chrono::seconds reportInterval{60};
+    // Each client that connects is given the first token nobody owns
+    bool assignTokens = false;
+    int frameMs = 16;
+};
+
+// Serves a scene file to clients without a window or GL context, eg, a
+// campaign left running on a server. Only uses the model library: clients'
+// edits are validated by the SceneHost and applied to the scene as the app
+// would, journaled as they happen and saved back to the file on an interval
+// and on exit, see SceneDocument. Runs until SIGINT or SIGTERM.
+class HeadlessHost
+{
+public:
+    HeadlessHost(const HeadlessOptions& options);
+    ~HeadlessHost();
+
+    // Loads the scene, replaying any journal a crash left, and starts
+    // listening. Returns false if either fails.
+    bool Start();
+    void Exec();
+
+private:
+    HeadlessOptions m_options;
+    std::shared_ptr<Resources> m_resources;
+    std::shared_ptr<Scene> m_scene;
+    JSONSerializer m_serializer;
+    SceneDocument m_document;
+    SceneHost m_host;
+
+    // Tokens handed out by assignTokens, returned when the client leaves
+    std::map<ClientID, ShapeID> m_assigned;
+
+    // Resource use as of the last report, and before any client connected
+    std::chrono::steady_clock::time_point m_lastReport;
+    double m_lastCPUMs = 0.0;
+    size_t m_idleResidentBytes = 0;
+
+    void ApplyEdits();
+    void AssignTokens();
+    void Report();
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -78,4 +79,124 @@ public:
 
 private:
     std::shared_ptr<Camera> m_camera;
-};
\ No newline at end of file
+};
+
+// Dynamic array of 2D positions at attribute location 0, for geometry rebuilt
+// on the CPU such as lines and fans
+class VertexBuffer2D
+{
+public:
+    VertexBuffer2D()
+    {
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        glBindVertexArray(0);
+    }
+    ~VertexBuffer2D()
+    {
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteVertexArrays(1, &m_VAO);
+    }
+    VertexBuffer2D(const VertexBuffer2D&) = delete;
+    VertexBuffer2D& operator=(const VertexBuffer2D&) = delete;
+
+    void Upload(const std::vector<glm::vec2>& points)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        // Only reallocated when it grows
+        if (points.size() > m_capacity)
+        {
+            m_capacity = points.size();
+            glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::vec2), points.data(), GL_DYNAMIC_DRAW);
+        }
+        else if (!points.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, points.size() * sizeof(glm::vec2), points.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_size = points.size();
+    }
+    size_t Size() const { return m_size; }
+
+    void Draw(GLenum mode, GLint first, GLsizei count)
+    {
+        glBindVertexArray(m_VAO);
+        glDrawArrays(mode, first, count);
+        glBindVertexArray(0);
+    }
+    // One draw call for many primitives, eg, a fan per polygon
+    void MultiDraw(GLenum mode, const std::vector<GLint>& firsts, const std::vector<GLsizei>& counts)
+    {
+        glBindVertexArray(m_VAO);
+        glMultiDrawArrays(mode, firsts.data(), counts.data(), firsts.size());
+        glBindVertexArray(0);
+    }
+
+private:
+    GLuint m_VAO, m_VBO;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+};
+
+
+// Single channel texture rendered to offscreen, resized to match the viewport
+class MaskTarget
+{
+public:
+    MaskTarget()
+    {
+        glGenFramebuffers(1, &m_FBO);
+        glGenTextures(1, &m_texture);
+    }
+    ~MaskTarget()
+    {
+        glDeleteTextures(1, &m_texture);
+        glDeleteFramebuffers(1, &m_FBO);
+    }
+    MaskTarget(const MaskTarget&) = delete;
+    MaskTarget& operator=(const MaskTarget&) = delete;
+
+    // Binds for drawing, remembering the framebuffer and viewport to restore
+    void Begin()
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFBO);
+        glGetIntegerv(GL_VIEWPORT, m_previousViewport);
+        Resize(m_previousViewport[2], m_previousViewport[3]);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glViewport(0, 0, m_width, m_height);
+    }
+    void End()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_previousFBO);
+        glViewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+    }
+    void Bind(GLenum unit)
+    {
+        glActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+    }
+
+private:
+    GLuint m_FBO, m_texture;
+    GLint m_width = 0, m_height = 0;
+    GLint m_previousFBO = 0;
+    GLint m_previousViewport[4] = {0, 0, 0, 0};
+
+    void Resize(GLint width, GLint height)
+    {
+        if (width == m_width && height == m_height)
+            return;
+        m_width = width;
+        m_height = height;
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_previousFBO);
+    }
+};
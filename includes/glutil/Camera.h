@@ -64,7 +64,7 @@ public:
     void Pan(glm::vec2 offset);
     void Pan(float xoffset, float yoffset);
     void ProcessKeyboard(Camera_Movement direction, float deltaTime);
-    void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true);
+    void ProcessMouseMovement(float xoffset, float yoffset, bool constrainPitch = true);
     void Zoom(float yoffset);
     void SetFocal(float focal);
     void SetAperture(float haperture);
@@ -0,0 +1,13 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <glutil/Texture.h>
+
+
+// Decodes and uploads the image if it hasn't been already. Returns false if the
+// texture has no usable image data.
+bool UploadTexture(Texture& texture);
+// Uploads if required and binds the texture to the given texture unit
+void BindTexture(Texture& texture, GLenum textureUnit);
+// Frees the GPU storage, the texture is uploaded again on next bind
+void ReleaseTexture(Texture& texture);
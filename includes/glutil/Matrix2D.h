@@ -1,11 +1,20 @@
 #pragma once
 #include <glm/glm.hpp>
 
+#include <glutil/TransformStore.h>
+
+// Handle to a transform in the global TransformStore. Setters are cheap, the
+// matrix is only rebuilt when read or by the per frame TransformStore::RebuildDirty.
 class Matrix2D
 {
 public:
     Matrix2D();
     Matrix2D(glm::vec2 pos, glm::vec2 scale, float rot);
+    // Takes ownership of a slot from TransformStore::AllocateRange
+    explicit Matrix2D(TransformHandle handle);
+    Matrix2D(const Matrix2D& other);
+    Matrix2D& operator=(const Matrix2D& other);
+    ~Matrix2D();
 
     void Offset(glm::vec2 offset);
 
@@ -21,12 +30,11 @@ public:
     float GetRotation() const;
 
     const glm::mat4* Value() const;
+    TransformHandle Handle() const;
+    uint64_t Version() const;
 
     void Rebuild();
 
 private:
-    glm::mat4 m_matrix;
-    glm::vec2 m_pos;
-    glm::vec2 m_scale;
-    float m_rot;
+    TransformHandle m_handle;
 };
@@ -1,21 +1,61 @@
 #pragma once
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
-#include <glad/glad.h>
-#include <stb_image.h>
+#include <ContentHash.h>
 
 
+struct MipLevel
+{
+    int width, height;
+    const unsigned char* pixels;
+};
+
+// Image file contents held in memory instead of read from the texture's
+// filename, eg, from a bundle. Pointers stay valid as long as owner does.
+struct TextureData
+{
+    std::shared_ptr<const void> owner;
+    // Encoded file contents
+    const unsigned char* bytes = nullptr;
+    size_t size = 0;
+    ContentHash hash;
+    // Optional pre-decoded levels, largest first, uploaded without decoding
+    std::vector<MipLevel> mips;
+};
+
+// Box filters tightly packed pixels to half the size, rounding down but never
+// below 1. The last row or column of an odd size is repeated.
+void HalveImage(const std::vector<unsigned char>& pixels, int width, int height, int numChannels, std::vector<unsigned char>& half);
+
+
+// CPU side description of an image file. Only the header is read on creation,
+// pixel data is decoded and uploaded by the renderer the first time it's used
+// (see glutil/GLTexture.h) so the model never needs a GL context.
 class Texture
 {
 public:
     std::string filename;
     int width = 0, height = 0, numChannels = 0;
-    GLuint ID = 0;
+    // GL texture name, 0 until uploaded by the renderer
+    unsigned int ID = 0;
+    // Encoded contents held in memory, eg, from a bundle or read when first
+    // requested, decoded instead of reading filename. Unset if it couldn't be read.
+    std::shared_ptr<const TextureData> data;
+    // Texture with identical contents that holds the decoded GPU copy, eg, the
+    // same file through another path. Null if this texture uploads its own.
+    std::shared_ptr<Texture> source;
 
     Texture() {}
     Texture(const char *filename);
+    // Filename is kept so the texture saves and displays as the original file
+    Texture(const std::string& filename, std::shared_ptr<const TextureData> data);
 
-    void activate(GLuint textureID) const;
     bool IsValid() const;
+    bool IsUploaded() const;
+    // Decoded size of the pixel data, ie, what an upload costs
+    size_t ByteSize() const;
     std::string Name() const;
 };
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+typedef uint32_t TransformHandle;
+
+// Structure of arrays storage for every 2D transform in the process. Setters
+// only write the component arrays and flag the slot as dirty, matrices are
+// rebuilt in a single pass by RebuildDirty() (once per frame, before drawing)
+// or on demand for a single slot when read.
+class TransformStore
+{
+public:
+    static TransformStore& Global() { return s_global; }
+
+    TransformHandle Allocate(glm::vec2 pos, glm::vec2 scale, float rot);
+    // Allocates count slots copied from the arrays, for bulk loading. Free slots
+    // are reused first and the rest are appended with one copy per array.
+    void AllocateRange(size_t count, const glm::vec2* pos, const glm::vec2* scale, const float* rot, TransformHandle* handles);
+    void Release(TransformHandle handle);
+
+    glm::vec2 GetPos(TransformHandle handle) const { return m_pos[handle]; }
+    glm::vec2 GetScale(TransformHandle handle) const { return m_scale[handle]; }
+    float GetRotation(TransformHandle handle) const { return m_rot[handle]; }
+    // Changes whenever the slot's transform is set, unique across slots
+    uint64_t GetVersion(TransformHandle handle) const { return m_versions[handle]; }
+
+    void SetPos(TransformHandle handle, glm::vec2 pos);
+    void SetScale(TransformHandle handle, glm::vec2 scale);
+    void SetRotation(TransformHandle handle, float degrees);
+
+    // Returns the up to date matrix, rebuilding just this slot if it's dirty.
+    // The pointer is only valid until the next Allocate.
+    const glm::mat4* GetMatrix(TransformHandle handle);
+    void Rebuild(TransformHandle handle);
+    // Rebuilds every dirty matrix in one pass
+    void RebuildDirty();
+
+    size_t NumAllocated() const { return m_pos.size() - m_freeSlots.size(); }
+    // Allocated and free
+    size_t NumSlots() const { return m_pos.size(); }
+    size_t NumDirty() const { return m_dirtySlots.size(); }
+
+private:
+    static TransformStore s_global;
+
+    void MarkDirty(TransformHandle handle);
+
+    std::vector<glm::vec2> m_pos;
+    std::vector<glm::vec2> m_scale;
+    std::vector<float> m_rot;
+    std::vector<glm::mat4> m_matrices;
+    std::vector<uint8_t> m_dirty;
+    std::vector<uint64_t> m_versions;
+    uint64_t m_clock = 0;
+    std::vector<TransformHandle> m_dirtySlots;
+    std::vector<TransformHandle> m_freeSlots;
+};
@@ -3,9 +3,8 @@
 
 #include <glm/glm.hpp>
 
+#include <Constants.h>
 #include <glutil/Matrix2D.h>
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
 #include <glutil/Texture.h>
 #include <model/Shape2D.h>
 
@@ -14,19 +13,33 @@ class BGImage: public Rect
 {
 public:
 
-    BGImage(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture);
-    void Draw(Shader &shader) override;
+    BGImage(std::shared_ptr<Texture> texture);
+    // With a transform already in the store, whose scale is kept
+    BGImage(std::shared_ptr<Texture> texture, const std::shared_ptr<Matrix2D>& model);
+    BGImage(const BGImage& image);
     std::shared_ptr<Texture> GetImage();
     void SetImage(std::shared_ptr<Texture> texture);
     void SetTint(glm::vec4 colour);
+    glm::vec4 GetTint();
     bool GetLockRatio();
     void SetLockRatio(bool lockRatio);
+    // Optional greyscale heights for line of sight, white at the height scale
+    std::shared_ptr<Texture> GetHeightmap() { return m_heightmap; }
+    void SetHeightmap(std::shared_ptr<Texture> heightmap);
+    float GetHeightScale() { return m_heightScale; }
+    void SetHeightScale(float scale);
     bool IsVisible() { return m_visible; }
-    void SetVisible(bool visible) { m_visible = visible; }
+    void SetVisible(bool visible)
+    {
+        m_visible = visible;
+        Touch();
+    }
 
 private:
     std::shared_ptr<Texture> m_texture;
     glm::vec4 m_tintColour = glm::vec4(1);
     bool m_lockRatio = false;
     bool m_visible = true;
+    std::shared_ptr<Texture> m_heightmap;
+    float m_heightScale = DEFAULT_HEIGHT_SCALE;
 };
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <WorkerPool.h>
+#include <glutil/Texture.h>
+#include <model/BGImage.h>
+#include <model/Bounds.h>
+#include <model/HeightField.h>
+#include <model/Shape2D.h>
+#include <model/Visibility.h>
+#include <model/Walls.h>
+
+
+// Token the fog is lifted around
+struct FogViewer
+{
+    ShapeID id;
+    glm::vec2 origin;
+    // Above the ground, see Token::GetHeight
+    float height = 0.0f;
+};
+
+// Visible area around a viewer, as a fan from its origin, or over terrain as
+// triangles within the fan
+struct VisionPolygon
+{
+    ShapeID viewer = NULL_SHAPE_ID;
+    glm::vec2 origin = glm::vec2(0);
+    float height = 0.0f;
+    float range = 0.0f;
+    std::vector<glm::vec2> points;
+    // Empty unless the viewer's over a heightmap
+    std::vector<glm::vec2> triangles;
+    uint64_t terrainVersion = 0;
+    // Update that last saw the viewer, to prune those no longer given
+    uint64_t generation = 0;
+    bool valid = false;
+};
+
+// The scene's walls and fog of war settings, which are saved, and the
+// visibility of the tokens the fog is currently drawn for, which isn't. Each
+// token's visibility is cached and only recomputed when it moves, the range
+// changes or a wall within its range changes, so dragging one token with many
+// others on the map only sweeps around the one being dragged. Those that do
+// need recomputing are shared between a pool of threads.
+//
+// Images with heightmaps are terrain: a viewer within range of one only sees
+// the ground that isn't hidden by higher ground, from eyes EYE_LEVEL above its
+// feet. Where images overlap the topmost is used, off it the ground's at 0.
+class FogOfWar
+{
+public:
+    Walls walls;
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return m_enabled; }
+    // How far tokens see when nothing's in the way
+    void SetRange(float range);
+    float GetRange() const { return m_range; }
+
+    // Takes the heightmaps from the images, decoding those not seen before.
+    // Any change means every viewer is recomputed.
+    void SetTerrain(const std::vector<std::shared_ptr<BGImage>>& images);
+    // Masks everything but what the viewers see, computing what's not cached
+    void Update(const std::vector<FogViewer>& viewers);
+    // Masks everything but the given polygons instead of computing them, eg,
+    // as mirrored from another process
+    void Show(std::vector<VisionPolygon> polygons);
+    // Stops masking, eg, for a host with nothing selected
+    void Reveal() { m_masking = false; }
+    bool IsMasking() const { return m_enabled && m_masking; }
+    // Whether a point's within what the viewers see, always while not masking
+    bool IsVisible(glm::vec2 point) const;
+    const std::vector<const VisionPolygon*>& Polygons() const { return m_polygons; }
+    // Changes whenever the polygons do, so they're only uploaded again then.
+    // Unique across instances, as Walls::Version is.
+    uint64_t PolygonsVersion() const { return m_polygonsVersion; }
+    // Viewers swept by the last Update, the rest were cached
+    size_t NumComputed() const { return m_numComputed; }
+
+    // How opaque the mask is drawn, the host sees through it
+    float maskOpacity = 1.0f;
+    // Editing state, drawn over the scene but never saved
+    bool showWalls = false;
+    // Points of the polyline being drawn, ending at the cursor
+    std::vector<glm::vec2> draft;
+
+private:
+    bool m_enabled = false;
+    float m_range = 30.0f;
+    bool m_masking = false;
+
+    // Scratch for each thread computing polygons
+    struct Worker
+    {
+        VisibilitySweep sweep;
+        TerrainViewshed viewshed;
+    };
+    // What the layers were built from, to tell when they're out of date
+    struct TerrainSource
+    {
+        const BGImage* image;
+        uint64_t version;
+        uint64_t transformVersion;
+        const Texture* heightmap;
+
+        bool operator==(const TerrainSource& other) const
+        {
+            return image == other.image && version == other.version && transformVersion == other.transformVersion &&
+                   heightmap == other.heightmap;
+        }
+    };
+
+    // Made on first use, most scenes never sweep more than one viewer at once
+    std::unique_ptr<WorkerPool> m_pool;
+    std::vector<Worker> m_workers;
+    std::unordered_map<ShapeID, VisionPolygon> m_cache;
+    std::vector<VisionPolygon*> m_stale;
+    std::vector<const VisionPolygon*> m_polygons;
+    // Given by Show rather than computed
+    std::vector<VisionPolygon> m_shown;
+    std::vector<Bounds2D> m_changes;
+    uint64_t m_wallsVersion = 0;
+    uint64_t m_generation = 0;
+    uint64_t m_polygonsVersion = NewPolygonsVersion();
+    size_t m_numComputed = 0;
+
+    std::vector<TerrainSource> m_terrainSources;
+    // Bottom to top
+    std::vector<TerrainLayer> m_layers;
+    // Decoded heightmaps, kept while an image uses them
+    std::unordered_map<std::shared_ptr<Texture>, std::shared_ptr<const HeightField>> m_fields;
+    uint64_t m_terrainVersion = 0;
+
+    static uint64_t NewPolygonsVersion();
+    bool IsStale(const VisionPolygon& polygon, const FogViewer& viewer, bool changesKnown) const;
+    void Compute(VisionPolygon& polygon, Worker& worker) const;
+};
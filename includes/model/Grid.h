@@ -1,8 +1,8 @@
 #pragma once
+#include <memory>
+
 #include <glm/glm.hpp>
 
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
 #include <model/Shape2D.h>
 #include <model/Token.h>
 
@@ -24,9 +24,8 @@ enum ShapeGridSize
 class Grid
 {
 public:
-    Grid(std::shared_ptr<Mesh> mesh, std::shared_ptr<Shader> shader);
+    Grid();
 
-    void Draw();
     void SetScale(float scale);
     float GetScale();
     void SetColour(glm::vec3 colour);
@@ -42,8 +41,6 @@ public:
     glm::vec2 ShapeSnapPosition(std::shared_ptr<Shape2D> token, glm::vec2 pos);
 
 private:
-    std::shared_ptr<Mesh> m_mesh;
-    std::shared_ptr<Shader> m_shader;
     float m_scale = 1.0f;
     glm::vec3 m_colour = glm::vec3(0.2);
     bool m_snap = false;
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <glutil/Texture.h>
+#include <model/Bounds.h>
+
+
+// Greyscale heights of a heightmap, levels 0 to 255, with a max-mip pyramid
+// above them: each texel of a level holds the highest of the 2x2 texels below
+// it. A ray whose horizon is above a coarse texel can skip every texel under
+// it, so marching across flat or low ground visits a few texels rather than
+// hundreds. Row 0 is the bottom of the image, as it's drawn.
+class HeightField
+{
+public:
+    HeightField(int width, int height, std::vector<uint8_t> heights);
+
+    // Decodes the texture's first channel. Null if it can't be read.
+    static std::shared_ptr<const HeightField> Decode(const Texture& texture);
+
+    int Width() const { return m_levels[0].width; }
+    int Height() const { return m_levels[0].height; }
+    // Down to a single texel
+    int NumLevels() const { return int(m_levels.size()); }
+    // Highest height within the texel of the level, 0 off the field
+    uint8_t Max(int level, int x, int y) const
+    {
+        const Level& heights = m_levels[level];
+        if (x < 0 || y < 0 || x >= heights.width || y >= heights.height)
+            return 0;
+        return heights.heights[size_t(y) * heights.width + x];
+    }
+
+private:
+    struct Level
+    {
+        int width, height;
+        std::vector<uint8_t> heights;
+    };
+    std::vector<Level> m_levels;
+};
+
+// A height field placed in the scene by its image's transform. Off the field
+// the ground is at 0.
+struct TerrainLayer
+{
+    std::shared_ptr<const HeightField> field;
+    // World to texel space, texel = origin + x * axisX + y * axisY
+    glm::vec2 origin = glm::vec2(0);
+    glm::vec2 axisX = glm::vec2(0);
+    glm::vec2 axisY = glm::vec2(0);
+    // World height of level 255
+    float heightScale = 0.0f;
+    Bounds2D bounds;
+
+    // Covers the unit quad of an image drawn with the model matrix
+    TerrainLayer(std::shared_ptr<const HeightField> field, const glm::mat4& model, float heightScale);
+
+    glm::vec2 ToTexel(glm::vec2 pos) const { return origin + pos.x * axisX + pos.y * axisY; }
+    float HeightAt(glm::vec2 pos) const;
+};
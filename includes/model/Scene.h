@@ -7,11 +7,12 @@
 
 #include <Resources.h>
 #include <glutil/Camera.h>
-#include <glutil/Shader.h>
 #include <model/BGImage.h>
 #include <model/Bounds.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Overlays.h>
+#include <model/Selection.h>
 #include <model/Token.h>
 
 // ViewIDs are a lookup for which camera is being used for what purpose
@@ -20,14 +21,32 @@
 typedef unsigned int ViewID;
 const ViewID PRIMARY = 0;
 
+// Returned by the index lookups for shapes not in the scene
+const size_t NO_INDEX = -1;
+
+// Shapes removed from the scene with the index they were removed from, in
+// ascending index order. Inserting them back restores the original draw order.
+template <typename T>
+struct RemovedShape
+{
+    size_t index;
+    std::shared_ptr<T> shape;
+    bool selected;
+};
+template <typename T>
+using RemovedShapes = std::vector<RemovedShape<T>>;
+
 class Scene
 {
 public:
     glm::vec4 bgColor = glm::vec4(0, 0, 0, 1);
+    // Add and remove shapes through the Scene methods to keep the ID lookup in sync
     std::vector<std::shared_ptr<BGImage>> images;
     std::vector<std::shared_ptr<Token>> tokens;
     std::vector<std::shared_ptr<Overlay>> overlays;
     std::shared_ptr<Grid> grid = nullptr;
+    // Walls and line of sight
+    std::shared_ptr<FogOfWar> fog = nullptr;
     std::vector<std::shared_ptr<Camera>> cameras;
     std::unordered_map<ViewID, std::shared_ptr<Camera>> views;
     std::string sourceFile;
@@ -37,20 +56,42 @@ public:
     void AddImage();
     void AddImage(std::string path);
     void AddImage(const std::shared_ptr<BGImage>& image);
+    void AddImages(const std::vector<std::shared_ptr<BGImage>>& toAdd);
     void AddToken();
     void AddToken(std::string path);
     void AddToken(const std::shared_ptr<Token>& token);
+    void AddTokens(const std::vector<std::shared_ptr<Token>>& toAdd);
     void RemoveOverlay(std::shared_ptr<Overlay> overlay);
-    void RemoveTokens(std::vector<std::shared_ptr<Token>> toRemove);
-    void RemoveImages(std::vector<std::shared_ptr<BGImage>> toRemove);
+    // Removal and insertion are linear in the number of shapes and preserve order
+    RemovedShapes<Token> RemoveTokens(const std::vector<ShapeID>& toRemove);
+    RemovedShapes<BGImage> RemoveImages(const std::vector<ShapeID>& toRemove);
+    void InsertTokens(const RemovedShapes<Token>& toInsert);
+    void InsertImages(const RemovedShapes<BGImage>& toInsert);
+    std::shared_ptr<Token> GetToken(ShapeID id);
+    std::shared_ptr<BGImage> GetImage(ShapeID id);
+    std::shared_ptr<Shape2D> GetShape(ShapeID id);
+    size_t GetTokenIndex(ShapeID id) const;
+    size_t GetImageIndex(ShapeID id) const;
+
+    const Selection& GetTokenSelection() const;
+    const Selection& GetImageSelection() const;
+    bool IsSelected(ShapeID id) const;
+    // Returns whether the state changed, shapes not in the scene are ignored
+    bool SetSelected(ShapeID id, bool selected);
+    size_t NumSelected() const;
+    void ClearSelection();
+    // Select all and invert skip locked shapes
+    void SelectAll();
+    void InvertSelection();
     bool RemoveCamera(const std::shared_ptr<Camera>& camera);
     bool IsEmpty();
     Bounds2D GetBounds();
+    // World space rect query, ignores locked shapes
+    std::vector<std::shared_ptr<Shape2D>> ShapesInRect(glm::vec2 lo, glm::vec2 hi);
     bool GetImagesLocked();
     void SetImagesLocked(bool locked);
     bool GetTokensLocked();
     void SetTokensLocked(bool locked);
-    void Draw();
 
     void AddDefaultCamera();
     void SetViewCamera(ViewID id, const std::shared_ptr<Camera>& camera);
@@ -58,7 +99,14 @@ public:
 
 private:
     std::shared_ptr<Resources> m_resources;
+    std::unordered_map<ShapeID, size_t> m_tokenIndices;
+    std::unordered_map<ShapeID, size_t> m_imageIndices;
+    Selection m_tokenSelection;
+    Selection m_imageSelection;
     bool m_lockImages = false;
     bool m_lockTokens = false;
     unsigned int m_primaryCamera = -1;
+
+    // Gives the shape a new ID if it's already used by another shape
+    void EnsureUniqueID(Shape2D& shape);
 };
\ No newline at end of file
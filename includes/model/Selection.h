@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <model/Shape2D.h>
+
+
+// Selected state for one of the Scene's shape lists. A bitset over the list
+// indices answers per shape queries in draw/serialise loops and a compact
+// member list gives the selected IDs without scanning the scene. Scene keeps
+// the bitset aligned with its list when shapes are added or removed.
+class Selection
+{
+public:
+    bool IsSelected(size_t index) const { return (m_bits[index >> 6] >> (index & 63)) & 1; }
+    bool Contains(ShapeID id) const { return m_positions.count(id) > 0; }
+    size_t Count() const { return m_members.size(); }
+    bool IsEmpty() const { return m_members.empty(); }
+    // Selected IDs in no particular order
+    const std::vector<ShapeID>& Members() const { return m_members; }
+
+    // Calls func with each selected index in ascending order, skipping empty words
+    template <typename Func>
+    void ForEachIndex(Func&& func) const
+    {
+        for (size_t i = 0; i < m_bits.size(); i++)
+        {
+            for (uint64_t word = m_bits[i]; word; word &= word - 1)
+                func(i * 64 + __builtin_ctzll(word));
+        }
+    }
+
+    // Returns whether the state changed
+    bool Set(size_t index, ShapeID id, bool selected);
+    void Clear();
+
+    template <typename T>
+    void SelectAll(const std::vector<std::shared_ptr<T>>& shapes)
+    {
+        std::fill(m_bits.begin(), m_bits.end(), ~uint64_t(0));
+        MaskTail();
+        RebuildMembers(shapes);
+    }
+
+    template <typename T>
+    void Invert(const std::vector<std::shared_ptr<T>>& shapes)
+    {
+        for (uint64_t& word: m_bits)
+            word = ~word;
+        MaskTail();
+        RebuildMembers(shapes);
+    }
+
+    // Index maintenance
+    size_t Size() const { return m_size; }
+    void Resize(size_t size);
+    // Moves the bit at from to to, clearing from
+    void Move(size_t from, size_t to);
+
+private:
+    std::vector<uint64_t> m_bits;
+    size_t m_size = 0;
+    std::vector<ShapeID> m_members;
+    // Position of each member in m_members for constant time removal
+    std::unordered_map<ShapeID, size_t> m_positions;
+
+    void SetBit(size_t index, bool value);
+    void AddMember(ShapeID id);
+    void RemoveMember(ShapeID id);
+    void MaskTail();
+
+    template <typename T>
+    void RebuildMembers(const std::vector<std::shared_ptr<T>>& shapes)
+    {
+        m_members.clear();
+        m_positions.clear();
+        for (size_t i = 0; i < shapes.size(); i++)
+            if (IsSelected(i))
+                AddMember(shapes[i]->GetID());
+    }
+};
@@ -1,36 +1,53 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 
 #include <glm/glm.hpp>
 
 #include <glutil/Matrix2D.h>
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
+
+// Stable identity for a shape across save/load, copy/paste and undo. IDs are
+// random so shapes from different scenes can be merged without renumbering.
+typedef uint64_t ShapeID;
+const ShapeID NULL_SHAPE_ID = 0;
+
+ShapeID NewShapeID();
+uint64_t NewShapeVersion();
 
 
 class Shape2D
 {
 public:
     bool isHighlighted = false;
-    bool isSelected = false;
 
+    Shape2D() = default;
+    // Takes a transform already in the store rather than allocating one
+    explicit Shape2D(const std::shared_ptr<Matrix2D>& model) : m_model(model) {}
+    virtual ~Shape2D() {}
+
+    ShapeID GetID() const;
+    void SetID(ShapeID id);
     std::shared_ptr<Matrix2D> GetModel();
     void SetModel(const std::shared_ptr<Matrix2D>& matrix);
     virtual bool Contains(glm::vec2 pt) = 0;
-    virtual void Draw(Shader& shader) = 0;
+    // Changes whenever a saved property other than the transform changes, the
+    // transform has its own version (Matrix2D::Version). Lets serialized copies
+    // be reused until the shape changes.
+    uint64_t GetVersion() const { return m_version; }
 
 protected:
+    ShapeID m_id = NewShapeID();
     std::shared_ptr<Matrix2D> m_model = std::make_shared<Matrix2D>();
+    uint64_t m_version = NewShapeVersion();
+
+    void Touch() { m_version = NewShapeVersion(); }
 };
 
 
 class Rect : public Shape2D
 {
 public:
-    Rect(std::shared_ptr<Mesh> mesh);
+    Rect() = default;
+    explicit Rect(const std::shared_ptr<Matrix2D>& model) : Shape2D(model) {}
     virtual bool Contains(glm::vec2 pt);
-    virtual void Draw(Shader& shader);
-
-private:
-    std::shared_ptr<Mesh> m_mesh;
 };
@@ -0,0 +1,77 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <glutil/Texture.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Shape2D.h>
+#include <model/Token.h>
+
+
+// Editable shape properties. Each has a ShapePropertyTraits specialisation
+// giving its value type, the shape type it applies to and accessors, so batch
+// edits can loop over arrays of values without per shape virtual dispatch.
+enum class ShapeProperty
+{
+    Position,
+    Rotation,
+    Scale,
+    Name,
+    Icon,
+    BorderWidth,
+    BorderColor,
+    Statuses,
+    XStatus,
+    Opacity,
+    NameHidden,
+    Height,
+    ImageTexture,
+    LockRatio,
+    Heightmap,
+    HeightScale
+};
+
+// Finds the shape an ID refers to for a given shape type
+template <typename T>
+std::shared_ptr<T> FindShape(Scene& scene, ShapeID id);
+template <>
+inline std::shared_ptr<Shape2D> FindShape<Shape2D>(Scene& scene, ShapeID id) { return scene.GetShape(id); }
+template <>
+inline std::shared_ptr<Token> FindShape<Token>(Scene& scene, ShapeID id) { return scene.GetToken(id); }
+template <>
+inline std::shared_ptr<BGImage> FindShape<BGImage>(Scene& scene, ShapeID id) { return scene.GetImage(id); }
+
+template <ShapeProperty P>
+struct ShapePropertyTraits;
+
+#define SHAPE_PROPERTY(property, owner, type, getter, setter) \
+    template <> \
+    struct ShapePropertyTraits<ShapeProperty::property> \
+    { \
+        typedef owner Owner; \
+        typedef type Type; \
+        static Type Get(Owner& shape) { return getter; } \
+        static void Set(Owner& shape, const Type& value) { setter; } \
+    };
+
+SHAPE_PROPERTY(Position, Shape2D, glm::vec2, shape.GetModel()->GetPos(), shape.GetModel()->SetPos(value))
+SHAPE_PROPERTY(Rotation, Shape2D, float, shape.GetModel()->GetRotation(), shape.GetModel()->SetRotation(value))
+SHAPE_PROPERTY(Scale, Shape2D, glm::vec2, shape.GetModel()->GetScale(), shape.GetModel()->SetScale(value))
+SHAPE_PROPERTY(Name, Token, std::string, shape.GetName(), shape.SetName(value))
+SHAPE_PROPERTY(Icon, Token, std::shared_ptr<Texture>, shape.GetIcon(), shape.SetIcon(value))
+SHAPE_PROPERTY(BorderWidth, Token, float, shape.GetBorderWidth(), shape.SetBorderWidth(value))
+SHAPE_PROPERTY(BorderColor, Token, glm::vec4, shape.GetBorderColor(), shape.SetBorderColor(value))
+SHAPE_PROPERTY(Statuses, Token, TokenStatuses, shape.GetStatuses(), shape.SetStatuses(value))
+SHAPE_PROPERTY(XStatus, Token, bool, shape.GetXStatus(), shape.SetXStatus(value))
+SHAPE_PROPERTY(Opacity, Token, float, shape.GetOpacity(), shape.SetOpacity(value))
+SHAPE_PROPERTY(NameHidden, Token, bool, shape.IsNameHidden(), shape.SetNameHidden(value))
+SHAPE_PROPERTY(Height, Token, float, shape.GetHeight(), shape.SetHeight(value))
+SHAPE_PROPERTY(ImageTexture, BGImage, std::shared_ptr<Texture>, shape.GetImage(), shape.SetImage(value))
+SHAPE_PROPERTY(LockRatio, BGImage, bool, shape.GetLockRatio(), shape.SetLockRatio(value))
+SHAPE_PROPERTY(Heightmap, BGImage, std::shared_ptr<Texture>, shape.GetHeightmap(), shape.SetHeightmap(value))
+SHAPE_PROPERTY(HeightScale, BGImage, float, shape.GetHeightScale(), shape.SetHeightScale(value))
+
+#undef SHAPE_PROPERTY
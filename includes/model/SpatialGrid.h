@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/Shape2D.h>
+
+
+// Uniform grid over world space for finding the shapes in a region without
+// visiting the whole scene. Each shape is listed in every cell its bounds
+// overlap, so moving one only touches the cells it left and entered. Shapes
+// covering more than MAX_CELLS, eg, a map image, are kept in a list of their
+// own that every query checks.
+class SpatialGrid
+{
+public:
+    static const int64_t MAX_CELLS = 256;
+
+    explicit SpatialGrid(float cellSize = 8.0f);
+
+    // Adds the shape or moves it to new bounds
+    void Insert(ShapeID id, const Bounds2D& bounds);
+    void Remove(ShapeID id);
+    void Clear();
+    bool Contains(ShapeID id) const { return m_entries.count(id) > 0; }
+    size_t Size() const { return m_entries.size(); }
+
+    // Appends each shape whose bounds overlap the region, once
+    void Query(const Bounds2D& region, std::vector<ShapeID>& found) const;
+
+    // Axis aligned bounds of a transformed unit shape, allowing for rotation
+    static Bounds2D ShapeBounds(glm::vec2 pos, glm::vec2 scale, float rotation);
+    static bool Overlaps(const Bounds2D& a, const Bounds2D& b);
+
+private:
+    struct Entry
+    {
+        Bounds2D bounds;
+        glm::ivec2 lo;
+        glm::ivec2 hi;
+        bool large;
+    };
+
+    float m_cellSize;
+    std::unordered_map<ShapeID, Entry> m_entries;
+    std::unordered_map<uint64_t, std::vector<ShapeID>> m_cells;
+    std::vector<ShapeID> m_large;
+
+    glm::ivec2 CellOf(glm::vec2 pos) const;
+    static uint64_t Key(int x, int y) { return (uint64_t(uint32_t(x)) << 32) | uint32_t(y); }
+    void AddToCells(ShapeID id, const Entry& entry);
+    void RemoveFromCells(ShapeID id, const Entry& entry);
+};
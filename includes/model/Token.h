@@ -6,8 +6,6 @@
 #include <glm/glm.hpp>
 
 #include <glutil/Matrix2D.h>
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
 #include <glutil/Texture.h>
 #include <model/Shape2D.h>
 
@@ -27,9 +25,11 @@ const glm::vec3 statusColors[NUM_TOKEN_STATUSES] {
 class Token : public Rect
 {
 public:
-    Token(std::shared_ptr<Mesh> mesh);
-    Token(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture);
-    Token(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture, std::string name);
+    Token();
+    Token(std::shared_ptr<Texture> texture);
+    Token(std::shared_ptr<Texture> texture, std::string name);
+    // With a transform already in the store, eg, one decoded in bulk
+    Token(std::shared_ptr<Texture> texture, std::string name, const std::shared_ptr<Matrix2D>& model);
     Token(const Token& token);
 
     void SetIcon(std::shared_ptr<Texture> texture);
@@ -46,9 +46,14 @@ public:
     bool IsStatusEnabled(int status);
     void SetXStatus(bool enabled);
     bool GetXStatus();
+    // Hidden names aren't sent to connected clients, other than the owner's
+    void SetNameHidden(bool hidden);
+    bool IsNameHidden();
+    // Elevation above the ground, eg, flying, which lets it see over terrain
+    void SetHeight(float height);
+    float GetHeight();
     void SetOpacity(float opacity);
     float GetOpacity();
-    virtual void Draw(Shader &shader);
     virtual bool Contains(glm::vec2 pt) const;
 
 private:
@@ -58,5 +63,7 @@ private:
     float m_borderWidth = 0.15f;
     TokenStatuses m_statuses;
     bool m_xStatus = false;
+    bool m_nameHidden = false;
     float m_opacity = 1.0f;
+    float m_height = 0.0f;
 };
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/HeightField.h>
+#include <model/Walls.h>
+
+
+// Finds the area visible from a point by sweeping a ray around it. Only walls
+// within range are considered, found through the Walls' grid, and the range
+// itself is a ring of segments so the sweep always has something to hit. Each
+// wall's end points are events: between two events the nearest wall along the
+// ray can't change, so the visible area is the polygon through the nearest hit
+// either side of each event. Sorting the events dominates, O(n log n) in the
+// walls in range.
+//
+// Walls are assumed not to cross part way along, as where they do the polygon
+// cuts the corner between the events either side. Walls drawn as polylines
+// only meet at their end points.
+class VisibilitySweep
+{
+public:
+    // Segments in the ring standing in for the range
+    static const int NUM_RANGE_SEGMENTS = 64;
+
+    // Replaces polygon with the points around the origin, in angle order,
+    // bounding what's visible from it within range. Drawn as a fan from the
+    // origin, closing back to the first point.
+    void Compute(const Walls& walls, glm::vec2 origin, float range, std::vector<glm::vec2>& polygon);
+
+private:
+    // A wall relative to the origin, counter-clockwise from a to b, split where
+    // it crosses the negative x axis so its angles don't wrap
+    struct Piece
+    {
+        glm::vec2 a;
+        glm::vec2 b;
+        float start;
+        float end;
+    };
+    struct Event
+    {
+        float angle;
+        uint32_t piece;
+        bool starts;
+    };
+
+    // Reused between calls, so each thread sweeping needs its own
+    std::vector<ShapeID> m_ids;
+    std::vector<const Wall*> m_walls;
+    std::vector<Piece> m_pieces;
+    std::vector<Event> m_events;
+    std::vector<uint32_t> m_active;
+
+    void AddSegment(glm::vec2 a, glm::vec2 b);
+    void AddPiece(glm::vec2 a, glm::vec2 b, float start, float end);
+    // Distance along the ray to the nearest active piece, or -1 if none
+    float Nearest(glm::vec2 direction) const;
+};
+
+// Narrows what a viewer sees to the ground not hidden behind higher ground, by
+// marching rays out over a TerrainLayer. Each ray keeps the steepest slope up
+// from the eye so far, its horizon, and ground is seen where its own slope
+// reaches the horizon. A coarse level of the field's max-mip pyramid lying
+// wholly under the horizon can't be seen or raise it, so the ray skips past it
+// in one step, climbing to coarser levels while that keeps working. Rays stop
+// at the walls, given as the polygon from a VisibilitySweep.
+//
+// Heights are sampled from the pyramid level nearest the step between samples
+// so distant ranges over a large field don't alias, which errs towards ground
+// being seen and hiding what's behind it.
+class TerrainViewshed
+{
+public:
+    // Rays are spaced a texel apart at the range, within these
+    static const int MIN_RAYS = 360;
+    static const int MAX_RAYS = 1440;
+    // Samples along a ray, fewer if the range spans fewer texels
+    static const int MAX_STEPS = 512;
+
+    // Replaces triangles with the ground visible from an eye at the height,
+    // each stretch of a ray that's seen drawn as a wedge out to its neighbours
+    void Compute(const TerrainLayer& layer, glm::vec2 origin, float eyeHeight, float range,
+                 const std::vector<glm::vec2>& polygon, std::vector<glm::vec2>& triangles);
+
+private:
+    // Reused between calls, so each thread marching needs its own
+    std::vector<float> m_angles;
+
+    // Distance along the ray to the polygon's edge, starting the search for the
+    // edge from next, which is left at the first point past the ray's angle
+    float WallDistance(const std::vector<glm::vec2>& polygon, glm::vec2 origin, float angle, size_t& next) const;
+    static void AddWedge(glm::vec2 origin, glm::vec2 left, glm::vec2 right, float start, float end, std::vector<glm::vec2>& triangles);
+};
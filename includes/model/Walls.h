@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/SpatialGrid.h>
+
+
+// Only unique within the scene's wall list, walls aren't saved with IDs
+typedef uint64_t WallID;
+const WallID NULL_WALL_ID = 0;
+
+// Blocks line of sight, see Visibility. Polylines are stored as their segments,
+// each sharing its end point with the next segment's start.
+struct Wall
+{
+    WallID id;
+    glm::vec2 start;
+    glm::vec2 end;
+};
+
+// Wall segments of a scene, indexed by a SpatialGrid so those near a point can
+// be found without visiting every wall. Every change bumps the version and
+// logs the region it touched, so cached visibility only has to be recomputed
+// near the change.
+class Walls
+{
+public:
+    // Changes older than this many are forgotten, see ChangedSince
+    static const size_t MAX_LOGGED_CHANGES = 1024;
+
+    Walls();
+
+    // Returns the new wall's ID
+    WallID Add(glm::vec2 start, glm::vec2 end);
+    // Keeps the wall's ID, eg, when a removal is undone
+    void Add(const Wall& wall);
+    bool Remove(WallID id);
+    void Clear();
+    const Wall* Get(WallID id) const;
+    // In no particular order, removal moves the last wall into the gap
+    const std::vector<Wall>& All() const { return m_walls; }
+    size_t Size() const { return m_walls.size(); }
+    bool IsEmpty() const { return m_walls.empty(); }
+
+    // Appends the walls whose bounds overlap the region, once each
+    void Query(const Bounds2D& region, std::vector<const Wall*>& found) const;
+    // Same, with the caller's scratch for the grid's IDs so threads can query
+    // at once
+    void Query(const Bounds2D& region, std::vector<const Wall*>& found, std::vector<ShapeID>& ids) const;
+    // Closest wall within distance of the point, NULL_WALL_ID if none is
+    WallID Nearest(glm::vec2 pos, float distance) const;
+    // Closest end point within distance of the point, so drawn walls can be
+    // joined without gaps. Returns false if there's none.
+    bool NearestEndpoint(glm::vec2 pos, float distance, glm::vec2& endpoint) const;
+
+    // Changes whenever the walls do. Unique across instances, so a cache keyed
+    // on the walls' address can't mistake a new set for the one before it.
+    uint64_t Version() const { return m_version; }
+    // Appends the regions changed since the version. Returns false if the
+    // version is too old to tell, in which case anything may have changed.
+    bool ChangedSince(uint64_t version, std::vector<Bounds2D>& changed) const;
+
+    static Bounds2D WallBounds(const Wall& wall);
+    static float DistanceTo(const Wall& wall, glm::vec2 pos);
+
+private:
+    std::vector<Wall> m_walls;
+    std::unordered_map<WallID, size_t> m_indices;
+    SpatialGrid m_grid;
+    WallID m_nextID = 1;
+    uint64_t m_version;
+    // Region changed by each version, the newest last
+    struct Change
+    {
+        uint64_t version;
+        Bounds2D bounds;
+    };
+    std::deque<Change> m_changes;
+    // The version before the oldest logged change
+    uint64_t m_oldestVersion;
+    mutable std::vector<ShapeID> m_found;
+
+    void Changed(const Bounds2D& bounds);
+};
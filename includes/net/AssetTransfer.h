@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ContentHash.h>
+#include <Resources.h>
+#include <glutil/Texture.h>
+#include <net/NetworkThread.h>
+#include <net/Protocol.h>
+
+
+// Image files are sent to clients by content hash, in chunks interleaved
+// with the scene's messages. Chunks are only sent while less than a window is
+// queued on the connection, see ThreadedConnection::Queued, so a delta never
+// waits behind more than about a window of asset data. The window grows while the
+// link drains it within a frame and shrinks when it doesn't, keeping the
+// wait to a frame or two however fast or slow the link.
+const size_t ASSET_CHUNK_SIZE = 32 * 1024;
+const size_t MIN_ASSET_WINDOW = 64 * 1024;
+// Also bounds the time spent sending per frame on fast links
+const size_t MAX_ASSET_WINDOW = 1024 * 1024;
+// Larger files get a preview no bigger than PREVIEW_SIZE on a side first
+const uint64_t PREVIEW_THRESHOLD = 256 * 1024;
+const int PREVIEW_SIZE = 256;
+
+struct AssetStats
+{
+    // Sent by the host or received by a client
+    uint64_t bytes = 0;
+    uint64_t completed = 0;
+    uint64_t previews = 0;
+    // Announced assets a client already had, locally or in its cache
+    uint64_t cached = 0;
+};
+
+
+// Host side. Reads and hashes the scene's image files as they're announced
+// and serves their chunks to clients.
+class AssetServer
+{
+public:
+    struct Transfer
+    {
+        ContentHash hash;
+        AssetPart part;
+        uint64_t offset;
+    };
+    // A client's queued sends
+    struct Queue
+    {
+        std::deque<Transfer> transfers;
+        size_t window = MIN_ASSET_WINDOW;
+    };
+
+    // Entries for the files not yet announced to a client, added to announced
+    std::vector<AssetEntry> Announce(const std::vector<std::shared_ptr<Texture>>& textures, std::unordered_set<std::string>& announced);
+    // Queues a requested asset, its preview ahead of any full files. Returns
+    // false for hashes no client was told about.
+    bool Request(Queue& queue, const ContentHash& hash, uint64_t offset, bool preview);
+    // Sends chunks from the front of the queue while the window has room
+    void Send(ThreadedConnection& connection, Queue& queue, AssetStats& stats);
+
+private:
+    struct Asset
+    {
+        std::shared_ptr<const std::string> bytes;
+        // Built on first request, empty if the image can't be decoded
+        std::shared_ptr<const std::string> preview;
+        bool previewBuilt = false;
+    };
+
+    // Hash of each path's file, empty for unreadable ones
+    std::unordered_map<std::string, std::unique_ptr<ContentHash>> m_paths;
+    std::map<ContentHash, Asset> m_assets;
+
+    const ContentHash* Describe(const std::shared_ptr<Texture>& texture);
+    const std::string* Bytes(const ContentHash& hash, AssetPart part);
+};
+
+
+// Client side. Announced assets are linked to their paths from a cache
+// directory keyed by hash. Missing ones are requested and written to a
+// partial file as chunks arrive, so an interrupted transfer picks up where it
+// left off. Linking points the path's texture at the cached one, see
+// Texture::source.
+class AssetCache
+{
+public:
+    struct Request
+    {
+        ContentHash hash;
+        uint64_t offset;
+        bool preview;
+    };
+
+    AssetCache(std::shared_ptr<Resources> resources);
+
+    // $XDG_CACHE_HOME/battlematt/assets, or under ~/.cache
+    static std::string DefaultDirectory();
+    void SetDirectory(const std::string& directory) { m_directory = directory; }
+    const std::string& GetDirectory() const { return m_directory; }
+
+    // Links what's available and returns what needs requesting
+    std::vector<Request> Announce(const std::vector<AssetEntry>& entries);
+    // Returns false if the chunk doesn't continue its transfer
+    bool Receive(const ContentHash& hash, AssetPart part, uint64_t offset, uint64_t total, const char* data, size_t size);
+    // Forgets transfers in progress, their partial files are kept to resume
+    void Reset();
+
+    size_t NumDownloads() const { return m_downloads.size(); }
+    const AssetStats& Stats() const { return m_stats; }
+
+private:
+    struct Download
+    {
+        uint64_t size;
+        uint64_t received;
+        std::vector<std::string> paths;
+        bool wantsPreview;
+        std::string preview;
+        uint64_t previewSize = 0;
+    };
+
+    std::shared_ptr<Resources> m_resources;
+    std::string m_directory;
+    std::map<ContentHash, Download> m_downloads;
+    // Paths whose own file was checked against the announced hash
+    std::unordered_map<std::string, ContentHash> m_localPaths;
+    AssetStats m_stats;
+
+    std::string PathFor(const ContentHash& hash) const;
+    bool HasLocally(const AssetEntry& entry);
+    void Link(const std::vector<std::string>& paths, const std::shared_ptr<Texture>& texture);
+    bool ReceivePreview(const ContentHash& hash, Download& download, uint64_t offset, uint64_t total, const char* data, size_t size);
+    bool Complete(const ContentHash& hash, Download& download);
+};
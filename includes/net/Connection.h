@@ -0,0 +1,109 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+
+// Non-blocking TCP connection exchanging length prefixed messages. Sends are
+// buffered until Flush and received bytes are buffered until a whole message
+// has arrived, so neither ever blocks the frame.
+//
+// Frame layout: u32 payload size, u8 message type, payload
+class Connection
+{
+public:
+    static const size_t FRAME_HEADER_SIZE = 5;
+    // Anything larger is treated as a corrupt stream
+    static const uint32_t MAX_MESSAGE_SIZE = 256 * 1024 * 1024;
+
+    struct Message
+    {
+        uint8_t type;
+        std::string payload;
+    };
+
+    // Takes ownership of a connected socket
+    explicit Connection(int fd);
+    ~Connection();
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Blocks until connected, returns nullptr on failure
+    static std::unique_ptr<Connection> Connect(const std::string& host, uint16_t port);
+
+    void Send(uint8_t type, const std::string& payload);
+    // Writes as much of the buffered data as the socket takes. Returns false
+    // once the connection has failed.
+    bool Flush();
+    // Reads whatever has arrived. Returns false once the peer has closed the
+    // connection or it has failed, buffered messages can still be taken.
+    bool Receive();
+    // Takes the next whole message, if any
+    bool Next(Message& message);
+
+    bool IsOpen() const { return m_fd >= 0; }
+    void Close();
+    int FileDescriptor() const { return m_fd; }
+    // Bytes waiting to be written
+    size_t Pending() const { return m_outgoing.size() - m_outgoingOffset + m_heldBytes; }
+    // Of those, the ones the socket wouldn't take, ie, not held back by
+    // latency
+    size_t Unwritten() const { return m_outgoing.size() - m_outgoingOffset; }
+    // Pending plus what the socket holds that the peer hasn't acknowledged,
+    // ie, how long a message sent now would wait behind others
+    size_t Queued() const;
+    // What a socket holds that the peer hasn't acknowledged
+    static size_t Unacknowledged(int fd);
+    // When the first message held back by latency is due, false if none is
+    bool NextDue(std::chrono::steady_clock::time_point& due) const;
+    // Holds each sent message this long before it's written, in order, for
+    // testing over loopback
+    void SetLatency(float latencyMs) { m_latencyMs = latencyMs; }
+
+    uint64_t BytesSent() const { return m_bytesSent; }
+    uint64_t BytesReceived() const { return m_bytesReceived; }
+
+private:
+    struct Held
+    {
+        std::chrono::steady_clock::time_point due;
+        std::string frame;
+    };
+
+    int m_fd;
+    std::string m_outgoing;
+    size_t m_outgoingOffset = 0;
+    float m_latencyMs = 0.0f;
+    std::deque<Held> m_held;
+    size_t m_heldBytes = 0;
+    std::string m_incoming;
+    size_t m_incomingOffset = 0;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+};
+
+
+// Listening socket accepting connections without blocking
+class Listener
+{
+public:
+    ~Listener();
+    Listener(const Listener&) = delete;
+    Listener& operator=(const Listener&) = delete;
+
+    // Port 0 picks a free port, see Port. Returns nullptr on failure.
+    static std::unique_ptr<Listener> Listen(uint16_t port);
+    // Returns nullptr if nothing is waiting
+    std::unique_ptr<Connection> Accept();
+    uint16_t Port() const { return m_port; }
+    int FileDescriptor() const { return m_fd; }
+
+private:
+    int m_fd;
+    uint16_t m_port;
+
+    Listener(int fd, uint16_t port) : m_fd(fd), m_port(port) {}
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Where a datagram came from or is going
+struct DatagramAddress
+{
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+
+    // Remote end of a connected socket
+    static DatagramAddress OfPeer(int fd);
+
+    bool operator==(const DatagramAddress& other) const;
+    bool operator!=(const DatagramAddress& other) const { return !(*this == other); }
+    bool IsValid() const { return length > 0; }
+    // The same host on another port
+    DatagramAddress WithPort(uint16_t port) const;
+};
+
+// Simulated network, applied to outgoing datagrams for testing
+struct NetworkConditions
+{
+    // Chance of each datagram being dropped
+    float lossRate = 0.0f;
+    // Each datagram is held for latency plus up to jitter, so later ones can
+    // overtake it. Messages on a connection are held for the latency alone,
+    // see Connection::SetLatency.
+    float latencyMs = 0.0f;
+    float jitterMs = 0.0f;
+};
+
+// Non-blocking UDP socket. Datagrams may be lost, duplicated or arrive out of
+// order, anything built on it must cope.
+class DatagramSocket
+{
+public:
+    // Large enough for a few hundred motion samples, under the usual loopback
+    // MTU and far under the UDP limit
+    static const size_t MAX_DATAGRAM_SIZE = 8192;
+
+    ~DatagramSocket();
+    DatagramSocket(const DatagramSocket&) = delete;
+    DatagramSocket& operator=(const DatagramSocket&) = delete;
+
+    // Port 0 picks a free one, see Port. Returns nullptr on failure.
+    static std::unique_ptr<DatagramSocket> Bind(uint16_t port);
+
+    void SendTo(const DatagramAddress& address, const std::string& payload);
+    // Takes the next datagram, if any
+    bool Receive(DatagramAddress& address, std::string& payload);
+    // Sends held datagrams that are due, only needed with simulated conditions
+    void Flush();
+
+    void SetConditions(const NetworkConditions& conditions, unsigned int seed = 1);
+    uint16_t Port() const { return m_port; }
+    int FileDescriptor() const { return m_fd; }
+
+    uint64_t BytesSent() const { return m_bytesSent; }
+    uint64_t BytesReceived() const { return m_bytesReceived; }
+    uint64_t DatagramsSent() const { return m_datagramsSent; }
+    uint64_t DatagramsReceived() const { return m_datagramsReceived; }
+    // Dropped by the simulated conditions
+    uint64_t DatagramsDropped() const { return m_datagramsDropped; }
+
+private:
+    struct Held
+    {
+        std::chrono::steady_clock::time_point due;
+        DatagramAddress address;
+        std::string payload;
+    };
+
+    int m_fd;
+    uint16_t m_port;
+    NetworkConditions m_conditions;
+    std::mt19937 m_rng;
+    std::vector<Held> m_held;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+    uint64_t m_datagramsSent = 0;
+    uint64_t m_datagramsReceived = 0;
+    uint64_t m_datagramsDropped = 0;
+
+    DatagramSocket(int fd, uint16_t port) : m_fd(fd), m_port(port) {}
+    void Write(const DatagramAddress& address, const std::string& payload);
+};
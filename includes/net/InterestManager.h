@@ -0,0 +1,97 @@
+#pragma once
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/Shape2D.h>
+#include <model/SpatialGrid.h>
+#include <net/Protocol.h>
+
+
+// Share of its size a client's view region is padded by on each side, so
+// shapes just off screen are already there when it pans a little
+const float VIEW_MARGIN = 0.25f;
+
+// Works out which shapes each client is sent. A client sees the tokens it
+// owns, and other shapes that overlap its view region once it has sent one.
+// Of those, tokens are only seen within the vision range of one of the
+// client's own when the host sets a range. Images hidden on the host aren't
+// seen by anyone.
+//
+// Kept up to date incrementally: a changed shape is only checked against
+// each client, and a client's set is only worked out again when its region,
+// its tokens or the range change, from the shapes the spatial index finds
+// near what it can see.
+class InterestManager
+{
+public:
+    struct Changes
+    {
+        std::vector<ShapeID> entered;
+        std::vector<ShapeID> left;
+    };
+
+    // 0 for no limit
+    void SetVisionRange(float range);
+    float GetVisionRange() const { return m_visionRange; }
+
+    // Adds the shape or takes its new state
+    void UpdateShape(ShapeID id, const ShapeState& state);
+    void RemoveShape(ShapeID id);
+    // Forgets every shape, clients stay but see nothing until shapes are added
+    void ClearShapes();
+
+    void AddClient(ClientID client);
+    void RemoveClient(ClientID client);
+    // World space area the client shows, padded by VIEW_MARGIN
+    void SetViewRegion(ClientID client, const Bounds2D& region);
+    // Starts the client's set again from nothing, eg, after a snapshot, so
+    // everything it sees is entered
+    void ResetClient(ClientID client);
+
+    // Brings every client's set up to date with the changes since last called
+    void Update();
+    // Entered and left since last taken
+    Changes TakeChanges(ClientID client);
+    bool IsVisible(ClientID client, ShapeID id) const;
+    size_t NumVisible(ClientID client) const;
+
+private:
+    struct Shape
+    {
+        SyncShapeType type;
+        Bounds2D bounds;
+        glm::vec2 center;
+        float radius;
+        ClientID owner;
+        bool hidden;
+    };
+
+    struct Viewer
+    {
+        bool hasRegion = false;
+        Bounds2D region;
+        std::unordered_set<ShapeID> owned;
+        std::unordered_set<ShapeID> visible;
+        // Since the changes were last taken
+        std::unordered_set<ShapeID> entered;
+        std::unordered_set<ShapeID> left;
+        bool dirty = true;
+    };
+
+    float m_visionRange = 0.0f;
+    std::unordered_map<ShapeID, Shape> m_shapes;
+    // Tokens clients can see, indexed by bounds
+    SpatialGrid m_tokens;
+    // Images clients can see, few and large so always checked
+    std::unordered_set<ShapeID> m_images;
+    std::unordered_map<ClientID, Viewer> m_viewers;
+    std::unordered_set<ShapeID> m_dirtyShapes;
+
+    bool Sees(const Viewer& viewer, ClientID client, const Shape& shape) const;
+    void Recompute(Viewer& viewer, ClientID client);
+    void SetVisible(Viewer& viewer, ShapeID id, bool visible);
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include <model/Scene.h>
+#include <net/Protocol.h>
+
+
+struct MotionStats
+{
+    uint64_t packetsReceived = 0;
+    // Gaps in an origin's sequence, ie, lost or yet to arrive
+    uint64_t packetsMissed = 0;
+    // Arrived after a newer packet from the same origin and were ignored
+    uint64_t packetsLate = 0;
+};
+
+// Plays back the drags streamed by other users. Samples are shown a fixed
+// delay behind when they were sent so there's usually a later one to
+// interpolate towards, letting a late or lost packet pass without the token
+// stalling. Positions are held rather than extrapolated past the newest.
+//
+// Previews are written to the tokens' models so the scene draws them as is.
+// Restore puts back the real positions before anything reads or changes the
+// scene, and Apply writes the previews again afterwards.
+class MotionInterpolator
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // A few send intervals, absorbs that much jitter or consecutive loss
+    static constexpr float DEFAULT_DELAY_MS = 100.0f;
+    // Once a drag ends its last position is kept until the real one catches
+    // up, or this long at most
+    static constexpr float FINAL_HOLD_MS = 1000.0f;
+    // Drags that go silent without ending are dropped after this long
+    static constexpr float TIMEOUT_MS = 1000.0f;
+
+    void SetDelay(float delayMs) { m_delayMs = delayMs; }
+    float GetDelay() const { return m_delayMs; }
+
+    // Returns false if the packet was older than one already received from
+    // the same origin
+    bool Add(const MotionPacket& packet, Clock::time_point now = Clock::now());
+    void Restore(Scene& scene);
+    void Apply(Scene& scene, Clock::time_point now = Clock::now());
+    bool IsMoving(ShapeID id) const { return m_tracks.count(id) != 0; }
+    size_t NumMoving() const { return m_tracks.size(); }
+    void Clear();
+
+    const MotionStats& Stats() const { return m_stats; }
+
+private:
+    struct Origin
+    {
+        uint32_t lastSequence;
+        // Local clock minus sender clock for the fastest recent packet, ie,
+        // the sender's clock plus the least transit time
+        uint32_t offset;
+        uint32_t windowMinimum;
+        double windowStartMs;
+    };
+
+    struct Sample
+    {
+        double timeMs;
+        glm::ivec2 position;
+    };
+
+    struct Track
+    {
+        std::deque<Sample> samples;
+        double lastReceivedMs = 0.0;
+        bool final = false;
+        double finalMs = 0.0;
+        // Set while the preview is written to the model
+        bool applied = false;
+        glm::vec2 authoritative = glm::vec2(0);
+    };
+
+    float m_delayMs = DEFAULT_DELAY_MS;
+    std::unordered_map<ClientID, Origin> m_origins;
+    std::unordered_map<ShapeID, Track> m_tracks;
+    MotionStats m_stats;
+
+    static double ToMs(Clock::time_point time);
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <SPSCQueue.hpp>
+#include <net/Connection.h>
+
+
+// Shared by a ThreadedConnection and the network thread running its socket
+struct ConnectionChannel
+{
+    // From the main thread to the network thread, and back
+    SPSCQueue<Connection::Message> outgoing;
+    SPSCQueue<Connection::Message> incoming;
+    // Cleared by the network thread once the socket has closed, after the
+    // last message received is in incoming
+    std::atomic<bool> open{true};
+    std::atomic<bool> closing{false};
+    std::atomic<float> latencyMs{0.0f};
+    // Bytes in outgoing, and what the network thread's connection had
+    // pending as of its last pass
+    std::atomic<size_t> unsent{0};
+    std::atomic<size_t> pending{0};
+    std::atomic<uint64_t> bytesSent{0};
+    std::atomic<uint64_t> bytesReceived{0};
+    // A duplicate of the connection's socket, watched by the network thread
+    // and asked by the main thread what the peer hasn't acknowledged, so
+    // neither has to poll. Closed with the channel.
+    int socket = -1;
+
+    ~ConnectionChannel();
+};
+
+class NetworkThread;
+
+// The main thread's end of a connection run by a NetworkThread, with the
+// same calls as a Connection. Messages are handed over to be written on
+// Flush, and received ones wait to be taken by Next. Must not outlive the
+// thread it came from.
+class ThreadedConnection
+{
+public:
+    ThreadedConnection(std::shared_ptr<ConnectionChannel> channel, NetworkThread& thread);
+    ~ThreadedConnection();
+    ThreadedConnection(const ThreadedConnection&) = delete;
+    ThreadedConnection& operator=(const ThreadedConnection&) = delete;
+
+    void Send(uint8_t type, const std::string& payload);
+    bool Flush();
+    // Messages are read on the network thread, returns false once closed
+    bool Receive() { return IsOpen(); }
+    bool Next(Connection::Message& message) { return m_channel->incoming.Pop(message); }
+
+    bool IsOpen() const { return !m_closed && m_channel->open.load(std::memory_order_acquire); }
+    void Close();
+    // Handed over but not yet written, plus what the socket holds that the
+    // peer hasn't acknowledged, see Connection::Queued
+    size_t Queued() const;
+    void SetLatency(float latencyMs) { m_channel->latencyMs = latencyMs; }
+
+    uint64_t BytesSent() const { return m_channel->bytesSent; }
+    uint64_t BytesReceived() const { return m_channel->bytesReceived; }
+
+private:
+    std::shared_ptr<ConnectionChannel> m_channel;
+    NetworkThread& m_thread;
+    bool m_unflushed = false;
+    bool m_closed = false;
+};
+
+
+// Runs a listening socket and the connections it accepts on a thread of its
+// own around an epoll loop, so the main thread never spends its frame on a
+// socket. Accepted connections and received messages are handed to the main
+// thread through lock-free queues, and what it sends comes back the same
+// way. Each connection buffers its own sends; callers hold back on
+// connections whose Queued grows, see AssetServer.
+//
+// The loop sleeps until a socket is readable, a blocked one writable, the
+// main thread hands something over or a message held back by latency is due.
+class NetworkThread
+{
+public:
+    // Port 0 picks a free one. Returns nullptr on failure.
+    static std::unique_ptr<NetworkThread> Listen(uint16_t port);
+    // Closes every connection
+    ~NetworkThread();
+    NetworkThread(const NetworkThread&) = delete;
+    NetworkThread& operator=(const NetworkThread&) = delete;
+
+    uint16_t Port() const { return m_port; }
+    // Returns nullptr if nothing is waiting
+    std::unique_ptr<ThreadedConnection> Accept();
+    // Has the thread pick up what was handed over
+    void Wake();
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<Connection> connection;
+        std::shared_ptr<ConnectionChannel> channel;
+        // Registered for writability, while the socket won't take more
+        bool blocked = false;
+    };
+
+    std::unique_ptr<Listener> m_listener;
+    uint16_t m_port;
+    int m_epoll;
+    int m_wake;
+    std::atomic<bool> m_stop{false};
+    SPSCQueue<std::shared_ptr<ConnectionChannel>> m_accepted;
+    // Network thread only, by the ID in their epoll events
+    std::unordered_map<uint64_t, Entry> m_entries;
+    uint64_t m_nextID;
+    std::thread m_thread;
+
+    NetworkThread(std::unique_ptr<Listener> listener, int epoll, int wake);
+    void Loop();
+    void AcceptAll();
+    void Read(Entry& entry);
+    // Returns false once the connection has closed
+    bool Write(uint64_t id, Entry& entry);
+};
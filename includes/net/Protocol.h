@@ -0,0 +1,254 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <ContentHash.h>
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/Shape2D.h>
+#include <model/Token.h>
+
+
+// Messages exchanged between a SceneHost and its SceneClients. Payloads are
+// packed little endian values, see ByteWriter.
+//
+// Host to client:
+//   Welcome   u32 protocol version, u32 client ID, u16 datagram port, u32
+//             datagram key
+//   Snapshot  binary scene, see BinarySerializer. Replaces the client's scene.
+//   Delta     u32 frame, u32 shape count, shape updates, u8 has settings,
+//             [string settings JSON]
+//   Ack       u32 edit sequence, u8 accepted. Sent after the delta holding
+//             the edit's result.
+//   Assets    u32 count, then string path, SHA-256, u64 size per image file
+//             the scene uses. Sent with the snapshot and whenever a delta
+//             refers to a path the client hasn't been told about.
+//   AssetChunk  SHA-256, u8 AssetPart, u64 offset, u64 total size, bytes
+// Client to host:
+//   Edit      u32 sequence, shape update naming only the edited fields
+//   AssetRequest  SHA-256, u64 offset to resume from, u8 wants a preview
+//   ViewRegion  f32 min x, min y, max x, max y of the world the client shows
+//
+// A shape update is u64 ID, u8 SyncShapeType, u16 field mask, then each field
+// in the mask in SyncField order. Shapes are addressed by ID so updates don't
+// depend on the order of the scene's lists; an index is only sent for shapes
+// the client doesn't have yet.
+//
+// Clients are only sent the shapes they can see, see InterestManager. The
+// snapshot holds the scene without its shapes, which follow in a delta, and
+// shapes coming into view or leaving it are added or removed like any other.
+// Fields a client may not see are cleared, see HideFields.
+//
+// Tokens being dragged also stream their positions over UDP, see
+// SyncDatagram. Each datagram starts u8 SyncDatagram, u32 key, where the key
+// is the recipient's or sender's from its Welcome.
+//   Hello     Registers the address the client receives datagrams on, sent
+//             periodically by clients
+//   Motion    u32 origin client, u32 sequence, u32 sender clock ms, u8 final,
+//             u16 sample count, then u64 ID, i32 x, i32 y per sample
+// Motion only previews a drag, its end result is sent reliably as an edit or
+// delta like any other change.
+const uint32_t SYNC_PROTOCOL_VERSION = 5;
+const uint16_t DEFAULT_SYNC_PORT = 7777;
+
+typedef uint32_t ClientID;
+// Owner of shapes no client may edit
+const ClientID HOST_CLIENT_ID = 0;
+
+enum class SyncMessage : uint8_t
+{
+    Welcome = 1,
+    Snapshot,
+    Delta,
+    Ack,
+    Edit,
+    Assets,
+    AssetRequest,
+    AssetChunk,
+    ViewRegion
+};
+
+enum class SyncDatagram : uint8_t
+{
+    Hello = 1,
+    Motion
+};
+
+enum class AssetPart : uint8_t
+{
+    // u32 width, u32 height, u32 channels, then the pixels of a downscaled
+    // copy, shown until the file arrives
+    Preview,
+    // The image file as is
+    Full
+};
+
+enum class SyncShapeType : uint8_t
+{
+    Token,
+    Image,
+    Removed
+};
+
+enum class SyncField : uint16_t
+{
+    None        = 0,
+    Index       = 1 << 0,
+    Position    = 1 << 1,
+    Scale       = 1 << 2,
+    Rotation    = 1 << 3,
+    Texture     = 1 << 4,
+    Name        = 1 << 5,
+    // Token border or image tint
+    Color       = 1 << 6,
+    BorderWidth = 1 << 7,
+    // Token statuses, X and hidden name, or image lock ratio and visibility
+    Flags       = 1 << 8,
+    Opacity     = 1 << 9,
+    // Client that may edit the shape, kept by the host rather than the scene
+    Owner       = 1 << 10,
+    // Token height, or image heightmap path and height scale
+    Height      = 1 << 11,
+    All         = (1 << 12) - 1
+};
+
+inline SyncField operator~ (SyncField a) { return (SyncField)(~(uint16_t)a & (uint16_t)SyncField::All); }
+inline SyncField operator| (SyncField a, SyncField b) { return (SyncField)((uint16_t)a | (uint16_t)b); }
+inline SyncField operator& (SyncField a, SyncField b) { return (SyncField)((uint16_t)a & (uint16_t)b); }
+inline SyncField& operator|= (SyncField& a, SyncField b) { return a = a | b; }
+inline bool HasField(SyncField fields, SyncField field) { return (fields & field) != SyncField::None; }
+
+// Fields a client may change on the tokens it owns
+const SyncField CLIENT_EDITABLE_FIELDS = SyncField::Position | SyncField::Rotation | SyncField::Flags | SyncField::Opacity |
+                                         SyncField::Height;
+
+// Positions are sent as fixed point. A 256th of a grid unit is well below
+// what's visible, and changes smaller than it aren't sent at all.
+const float POSITION_QUANTUM = 1.0f / 256.0f;
+
+inline glm::ivec2 QuantizePosition(glm::vec2 pos) { return glm::ivec2(glm::round(pos / POSITION_QUANTUM)); }
+inline glm::vec2 DequantizePosition(glm::ivec2 pos) { return glm::vec2(pos) * POSITION_QUANTUM; }
+
+// A shape's synced fields, as last sent or as decoded from an update
+struct ShapeState
+{
+    SyncShapeType type = SyncShapeType::Token;
+    uint32_t index = 0;
+    glm::ivec2 position = glm::ivec2(0);
+    glm::vec2 scale = glm::vec2(1);
+    float rotation = 0.0f;
+    std::string texture;
+    std::string name;
+    glm::vec4 color = glm::vec4(1);
+    float borderWidth = 0.0f;
+    uint8_t flags = 0;
+    float opacity = 1.0f;
+    ClientID owner = HOST_CLIENT_ID;
+    // Token height or image height scale
+    float height = 0.0f;
+    // Images only, empty if there's none
+    std::string heightmap;
+};
+
+ShapeState CaptureToken(Token& token);
+ShapeState CaptureImage(BGImage& image);
+// Clears what the client may not see, ie, hidden names of tokens it doesn't own
+void HideFields(ShapeState& state, ClientID client);
+// Images hidden on the host aren't sent to clients at all
+bool IsShownToClients(const ShapeState& state);
+// Fields that differ between the two, index aside
+SyncField DiffFields(const ShapeState& a, const ShapeState& b);
+void ApplyToken(const ShapeState& state, SyncField fields, Token& token, Resources& resources);
+void ApplyImage(const ShapeState& state, SyncField fields, BGImage& image, Resources& resources);
+
+// Positions of dragged tokens at one moment on the sender's clock
+struct MotionSample
+{
+    ShapeID id;
+    glm::ivec2 position;
+};
+
+// Keeps a motion datagram within DatagramSocket::MAX_DATAGRAM_SIZE
+const size_t MAX_MOTION_SAMPLES = 400;
+
+struct MotionPacket
+{
+    ClientID origin = HOST_CLIENT_ID;
+    uint32_t sequence = 0;
+    uint32_t timeMs = 0;
+    // The drag has ended, the final position follows reliably
+    bool final = false;
+    std::vector<MotionSample> samples;
+};
+
+// Milliseconds on a steady clock, wrapping. Only differences are meaningful.
+uint32_t MotionClockMs();
+std::string EncodeHello(uint32_t key);
+std::string EncodeMotion(uint32_t key, const MotionPacket& packet);
+// Returns false for anything malformed, packet is only set for Motion
+bool DecodeDatagram(const std::string& bytes, SyncDatagram& type, uint32_t& key, MotionPacket& packet);
+
+// An image file the scene refers to, see SyncMessage::Assets
+struct AssetEntry
+{
+    std::string path;
+    ContentHash hash;
+    uint64_t size;
+};
+
+
+// Appends packed values to a payload
+class ByteWriter
+{
+public:
+    explicit ByteWriter(std::string& bytes) : m_bytes(bytes) {}
+
+    template <typename T>
+    void Write(T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written");
+        m_bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void WriteString(const std::string& value)
+    {
+        Write<uint32_t>(value.size());
+        m_bytes.append(value);
+    }
+    void WriteShape(ShapeID id, SyncField fields, const ShapeState& state);
+
+private:
+    std::string& m_bytes;
+};
+
+// Reads packed values, failing rather than reading past the end
+class ByteReader
+{
+public:
+    explicit ByteReader(const std::string& bytes) : m_data(bytes.data()), m_size(bytes.size()) {}
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read");
+        if (m_size - m_offset < sizeof(T))
+            return false;
+        std::memcpy(&value, m_data + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+    bool ReadString(std::string& value);
+    // Fields not in the mask are left as they were
+    bool ReadShape(ShapeID& id, SyncField& fields, ShapeState& state);
+    bool AtEnd() const { return m_offset == m_size; }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_offset = 0;
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <BinarySerializer.h>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/Bounds.h>
+#include <model/Scene.h>
+#include <net/AssetTransfer.h>
+#include <net/Connection.h>
+#include <net/Datagram.h>
+#include <net/Protocol.h>
+#include <net/SceneHost.h>
+
+
+// Mirrors the part of a SceneHost's scene the client can see. The scene is
+// replaced by each snapshot and updated in place by deltas. Images the client
+// doesn't have are fetched into an AssetCache.
+//
+// Changes to the client's own tokens are predicted: the caller applies them
+// straight away and sends them as edit requests. Until the host answers, each
+// Update puts the host's values back before applying its messages and
+// replays the edits still waiting on top, so an accepted edit stays put and a
+// rejected one rolls back without disturbing those after it.
+class SceneClient
+{
+public:
+    SceneClient(std::shared_ptr<Resources> resources);
+
+    bool Connect(const std::string& host, uint16_t port);
+    void Disconnect();
+    bool IsConnected() const { return m_connection && m_connection->IsOpen(); }
+    // Assigned by the host once connected
+    ClientID ID() const { return m_id; }
+
+    // Applies everything received so far. Returns true if a snapshot replaced
+    // the scene.
+    bool Update(std::shared_ptr<Scene>& scene);
+    // Asks the host to change the fields of a token this client owns, which
+    // the caller has already changed in the scene. Returns the request's
+    // sequence number.
+    uint32_t RequestEdit(ShapeID id, SyncField fields, const ShapeState& state);
+    bool Owns(ShapeID id) const;
+    // Tells the host which part of the world is shown, so shapes elsewhere
+    // needn't be sent. Only sent once it's moved by a good part of the
+    // margin the host pads it by, see VIEW_MARGIN.
+    void SetViewRegion(const Bounds2D& region);
+
+    // Sends the current positions of the owned tokens being dragged, final
+    // once the drag is over. Samples for other tokens are skipped.
+    void StreamMotion(const std::vector<MotionSample>& samples, bool final);
+    // Other users' drags received since last called, see MotionInterpolator
+    std::vector<MotionPacket> TakeMotion();
+    // Applies to outgoing datagrams and messages, for testing
+    void SetNetworkConditions(const NetworkConditions& conditions);
+    // Where fetched images are kept, see AssetCache::DefaultDirectory
+    void SetAssetDirectory(const std::string& directory) { m_assets.SetDirectory(directory); }
+    // Images still being fetched
+    size_t NumDownloads() const { return m_assets.NumDownloads(); }
+
+    // Whether a snapshot has been received yet
+    bool HasScene() const { return m_hasScene; }
+    uint32_t Frame() const { return m_frame; }
+    size_t NumPendingEdits() const { return m_pendingEdits.size(); }
+    SyncStats Stats() const;
+
+private:
+    std::shared_ptr<Resources> m_resources;
+    JSONSerializer m_serializer;
+    BinarySerializer m_binarySerializer;
+    std::unique_ptr<Connection> m_connection;
+    std::unique_ptr<DatagramSocket> m_datagrams;
+    DatagramAddress m_hostAddress;
+    uint32_t m_key = 0;
+    NetworkConditions m_conditions;
+    std::chrono::steady_clock::time_point m_lastHello;
+    std::vector<MotionPacket> m_motion;
+    uint32_t m_motionSequence = 0;
+    AssetCache m_assets;
+    ClientID m_id = HOST_CLIENT_ID;
+    bool m_hasScene = false;
+    uint32_t m_frame = 0;
+    uint32_t m_nextSequence = 1;
+    std::unordered_map<ShapeID, ClientID> m_owners;
+    bool m_hasViewRegion = false;
+    Bounds2D m_viewRegion;
+    SyncStats m_stats;
+
+    struct PendingEdit
+    {
+        ShapeID id;
+        SyncField fields;
+        ShapeState state;
+        std::chrono::steady_clock::time_point sent;
+    };
+    // By sequence, the order they're replayed in
+    std::map<uint32_t, PendingEdit> m_pendingEdits;
+    // The host's state of each owned token as last received
+    std::unordered_map<ShapeID, ShapeState> m_confirmed;
+    // Predicted tokens as shown before the host's state was put back
+    std::unordered_map<ShapeID, ShapeState> m_shown;
+
+    bool ApplySnapshot(const std::string& payload, std::shared_ptr<Scene>& scene);
+    bool ApplyDelta(const std::string& payload, Scene& scene);
+    bool ApplyAck(const std::string& payload);
+    bool ApplyWelcome(const std::string& payload);
+    // Keeps the host's state of the token if it's owned
+    void Confirm(ShapeID id, Token& token);
+    void RestorePredictions(Scene& scene);
+    void ReplayPredictions(Scene& scene);
+    bool ApplyAssets(const std::string& payload);
+    bool ApplyAssetChunk(const std::string& payload);
+    void ReadDatagrams();
+};
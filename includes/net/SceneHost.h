@@ -0,0 +1,200 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Actions.hpp>
+#include <BinarySerializer.h>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/Scene.h>
+#include <net/AssetTransfer.h>
+#include <net/Datagram.h>
+#include <net/InterestManager.h>
+#include <net/NetworkThread.h>
+#include <net/Protocol.h>
+
+
+// Bytes waiting for a client before it's dropped rather than buffered for
+// without limit
+const size_t MAX_CLIENT_BACKLOG = 64 * 1024 * 1024;
+
+// Counts of latencies in millisecond buckets, the last holding anything
+// longer
+struct LatencyHistogram
+{
+    static const size_t NUM_BUCKETS = 1000;
+    uint32_t counts[NUM_BUCKETS] = {};
+
+    void Add(double latencyMs);
+    void Merge(const LatencyHistogram& other);
+    uint64_t Total() const;
+    // Latency the given share are within, eg, 0.99, to the millisecond above
+    double Percentile(double fraction) const;
+};
+
+// Counters for a connection or a whole host, cumulative since it started
+struct SyncStats
+{
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t messagesSent = 0;
+    uint64_t messagesReceived = 0;
+    // Motion datagrams, counted separately from the reliable stream
+    uint64_t datagramBytesSent = 0;
+    uint64_t datagramBytesReceived = 0;
+    uint64_t editsAccepted = 0;
+    uint64_t editsRejected = 0;
+    AssetStats assets;
+    // Times a token with predicted edits moved when the host's state
+    // arrived, eg, a rejected edit rolling back, clients only
+    uint64_t corrections = 0;
+    // Time from an edit being sent to its result arriving, clients only
+    double lastLatencyMs = 0.0;
+    double averageLatencyMs = 0.0;
+    double maxLatencyMs = 0.0;
+    LatencyHistogram latencies;
+};
+
+// Serves a scene to clients over TCP. Each client gets the scene's settings
+// as a snapshot when it connects, then one delta per frame holding the shapes
+// that came into its view, those that left it and the changed fields of the
+// ones it sees, see InterestManager. A copy of each shape's state as last
+// sent to each client is kept so only the fields that actually differ, with
+// the client's hidden fields cleared, are sent.
+//
+// Clients request edits rather than changing the scene. Requests are checked
+// against the shape's owner and the fields clients may change, then handed
+// to the caller to apply, eg, as undoable actions. Their result goes out with
+// the next delta.
+//
+// Image files the scene uses are announced by content hash and sent in
+// chunks between the deltas to clients that don't already have them, see
+// AssetServer.
+//
+// The sockets are read and written on a NetworkThread, this only encodes and
+// decodes. A client that stops reading is dropped once MAX_CLIENT_BACKLOG is
+// waiting for it.
+//
+// Drags are previewed over UDP alongside: the host streams its own and relays
+// each client's to the others, dropping samples for tokens the sender doesn't
+// own or the recipient doesn't see.
+class SceneHost
+{
+public:
+    // An edit request that passed validation
+    struct Edit
+    {
+        ClientID client;
+        uint32_t sequence;
+        ShapeID id;
+        SyncField fields;
+        ShapeState state;
+    };
+
+    SceneHost(std::shared_ptr<Resources> resources);
+
+    // Port 0 picks a free one, see Port
+    bool Listen(uint16_t port);
+    void Stop();
+    bool IsListening() const { return bool(m_network); }
+    uint16_t Port() const;
+
+    // Which client may edit a shape, the host by default
+    void SetOwner(ShapeID id, ClientID client);
+    ClientID GetOwner(ShapeID id) const;
+    // How far clients' tokens see other tokens, 0 for no limit
+    void SetVisionRange(float range) { m_interest.SetVisionRange(range); }
+    float GetVisionRange() const { return m_interest.GetVisionRange(); }
+    // Whether the client is sent the shape, as of the last Update
+    bool IsVisible(ClientID client, ShapeID id) const { return m_interest.IsVisible(client, id); }
+
+    // Adds what an action changed to the next delta
+    void Record(const ActionEffects& effects);
+    // Sends the whole scene again, eg, after loading a different one
+    void Resync() { m_resync = true; }
+    // Sends the frame's delta, accepts new clients and reads their requests.
+    // Call once per frame, after applying the edits taken last frame.
+    void Update(const std::shared_ptr<Scene>& scene);
+    // Validated requests, to be applied before the next Update
+    std::vector<Edit> TakeEdits();
+
+    // Sends the current positions of the tokens the host is dragging, final
+    // once the drag is over
+    void StreamMotion(const std::vector<MotionSample>& samples, bool final);
+    // Clients' drags received since last called, see MotionInterpolator
+    std::vector<MotionPacket> TakeMotion();
+    // Applies to outgoing datagrams and messages, for testing
+    void SetNetworkConditions(const NetworkConditions& conditions);
+
+    size_t NumClients() const { return m_clients.size(); }
+    std::vector<ClientID> Clients() const;
+    SyncStats Stats() const;
+
+private:
+    struct Client
+    {
+        ClientID id;
+        std::unique_ptr<ThreadedConnection> connection;
+        bool needsSnapshot = true;
+        // Identifies the client's datagrams, which arrive from an address
+        // the host only learns from its Hello
+        uint32_t key = 0;
+        DatagramAddress datagramAddress;
+        std::unordered_set<std::string> announcedAssets;
+        AssetServer::Queue assetQueue;
+        // State of each shape the client has as it was last sent
+        std::unordered_map<ShapeID, ShapeState> known;
+        uint64_t messagesSent = 0;
+        uint64_t messagesReceived = 0;
+    };
+
+    std::shared_ptr<Resources> m_resources;
+    JSONSerializer m_serializer;
+    BinarySerializer m_binarySerializer;
+    // Runs the clients' sockets, declared ahead of them so it outlives them
+    std::unique_ptr<NetworkThread> m_network;
+    std::unique_ptr<DatagramSocket> m_datagrams;
+    NetworkConditions m_conditions;
+    std::mt19937 m_keys{std::random_device{}()};
+    std::vector<Client> m_clients;
+    ClientID m_nextClient = HOST_CLIENT_ID + 1;
+    std::unordered_map<ShapeID, ClientID> m_owners;
+
+    // State of every shape as of the last delta
+    std::unordered_map<ShapeID, ShapeState> m_sent;
+    InterestManager m_interest;
+    ActionEffects m_pending;
+    bool m_resync = true;
+    uint32_t m_frame = 0;
+
+    // Accepted edits waiting to be applied, then acknowledged after the delta
+    std::vector<Edit> m_edits;
+    std::vector<Edit> m_applying;
+    SyncStats m_closedStats;
+
+    std::vector<MotionPacket> m_motion;
+    uint32_t m_motionSequence = 0;
+
+    AssetServer m_assets;
+    AssetStats m_assetStats;
+
+    void Send(Client& client, SyncMessage type, const std::string& payload);
+    void SendSnapshot(Client& client, const std::shared_ptr<Scene>& scene);
+    void SendDelta(const std::shared_ptr<Scene>& scene);
+    // The client's entered, left and changed shapes, returns false if there
+    // was nothing to send
+    bool SendShapes(Client& client, const std::shared_ptr<Scene>& scene, const std::vector<ShapeID>& changed, const std::string* settings);
+    bool ReadViewRegion(Client& client, const std::string& payload);
+    void AnnounceAssets(Client& client, const std::vector<std::shared_ptr<Texture>>& textures);
+    bool ReadAssetRequest(Client& client, const std::string& payload);
+    void ReadRequests(Client& client, const std::shared_ptr<Scene>& scene);
+    void ReadDatagrams();
+    void SendMotion(const MotionPacket& packet);
+    bool Validate(const Client& client, const Edit& edit, const std::shared_ptr<Scene>& scene) const;
+    void Disconnect(Client& client);
+};
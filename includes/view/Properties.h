@@ -19,7 +19,9 @@ enum TokenProperty
     Token_Texture,
     Token_Statuses,
     Token_XStatus,
-    Token_Opacity
+    Token_Opacity,
+    Token_NameHidden,
+    Token_Height
 };
 
 enum ImageProperty
@@ -28,7 +30,9 @@ enum ImageProperty
     Image_Rotation,
     Image_Scale,
     Image_Texture,
-    Image_LockRatio
+    Image_LockRatio,
+    Image_Heightmap,
+    Image_HeightScale
 };
 
 enum GridProperty
@@ -38,6 +42,12 @@ enum GridProperty
     Grid_Color
 };
 
+enum FogProperty
+{
+    Fog_Enabled,
+    Fog_Range
+};
+
 enum CameraProperty
 {
     Camera_Name,
@@ -47,4 +57,5 @@ enum CameraProperty
 typedef std::variant<float, bool, TokenStatuses, glm::vec2, glm::vec4, std::string> TokenPropertyValue;
 typedef std::variant<float, glm::vec2, bool, std::string> ImagePropertyValue;
 typedef std::variant<float, glm::vec3, bool> GridPropertyValue;
+typedef std::variant<bool, float> FogPropertyValue;
 typedef std::variant<std::string, float> CameraPropertyValue;
@@ -0,0 +1,67 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <Resources.h>
+#include <glutil/Buffers.h>
+#include <glutil/Mesh.h>
+#include <glutil/Shader.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Grid.h>
+#include <model/Overlays.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Walls.h>
+
+
+// Draws the model. Owns all GPU resources, so must be created once a GL context
+// exists, but the model itself never references it.
+class Renderer
+{
+public:
+    enum class MeshType { Quad, Quad2 };
+    enum class ShaderType { Flat, Fog, Grid, Image, ScreenRect, Status, Token };
+
+    Renderer(std::shared_ptr<Resources> resources);
+
+    void CreateMesh(MeshType meshType, std::vector<Vertex> vertices, std::vector<uint> indices);
+    std::shared_ptr<Mesh> GetMesh(MeshType meshType);
+    void CreateShader(ShaderType shaderType, const char* vs, const char* fs);
+    std::shared_ptr<Shader> GetShader(ShaderType shaderType);
+
+    void Draw(Scene& scene);
+    // Frees GPU storage for textures nothing but the resource cache holds.
+    // Returns the number released.
+    size_t ReleaseUnusedTextures();
+
+private:
+    std::shared_ptr<Resources> m_resources;
+    std::unordered_map<MeshType, std::shared_ptr<Mesh>> m_meshes;
+    std::unordered_map<ShaderType, std::shared_ptr<Shader>> m_shaders;
+
+    // Fog of war, created on first use. Polygons and walls are only uploaded
+    // when they change, the mask is redrawn every frame as the camera moves.
+    std::unique_ptr<MaskTarget> m_fogMask;
+    std::unique_ptr<VertexBuffer2D> m_fogFans;
+    std::unique_ptr<VertexBuffer2D> m_fogTriangles;
+    std::unique_ptr<VertexBuffer2D> m_wallLines;
+    std::unique_ptr<VertexBuffer2D> m_draftLine;
+    const FogOfWar* m_fog = nullptr;
+    uint64_t m_polygonsVersion = 0;
+    const Walls* m_walls = nullptr;
+    uint64_t m_wallsVersion = 0;
+    std::vector<GLint> m_fanFirsts;
+    std::vector<GLsizei> m_fanCounts;
+    std::vector<glm::vec2> m_points;
+    std::vector<glm::vec2> m_triangles;
+
+    void DrawImage(BGImage& image, Shader& shader, bool selected);
+    void DrawGrid(Grid& grid);
+    void DrawToken(Token& token, Shader& shader, bool selected);
+    void DrawTokenStatuses(Token& token);
+    void DrawOverlay(Overlay& overlay);
+    void DrawFog(FogOfWar& fog);
+    void DrawWalls(FogOfWar& fog);
+};
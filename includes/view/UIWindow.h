@@ -1,20 +1,42 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <Actions.hpp>
 #include <Resources.h>
 #include <Signal.hpp>
 #include <glutil/Matrix2D.h>
 #include <model/BGImage.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Scene.h>
 #include <model/Shape2D.h>
 #include <model/Token.h>
+#include <net/MotionInterpolator.h>
+#include <net/Protocol.h>
+#include <net/SceneHost.h>
 #include <view/Properties.h>
 #include <view/Window.h>
 
 
+// What the network section shows, pushed by the controller each frame
+struct SyncStatus
+{
+    enum class Mode { Offline, Hosting, Client };
+    Mode mode = Mode::Offline;
+    uint16_t port = 0;
+    ClientID id = HOST_CLIENT_ID;
+    std::vector<ClientID> clients;
+    // How far clients' tokens see, 0 for no limit
+    float visionRange = 0.0f;
+    SyncStats stats;
+    MotionStats motion;
+    // Whether the scene is shared with a local display process
+    bool mirrored = false;
+};
+
+
 class UIWindow : public Window
 {
 public:
@@ -28,12 +50,22 @@ public:
     Signal<const std::shared_ptr<Token>&, TokenProperty, TokenPropertyValue> tokenPropertyChanged;
     Signal<const std::shared_ptr<BGImage>&, ImageProperty, ImagePropertyValue> imagePropertyChanged;
     Signal<const std::shared_ptr<Grid>&, GridProperty, GridPropertyValue> gridPropertyChanged;
+    Signal<const std::shared_ptr<FogOfWar>&, FogProperty, FogPropertyValue> fogPropertyChanged;
     Signal<const std::shared_ptr<Camera>&, CameraProperty, CameraPropertyValue> cameraPropertyChanged;
     Signal<bool> imageLockChanged;
     Signal<bool> tokenLockChanged;
+    Signal<bool> wallToolChanged;
+    Signal<> clearWallsClicked;
     Signal<const std::shared_ptr<Camera>&> cameraSelectionChanged;
     Signal<> cloneCameraClicked;
     Signal<> deleteCameraClicked;
+    Signal<int> hostClicked;
+    Signal<std::string, int> joinClicked;
+    Signal<> disconnectClicked;
+    // Gives the selected tokens to a client, or back to the host
+    Signal<ClientID> assignOwnerClicked;
+    Signal<float> visionRangeChanged;
+    Signal<bool> mirrorChanged;
 
     UIWindow(unsigned int width, unsigned int height, std::shared_ptr<Resources> resources, std::shared_ptr<Window> share = NULL);
     ~UIWindow();
@@ -45,6 +77,7 @@ public:
 
     void SetDisplayPropertiesToken(const std::shared_ptr<Token>& token);
     void SetDisplayPropertiesImage(const std::shared_ptr<BGImage>& image);
+    void SetSyncStatus(const SyncStatus& status) { m_syncStatus = status; }
 
     virtual void OnKeyChanged(int key, int scancode, int action, int mods);
 
@@ -54,6 +87,9 @@ private:
     std::string m_promptMsg = "";
     int m_promptType = 0;
     bool mergeLoad = false;
+    SyncStatus m_syncStatus;
+    std::string m_joinAddress = "localhost";
+    int m_syncPort = DEFAULT_SYNC_PORT;
 
     std::string tokenNames[NUM_TOKEN_STATUSES] {"Red", "Green", "Blue", "Yellow", "Cyan", "Pink"};
 
@@ -65,9 +101,11 @@ private:
     void DrawTokenOptions(const std::shared_ptr<Token>& tokens);
 
     void DrawCameraSection();
+    void DrawFogSection();
     void DrawGridSection();
     void DrawImageSection();
     void DrawTokenSection();
+    void DrawNetworkSection();
 
     void RespondToPrompt(bool response);
 
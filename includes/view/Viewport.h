@@ -3,6 +3,7 @@
 
 #include <glutil/Buffers.h>
 #include <model/Scene.h>
+#include <view/Renderer.h>
 #include <view/Window.h>
 
 
@@ -13,6 +14,7 @@ public:
     // ~Viewport();
 
     virtual void Draw();
+    void SetRenderer(std::shared_ptr<Renderer> renderer);
     void SetScene(std::shared_ptr<Scene> scene, int cameraIndex=0);
     void SetCamera(const std::shared_ptr<Camera>& camera);
     const std::shared_ptr<Camera>& GetCamera();
@@ -26,6 +28,7 @@ public:
 
     virtual void OnWindowResized(int width, int height);
 private:
+    std::shared_ptr<Renderer> m_renderer = nullptr;
     std::shared_ptr<Scene> m_scene = nullptr;
     std::shared_ptr<Camera> m_camera = nullptr;
     std::shared_ptr<CameraBuffer> m_cameraBuffer = nullptr;
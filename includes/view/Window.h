@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 
+#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
@@ -16,6 +17,7 @@ public:
     Signal<int, int, int, int> keyChanged;
     Signal<int, int> sizeChanged;
     Signal<> closeRequested;
+    Signal<bool> focusChanged;
 
     Window(unsigned int width, unsigned int height, const char* name, std::shared_ptr<Window> share = NULL);
     ~Window();
@@ -45,6 +47,7 @@ public:
     virtual void OnKeyChanged(int key, int scancode, int action, int mods);
     virtual void OnWindowResized(int width, int height);
     virtual void OnCloseRequested();
+    virtual void OnFocusChanged(bool focused);
 
 protected:
     GLFWwindow* window;
@@ -0,0 +1,9 @@
+#version 330 core
+uniform vec4 colour;
+
+out vec4 FragColor;
+
+
+void main() {
+    FragColor = colour;
+}
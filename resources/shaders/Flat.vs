@@ -0,0 +1,15 @@
+#version 420 core
+layout (location = 0) in vec2 aPos;
+layout(std140, binding=0) uniform Camera
+{
+    mat4 projection;
+    mat4 projectionInv;
+    mat4 view;
+    mat4 viewInv;
+} camera;
+
+
+void main()
+{
+    gl_Position = camera.projection * camera.view * vec4(aPos, 0.0, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// Visible areas are drawn into the mask, everything else is covered
+uniform sampler2D mask;
+uniform vec4 colour;
+
+in vec3 outPos;
+
+out vec4 FragColor;
+
+
+void main() {
+    float visible = texelFetch(mask, ivec2(gl_FragCoord.xy), 0).r;
+    FragColor = vec4(colour.rgb, colour.a * (1.0 - visible));
+}
@@ -0,0 +1,562 @@
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <MappedFile.h>
+#include <Resources.h>
+#include <glutil/Camera.h>
+#include <glutil/Matrix2D.h>
+#include <glutil/TransformStore.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Grid.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Walls.h>
+
+#include <BinarySerializer.h>
+
+
+static const char MAGIC[4] = {'B', 'M', 'S', 'B'};
+// Written natively, reads back differently on a machine with the other byte order
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const size_t ALIGNMENT = 8;
+
+enum SectionType : uint32_t
+{
+    STRINGS = 1,
+    SETTINGS = 2,
+    CAMERAS = 3,
+    VIEWS = 4,
+    IMAGES = 5,
+    TOKENS = 6,
+    // Images then tokens, as three arrays: vec2 pos[], vec2 scale[], float rot[]
+    TRANSFORMS = 7,
+    FOG = 8,
+    WALLS = 9,
+    // Only for the images that have one
+    HEIGHTMAPS = 10
+};
+
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t numSections;
+};
+
+struct SectionEntry
+{
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// String table: StringRef[count] followed by the characters, offsets are from
+// the end of the refs
+struct StringRef
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct SettingsRecord
+{
+    float gridScale;
+    uint8_t imagesLocked;
+    uint8_t tokensLocked;
+    uint8_t padding[2];
+};
+
+struct CameraRecord
+{
+    float pos[3];
+    float focal;
+    uint32_t name;
+};
+
+struct ViewRecord
+{
+    uint32_t id;
+    uint32_t camera;
+};
+
+struct ImageRecord
+{
+    uint64_t id;
+    uint32_t texture;
+    uint8_t visible;
+    uint8_t lockRatio;
+    uint8_t padding[2];
+};
+
+struct TokenRecord
+{
+    uint64_t id;
+    uint64_t statuses;
+    float borderColour[4];
+    float borderWidth;
+    float opacity;
+    uint32_t name;
+    uint32_t texture;
+    uint8_t xstatus;
+    // Zero in files written before names could be hidden
+    uint8_t hideName;
+    uint8_t padding[2];
+    // Zero in files written before tokens had heights
+    float height;
+};
+
+struct FogRecord
+{
+    float range;
+    uint8_t enabled;
+    uint8_t padding[3];
+};
+
+struct WallRecord
+{
+    uint64_t id;
+    float start[2];
+    float end[2];
+};
+
+struct HeightmapRecord
+{
+    uint32_t image;
+    uint32_t texture;
+    float heightScale;
+    uint32_t padding;
+};
+
+static_assert(sizeof(FileHeader) == 16, "FileHeader must be packed");
+static_assert(sizeof(SectionEntry) == 24, "SectionEntry must be packed");
+static_assert(sizeof(StringRef) == 8, "StringRef must be packed");
+static_assert(sizeof(SettingsRecord) == 8, "SettingsRecord must be packed");
+static_assert(sizeof(CameraRecord) == 20, "CameraRecord must be packed");
+static_assert(sizeof(ViewRecord) == 8, "ViewRecord must be packed");
+static_assert(sizeof(ImageRecord) == 16, "ImageRecord must be packed");
+static_assert(sizeof(TokenRecord) == 56, "TokenRecord must be packed");
+static_assert(sizeof(FogRecord) == 8, "FogRecord must be packed");
+static_assert(sizeof(WallRecord) == 24, "WallRecord must be packed");
+static_assert(sizeof(HeightmapRecord) == 16, "HeightmapRecord must be packed");
+static_assert(sizeof(glm::vec2) == 2 * sizeof(float), "Transforms are read in place as glm::vec2");
+static_assert(NUM_TOKEN_STATUSES <= 64, "Statuses are stored as a 64 bit mask");
+
+
+bool BinarySerializer::IsBinaryPath(const std::string& path)
+{
+    size_t size = std::strlen(EXTENSION);
+    return path.size() >= size && path.compare(path.size() - size, size, EXTENSION) == 0;
+}
+
+BinarySerializer::BinarySerializer(std::shared_ptr<Resources> resources) : m_resources(resources) {}
+
+// Encoding
+namespace
+{
+    class StringTable
+    {
+    public:
+        uint32_t Intern(const std::string& text)
+        {
+            auto it = m_indices.find(text);
+            if (it != m_indices.end())
+                return it->second;
+            uint32_t index = m_refs.size();
+            m_refs.push_back({(uint32_t)m_chars.size(), (uint32_t)text.size()});
+            m_chars += text;
+            m_indices.emplace(text, index);
+            return index;
+        }
+
+        uint32_t Count() const { return m_refs.size(); }
+        std::string Data() const
+        {
+            std::string data(reinterpret_cast<const char*>(m_refs.data()), m_refs.size() * sizeof(StringRef));
+            return data + m_chars;
+        }
+
+    private:
+        std::unordered_map<std::string, uint32_t> m_indices;
+        std::vector<StringRef> m_refs;
+        std::string m_chars;
+    };
+
+    class SectionWriter
+    {
+    public:
+        SectionWriter(std::string& out, uint32_t numSections) : m_out(out), m_numSections(numSections)
+        {
+            FileHeader header;
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = BinarySerializer::VERSION;
+            header.byteOrder = BYTE_ORDER_MARK;
+            header.numSections = numSections;
+            m_out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            // Table is filled in as sections are added
+            m_out.append(numSections * sizeof(SectionEntry), '\0');
+        }
+
+        void Add(SectionType type, uint32_t count, const void* data, size_t size)
+        {
+            m_out.append((ALIGNMENT - m_out.size() % ALIGNMENT) % ALIGNMENT, '\0');
+            SectionEntry entry{type, count, m_out.size(), size};
+            std::memcpy(&m_out[sizeof(FileHeader) + m_numAdded++ * sizeof(SectionEntry)], &entry, sizeof(entry));
+            m_out.append(static_cast<const char*>(data), size);
+        }
+
+        template <typename T>
+        void Add(SectionType type, const std::vector<T>& records)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Records are copied as bytes");
+            Add(type, records.size(), records.data(), records.size() * sizeof(T));
+        }
+
+    private:
+        std::string& m_out;
+        uint32_t m_numSections;
+        uint32_t m_numAdded = 0;
+    };
+}
+
+std::string BinarySerializer::Encode(const std::shared_ptr<Scene>& scene)
+{
+    StringTable strings;
+
+    SettingsRecord settings{};
+    settings.gridScale = scene->grid->GetScale();
+    settings.imagesLocked = scene->GetImagesLocked();
+    settings.tokensLocked = scene->GetTokensLocked();
+
+    std::vector<CameraRecord> cameras;
+    cameras.reserve(scene->cameras.size());
+    for (const auto& camera: scene->cameras)
+    {
+        CameraRecord record{};
+        record.pos[0] = camera->Position.x;
+        record.pos[1] = camera->Position.y;
+        record.pos[2] = camera->Position.z;
+        record.focal = camera->Focal;
+        record.name = strings.Intern(camera->GetName());
+        cameras.push_back(record);
+    }
+
+    std::vector<ViewRecord> views;
+    for (const auto& pair: scene->views)
+    {
+        if (pair.second == nullptr)
+            continue;
+        auto it = std::find(scene->cameras.begin(), scene->cameras.end(), pair.second);
+        views.push_back({pair.first, uint32_t(it - scene->cameras.begin())});
+    }
+
+    size_t numTransforms = scene->images.size() + scene->tokens.size();
+    std::vector<glm::vec2> positions, scales;
+    std::vector<float> rotations;
+    positions.reserve(numTransforms);
+    scales.reserve(numTransforms);
+    rotations.reserve(numTransforms);
+    auto addTransform = [&](const std::shared_ptr<Matrix2D>& model)
+    {
+        positions.push_back(model->GetPos());
+        scales.push_back(model->GetScale());
+        rotations.push_back(model->GetRotation());
+    };
+
+    std::vector<ImageRecord> images;
+    std::vector<HeightmapRecord> heightmaps;
+    images.reserve(scene->images.size());
+    for (const auto& image: scene->images)
+    {
+        if (image->GetHeightmap())
+        {
+            HeightmapRecord heightmap{};
+            heightmap.image = images.size();
+            heightmap.texture = strings.Intern(image->GetHeightmap()->filename);
+            heightmap.heightScale = image->GetHeightScale();
+            heightmaps.push_back(heightmap);
+        }
+        ImageRecord record{};
+        record.id = image->GetID();
+        record.texture = strings.Intern(image->GetImage()->filename);
+        record.visible = image->IsVisible();
+        record.lockRatio = image->GetLockRatio();
+        images.push_back(record);
+        addTransform(image->GetModel());
+    }
+
+    std::vector<TokenRecord> tokens;
+    tokens.reserve(scene->tokens.size());
+    for (const auto& token: scene->tokens)
+    {
+        glm::vec4 borderColour = token->GetBorderColor();
+        TokenRecord record{};
+        record.id = token->GetID();
+        record.statuses = token->GetStatuses().to_ullong();
+        record.borderColour[0] = borderColour.x;
+        record.borderColour[1] = borderColour.y;
+        record.borderColour[2] = borderColour.z;
+        record.borderColour[3] = borderColour.w;
+        record.borderWidth = token->GetBorderWidth();
+        record.opacity = token->GetOpacity();
+        record.name = strings.Intern(token->GetName());
+        record.texture = strings.Intern(token->GetIcon()->filename);
+        record.xstatus = token->GetXStatus();
+        record.hideName = token->IsNameHidden();
+        record.height = token->GetHeight();
+        tokens.push_back(record);
+        addTransform(token->GetModel());
+    }
+
+    FogRecord fog{};
+    fog.range = scene->fog->GetRange();
+    fog.enabled = scene->fog->IsEnabled();
+
+    std::vector<WallRecord> walls;
+    walls.reserve(scene->fog->walls.Size());
+    for (const Wall& wall: scene->fog->walls.All())
+        walls.push_back({wall.id, {wall.start.x, wall.start.y}, {wall.end.x, wall.end.y}});
+
+    std::string transforms;
+    transforms.reserve(numTransforms * (2 * sizeof(glm::vec2) + sizeof(float)));
+    transforms.append(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(glm::vec2));
+    transforms.append(reinterpret_cast<const char*>(scales.data()), scales.size() * sizeof(glm::vec2));
+    transforms.append(reinterpret_cast<const char*>(rotations.data()), rotations.size() * sizeof(float));
+
+    std::string out;
+    std::string stringData = strings.Data();
+    out.reserve(1024 + stringData.size() + transforms.size() +
+                images.size() * sizeof(ImageRecord) + tokens.size() * sizeof(TokenRecord) +
+                walls.size() * sizeof(WallRecord));
+    SectionWriter writer(out, 10);
+    writer.Add(STRINGS, strings.Count(), stringData.data(), stringData.size());
+    writer.Add(SETTINGS, 1, &settings, sizeof(settings));
+    writer.Add(CAMERAS, cameras);
+    writer.Add(VIEWS, views);
+    writer.Add(IMAGES, images);
+    writer.Add(TOKENS, tokens);
+    writer.Add(TRANSFORMS, numTransforms, transforms.data(), transforms.size());
+    writer.Add(FOG, 1, &fog, sizeof(fog));
+    writer.Add(WALLS, walls);
+    writer.Add(HEIGHTMAPS, heightmaps);
+    return out;
+}
+
+// Decoding
+namespace
+{
+    struct Section
+    {
+        const char* data = nullptr;
+        uint32_t count = 0;
+        uint64_t size = 0;
+
+        template <typename T>
+        const T* Records() const { return reinterpret_cast<const T*>(data); }
+        template <typename T>
+        bool Holds() const { return size >= uint64_t(count) * sizeof(T); }
+    };
+}
+
+bool BinarySerializer::Decode(const char* data, size_t size, Scene& scene)
+{
+    auto fail = [](const char* reason)
+    {
+        std::cerr << "Unable to read binary scene: " << reason << std::endl;
+        return false;
+    };
+
+    if (reinterpret_cast<uintptr_t>(data) % ALIGNMENT != 0)
+        return fail("data is misaligned");
+    if (size < sizeof(FileHeader))
+        return fail("file is truncated");
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(data);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+        return fail("not a binary scene");
+    if (header->byteOrder != BYTE_ORDER_MARK)
+        return fail("written with a different byte order");
+    if (header->version > VERSION)
+        return fail("written by a newer version");
+    if (size < sizeof(FileHeader) + uint64_t(header->numSections) * sizeof(SectionEntry))
+        return fail("file is truncated");
+
+    // Unknown sections are skipped so later versions can add to the file
+    Section strings, settings, cameras, views, images, tokens, transforms, fog, walls, heightmaps;
+    const SectionEntry* entries = reinterpret_cast<const SectionEntry*>(data + sizeof(FileHeader));
+    for (uint32_t i = 0; i < header->numSections; i++)
+    {
+        const SectionEntry& entry = entries[i];
+        if (entry.offset % ALIGNMENT != 0 || entry.offset > size || entry.size > size - entry.offset)
+            return fail("section is out of bounds");
+        Section section{data + entry.offset, entry.count, entry.size};
+        switch (entry.type)
+        {
+            case STRINGS: strings = section; break;
+            case SETTINGS: settings = section; break;
+            case CAMERAS: cameras = section; break;
+            case VIEWS: views = section; break;
+            case IMAGES: images = section; break;
+            case TOKENS: tokens = section; break;
+            case TRANSFORMS: transforms = section; break;
+            case FOG: fog = section; break;
+            case WALLS: walls = section; break;
+            case HEIGHTMAPS: heightmaps = section; break;
+        }
+    }
+
+    // Validate everything before touching the scene
+    if (!strings.Holds<StringRef>() || !settings.Holds<SettingsRecord>() || !cameras.Holds<CameraRecord>() ||
+        !views.Holds<ViewRecord>() || !images.Holds<ImageRecord>() || !tokens.Holds<TokenRecord>() ||
+        !fog.Holds<FogRecord>() || !walls.Holds<WallRecord>() || !heightmaps.Holds<HeightmapRecord>())
+        return fail("section is truncated");
+    uint64_t numTransforms = uint64_t(images.count) + tokens.count;
+    if (transforms.count != numTransforms || transforms.size < numTransforms * (2 * sizeof(glm::vec2) + sizeof(float)))
+        return fail("transforms don't match the shapes");
+
+    const StringRef* refs = strings.Records<StringRef>();
+    const char* chars = strings.data + strings.count * sizeof(StringRef);
+    uint64_t charsSize = strings.size - strings.count * sizeof(StringRef);
+    for (uint32_t i = 0; i < strings.count; i++)
+        if (refs[i].offset > charsSize || refs[i].size > charsSize - refs[i].offset)
+            return fail("string is out of bounds");
+    auto validString = [&strings](uint32_t index) { return index < strings.count; };
+
+    for (uint32_t i = 0; i < cameras.count; i++)
+        if (!validString(cameras.Records<CameraRecord>()[i].name))
+            return fail("camera name is out of bounds");
+    for (uint32_t i = 0; i < views.count; i++)
+        if (views.Records<ViewRecord>()[i].camera >= cameras.count)
+            return fail("view camera is out of bounds");
+    for (uint32_t i = 0; i < images.count; i++)
+        if (!validString(images.Records<ImageRecord>()[i].texture))
+            return fail("image texture is out of bounds");
+    for (uint32_t i = 0; i < tokens.count; i++)
+    {
+        const TokenRecord& record = tokens.Records<TokenRecord>()[i];
+        if (!validString(record.name) || !validString(record.texture))
+            return fail("token string is out of bounds");
+    }
+    for (uint32_t i = 0; i < heightmaps.count; i++)
+    {
+        const HeightmapRecord& record = heightmaps.Records<HeightmapRecord>()[i];
+        if (record.image >= images.count || !validString(record.texture))
+            return fail("heightmap is out of bounds");
+    }
+
+    // Build
+    auto getString = [refs, chars](uint32_t index) { return std::string(chars + refs[index].offset, refs[index].size); };
+    // Each path is looked up once however many shapes use it
+    std::vector<std::shared_ptr<Texture>> textures(strings.count);
+    auto getTexture = [&](uint32_t index) -> const std::shared_ptr<Texture>&
+    {
+        if (!textures[index])
+            textures[index] = m_resources->GetTexture(getString(index));
+        return textures[index];
+    };
+
+    if (settings.count > 0)
+    {
+        const SettingsRecord& record = *settings.Records<SettingsRecord>();
+        scene.grid = std::make_shared<Grid>();
+        scene.grid->SetScale(record.gridScale);
+        scene.SetImagesLocked(record.imagesLocked);
+        scene.SetTokensLocked(record.tokensLocked);
+    }
+
+    // Files written before fog of war have neither section
+    if (fog.count > 0)
+    {
+        const FogRecord& record = *fog.Records<FogRecord>();
+        scene.fog->SetEnabled(record.enabled);
+        scene.fog->SetRange(record.range);
+    }
+    for (uint32_t i = 0; i < walls.count; i++)
+    {
+        const WallRecord& record = walls.Records<WallRecord>()[i];
+        scene.fog->walls.Add({record.id, glm::vec2(record.start[0], record.start[1]), glm::vec2(record.end[0], record.end[1])});
+    }
+
+    size_t firstCamera = scene.cameras.size();
+    for (uint32_t i = 0; i < cameras.count; i++)
+    {
+        const CameraRecord& record = cameras.Records<CameraRecord>()[i];
+        auto camera = std::make_shared<Camera>(
+            glm::vec3(record.pos[0], record.pos[1], record.pos[2]), glm::vec3(0.0f, 0.0f, -1.0f), true, record.focal);
+        camera->SetName(getString(record.name));
+        scene.cameras.push_back(camera);
+    }
+    for (uint32_t i = 0; i < views.count; i++)
+    {
+        const ViewRecord& record = views.Records<ViewRecord>()[i];
+        scene.SetViewCamera(record.id, scene.cameras[firstCamera + record.camera]);
+    }
+
+    // Transforms go straight into the store
+    const glm::vec2* positions = reinterpret_cast<const glm::vec2*>(transforms.data);
+    const glm::vec2* scales = positions + numTransforms;
+    const float* rotations = reinterpret_cast<const float*>(scales + numTransforms);
+    std::vector<TransformHandle> handles(numTransforms);
+    TransformStore::Global().AllocateRange(numTransforms, positions, scales, rotations, handles.data());
+    size_t handle = 0;
+
+    std::vector<std::shared_ptr<BGImage>> newImages;
+    newImages.reserve(images.count);
+    for (uint32_t i = 0; i < images.count; i++)
+    {
+        const ImageRecord& record = images.Records<ImageRecord>()[i];
+        auto image = std::make_shared<BGImage>(getTexture(record.texture), std::make_shared<Matrix2D>(handles[handle++]));
+        image->SetID(record.id);
+        image->SetLockRatio(record.lockRatio);
+        image->SetVisible(record.visible);
+        newImages.push_back(image);
+    }
+    for (uint32_t i = 0; i < heightmaps.count; i++)
+    {
+        const HeightmapRecord& record = heightmaps.Records<HeightmapRecord>()[i];
+        newImages[record.image]->SetHeightmap(getTexture(record.texture));
+        newImages[record.image]->SetHeightScale(record.heightScale);
+    }
+    scene.AddImages(newImages);
+
+    std::vector<std::shared_ptr<Token>> newTokens;
+    newTokens.reserve(tokens.count);
+    for (uint32_t i = 0; i < tokens.count; i++)
+    {
+        const TokenRecord& record = tokens.Records<TokenRecord>()[i];
+        auto token = std::make_shared<Token>(getTexture(record.texture), getString(record.name), std::make_shared<Matrix2D>(handles[handle++]));
+        token->SetID(record.id);
+        token->SetBorderWidth(record.borderWidth);
+        token->SetBorderColor(glm::vec4(record.borderColour[0], record.borderColour[1], record.borderColour[2], record.borderColour[3]));
+        token->SetStatuses(TokenStatuses(record.statuses));
+        token->SetOpacity(record.opacity);
+        token->SetXStatus(record.xstatus);
+        token->SetNameHidden(record.hideName);
+        token->SetHeight(record.height);
+        newTokens.push_back(token);
+    }
+    scene.AddTokens(newTokens);
+    return true;
+}
+
+bool BinarySerializer::Read(const std::string& path, Scene& scene)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+    if (!file)
+        return false;
+    // Pages are read once front to back
+    madvise(const_cast<char*>(file->Data()), file->Size(), MADV_SEQUENTIAL);
+    return Decode(file->Data(), file->Size(), scene);
+}
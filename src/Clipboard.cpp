@@ -0,0 +1,69 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include <Clipboard.h>
+
+
+std::shared_ptr<Scene> Clipboard::Clone(const std::shared_ptr<Resources>& resources,
+                                        const std::vector<std::shared_ptr<Token>>& tokens,
+                                        const std::vector<std::shared_ptr<BGImage>>& images)
+{
+    auto scene = std::make_shared<Scene>(resources);
+    // Copies keep their originals' IDs, which the clones mustn't share once
+    // merged back into the same scene
+    scene->tokens.reserve(tokens.size());
+    for (const auto& token: tokens)
+    {
+        auto clone = std::make_shared<Token>(*token);
+        clone->SetID(NewShapeID());
+        scene->AddToken(clone);
+    }
+    scene->images.reserve(images.size());
+    for (const auto& image: images)
+    {
+        auto clone = std::make_shared<BGImage>(*image);
+        clone->SetID(NewShapeID());
+        scene->AddImage(clone);
+    }
+    return scene;
+}
+
+void Clipboard::Copy(const std::vector<std::shared_ptr<Token>>& tokens, const std::vector<std::shared_ptr<BGImage>>& images)
+{
+    m_tokens.clear();
+    m_tokens.reserve(tokens.size());
+    for (const auto& token: tokens)
+        m_tokens.push_back(std::make_shared<Token>(*token));
+    m_images.clear();
+    m_images.reserve(images.size());
+    for (const auto& image: images)
+        m_images.push_back(std::make_shared<BGImage>(*image));
+
+    m_text.clear();
+    m_hasText = false;
+    m_exported = false;
+}
+
+bool Clipboard::IsEmpty() const { return m_tokens.empty() && m_images.empty(); }
+
+std::shared_ptr<Scene> Clipboard::Paste(const std::shared_ptr<Resources>& resources) const
+{
+    return Clone(resources, m_tokens, m_images);
+}
+
+const std::string& Clipboard::Text(const std::shared_ptr<Resources>& resources)
+{
+    if (!m_hasText)
+    {
+        m_text = m_serializer.WriteScene(Paste(resources), SerializeFlag::Image | SerializeFlag::Token);
+        m_hasText = true;
+    }
+    return m_text;
+}
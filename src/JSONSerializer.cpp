@@ -1,17 +1,24 @@
 #include <algorithm>
+#include <iostream>
+#include <istream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <json.hpp>
 
+#include <JSONWriter.h>
 #include <Resources.h>
+#include <SceneReader.h>
 #include <glutil/Camera.h>
 #include <glutil/Matrix2D.h>
 #include <model/BGImage.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Overlays.h>
 #include <model/Scene.h>
 #include <model/Token.h>
+#include <model/Walls.h>
 
 #include <JSONSerializer.h>
 
@@ -35,6 +42,20 @@ std::shared_ptr<Camera> JSONSerializer::DeserializeCamera(nlohmann::json &json)
     return camera;
 }
 
+// Fog
+bool JSONSerializer::SerializeFog(const std::shared_ptr<FogOfWar> &fog, nlohmann::json &json)
+{
+    json["enabled"] = fog->IsEnabled();
+    json["range"] = fog->GetRange();
+    return true;
+}
+
+void JSONSerializer::DeserializeFog(nlohmann::json &json, FogOfWar &fog)
+{
+    fog.SetEnabled(json["enabled"]);
+    fog.SetRange(json["range"]);
+}
+
 // Grid
 bool JSONSerializer::SerializeGrid(const std::shared_ptr<Grid> &grid, nlohmann::json &json)
 {
@@ -44,9 +65,7 @@ bool JSONSerializer::SerializeGrid(const std::shared_ptr<Grid> &grid, nlohmann::
 
 std::shared_ptr<Grid> JSONSerializer::DeserializeGrid(nlohmann::json &json)
 {
-    std::shared_ptr<Grid> grid = std::make_shared<Grid>(
-        m_resources->GetMesh(Resources::MeshType::Quad2),
-        m_resources->GetShader(Resources::ShaderType::Grid));
+    std::shared_ptr<Grid> grid = std::make_shared<Grid>();
     grid->SetScale(json["scale"]);
     return grid;
 }
@@ -54,34 +73,42 @@ std::shared_ptr<Grid> JSONSerializer::DeserializeGrid(nlohmann::json &json)
 // Image
 bool JSONSerializer::SerializeImage(const std::shared_ptr<BGImage> &image, nlohmann::json &json)
 {
+    json["id"] = image->GetID();
     json["visible"] = image->IsVisible();
     json["texture"] = image->GetImage()->filename;
     nlohmann::json matrix;
     SerializeMatrix2D(image->GetModel(), matrix);
     json["matrix2D"] = matrix;
     json["lockRatio"] = image->GetLockRatio();
+    if (image->GetHeightmap())
+    {
+        json["heightmap"] = image->GetHeightmap()->filename;
+        json["heightScale"] = image->GetHeightScale();
+    }
     return true;
 }
 
-nlohmann::json JSONSerializer::SerializeImages(const std::vector<std::shared_ptr<BGImage>> &images, bool selectedOnly)
+nlohmann::json JSONSerializer::SerializeImages(const std::vector<std::shared_ptr<BGImage>> &images, const Selection* selection)
 {
     nlohmann::json jimages = nlohmann::json::array();
     unsigned int i = 0;
-    std::for_each(images.begin(), images.end(),
-                  [this, &i, &jimages, &selectedOnly](const std::shared_ptr<BGImage> image)
-                  {
-                      if (image->isSelected || !selectedOnly)
-                          SerializeImage(image, jimages[i++]);
-                  });
+    if (selection)
+        selection->ForEachIndex([this, &i, &jimages, &images](size_t index)
+                                { SerializeImage(images[index], jimages[i++]); });
+    else
+        std::for_each(images.begin(), images.end(),
+                      [this, &i, &jimages](const std::shared_ptr<BGImage> image)
+                      { SerializeImage(image, jimages[i++]); });
     return jimages;
 }
 
 std::shared_ptr<BGImage> JSONSerializer::DeserializeImage(nlohmann::json &json)
 {
-    std::shared_ptr<BGImage> image = std::make_shared<BGImage>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(std::string(json["texture"])));
-    image->SetModel(DeserializeMatrix2D(json["matrix2D"]));
+    std::shared_ptr<BGImage> image = std::make_shared<BGImage>(m_resources->GetTexture(std::string(json["texture"])),
+                                                               DeserializeMatrix2D(json["matrix2D"]));
+    // Older scenes have no IDs, keep the generated one
+    if (json.contains("id"))
+        image->SetID(json["id"]);
     if (json.contains("lockRatio"))
     {
         image->SetLockRatio(json["lockRatio"]);
@@ -90,6 +117,11 @@ std::shared_ptr<BGImage> JSONSerializer::DeserializeImage(nlohmann::json &json)
     {
         image->SetVisible(json["visible"]);
     }
+    if (json.contains("heightmap"))
+    {
+        image->SetHeightmap(m_resources->GetTexture(std::string(json["heightmap"])));
+        image->SetHeightScale(json["heightScale"]);
+    }
     return image;
 }
 
@@ -113,6 +145,7 @@ std::shared_ptr<Matrix2D> JSONSerializer::DeserializeMatrix2D(nlohmann::json &js
 // Token
 bool JSONSerializer::SerializeToken(const std::shared_ptr<Token> &token, nlohmann::json &json)
 {
+    json["id"] = token->GetID();
     nlohmann::json matrix;
     SerializeMatrix2D(token->GetModel(), matrix);
     json["matrix2D"] = matrix;
@@ -123,30 +156,34 @@ bool JSONSerializer::SerializeToken(const std::shared_ptr<Token> &token, nlohman
     json["statuses"] = token->GetStatuses().to_string();
     json["xstatus"] = token->GetXStatus();
     json["opacity"] = token->GetOpacity();
+    json["hideName"] = token->IsNameHidden();
+    json["height"] = token->GetHeight();
 
     return true;
 }
 
-nlohmann::json JSONSerializer::SerializeTokens(const std::vector<std::shared_ptr<Token>> &tokens, bool selectedOnly)
+nlohmann::json JSONSerializer::SerializeTokens(const std::vector<std::shared_ptr<Token>> &tokens, const Selection* selection)
 {
     nlohmann::json jtokens = nlohmann::json::array();
     uint i = 0;
-    std::for_each(tokens.begin(), tokens.end(),
-                  [this, &i, &jtokens, &selectedOnly](const std::shared_ptr<Token> token)
-                  {
-                      if (token->isSelected || !selectedOnly)
-                          SerializeToken(token, jtokens[i++]);
-                  });
+    if (selection)
+        selection->ForEachIndex([this, &i, &jtokens, &tokens](size_t index)
+                                { SerializeToken(tokens[index], jtokens[i++]); });
+    else
+        std::for_each(tokens.begin(), tokens.end(),
+                      [this, &i, &jtokens](const std::shared_ptr<Token> token)
+                      { SerializeToken(token, jtokens[i++]); });
     return jtokens;
 }
 
 std::shared_ptr<Token> JSONSerializer::DeserializeToken(nlohmann::json &json)
 {
     std::shared_ptr<Token> token = std::make_shared<Token>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
         m_resources->GetTexture(std::string(json["texture"])),
-        json["name"]);
-    token->SetModel(DeserializeMatrix2D(json["matrix2D"]));
+        json["name"],
+        DeserializeMatrix2D(json["matrix2D"]));
+    if (json.contains("id"))
+        token->SetID(json["id"]);
     token->SetBorderWidth(json["borderWidth"]);
     token->SetBorderColor(glm::vec4(
         json["borderColour"][0], json["borderColour"][1], json["borderColour"][2], json["borderColour"][3]));
@@ -158,9 +195,38 @@ std::shared_ptr<Token> JSONSerializer::DeserializeToken(nlohmann::json &json)
         token->SetOpacity(json["opacity"]);
         token->SetXStatus(json["xstatus"]);
     }
+    if (json.contains("hideName"))
+        token->SetNameHidden(json["hideName"]);
+    if (json.contains("height"))
+        token->SetHeight(json["height"]);
     return token;
 }
 
+// Walls
+nlohmann::json JSONSerializer::SerializeWalls(const Walls &walls)
+{
+    nlohmann::json jwalls = nlohmann::json::array();
+    for (const Wall &wall : walls.All())
+    {
+        jwalls.push_back({{"end", {wall.end.x, wall.end.y}},
+                          {"id", wall.id},
+                          {"start", {wall.start.x, wall.start.y}}});
+    }
+    return jwalls;
+}
+
+void JSONSerializer::DeserializeWalls(nlohmann::json &json, Walls &walls)
+{
+    walls.Clear();
+    for (nlohmann::json &jwall : json)
+    {
+        Wall wall{jwall["id"],
+                  glm::vec2(jwall["start"][0], jwall["start"][1]),
+                  glm::vec2(jwall["end"][0], jwall["end"][1])};
+        walls.Add(wall);
+    }
+}
+
 // Scene
 bool JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scene, nlohmann::json &json)
 {
@@ -193,6 +259,11 @@ bool JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scene, nlohman
     SerializeGrid(scene->grid, jgrid);
     json["grid"] = jgrid;
 
+    nlohmann::json jfog;
+    SerializeFog(scene->fog, jfog);
+    json["fog"] = jfog;
+    json["walls"] = SerializeWalls(scene->fog->walls);
+
     return true;
 }
 
@@ -220,13 +291,18 @@ void JSONSerializer::DeserializeScene(nlohmann::json &json, Scene &scene)
     if (json.contains("grid"))
         scene.grid = DeserializeGrid(json["grid"]);
 
+    if (json.contains("fog"))
+        DeserializeFog(json["fog"], *scene.fog);
+    if (json.contains("walls"))
+        DeserializeWalls(json["walls"], scene.fog->walls);
+
     if (json.contains("images"))
     {
         nlohmann::json jimages = json["images"];
         scene.images.reserve(jimages.size());
         std::for_each(jimages.begin(), jimages.end(),
                       [this, &scene](nlohmann::json &jimage)
-                      { scene.images.push_back(DeserializeImage(jimage)); });
+                      { scene.AddImage(DeserializeImage(jimage)); });
     }
     if (json.contains("imagesLocked"))
         scene.SetImagesLocked(json["imagesLocked"]);
@@ -237,7 +313,7 @@ void JSONSerializer::DeserializeScene(nlohmann::json &json, Scene &scene)
         scene.tokens.reserve(jtokens.size());
         std::for_each(jtokens.begin(), jtokens.end(),
                       [this, &scene](nlohmann::json &jtoken)
-                      { scene.tokens.push_back(DeserializeToken(jtoken)); });
+                      { scene.AddToken(DeserializeToken(jtoken)); });
     }
     if (json.contains("tokensLocked"))
         scene.SetTokensLocked(json["tokensLocked"]);
@@ -266,16 +342,17 @@ nlohmann::json JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scen
 nlohmann::json JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scene, SerializeFlag flags)
 {
     nlohmann::json json;
+    bool selectedOnly = bool(flags & SerializeFlag::Selected) && !bool(flags & SerializeFlag::All);
     if (bool(flags & SerializeFlag::Token) || bool(flags & SerializeFlag::All))
     {
-        auto serialized = SerializeTokens(scene->tokens, bool(flags & SerializeFlag::Selected) && !bool(flags & SerializeFlag::All));
+        auto serialized = SerializeTokens(scene->tokens, selectedOnly ? &scene->GetTokenSelection() : nullptr);
         if (!serialized.empty())
             json["tokens"] = serialized;
     }
 
     if (bool(flags & SerializeFlag::Image) || bool(flags & SerializeFlag::All))
     {
-        auto serialized = SerializeImages(scene->images, bool(flags & SerializeFlag::Selected) && !bool(flags & SerializeFlag::All));
+        auto serialized = SerializeImages(scene->images, selectedOnly ? &scene->GetImageSelection() : nullptr);
         if (!serialized.empty())
             json["images"] = serialized;
     }
@@ -297,6 +374,16 @@ nlohmann::json JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scen
         json["grid"] = jgrid;
     }
 
+    if (bool(flags & SerializeFlag::Fog) || bool(flags & SerializeFlag::All))
+    {
+        nlohmann::json jfog;
+        SerializeFog(scene->fog, jfog);
+        json["fog"] = jfog;
+    }
+
+    if (bool(flags & SerializeFlag::Walls) || bool(flags & SerializeFlag::All))
+        json["walls"] = SerializeWalls(scene->fog->walls);
+
     if (bool(flags & SerializeFlag::View) || bool(flags & SerializeFlag::All))
     {
         nlohmann::json jviews = nlohmann::json::array();
@@ -314,3 +401,310 @@ nlohmann::json JSONSerializer::SerializeScene(const std::shared_ptr<Scene> &scen
 
     return json;
 }
+
+// Streaming writer. Keys are written in the sorted order nlohmann::json stores
+// them in, so the text is identical to dumping the document.
+void JSONSerializer::WriteCamera(JSONWriter& writer, const std::shared_ptr<Camera>& camera)
+{
+    writer.StartObject();
+    writer.Key("focal");
+    writer.Float(camera->Focal);
+    writer.Key("name");
+    writer.String(camera->GetName());
+    writer.Key("pos");
+    writer.StartArray();
+    writer.Float(camera->Position.x);
+    writer.Float(camera->Position.y);
+    writer.Float(camera->Position.z);
+    writer.EndArray();
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteCameras(JSONWriter& writer, const std::shared_ptr<Scene>& scene)
+{
+    writer.StartArray();
+    for (const auto& camera: scene->cameras)
+        WriteCamera(writer, camera);
+    writer.EndArray();
+}
+
+void JSONSerializer::WriteFog(JSONWriter& writer, const std::shared_ptr<FogOfWar>& fog)
+{
+    writer.StartObject();
+    writer.Key("enabled");
+    writer.Bool(fog->IsEnabled());
+    writer.Key("range");
+    writer.Float(fog->GetRange());
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteGrid(JSONWriter& writer, const std::shared_ptr<Grid>& grid)
+{
+    writer.StartObject();
+    writer.Key("scale");
+    writer.Float(grid->GetScale());
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteImage(JSONWriter& writer, const std::shared_ptr<BGImage>& image)
+{
+    writer.StartObject();
+    if (image->GetHeightmap())
+    {
+        writer.Key("heightScale");
+        writer.Float(image->GetHeightScale());
+        writer.Key("heightmap");
+        writer.String(image->GetHeightmap()->filename);
+    }
+    writer.Key("id");
+    writer.UInt(image->GetID());
+    writer.Key("lockRatio");
+    writer.Bool(image->GetLockRatio());
+    writer.Key("matrix2D");
+    WriteMatrix2D(writer, image->GetModel());
+    writer.Key("texture");
+    writer.String(image->GetImage()->filename);
+    writer.Key("visible");
+    writer.Bool(image->IsVisible());
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteMatrix2D(JSONWriter& writer, const std::shared_ptr<Matrix2D>& matrix)
+{
+    glm::vec2 pos = matrix->GetPos();
+    glm::vec2 scale = matrix->GetScale();
+    writer.StartObject();
+    writer.Key("pos");
+    writer.StartArray();
+    writer.Float(pos.x);
+    writer.Float(pos.y);
+    writer.EndArray();
+    writer.Key("rotation");
+    writer.Float(matrix->GetRotation());
+    writer.Key("scale");
+    writer.StartArray();
+    writer.Float(scale.x);
+    writer.Float(scale.y);
+    writer.EndArray();
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteToken(JSONWriter& writer, const std::shared_ptr<Token>& token)
+{
+    glm::vec4 borderColour = token->GetBorderColor();
+    writer.StartObject();
+    writer.Key("borderColour");
+    writer.StartArray();
+    writer.Float(borderColour.x);
+    writer.Float(borderColour.y);
+    writer.Float(borderColour.z);
+    writer.Float(borderColour.w);
+    writer.EndArray();
+    writer.Key("borderWidth");
+    writer.Float(token->GetBorderWidth());
+    writer.Key("height");
+    writer.Float(token->GetHeight());
+    writer.Key("hideName");
+    writer.Bool(token->IsNameHidden());
+    writer.Key("id");
+    writer.UInt(token->GetID());
+    writer.Key("matrix2D");
+    WriteMatrix2D(writer, token->GetModel());
+    writer.Key("name");
+    writer.String(token->GetName());
+    writer.Key("opacity");
+    writer.Float(token->GetOpacity());
+    writer.Key("statuses");
+    writer.String(token->GetStatuses().to_string());
+    writer.Key("texture");
+    writer.String(token->GetIcon()->filename);
+    writer.Key("xstatus");
+    writer.Bool(token->GetXStatus());
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteViews(JSONWriter& writer, const std::shared_ptr<Scene>& scene)
+{
+    writer.StartArray();
+    for (const auto& pair: scene->views)
+    {
+        if (pair.second == nullptr)
+            continue;
+        auto it = std::find(scene->cameras.begin(), scene->cameras.end(), pair.second);
+        writer.StartObject();
+        writer.Key("id");
+        writer.UInt(pair.first);
+        writer.Key("index");
+        writer.Int(it - scene->cameras.begin());
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+void JSONSerializer::WriteWalls(JSONWriter& writer, const Walls& walls)
+{
+    writer.StartArray();
+    for (const Wall& wall: walls.All())
+    {
+        writer.StartObject();
+        writer.Key("end");
+        writer.StartArray();
+        writer.Float(wall.end.x);
+        writer.Float(wall.end.y);
+        writer.EndArray();
+        writer.Key("id");
+        writer.UInt(wall.id);
+        writer.Key("start");
+        writer.StartArray();
+        writer.Float(wall.start.x);
+        writer.Float(wall.start.y);
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+void JSONSerializer::WriteScene(JSONWriter& writer, const std::shared_ptr<Scene>& scene)
+{
+    writer.StartObject();
+    writer.Key("cameras");
+    WriteCameras(writer, scene);
+    writer.Key("fog");
+    WriteFog(writer, scene->fog);
+    writer.Key("grid");
+    WriteGrid(writer, scene->grid);
+    writer.Key("images");
+    writer.StartArray();
+    for (const auto& image: scene->images)
+        WriteImage(writer, image);
+    writer.EndArray();
+    writer.Key("imagesLocked");
+    writer.Bool(scene->GetImagesLocked());
+    writer.Key("tokens");
+    writer.StartArray();
+    for (const auto& token: scene->tokens)
+        WriteToken(writer, token);
+    writer.EndArray();
+    writer.Key("tokensLocked");
+    writer.Bool(scene->GetTokensLocked());
+    writer.Key("views");
+    WriteViews(writer, scene);
+    writer.Key("walls");
+    WriteWalls(writer, scene->fog->walls);
+    writer.EndObject();
+}
+
+void JSONSerializer::WriteScene(JSONWriter& writer, const std::shared_ptr<Scene>& scene, SerializeFlag flags)
+{
+    bool all = bool(flags & SerializeFlag::All);
+    bool selectedOnly = bool(flags & SerializeFlag::Selected) && !all;
+    writer.StartObject();
+    if (bool(flags & SerializeFlag::Camera) || all)
+    {
+        writer.Key("cameras");
+        WriteCameras(writer, scene);
+    }
+
+    if (bool(flags & SerializeFlag::Fog) || all)
+    {
+        writer.Key("fog");
+        WriteFog(writer, scene->fog);
+    }
+
+    if (bool(flags & SerializeFlag::Grid) || all)
+    {
+        writer.Key("grid");
+        WriteGrid(writer, scene->grid);
+    }
+
+    // Empty shape lists are left out
+    if ((bool(flags & SerializeFlag::Image) || all) &&
+        (selectedOnly ? scene->GetImageSelection().Count() : scene->images.size()) > 0)
+    {
+        writer.Key("images");
+        writer.StartArray();
+        if (selectedOnly)
+            scene->GetImageSelection().ForEachIndex([this, &writer, &scene](size_t index)
+                                                    { WriteImage(writer, scene->images[index]); });
+        else
+            for (const auto& image: scene->images)
+                WriteImage(writer, image);
+        writer.EndArray();
+    }
+
+    if ((bool(flags & SerializeFlag::Token) || all) &&
+        (selectedOnly ? scene->GetTokenSelection().Count() : scene->tokens.size()) > 0)
+    {
+        writer.Key("tokens");
+        writer.StartArray();
+        if (selectedOnly)
+            scene->GetTokenSelection().ForEachIndex([this, &writer, &scene](size_t index)
+                                                    { WriteToken(writer, scene->tokens[index]); });
+        else
+            for (const auto& token: scene->tokens)
+                WriteToken(writer, token);
+        writer.EndArray();
+    }
+
+    if (bool(flags & SerializeFlag::View) || all)
+    {
+        writer.Key("views");
+        WriteViews(writer, scene);
+    }
+
+    if (bool(flags & SerializeFlag::Walls) || all)
+    {
+        writer.Key("walls");
+        WriteWalls(writer, scene->fog->walls);
+    }
+    writer.EndObject();
+}
+
+std::string JSONSerializer::WriteScene(const std::shared_ptr<Scene>& scene)
+{
+    std::string text;
+    JSONWriter writer(text);
+    WriteScene(writer, scene);
+    return text;
+}
+
+std::string JSONSerializer::WriteScene(const std::shared_ptr<Scene>& scene, SerializeFlag flags)
+{
+    std::string text;
+    JSONWriter writer(text);
+    WriteScene(writer, scene, flags);
+    return text;
+}
+
+// Streaming reader
+bool JSONSerializer::ReadScene(std::istream& stream, Scene& scene)
+{
+    SceneReader reader(*this, scene);
+    if (!nlohmann::json::sax_parse(stream, &reader))
+    {
+        std::cerr << "Unable to read scene: " << reader.GetError() << std::endl;
+        return false;
+    }
+    reader.Finish();
+    return true;
+}
+
+bool JSONSerializer::ReadScene(const std::string& text, Scene& scene)
+{
+    SceneReader reader(*this, scene);
+    if (!nlohmann::json::sax_parse(text, &reader))
+    {
+        std::cerr << "Unable to read scene: " << reader.GetError() << std::endl;
+        return false;
+    }
+    reader.Finish();
+    return true;
+}
+
+std::shared_ptr<Scene> JSONSerializer::ReadScene(const std::string& text)
+{
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(m_resources);
+    if (!ReadScene(text, *scene))
+        return nullptr;
+    return scene;
+}
@@ -0,0 +1,170 @@
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <json.hpp>
+
+#include <JSONWriter.h>
+
+
+JSONWriter::JSONWriter(std::ostream& stream) : m_stream(&stream), m_buffer(m_ownBuffer)
+{
+    m_buffer.reserve(BUFFER_SIZE + 1024);
+}
+
+JSONWriter::JSONWriter(std::string& text) : m_buffer(text) {}
+
+JSONWriter::~JSONWriter()
+{
+    Flush();
+}
+
+void JSONWriter::StartObject()
+{
+    BeforeValue();
+    m_buffer += '{';
+    m_hasValue.push_back(false);
+}
+
+void JSONWriter::EndObject()
+{
+    m_buffer += '}';
+    m_hasValue.pop_back();
+    FlushIfFull();
+}
+
+void JSONWriter::StartArray()
+{
+    BeforeValue();
+    m_buffer += '[';
+    m_hasValue.push_back(false);
+}
+
+void JSONWriter::EndArray()
+{
+    m_buffer += ']';
+    m_hasValue.pop_back();
+    FlushIfFull();
+}
+
+void JSONWriter::Key(const char* key)
+{
+    BeforeValue();
+    Escape(key, std::strlen(key));
+    m_buffer += ':';
+    m_afterKey = true;
+}
+
+void JSONWriter::Bool(bool value)
+{
+    BeforeValue();
+    m_buffer += value ? "true" : "false";
+}
+
+void JSONWriter::Int(int64_t value)
+{
+    BeforeValue();
+    std::array<char, 24> digits;
+    auto result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+    m_buffer.append(digits.data(), result.ptr);
+}
+
+void JSONWriter::UInt(uint64_t value)
+{
+    BeforeValue();
+    std::array<char, 24> digits;
+    auto result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+    m_buffer.append(digits.data(), result.ptr);
+}
+
+void JSONWriter::Float(double value)
+{
+    BeforeValue();
+    if (!std::isfinite(value))
+    {
+        m_buffer += "null";
+        return;
+    }
+    // Same shortest round trip formatting nlohmann::json uses
+    std::array<char, 64> digits;
+    char* end = nlohmann::detail::to_chars(digits.data(), digits.data() + digits.size(), value);
+    m_buffer.append(digits.data(), end);
+}
+
+void JSONWriter::String(const std::string& value)
+{
+    BeforeValue();
+    Escape(value.data(), value.size());
+}
+
+void JSONWriter::Raw(const std::string& text)
+{
+    BeforeValue();
+    m_buffer += text;
+    FlushIfFull();
+}
+
+void JSONWriter::Flush()
+{
+    if (m_stream && !m_buffer.empty())
+    {
+        m_stream->write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+}
+
+void JSONWriter::BeforeValue()
+{
+    if (m_afterKey)
+    {
+        m_afterKey = false;
+        return;
+    }
+    if (!m_hasValue.empty())
+    {
+        if (m_hasValue.back())
+            m_buffer += ',';
+        m_hasValue.back() = true;
+    }
+}
+
+void JSONWriter::Escape(const char* value, size_t size)
+{
+    static const char* HEX = "0123456789abcdef";
+    m_buffer += '"';
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = value[i];
+        switch (c)
+        {
+            case '"': m_buffer += "\\\""; break;
+            case '\\': m_buffer += "\\\\"; break;
+            case '\b': m_buffer += "\\b"; break;
+            case '\f': m_buffer += "\\f"; break;
+            case '\n': m_buffer += "\\n"; break;
+            case '\r': m_buffer += "\\r"; break;
+            case '\t': m_buffer += "\\t"; break;
+            default:
+                // UTF-8 passes through, only control characters are escaped
+                if ((unsigned char)c < 0x20)
+                {
+                    m_buffer += "\\u00";
+                    m_buffer += HEX[(c >> 4) & 0xF];
+                    m_buffer += HEX[c & 0xF];
+                }
+                else
+                    m_buffer += c;
+        }
+    }
+    m_buffer += '"';
+}
+
+void JSONWriter::FlushIfFull()
+{
+    if (m_stream && m_buffer.size() >= BUFFER_SIZE)
+        Flush();
+}
@@ -0,0 +1,547 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <json.hpp>
+
+#include <Actions.hpp>
+#include <JSONSerializer.h>
+#include <model/Scene.h>
+
+#include <Journal.h>
+
+
+static const char JOURNAL_MAGIC[4] = {'B', 'M', 'J', 'L'};
+static const uint32_t JOURNAL_VERSION = 1;
+static const size_t HEADER_SIZE = 8;
+static const size_t FRAME_HEADER_SIZE = 8;
+// How long a merging action has to settle before it's written
+static const std::chrono::milliseconds DEFER_TIME{250};
+
+static uint32_t Crc32(const char* data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = []()
+    {
+        std::array<uint32_t, 256> table;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void AppendFrame(std::string& bytes, const nlohmann::json& record)
+{
+    std::vector<std::uint8_t> payload = nlohmann::json::to_msgpack(record);
+    uint32_t header[2] = {(uint32_t)payload.size(), Crc32((const char*)payload.data(), payload.size())};
+    bytes.append((const char*)header, sizeof(header));
+    bytes.append(payload.begin(), payload.end());
+}
+
+static std::string Header()
+{
+    std::string bytes(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    bytes.append((const char*)&JOURNAL_VERSION, sizeof(JOURNAL_VERSION));
+    return bytes;
+}
+
+static bool WriteAll(int fd, const std::string& bytes)
+{
+    size_t written = 0;
+    while (written < bytes.size())
+    {
+        ssize_t count = write(fd, bytes.data() + written, bytes.size() - written);
+        if (count < 0)
+            return false;
+        written += count;
+    }
+    return true;
+}
+
+Journal::Journal(JSONSerializer& serializer, SceneSnapshotter& snapshotter, size_t compactSize) :
+    m_serializer(serializer), m_snapshotter(snapshotter), m_compactSize(compactSize)
+{
+    m_writer = std::thread(&Journal::WriterLoop, this);
+}
+
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_writer.join();
+    CloseFile();
+}
+
+std::string Journal::PathFor(const std::string& sceneFile)
+{
+    return sceneFile.empty() ? UNTITLED_PATH : sceneFile + ".journal";
+}
+
+// Replay
+
+static void ApplySettings(JSONSerializer& serializer, nlohmann::json& settings, Scene& scene)
+{
+    scene.cameras.clear();
+    scene.views.clear();
+    serializer.DeserializeScene(settings, scene);
+}
+
+template <typename T, typename Deserialize>
+static void ApplyShapes(nlohmann::json& jshapes, std::vector<std::shared_ptr<T>>& shapes, RemovedShapes<T>& toInsert, Deserialize&& deserialize)
+{
+    for (auto& jshape: jshapes)
+        toInsert.push_back({jshape["index"].template get<size_t>(), deserialize(jshape["data"]), false});
+    std::sort(toInsert.begin(), toInsert.end(), [](const auto& a, const auto& b) { return a.index < b.index; });
+    // Guard against a log that doesn't match the scene it's replayed on
+    size_t size = shapes.size();
+    for (size_t i = 0; i < toInsert.size(); i++)
+        toInsert[i].index = std::min(toInsert[i].index, size + i);
+}
+
+static void ApplyRecord(JSONSerializer& serializer, nlohmann::json& record, std::shared_ptr<Scene>& scene)
+{
+    if (record.contains("snapshot"))
+    {
+        std::shared_ptr<Scene> snapshot = serializer.ReadScene(record["snapshot"].get<std::string>());
+        if (!snapshot)
+            return;
+        snapshot->sourceFile = scene->sourceFile;
+        scene = snapshot;
+        return;
+    }
+
+    if (record.contains("settings"))
+        ApplySettings(serializer, record["settings"], *scene);
+    if (record.contains("walls"))
+        serializer.DeserializeWalls(record["walls"], scene->fog->walls);
+
+    // Everything touched is removed, then whatever still exists is reinserted
+    // at its recorded index, which leaves untouched shapes in the same order
+    std::vector<ShapeID> touched = record.value("removed", std::vector<ShapeID>());
+    for (const char* key: {"tokens", "images"})
+    {
+        if (record.contains(key))
+            for (auto& jshape: record[key])
+                touched.push_back(jshape["data"]["id"]);
+    }
+    scene->RemoveTokens(touched);
+    scene->RemoveImages(touched);
+
+    if (record.contains("tokens"))
+    {
+        RemovedShapes<Token> tokens;
+        ApplyShapes(record["tokens"], scene->tokens, tokens, [&serializer](nlohmann::json& json) { return serializer.DeserializeToken(json); });
+        scene->InsertTokens(tokens);
+    }
+    if (record.contains("images"))
+    {
+        RemovedShapes<BGImage> images;
+        ApplyShapes(record["images"], scene->images, images, [&serializer](nlohmann::json& json) { return serializer.DeserializeImage(json); });
+        scene->InsertImages(images);
+    }
+}
+
+size_t Journal::Replay(const std::string& path, JSONSerializer& serializer, std::shared_ptr<Scene>& scene)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < HEADER_SIZE || bytes.compare(0, HEADER_SIZE, Header()) != 0)
+    {
+        std::cerr << "Ignoring invalid journal: " << path << std::endl;
+        return 0;
+    }
+
+    size_t numRecords = 0;
+    size_t offset = HEADER_SIZE;
+    while (offset + FRAME_HEADER_SIZE <= bytes.size())
+    {
+        uint32_t header[2];
+        std::memcpy(header, bytes.data() + offset, sizeof(header));
+        const char* payload = bytes.data() + offset + FRAME_HEADER_SIZE;
+        // Torn write from a crash, everything before it is intact
+        if (offset + FRAME_HEADER_SIZE + header[0] > bytes.size() || Crc32(payload, header[0]) != header[1])
+            break;
+
+        try
+        {
+            nlohmann::json record = nlohmann::json::from_msgpack(payload, payload + header[0]);
+            ApplyRecord(serializer, record, scene);
+        }
+        catch (const nlohmann::json::exception& e)
+        {
+            std::cerr << "Failed to replay journal record: " << e.what() << std::endl;
+            break;
+        }
+        numRecords++;
+        offset += FRAME_HEADER_SIZE + header[0];
+    }
+
+    std::cerr << "Replayed " << numRecords << " journal records from " << path << std::endl;
+    return numRecords;
+}
+
+// Recording
+
+void Journal::Start(const std::string& path)
+{
+    if (path == m_path && !m_started)
+        return;
+
+    Discard();
+    m_path = path;
+}
+
+void Journal::Record(const std::shared_ptr<Scene>& scene, const ActionEffects& effects)
+{
+    WriteDeferred(scene);
+    if (m_path.empty() || (effects.shapes.empty() && !effects.settings && !effects.walls))
+        return;
+
+    // The first record replaces whatever log was there
+    if (!m_started)
+    {
+        Queue({Op::Type::Replace, m_path, nullptr});
+        m_started = true;
+    }
+    Queue({Op::Type::Append, m_path, BuildRecord(scene, effects)});
+
+    // Wait for the last snapshot to be written before checking the size again
+    bool compact = m_logSize > m_compactSize;
+    if (compact)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        compact = m_numWritten >= m_compactedAt;
+    }
+    if (compact)
+        Snapshot(scene);
+}
+
+void Journal::Defer(const ActionEffects& effects)
+{
+    m_deferred.shapes.insert(m_deferred.shapes.end(), effects.shapes.begin(), effects.shapes.end());
+    m_deferred.settings |= effects.settings;
+    m_deferred.walls |= effects.walls;
+    m_hasDeferred = true;
+    m_deferredAt = std::chrono::steady_clock::now();
+}
+
+void Journal::Update(const std::shared_ptr<Scene>& scene)
+{
+    if (m_hasDeferred && std::chrono::steady_clock::now() - m_deferredAt > DEFER_TIME)
+        WriteDeferred(scene);
+}
+
+void Journal::WriteDeferred(const std::shared_ptr<Scene>& scene)
+{
+    if (!m_hasDeferred)
+        return;
+
+    ActionEffects effects;
+    std::swap(effects, m_deferred);
+    m_hasDeferred = false;
+    // Merged actions keep touching the same shapes
+    std::sort(effects.shapes.begin(), effects.shapes.end());
+    effects.shapes.erase(std::unique(effects.shapes.begin(), effects.shapes.end()), effects.shapes.end());
+    Record(scene, effects);
+}
+
+void Journal::Snapshot(const std::shared_ptr<Scene>& scene)
+{
+    m_hasDeferred = false;
+    m_deferred = ActionEffects();
+    if (m_path.empty())
+        return;
+
+    Op op{Op::Type::Replace, m_path};
+    op.snapshot = m_snapshotter.Take(scene);
+    Queue(std::move(op));
+    m_started = true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_compactedAt = m_numQueued;
+}
+
+Journal::CheckpointID Journal::Checkpoint()
+{
+    Op op{Op::Type::Checkpoint, m_path};
+    op.checkpoint = m_nextCheckpoint++;
+    CheckpointID checkpoint = op.checkpoint;
+    Queue(std::move(op));
+    return checkpoint;
+}
+
+void Journal::Rebase(CheckpointID checkpoint, const std::string& sceneFile)
+{
+    std::string path = PathFor(sceneFile);
+    if (m_started)
+    {
+        Op op{Op::Type::Rebase, m_path};
+        op.checkpoint = checkpoint;
+        op.newPath = path;
+        Queue(std::move(op));
+    }
+    m_path = path;
+}
+
+void Journal::Discard()
+{
+    m_hasDeferred = false;
+    m_deferred = ActionEffects();
+    if (!m_started)
+        return;
+
+    Queue({Op::Type::Remove, m_path, nullptr});
+    m_started = false;
+}
+
+void Journal::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushed.wait(lock, [this]() { return m_numWritten == m_numQueued; });
+}
+
+void Journal::Queue(Op op)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(op));
+        m_numQueued++;
+    }
+    m_wake.notify_one();
+}
+
+nlohmann::json Journal::BuildRecord(const std::shared_ptr<Scene>& scene, const ActionEffects& effects)
+{
+    nlohmann::json record = nlohmann::json::object();
+    std::unordered_set<ShapeID> seen;
+    for (ShapeID id: effects.shapes)
+    {
+        if (!seen.insert(id).second)
+            continue;
+
+        size_t index;
+        if ((index = scene->GetTokenIndex(id)) != NO_INDEX)
+        {
+            nlohmann::json jtoken = {{"index", index}};
+            m_serializer.SerializeToken(scene->tokens[index], jtoken["data"]);
+            record["tokens"].push_back(std::move(jtoken));
+        }
+        else if ((index = scene->GetImageIndex(id)) != NO_INDEX)
+        {
+            nlohmann::json jimage = {{"index", index}};
+            m_serializer.SerializeImage(scene->images[index], jimage["data"]);
+            record["images"].push_back(std::move(jimage));
+        }
+        else
+            record["removed"].push_back(id);
+    }
+
+    if (effects.settings)
+    {
+        nlohmann::json settings = m_serializer.SerializeScene(scene, SerializeFlag::Camera | SerializeFlag::Fog | SerializeFlag::Grid | SerializeFlag::View);
+        settings["imagesLocked"] = scene->GetImagesLocked();
+        settings["tokensLocked"] = scene->GetTokensLocked();
+        record["settings"] = std::move(settings);
+    }
+    // Every wall is written, edits are rare and usually a few walls at a time
+    if (effects.walls)
+        record["walls"] = m_serializer.SerializeWalls(scene->fog->walls);
+    return record;
+}
+
+// Writer thread
+
+void Journal::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty() && m_stop)
+            break;
+
+        // Group commit, everything queued so far is written with a single sync
+        std::deque<Op> ops;
+        std::swap(ops, m_queue);
+        lock.unlock();
+
+        std::string pending;
+        std::string pendingPath;
+        for (Op& op: ops)
+        {
+            if (op.type == Op::Type::Append)
+            {
+                if (!pending.empty() && op.path != pendingPath)
+                {
+                    Append(pendingPath, pending);
+                    pending.clear();
+                }
+                pendingPath = op.path;
+                AppendFrame(pending, op.record);
+                continue;
+            }
+
+            // Everything else acts on the whole file so pending appends go first
+            if (!pending.empty())
+            {
+                Append(pendingPath, pending);
+                pending.clear();
+            }
+            switch (op.type)
+            {
+            case Op::Type::Replace:
+            {
+                std::string bytes = Header();
+                if (op.snapshot)
+                    AppendFrame(bytes, {{"snapshot", op.snapshot->ToString()}});
+                Replace(op.path, bytes);
+                break;
+            }
+            case Op::Type::Remove:
+                Remove(op.path);
+                break;
+            case Op::Type::Checkpoint:
+                m_checkpoints[op.checkpoint] = {m_generation, m_logSize};
+                break;
+            case Op::Type::Rebase:
+                RebaseFile(op);
+                break;
+            default:
+                break;
+            }
+        }
+        if (!pending.empty())
+            Append(pendingPath, pending);
+        Sync();
+
+        lock.lock();
+        m_numWritten += ops.size();
+        m_flushed.notify_all();
+    }
+}
+
+bool Journal::Append(const std::string& path, const std::string& bytes)
+{
+    if (m_fd < 0 || m_fdPath != path)
+    {
+        CloseFile();
+        m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (m_fd < 0)
+        {
+            std::cerr << "Unable to open journal: " << path << std::endl;
+            return false;
+        }
+        m_fdPath = path;
+    }
+
+    if (!WriteAll(m_fd, bytes))
+    {
+        std::cerr << "Failed to write journal: " << path << std::endl;
+        return false;
+    }
+    m_logSize += bytes.size();
+    return true;
+}
+
+// Written to a temp file and renamed over the log so a crash leaves either the
+// old log or the new one
+bool Journal::Replace(const std::string& path, const std::string& bytes)
+{
+    CloseFile();
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !WriteAll(fd, bytes) || fsync(fd) != 0)
+    {
+        std::cerr << "Failed to write journal: " << tmpPath << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    close(fd);
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Failed to replace journal: " << path << std::endl;
+        return false;
+    }
+    m_logSize = bytes.size();
+    m_generation++;
+    return true;
+}
+
+void Journal::Remove(const std::string& path)
+{
+    if (m_fdPath == path)
+        CloseFile();
+    unlink(path.c_str());
+    m_logSize = 0;
+    m_generation++;
+}
+
+void Journal::RebaseFile(const Op& op)
+{
+    auto it = m_checkpoints.find(op.checkpoint);
+    // The file was replaced since the checkpoint (eg, compacted) so everything
+    // in it is still needed
+    bool dropPrefix = it != m_checkpoints.end() && it->second.generation == m_generation && it->second.offset > HEADER_SIZE;
+    size_t offset = dropPrefix ? it->second.offset : 0;
+    m_checkpoints.clear();
+
+    if (dropPrefix)
+    {
+        std::ifstream file(op.path, std::ios::binary);
+        file.seekg(offset);
+        std::string bytes = Header();
+        bytes.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        file.close();
+        if (Replace(op.newPath, bytes) && op.newPath != op.path)
+            unlink(op.path.c_str());
+    }
+    else if (op.newPath != op.path)
+    {
+        CloseFile();
+        if (rename(op.path.c_str(), op.newPath.c_str()) != 0)
+            std::cerr << "Failed to move journal to " << op.newPath << std::endl;
+    }
+}
+
+void Journal::Sync()
+{
+    if (m_fd >= 0)
+        fdatasync(m_fd);
+}
+
+void Journal::CloseFile()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    m_fdPath.clear();
+}
@@ -1,33 +1,36 @@
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <string>
+#include <system_error>
+#include <vector>
 
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
+#include <ContentHash.h>
 #include <glutil/Texture.h>
 
 #include <Resources.h>
 
 
-void Resources::CreateMesh(MeshType meshType, std::vector<Vertex> vertices, std::vector<uint> indices)
+// Absolute path with symlinks and relative parts resolved, as far as they exist
+static std::string CanonicalPath(const std::string& path)
 {
-    m_meshes[meshType] = std::make_shared<Mesh>(vertices, indices);
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path : canonical.string();
 }
 
-std::shared_ptr<Mesh> Resources::GetMesh(MeshType meshType)
+// A texture for the path that shares the source's GPU copy
+static std::shared_ptr<Texture> MakeAlias(const std::string& path, const std::shared_ptr<Texture>& source)
 {
-    return m_meshes.at(meshType);
-}
-
-void Resources::CreateShader(ShaderType shaderType, const char* vs, const char* fs)
-{
-    m_shaders[shaderType] = std::make_shared<Shader>(vs, fs);
-}
-
-std::shared_ptr<Shader> Resources::GetShader(ShaderType shaderType)
-{
-    return m_shaders.at(shaderType);
+    auto texture = std::make_shared<Texture>(*source);
+    texture->filename = path;
+    texture->ID = 0;
+    texture->source = source;
+    return texture;
 }
 
 void Resources::CreateTexture(TextureType textureType, std::string path)
@@ -43,12 +46,132 @@ std::shared_ptr<Texture> Resources::GetTexture(TextureType textureType)
 std::shared_ptr<Texture> Resources::GetTexture(std::string path)
 {
     auto [it, success] = m_textures.try_emplace(path, nullptr);
-    if (success)
+    if (!success)
     {
+        std::cerr << "Re-using texture: " << path  << std::endl;
+        return it->second;
+    }
+
+    std::string canonicalPath = CanonicalPath(path);
+    std::shared_ptr<Texture> source = FindSource(canonicalPath, nullptr);
+    if (source)
+    {
+        std::cerr << "Re-using texture: " << source->filename << " for " << path << std::endl;
+        it->second = MakeAlias(path, source);
+        return it->second;
+    }
+
+    // Only files that exist are worth comparing, missing ones are all invalid
+    std::ifstream file(path, std::ios::binary);
+    if (file.is_open())
+    {
+        auto contents = std::make_shared<std::string>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        // The same hash bundles and asset transfers key images by, so all
+        // three match. It's several times faster than decoding the image.
+        ContentHash hash = HashContent(contents->data(), contents->size());
+        source = FindSource(canonicalPath, &hash);
+        if (source)
+        {
+            std::cerr << "Re-using texture: " << source->filename << " with identical contents for " << path << std::endl;
+            it->second = MakeAlias(path, source);
+            // Later requests through the same file skip hashing
+            m_canonicalPaths[canonicalPath] = source;
+            return it->second;
+        }
         std::cerr << "Loading texture: " << path  << std::endl;
-        it->second = std::make_shared<Texture>(path.c_str());
+        // Decoded from the contents already read rather than the file again
+        auto data = std::make_shared<TextureData>();
+        data->owner = contents;
+        data->bytes = reinterpret_cast<const unsigned char*>(contents->data());
+        data->size = contents->size();
+        data->hash = hash;
+        it->second = std::make_shared<Texture>(path, data);
+        AddSource(it->second, canonicalPath, &hash);
+        return it->second;
     }
-    else
-        std::cerr << "Re-using texture: " << path  << std::endl;
+
+    std::cerr << "Loading texture: " << path  << std::endl;
+    it->second = std::make_shared<Texture>(path.c_str());
     return it->second;
 }
+
+void Resources::AddTexture(const std::shared_ptr<Texture>& texture)
+{
+    // Textures with their contents in memory are already hashed
+    if (texture->data && !texture->source)
+    {
+        std::shared_ptr<Texture> source = FindSource("", &texture->data->hash);
+        if (source && source != texture)
+            texture->source = source;
+        else
+            AddSource(texture, "", &texture->data->hash);
+    }
+    m_textures[texture->filename] = texture;
+}
+
+std::shared_ptr<Texture> Resources::FindSource(const std::string& canonicalPath, const ContentHash* hash)
+{
+    if (hash)
+    {
+        auto it = m_contentHashes.find(*hash);
+        return it != m_contentHashes.end() ? it->second.lock() : nullptr;
+    }
+    auto it = m_canonicalPaths.find(canonicalPath);
+    return it != m_canonicalPaths.end() ? it->second.lock() : nullptr;
+}
+
+void Resources::AddSource(const std::shared_ptr<Texture>& texture, const std::string& canonicalPath, const ContentHash* hash)
+{
+    if (!texture->IsValid())
+        return;
+    if (!canonicalPath.empty())
+        m_canonicalPaths[canonicalPath] = texture;
+    if (hash)
+        m_contentHashes[*hash] = texture;
+}
+
+std::vector<std::shared_ptr<Texture>> Resources::UnreferencedTextures()
+{
+    // Sources are also held by the cached textures sharing them, which only
+    // count as uses when something outside the cache holds them
+    std::unordered_map<const Texture*, long> cachedAliases;
+    std::unordered_set<const Texture*> usedByAlias;
+    for (const auto& [path, texture]: m_textures)
+    {
+        if (!texture->source)
+            continue;
+        cachedAliases[texture->source.get()]++;
+        if (texture.use_count() > 1)
+            usedByAlias.insert(texture->source.get());
+    }
+
+    std::vector<std::shared_ptr<Texture>> textures;
+    for (const auto& [path, texture]: m_textures)
+    {
+        if (texture->source || !texture->IsUploaded() || usedByAlias.count(texture.get()))
+            continue;
+        auto it = cachedAliases.find(texture.get());
+        long numAliases = it != cachedAliases.end() ? it->second : 0;
+        if (texture.use_count() == 1 + numAliases)
+            textures.push_back(texture);
+    }
+    return textures;
+}
+
+Resources::TextureStats Resources::Stats(const std::vector<std::shared_ptr<Texture>>& textures)
+{
+    TextureStats stats;
+    std::unordered_set<const Texture*> paths, uploads;
+    for (const auto& texture: textures)
+    {
+        if (!paths.insert(texture.get()).second)
+            continue;
+        stats.numTextures++;
+        const Texture* upload = texture->source ? texture->source.get() : texture.get();
+        if (uploads.insert(upload).second)
+            stats.numUploads++;
+        else
+            stats.bytesAvoided += upload->ByteSize();
+    }
+    return stats;
+}
@@ -0,0 +1,495 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <stb_image.h>
+
+#include <BinarySerializer.h>
+#include <ContentHash.h>
+#include <MappedFile.h>
+#include <Resources.h>
+#include <glutil/Texture.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include <SceneBundle.h>
+
+
+static const char MAGIC[4] = {'B', 'M', 'B', 'D'};
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const uint64_t ALIGNMENT = 8;
+static const uint32_t NO_BLOB = 0xFFFFFFFF;
+
+struct BundleHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+};
+
+// Index: IndexHeader, BlobEntry[numBlobs], PathEntry[numPaths], path chars
+struct IndexHeader
+{
+    uint64_t sceneOffset;
+    uint64_t sceneSize;
+    uint32_t numBlobs;
+    uint32_t numPaths;
+    uint64_t charsSize;
+};
+
+struct BlobEntry
+{
+    uint8_t hash[32];
+    uint64_t offset;
+    uint64_t size;
+    // Mip levels are tightly packed, largest first, each half the size of the
+    // last rounded down
+    uint64_t mipsOffset;
+    uint64_t mipsSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numChannels;
+    uint32_t numMips;
+};
+
+struct PathEntry
+{
+    uint32_t blob;
+    uint32_t pathOffset;
+    uint32_t pathSize;
+    uint32_t padding;
+};
+
+static_assert(sizeof(BundleHeader) == 32, "BundleHeader must be packed");
+static_assert(sizeof(IndexHeader) == 32, "IndexHeader must be packed");
+static_assert(sizeof(BlobEntry) == 80, "BlobEntry must be packed");
+static_assert(sizeof(PathEntry) == 16, "PathEntry must be packed");
+
+
+static uint64_t Align(uint64_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+static size_t MipSize(uint32_t width, uint32_t height, uint32_t numChannels, uint32_t level)
+{
+    return size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * numChannels;
+}
+
+// Parsed index of a mapped bundle, with every offset checked against the file
+struct BundleIndex
+{
+    IndexHeader header;
+    const BlobEntry* blobs;
+    const PathEntry* paths;
+    const char* chars;
+};
+
+static bool ParseIndex(const MappedFile& file, BundleIndex& index)
+{
+    const char* data = file.Data();
+    uint64_t size = file.Size();
+    if (size < sizeof(BundleHeader))
+        return false;
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(data);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->byteOrder != BYTE_ORDER_MARK || header->version > SceneBundle::VERSION)
+        return false;
+    if (header->indexOffset % ALIGNMENT != 0 || header->indexOffset > size || header->indexSize > size - header->indexOffset ||
+        header->indexSize < sizeof(IndexHeader))
+        return false;
+
+    const char* indexData = data + header->indexOffset;
+    index.header = *reinterpret_cast<const IndexHeader*>(indexData);
+    const IndexHeader& ih = index.header;
+    uint64_t tablesSize = sizeof(IndexHeader) + uint64_t(ih.numBlobs) * sizeof(BlobEntry) + uint64_t(ih.numPaths) * sizeof(PathEntry);
+    if (tablesSize > header->indexSize || ih.charsSize > header->indexSize - tablesSize)
+        return false;
+    if (ih.sceneOffset % ALIGNMENT != 0 || ih.sceneOffset > size || ih.sceneSize > size - ih.sceneOffset)
+        return false;
+
+    index.blobs = reinterpret_cast<const BlobEntry*>(indexData + sizeof(IndexHeader));
+    index.paths = reinterpret_cast<const PathEntry*>(index.blobs + ih.numBlobs);
+    index.chars = reinterpret_cast<const char*>(index.paths + ih.numPaths);
+    for (uint32_t i = 0; i < ih.numBlobs; i++)
+    {
+        const BlobEntry& blob = index.blobs[i];
+        if (blob.offset > size || blob.size > size - blob.offset || blob.mipsOffset > size || blob.mipsSize > size - blob.mipsOffset)
+            return false;
+        size_t mipsSize = 0;
+        for (uint32_t level = 0; level < blob.numMips && level < 32; level++)
+            mipsSize += MipSize(blob.width, blob.height, blob.numChannels, level);
+        if (blob.numMips >= 32 || mipsSize != blob.mipsSize)
+            return false;
+    }
+    for (uint32_t i = 0; i < ih.numPaths; i++)
+    {
+        const PathEntry& path = index.paths[i];
+        if ((path.blob != NO_BLOB && path.blob >= ih.numBlobs) || path.pathOffset > ih.charsSize || path.pathSize > ih.charsSize - path.pathOffset)
+            return false;
+    }
+    return true;
+}
+
+
+bool SceneBundle::IsBundlePath(const std::string& path)
+{
+    size_t size = std::strlen(EXTENSION);
+    return path.size() >= size && path.compare(path.size() - size, size, EXTENSION) == 0;
+}
+
+SceneBundle::SceneBundle(std::shared_ptr<Resources> resources) : m_resources(resources), m_serializer(resources) {}
+
+std::shared_ptr<const SceneBundle::Contents> SceneBundle::Gather(const std::shared_ptr<Scene>& scene)
+{
+    auto contents = std::make_shared<Contents>();
+    contents->scene = m_serializer.Encode(scene);
+
+    std::unordered_set<std::string> seen;
+    auto addTexture = [&contents, &seen](const std::shared_ptr<Texture>& texture)
+    {
+        if (seen.insert(texture->filename).second)
+            contents->assets.push_back({texture->filename, texture->data});
+    };
+    for (const auto& image: scene->images)
+    {
+        addTexture(image->GetImage());
+        if (image->GetHeightmap())
+            addTexture(image->GetHeightmap());
+    }
+    for (const auto& token: scene->tokens)
+        addTexture(token->GetIcon());
+    return contents;
+}
+
+// Writing
+namespace
+{
+    // Sequential writes to a file descriptor, padding each part to the alignment
+    class BundleWriter
+    {
+    public:
+        BundleWriter(int fd, uint64_t offset) : m_fd(fd), m_offset(offset) {}
+
+        // Returns the aligned offset the data was written at
+        uint64_t Write(const void* data, size_t size)
+        {
+            Pad();
+            uint64_t offset = m_offset;
+            Append(data, size);
+            return offset;
+        }
+
+        void Pad()
+        {
+            static const char zeros[ALIGNMENT] = {0};
+            Append(zeros, Align(m_offset) - m_offset);
+        }
+
+        void Append(const void* data, size_t size)
+        {
+            const char* bytes = static_cast<const char*>(data);
+            while (m_ok && size > 0)
+            {
+                ssize_t written = pwrite(m_fd, bytes, size, m_offset);
+                if (written <= 0)
+                {
+                    m_ok = false;
+                    break;
+                }
+                bytes += written;
+                size -= written;
+                m_offset += written;
+            }
+        }
+
+        uint64_t Offset() const { return m_offset; }
+        bool Ok() const { return m_ok; }
+
+    private:
+        int m_fd;
+        uint64_t m_offset;
+        bool m_ok = true;
+    };
+
+    // Encoded bytes of an asset, either borrowed from a bundle or read from disk
+    struct AssetBytes
+    {
+        std::string owned;
+        const unsigned char* bytes = nullptr;
+        size_t size = 0;
+        ContentHash hash;
+        std::shared_ptr<const TextureData> data;
+    };
+
+    bool LoadAsset(const SceneBundle::Asset& asset, AssetBytes& loaded)
+    {
+        loaded.data = asset.data;
+        if (asset.data)
+        {
+            loaded.bytes = asset.data->bytes;
+            loaded.size = asset.data->size;
+            loaded.hash = asset.data->hash;
+            return true;
+        }
+
+        std::ifstream file(asset.path, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to bundle missing image " << asset.path << std::endl;
+            return false;
+        }
+        loaded.owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        loaded.bytes = reinterpret_cast<const unsigned char*>(loaded.owned.data());
+        loaded.size = loaded.owned.size();
+        loaded.hash = HashContent(loaded.bytes, loaded.size);
+        return true;
+    }
+
+    // Box filters each level down from the decoded image and writes them all
+    void WriteMips(BundleWriter& writer, const AssetBytes& asset, BlobEntry& entry)
+    {
+        int width, height, numChannels;
+        unsigned char* pixels = stbi_load_from_memory(asset.bytes, asset.size, &width, &height, &numChannels, 0);
+        if (!pixels)
+            return;
+
+        entry.width = width;
+        entry.height = height;
+        entry.numChannels = numChannels;
+        entry.mipsOffset = Align(writer.Offset());
+        writer.Pad();
+
+        std::vector<unsigned char> level(pixels, pixels + size_t(width) * height * numChannels);
+        stbi_image_free(pixels);
+        std::vector<unsigned char> next;
+        while (true)
+        {
+            writer.Append(level.data(), level.size());
+            entry.numMips++;
+            if (width == 1 && height == 1)
+                break;
+
+            HalveImage(level, width, height, numChannels, next);
+            std::swap(level, next);
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        entry.mipsSize = writer.Offset() - entry.mipsOffset;
+    }
+}
+
+bool SceneBundle::Write(const Contents& contents, const std::string& path, bool buildMips)
+{
+    // Blobs already in the file can be kept where they are
+    std::shared_ptr<MappedFile> existing;
+    BundleIndex existingIndex;
+    std::map<ContentHash, const BlobEntry*> existingBlobs;
+    if (std::filesystem::exists(path))
+    {
+        existing = MappedFile::Open(path);
+        if (existing && ParseIndex(*existing, existingIndex))
+        {
+            for (uint32_t i = 0; i < existingIndex.header.numBlobs; i++)
+            {
+                ContentHash hash;
+                std::copy(std::begin(existingIndex.blobs[i].hash), std::end(existingIndex.blobs[i].hash), hash.begin());
+                existingBlobs.emplace(hash, &existingIndex.blobs[i]);
+            }
+        }
+        else
+            existing = nullptr;
+    }
+
+    // Unique blobs in the order they're first used
+    std::vector<AssetBytes> assets(contents.assets.size());
+    std::vector<uint32_t> pathBlobs(contents.assets.size(), NO_BLOB);
+    std::vector<size_t> blobAssets;
+    std::map<ContentHash, uint32_t> blobIndices;
+    uint64_t reusedSize = 0, newSize = contents.scene.size();
+    for (size_t i = 0; i < contents.assets.size(); i++)
+    {
+        if (!LoadAsset(contents.assets[i], assets[i]))
+            continue;
+        auto [it, inserted] = blobIndices.emplace(assets[i].hash, blobAssets.size());
+        pathBlobs[i] = it->second;
+        if (!inserted)
+            continue;
+        blobAssets.push_back(i);
+        auto existingIt = existingBlobs.find(assets[i].hash);
+        if (existingIt != existingBlobs.end())
+            reusedSize += existingIt->second->size + existingIt->second->mipsSize;
+        else
+            newSize += assets[i].size;
+    }
+
+    // Append while at least half the file is still in use
+    bool append = existing && existing->Size() - reusedSize <= reusedSize + newSize;
+    std::string tmpPath = path + ".tmp";
+    int fd = append ? open(path.c_str(), O_WRONLY) : open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to open file " << (append ? path : tmpPath) << std::endl;
+        return false;
+    }
+
+    // The header is written last, once everything it points to is on disk
+    BundleWriter writer(fd, append ? existing->Size() : sizeof(BundleHeader));
+
+    std::vector<BlobEntry> blobs(blobAssets.size());
+    for (size_t i = 0; i < blobAssets.size(); i++)
+    {
+        const AssetBytes& asset = assets[blobAssets[i]];
+        BlobEntry& entry = blobs[i];
+        std::memset(&entry, 0, sizeof(entry));
+        std::copy(asset.hash.begin(), asset.hash.end(), entry.hash);
+
+        auto existingIt = existingBlobs.find(asset.hash);
+        if (existingIt != existingBlobs.end())
+        {
+            entry = *existingIt->second;
+            if (append)
+                continue;
+            // Rewriting, copy the blob out of the old file
+            entry.offset = writer.Write(existing->Data() + existingIt->second->offset, existingIt->second->size);
+            if (entry.numMips > 0)
+                entry.mipsOffset = writer.Write(existing->Data() + existingIt->second->mipsOffset, existingIt->second->mipsSize);
+            continue;
+        }
+
+        entry.offset = writer.Write(asset.bytes, asset.size);
+        entry.size = asset.size;
+        if (asset.data && !asset.data->mips.empty())
+        {
+            // Already decoded by the bundle it came from
+            const std::vector<MipLevel>& mips = asset.data->mips;
+            int width, height, numChannels;
+            stbi_info_from_memory(asset.bytes, asset.size, &width, &height, &numChannels);
+            entry.width = width;
+            entry.height = height;
+            entry.numChannels = numChannels;
+            entry.numMips = mips.size();
+            writer.Pad();
+            entry.mipsOffset = writer.Offset();
+            for (uint32_t level = 0; level < mips.size(); level++)
+                writer.Append(mips[level].pixels, MipSize(width, height, numChannels, level));
+            entry.mipsSize = writer.Offset() - entry.mipsOffset;
+        }
+        else if (buildMips)
+            WriteMips(writer, asset, entry);
+    }
+
+    // Index
+    IndexHeader indexHeader{};
+    indexHeader.sceneOffset = writer.Write(contents.scene.data(), contents.scene.size());
+    indexHeader.sceneSize = contents.scene.size();
+    indexHeader.numBlobs = blobs.size();
+    indexHeader.numPaths = contents.assets.size();
+    std::string chars;
+    std::vector<PathEntry> paths;
+    for (size_t i = 0; i < contents.assets.size(); i++)
+    {
+        paths.push_back({pathBlobs[i], uint32_t(chars.size()), uint32_t(contents.assets[i].path.size()), 0});
+        chars += contents.assets[i].path;
+    }
+    indexHeader.charsSize = chars.size();
+
+    BundleHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.indexOffset = writer.Write(&indexHeader, sizeof(indexHeader));
+    writer.Append(blobs.data(), blobs.size() * sizeof(BlobEntry));
+    writer.Append(paths.data(), paths.size() * sizeof(PathEntry));
+    writer.Append(chars.data(), chars.size());
+    header.indexSize = writer.Offset() - header.indexOffset;
+
+    // Everything the new index refers to is on disk before the header points
+    // at it, so a crash leaves the previous index in use
+    bool success = writer.Ok() && fdatasync(fd) == 0;
+    if (success)
+    {
+        BundleWriter headerWriter(fd, 0);
+        headerWriter.Append(&header, sizeof(header));
+        success = headerWriter.Ok() && fdatasync(fd) == 0;
+    }
+    close(fd);
+
+    if (!append)
+    {
+        if (success && std::rename(tmpPath.c_str(), path.c_str()) != 0)
+            success = false;
+        if (!success)
+            std::remove(tmpPath.c_str());
+    }
+    if (!success)
+        std::cerr << "Failed to write bundle " << path << std::endl;
+    else
+        std::cerr << (append ? "Updated bundle " : "Wrote bundle ") << path << std::endl;
+    return success;
+}
+
+// Reading
+bool SceneBundle::Read(const std::string& path, Scene& scene)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+    if (!file)
+        return false;
+    BundleIndex index;
+    if (!ParseIndex(*file, index))
+    {
+        std::cerr << "Unable to read bundle " << path << std::endl;
+        return false;
+    }
+
+    // One set of data per blob, shared by every path with the same contents
+    std::vector<std::shared_ptr<const TextureData>> blobData(index.header.numBlobs);
+    for (uint32_t i = 0; i < index.header.numBlobs; i++)
+    {
+        const BlobEntry& blob = index.blobs[i];
+        auto data = std::make_shared<TextureData>();
+        data->owner = file;
+        data->bytes = reinterpret_cast<const unsigned char*>(file->Data() + blob.offset);
+        data->size = blob.size;
+        std::copy(std::begin(blob.hash), std::end(blob.hash), data->hash.begin());
+        const unsigned char* pixels = reinterpret_cast<const unsigned char*>(file->Data() + blob.mipsOffset);
+        for (uint32_t level = 0; level < blob.numMips; level++)
+        {
+            data->mips.push_back({int(std::max(blob.width >> level, 1u)), int(std::max(blob.height >> level, 1u)), pixels});
+            pixels += MipSize(blob.width, blob.height, blob.numChannels, level);
+        }
+        blobData[i] = data;
+    }
+
+    for (uint32_t i = 0; i < index.header.numPaths; i++)
+    {
+        const PathEntry& entry = index.paths[i];
+        if (entry.blob == NO_BLOB)
+            continue;
+        std::string texturePath(index.chars + entry.pathOffset, entry.pathSize);
+        auto texture = std::make_shared<Texture>(texturePath, blobData[entry.blob]);
+        // Levels that don't match the image are ignored rather than uploaded
+        if (!blobData[entry.blob]->mips.empty() && (uint32_t)texture->numChannels != index.blobs[entry.blob].numChannels)
+        {
+            auto data = std::make_shared<TextureData>(*blobData[entry.blob]);
+            data->mips.clear();
+            texture->data = data;
+        }
+        m_resources->AddTexture(texture);
+    }
+
+    return m_serializer.Decode(file->Data() + index.header.sceneOffset, index.header.sceneSize, scene);
+}
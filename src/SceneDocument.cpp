@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <Actions.hpp>
+#include <Journal.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <net/Protocol.h>
+
+#include <SceneDocument.h>
+
+
+SceneDocument::SceneDocument(std::shared_ptr<Resources> resources, JSONSerializer& serializer) :
+    m_resources(resources), m_serializer(serializer), m_binarySerializer(resources), m_bundle(resources),
+    m_snapshotter(serializer), m_journal(serializer, m_snapshotter), m_lastAutosave(std::chrono::steady_clock::now()) {}
+
+bool SceneDocument::Read(const std::string& path, Scene& scene)
+{
+    std::cerr << "Loading Scene from " << path << std::endl;
+    if (SceneBundle::IsBundlePath(path))
+        return m_bundle.Read(path, scene);
+    if (BinarySerializer::IsBinaryPath(path))
+        return m_binarySerializer.Read(path, scene);
+
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Unable to open file" << std::endl;
+        return false;
+    }
+    return m_serializer.ReadScene(file, scene);
+}
+
+void SceneDocument::Start(const std::shared_ptr<Scene>& scene)
+{
+    m_snapshotter.Clear();
+    m_journal.Start(Journal::PathFor(scene->sourceFile));
+    m_changeCount = m_savedChangeCount = 0;
+    m_lastAutosave = std::chrono::steady_clock::now();
+}
+
+bool SceneDocument::Replay(std::shared_ptr<Scene>& scene)
+{
+    std::string sourceFile = scene->sourceFile;
+    std::string path = Journal::PathFor(sourceFile);
+    if (!Journal::Replay(path, m_serializer, scene))
+        return false;
+    std::cerr << "Recovered unsaved changes from " << path << std::endl;
+    scene->sourceFile = sourceFile;
+    return true;
+}
+
+void SceneDocument::Recovered(const std::shared_ptr<Scene>& scene)
+{
+    m_journal.Snapshot(scene);
+    m_changeCount++;
+}
+
+void SceneDocument::Record(const std::shared_ptr<Scene>& scene, const ActionEffects& effects)
+{
+    m_journal.Record(scene, effects);
+    m_changeCount++;
+}
+
+void SceneDocument::Defer(const ActionEffects& effects)
+{
+    // Written once the merging settles
+    m_journal.Defer(effects);
+    m_changeCount++;
+}
+
+void SceneDocument::Update(const std::shared_ptr<Scene>& scene)
+{
+    m_journal.Update(scene);
+    HandleSaveResults(scene);
+}
+
+void SceneDocument::Save(const std::shared_ptr<Scene>& scene, const std::string& path)
+{
+    std::cerr << "Saving to " << path << std::endl;
+    PendingSave pending;
+    // Format is picked by extension, saving to the other converts the scene
+    if (SceneBundle::IsBundlePath(path))
+    {
+        // Image files are read and hashed on the saver's thread
+        std::shared_ptr<const SceneBundle::Contents> contents = m_bundle.Gather(scene);
+        pending.id = m_saver.Save([contents, path]() { return SceneBundle::Write(*contents, path); }, path);
+    }
+    else if (BinarySerializer::IsBinaryPath(path))
+        pending.id = m_saver.Save(std::make_shared<const std::string>(m_binarySerializer.Encode(scene)), path);
+    else
+        pending.id = m_saver.Save(m_snapshotter.Take(scene), path);
+    pending.scene = scene;
+    // Changes journaled while the file is written are kept once it's done
+    pending.checkpoint = m_journal.Checkpoint();
+    pending.changeCount = m_changeCount;
+    m_pendingSaves.push_back(pending);
+}
+
+void SceneDocument::Autosave(const std::shared_ptr<Scene>& scene, std::chrono::steady_clock::duration interval)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (scene->sourceFile.empty() || !IsUnsaved() || now - m_lastAutosave <= interval || m_saver.IsBusy())
+        return;
+    m_lastAutosave = now;
+    Save(scene, scene->sourceFile);
+}
+
+void SceneDocument::Finish(const std::shared_ptr<Scene>& scene)
+{
+    m_saver.Wait();
+    HandleSaveResults(scene);
+}
+
+void SceneDocument::HandleSaveResults(const std::shared_ptr<Scene>& scene)
+{
+    for (const SceneSaver::Result& result: m_saver.TakeResults())
+    {
+        auto it = std::find_if(m_pendingSaves.begin(), m_pendingSaves.end(),
+                               [&result](const PendingSave& pending) { return pending.id == result.id; });
+        if (it == m_pendingSaves.end())
+            continue;
+        PendingSave pending = *it;
+        m_pendingSaves.erase(it);
+
+        if (!result.success)
+        {
+            std::cerr << "Unable to save " << result.path << std::endl;
+            continue;
+        }
+        // The scene may have been replaced while it was saving
+        if (pending.scene.lock() != scene)
+            continue;
+        scene->sourceFile = result.path;
+        m_journal.Rebase(pending.checkpoint, result.path);
+        m_savedChangeCount = std::max(m_savedChangeCount, pending.changeCount);
+    }
+}
+
+std::shared_ptr<Action> SceneDocument::EditAction(const std::shared_ptr<Scene>& scene, const SceneHost::Edit& edit)
+{
+    std::shared_ptr<Token> token = scene->GetToken(edit.id);
+    if (!token)
+        return nullptr;
+    // Worked out on a copy so the action holds the exact values the host sends
+    Token edited(*token);
+    ApplyToken(edit.state, edit.fields, edited, *m_resources);
+
+    std::shared_ptr<ActionGroup> actionGroup = std::make_shared<ActionGroup>();
+    if (HasField(edit.fields, SyncField::Position))
+    {
+        auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Position>>(scene);
+        action->Add(edit.id, token->GetModel()->GetPos(), edited.GetModel()->GetPos());
+        actionGroup->Add(action);
+    }
+    if (HasField(edit.fields, SyncField::Rotation))
+    {
+        auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Rotation>>(scene);
+        action->Add(edit.id, token->GetModel()->GetRotation(), edited.GetModel()->GetRotation());
+        actionGroup->Add(action);
+    }
+    if (HasField(edit.fields, SyncField::Flags))
+    {
+        auto statuses = std::make_shared<BatchPropertyAction<ShapeProperty::Statuses>>(scene);
+        statuses->Add(edit.id, token->GetStatuses(), edited.GetStatuses());
+        actionGroup->Add(statuses);
+        auto xStatus = std::make_shared<BatchPropertyAction<ShapeProperty::XStatus>>(scene);
+        xStatus->Add(edit.id, token->GetXStatus(), edited.GetXStatus());
+        actionGroup->Add(xStatus);
+        auto nameHidden = std::make_shared<BatchPropertyAction<ShapeProperty::NameHidden>>(scene);
+        nameHidden->Add(edit.id, token->IsNameHidden(), edited.IsNameHidden());
+        actionGroup->Add(nameHidden);
+    }
+    if (HasField(edit.fields, SyncField::Opacity))
+    {
+        auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Opacity>>(scene);
+        action->Add(edit.id, token->GetOpacity(), edited.GetOpacity());
+        actionGroup->Add(action);
+    }
+    if (HasField(edit.fields, SyncField::Height))
+    {
+        auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Height>>(scene);
+        action->Add(edit.id, token->GetHeight(), edited.GetHeight());
+        actionGroup->Add(action);
+    }
+    if (actionGroup->IsEmpty())
+        return nullptr;
+    return actionGroup;
+}
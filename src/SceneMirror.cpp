@@ -0,0 +1,444 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Resources.h>
+#include <glutil/Camera.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include <SceneMirror.h>
+
+
+const uint32_t MIRROR_MAGIC = 0x524D4D42;  // "BMMR"
+const uint32_t MIRROR_VERSION = 2;
+const size_t INITIAL_MIRROR_SIZE = 1024 * 1024;
+// A reader gives up on a frame after this many torn copies, and tries again
+// next call
+const int MAX_READ_ATTEMPTS = 8;
+
+
+std::unique_ptr<SceneMirrorWriter> SceneMirrorWriter::Create(const std::string& name)
+{
+    // A region left by a crash is replaced, readers still mapping it keep
+    // their copy until they reopen
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to create shared memory " << name << std::endl;
+        return nullptr;
+    }
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, INITIAL_MIRROR_SIZE) == 0)
+        data = mmap(nullptr, INITIAL_MIRROR_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Unable to map shared memory " << name << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    // Fresh shared memory is zeroed, so the sequence starts even
+    MirrorHeader* header = static_cast<MirrorHeader*>(data);
+    header->magic = MIRROR_MAGIC;
+    header->version = MIRROR_VERSION;
+    header->size.store(INITIAL_MIRROR_SIZE, std::memory_order_release);
+    return std::unique_ptr<SceneMirrorWriter>(new SceneMirrorWriter(name, fd, static_cast<char*>(data), INITIAL_MIRROR_SIZE));
+}
+
+SceneMirrorWriter::SceneMirrorWriter(const std::string& name, int fd, char* data, size_t size) :
+    m_name(name), m_fd(fd), m_data(data), m_size(size) {}
+
+SceneMirrorWriter::~SceneMirrorWriter()
+{
+    reinterpret_cast<MirrorHeader*>(m_data)->closed.store(1, std::memory_order_release);
+    munmap(m_data, m_size);
+    close(m_fd);
+    shm_unlink(m_name.c_str());
+}
+
+uint32_t SceneMirrorWriter::AddString(const Texture& texture)
+{
+    auto it = m_stringOffsets.find(&texture);
+    if (it != m_stringOffsets.end())
+        return it->second;
+    uint32_t offset = m_strings.size();
+    m_strings.append(texture.filename.c_str(), texture.filename.size() + 1);
+    m_stringOffsets[&texture] = offset;
+    return offset;
+}
+
+bool SceneMirrorWriter::Reserve(size_t size)
+{
+    if (size <= m_size)
+        return true;
+    size_t grown = std::max(size, m_size * 2);
+    if (ftruncate(m_fd, grown) != 0)
+        return false;
+    void* data = mremap(m_data, m_size, grown, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = static_cast<char*>(data);
+    m_size = grown;
+    reinterpret_cast<MirrorHeader*>(m_data)->size.store(grown, std::memory_order_release);
+    return true;
+}
+
+bool SceneMirrorWriter::IsShown(const FogOfWar& fog, glm::vec2 point)
+{
+    // The host lifting the fog, eg, with nothing selected, isn't the players'
+    if (fog.IsEnabled() && !fog.IsMasking())
+        return false;
+    return fog.IsVisible(point);
+}
+
+bool SceneMirrorWriter::Write(Scene& scene)
+{
+    // Built outside the region so readers are only held off for the copy
+    m_tokens.clear();
+    m_images.clear();
+    m_fogPolygons.clear();
+    m_fogPoints.clear();
+    m_strings.clear();
+    m_stringOffsets.clear();
+    // What the players can't see never leaves this process
+    const FogOfWar& fog = *scene.fog;
+    for (const auto& token: scene.tokens)
+    {
+        auto model = token->GetModel();
+        if (!IsShown(fog, model->GetPos()))
+            continue;
+        m_tokens.push_back({token->GetID(), model->GetPos(), model->GetScale(), model->GetRotation(), token->GetOpacity(),
+                            token->GetBorderColor(), token->GetBorderWidth(), uint32_t(token->GetStatuses().to_ulong()),
+                            token->GetXStatus(), AddString(*token->GetIcon())});
+    }
+    for (const auto& image: scene.images)
+    {
+        if (!image->IsVisible())
+            continue;
+        auto model = image->GetModel();
+        m_images.push_back({image->GetID(), model->GetPos(), model->GetScale(), model->GetRotation(), image->GetTint(),
+                            AddString(*image->GetImage())});
+    }
+    if (fog.IsMasking())
+    {
+        for (const VisionPolygon* polygon: fog.Polygons())
+        {
+            m_fogPolygons.push_back({polygon->origin, polygon->range, uint32_t(polygon->points.size()),
+                                     uint32_t(polygon->triangles.size())});
+            m_fogPoints.insert(m_fogPoints.end(), polygon->points.begin(), polygon->points.end());
+            m_fogPoints.insert(m_fogPoints.end(), polygon->triangles.begin(), polygon->triangles.end());
+        }
+    }
+
+    size_t tokenBytes = m_tokens.size() * sizeof(MirrorToken);
+    size_t imageBytes = m_images.size() * sizeof(MirrorImage);
+    size_t fogBytes = m_fogPolygons.size() * sizeof(MirrorFogPolygon) + m_fogPoints.size() * sizeof(glm::vec2);
+    if (!Reserve(sizeof(MirrorHeader) + tokenBytes + imageBytes + fogBytes + m_strings.size()))
+        return false;
+    MirrorHeader* header = reinterpret_cast<MirrorHeader*>(m_data);
+
+    MirrorFrame frame{};
+    frame.frame = header->frame.frame + 1;
+    frame.bgColor = scene.bgColor;
+    frame.gridScale = scene.grid->GetScale();
+    frame.gridColour = scene.grid->GetColour();
+    auto view = scene.views.find(PRIMARY);
+    if (view != scene.views.end() && view->second)
+    {
+        frame.cameraPosition = view->second->Position;
+        frame.cameraFocal = view->second->Focal;
+    }
+    frame.numTokens = m_tokens.size();
+    frame.numImages = m_images.size();
+    frame.fogMasking = fog.IsEnabled();
+    frame.numFogPolygons = m_fogPolygons.size();
+    frame.numFogPoints = m_fogPoints.size();
+    frame.stringBytes = m_strings.size();
+
+    uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->frame = frame;
+    char* records = m_data + sizeof(MirrorHeader);
+    std::memcpy(records, m_tokens.data(), tokenBytes);
+    records += tokenBytes;
+    std::memcpy(records, m_images.data(), imageBytes);
+    records += imageBytes;
+    std::memcpy(records, m_fogPolygons.data(), m_fogPolygons.size() * sizeof(MirrorFogPolygon));
+    records += m_fogPolygons.size() * sizeof(MirrorFogPolygon);
+    std::memcpy(records, m_fogPoints.data(), m_fogPoints.size() * sizeof(glm::vec2));
+    records += m_fogPoints.size() * sizeof(glm::vec2);
+    std::memcpy(records, m_strings.data(), m_strings.size());
+    header->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+
+std::unique_ptr<SceneMirrorReader> SceneMirrorReader::Open(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(MirrorHeader))
+    {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+    const MirrorHeader* header = static_cast<const MirrorHeader*>(data);
+    if (header->magic != MIRROR_MAGIC || header->version != MIRROR_VERSION)
+    {
+        std::cerr << "Shared memory " << name << " isn't a scene mirror this version can read" << std::endl;
+        munmap(data, info.st_size);
+        close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<SceneMirrorReader>(new SceneMirrorReader(fd, static_cast<char*>(data), info.st_size));
+}
+
+SceneMirrorReader::SceneMirrorReader(int fd, char* data, size_t size) : m_fd(fd), m_data(data), m_size(size) {}
+
+SceneMirrorReader::~SceneMirrorReader()
+{
+    munmap(m_data, m_size);
+    close(m_fd);
+}
+
+bool SceneMirrorReader::Remap(size_t size)
+{
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+    munmap(m_data, m_size);
+    m_data = static_cast<char*>(data);
+    m_size = size;
+    return true;
+}
+
+bool SceneMirrorReader::IsClosed() const
+{
+    return reinterpret_cast<const MirrorHeader*>(m_data)->closed.load(std::memory_order_acquire);
+}
+
+template <typename T>
+static bool SameRecords(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+bool SceneMirrorReader::Read()
+{
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
+    {
+        const MirrorHeader* header = reinterpret_cast<const MirrorHeader*>(m_data);
+        size_t size = header->size.load(std::memory_order_acquire);
+        if (size > m_size)
+        {
+            if (!Remap(size))
+                return false;
+            header = reinterpret_cast<const MirrorHeader*>(m_data);
+        }
+
+        uint32_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            m_retries++;
+            continue;
+        }
+        MirrorFrame frame = header->frame;
+        if (frame.frame == m_frame.frame)
+            return false;
+        // Counts from a torn copy can be anything, they're only trusted once
+        // the sequence is checked
+        size_t tokenBytes = size_t(frame.numTokens) * sizeof(MirrorToken);
+        size_t imageBytes = size_t(frame.numImages) * sizeof(MirrorImage);
+        size_t polygonBytes = size_t(frame.numFogPolygons) * sizeof(MirrorFogPolygon);
+        size_t pointBytes = size_t(frame.numFogPoints) * sizeof(glm::vec2);
+        bool fits = sizeof(MirrorHeader) + tokenBytes + imageBytes + polygonBytes + pointBytes + frame.stringBytes <= m_size;
+        if (fits)
+        {
+            const char* records = m_data + sizeof(MirrorHeader);
+            m_nextTokens.resize(frame.numTokens);
+            m_nextImages.resize(frame.numImages);
+            m_nextFogPolygons.resize(frame.numFogPolygons);
+            m_nextFogPoints.resize(frame.numFogPoints);
+            m_nextStrings.resize(frame.stringBytes);
+            std::memcpy(m_nextTokens.data(), records, tokenBytes);
+            records += tokenBytes;
+            std::memcpy(m_nextImages.data(), records, imageBytes);
+            records += imageBytes;
+            std::memcpy(m_nextFogPolygons.data(), records, polygonBytes);
+            records += polygonBytes;
+            std::memcpy(m_nextFogPoints.data(), records, pointBytes);
+            records += pointBytes;
+            std::memcpy(&m_nextStrings[0], records, frame.stringBytes);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) != before || !fits)
+        {
+            m_retries++;
+            continue;
+        }
+        m_fogChanged |= frame.fogMasking != m_frame.fogMasking || !SameRecords(m_nextFogPolygons, m_fogPolygons) ||
+                        !SameRecords(m_nextFogPoints, m_fogPoints);
+        m_frame = frame;
+        std::swap(m_tokens, m_nextTokens);
+        std::swap(m_images, m_nextImages);
+        std::swap(m_fogPolygons, m_nextFogPolygons);
+        std::swap(m_fogPoints, m_nextFogPoints);
+        std::swap(m_strings, m_nextStrings);
+        return true;
+    }
+    return false;
+}
+
+std::shared_ptr<Texture> SceneMirrorReader::GetTexture(Resources& resources, uint32_t offset) const
+{
+    if (offset >= m_strings.size())
+        return resources.GetTexture(Resources::TextureType::Default);
+    return resources.GetTexture(std::string(m_strings.c_str() + offset));
+}
+
+// Transforms are only set when they differ, so unmoved shapes aren't rebuilt
+static void ApplyTransform(Matrix2D& model, glm::vec2 position, glm::vec2 scale, float rotation)
+{
+    if (model.GetPos() != position)
+        model.SetPos(position);
+    if (model.GetScale() != scale)
+        model.SetScale(scale);
+    if (model.GetRotation() != rotation)
+        model.SetRotation(rotation);
+}
+
+void SceneMirrorReader::Apply(Scene& scene, Resources& resources)
+{
+    std::vector<std::shared_ptr<Token>> tokens;
+    tokens.reserve(m_tokens.size());
+    bool sameTokens = scene.tokens.size() == m_tokens.size();
+    for (const MirrorToken& record: m_tokens)
+    {
+        std::shared_ptr<Token> token = scene.GetToken(record.id);
+        if (!token)
+        {
+            token = std::make_shared<Token>(GetTexture(resources, record.texture));
+            token->SetID(record.id);
+        }
+        else if (record.texture < m_strings.size() && token->GetIcon()->filename != m_strings.c_str() + record.texture)
+            token->SetIcon(GetTexture(resources, record.texture));
+        sameTokens = sameTokens && scene.tokens[tokens.size()] == token;
+
+        ApplyTransform(*token->GetModel(), record.position, record.scale, record.rotation);
+        if (token->GetOpacity() != record.opacity)
+            token->SetOpacity(record.opacity);
+        if (token->GetBorderColor() != record.borderColor)
+            token->SetBorderColor(record.borderColor);
+        if (token->GetBorderWidth() != record.borderWidth)
+            token->SetBorderWidth(record.borderWidth);
+        if (token->GetStatuses().to_ulong() != record.statuses)
+            token->SetStatuses(TokenStatuses(record.statuses));
+        if (token->GetXStatus() != bool(record.xStatus))
+            token->SetXStatus(record.xStatus);
+        tokens.push_back(token);
+    }
+    // Added, removed or reordered, the whole list is replaced to keep draw order
+    if (!sameTokens)
+    {
+        std::vector<ShapeID> ids;
+        for (const auto& token: scene.tokens)
+            ids.push_back(token->GetID());
+        scene.RemoveTokens(ids);
+        scene.AddTokens(tokens);
+    }
+
+    std::vector<std::shared_ptr<BGImage>> images;
+    images.reserve(m_images.size());
+    bool sameImages = scene.images.size() == m_images.size();
+    for (const MirrorImage& record: m_images)
+    {
+        std::shared_ptr<BGImage> image = scene.GetImage(record.id);
+        if (!image)
+        {
+            image = std::make_shared<BGImage>(GetTexture(resources, record.texture));
+            image->SetID(record.id);
+        }
+        else if (record.texture < m_strings.size() && image->GetImage()->filename != m_strings.c_str() + record.texture)
+            image->SetImage(GetTexture(resources, record.texture));
+        sameImages = sameImages && scene.images[images.size()] == image;
+
+        ApplyTransform(*image->GetModel(), record.position, record.scale, record.rotation);
+        if (image->GetTint() != record.tint)
+            image->SetTint(record.tint);
+        images.push_back(image);
+    }
+    if (!sameImages)
+    {
+        std::vector<ShapeID> ids;
+        for (const auto& image: scene.images)
+            ids.push_back(image->GetID());
+        scene.RemoveImages(ids);
+        scene.AddImages(images);
+    }
+
+    if (m_fogChanged)
+    {
+        FogOfWar& fog = *scene.fog;
+        fog.SetEnabled(m_frame.fogMasking);
+        fog.maskOpacity = 1.0f;
+        std::vector<VisionPolygon> polygons(m_fogPolygons.size());
+        size_t point = 0;
+        for (size_t i = 0; i < m_fogPolygons.size(); i++)
+        {
+            const MirrorFogPolygon& record = m_fogPolygons[i];
+            // Counts were written with the points, but a bad one mustn't read
+            // past them
+            size_t numPoints = std::min<size_t>(record.numPoints, m_fogPoints.size() - point);
+            size_t numTriangleVertices = std::min<size_t>(record.numTriangleVertices, m_fogPoints.size() - point - numPoints);
+            VisionPolygon& polygon = polygons[i];
+            polygon.origin = record.origin;
+            polygon.range = record.range;
+            polygon.points.assign(m_fogPoints.begin() + point, m_fogPoints.begin() + point + numPoints);
+            point += numPoints;
+            polygon.triangles.assign(m_fogPoints.begin() + point, m_fogPoints.begin() + point + numTriangleVertices);
+            point += numTriangleVertices;
+            polygon.valid = true;
+        }
+        fog.Show(std::move(polygons));
+        m_fogChanged = false;
+    }
+
+    scene.bgColor = m_frame.bgColor;
+    if (scene.grid->GetScale() != m_frame.gridScale)
+        scene.grid->SetScale(m_frame.gridScale);
+    if (scene.grid->GetColour() != m_frame.gridColour)
+        scene.grid->SetColour(m_frame.gridColour);
+}
+
+void SceneMirrorReader::ApplyCamera(Camera& camera) const
+{
+    if (m_frame.cameraFocal <= 0.0f)
+        return;
+    camera.Position = m_frame.cameraPosition;
+    camera.Focal = m_frame.cameraFocal;
+    camera.RefreshMatrices();
+}
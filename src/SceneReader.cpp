@@ -0,0 +1,306 @@
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <json.hpp>
+
+#include <JSONSerializer.h>
+#include <glutil/Matrix2D.h>
+#include <model/BGImage.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+
+#include <SceneReader.h>
+
+
+SceneReader::SceneReader(JSONSerializer& serializer, Scene& scene) : m_serializer(serializer), m_scene(scene) {}
+
+void SceneReader::Finish()
+{
+    m_serializer.DeserializeScene(m_settings, m_scene);
+}
+
+// Scalars
+bool SceneReader::null()
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->null();
+    if (m_depth == 1)
+        m_settings[m_rootKey] = nullptr;
+    return true;
+}
+
+bool SceneReader::boolean(bool value)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->boolean(value);
+    if (m_depth == 1)
+        m_settings[m_rootKey] = value;
+    else if (m_depth == 3)
+    {
+        if (m_field == "xstatus")
+            m_shape.xstatus = value;
+        else if (m_field == "hideName")
+            m_shape.hideName = value;
+        else if (m_field == "lockRatio")
+        {
+            m_shape.hasLockRatio = true;
+            m_shape.lockRatio = value;
+        }
+        else if (m_field == "visible")
+        {
+            m_shape.hasVisible = true;
+            m_shape.visible = value;
+        }
+    }
+    return true;
+}
+
+bool SceneReader::number_integer(json::number_integer_t value)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->number_integer(value);
+    if (m_depth == 1)
+    {
+        m_settings[m_rootKey] = value;
+        return true;
+    }
+    return Number(value, value);
+}
+
+bool SceneReader::number_unsigned(json::number_unsigned_t value)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->number_unsigned(value);
+    if (m_depth == 1)
+    {
+        m_settings[m_rootKey] = value;
+        return true;
+    }
+    return Number(value, value);
+}
+
+bool SceneReader::number_float(json::number_float_t value, const json::string_t& text)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->number_float(value, text);
+    if (m_depth == 1)
+    {
+        m_settings[m_rootKey] = value;
+        return true;
+    }
+    return Number(value, (uint64_t)value);
+}
+
+bool SceneReader::string(json::string_t& value)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->string(value);
+    if (m_depth == 1)
+        m_settings[m_rootKey] = std::move(value);
+    else if (m_depth == 3)
+    {
+        if (m_field == "texture")
+            m_shape.texture = std::move(value);
+        else if (m_field == "name")
+            m_shape.name = std::move(value);
+        else if (m_field == "statuses")
+        {
+            m_shape.hasStatuses = true;
+            m_shape.statuses = std::move(value);
+        }
+        else if (m_field == "heightmap")
+            m_shape.heightmap = std::move(value);
+    }
+    return true;
+}
+
+bool SceneReader::binary(json::binary_t& value)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->binary(value);
+    return true;
+}
+
+// Containers
+bool SceneReader::start_object(std::size_t size)
+{
+    m_depth++;
+    if (m_section == Section::Settings)
+        return m_settingsParser->start_object(size);
+
+    if (m_depth == 2)
+    {
+        // Grid, camera, etc
+        m_section = Section::Settings;
+        m_settingsParser = std::make_unique<nlohmann::detail::json_sax_dom_parser<json>>(m_settings[m_rootKey]);
+        return m_settingsParser->start_object(size);
+    }
+    if (m_depth == 3)
+    {
+        m_shape = ShapeFields();
+        m_field.clear();
+    }
+    else if (m_depth == 4)
+        m_subField.clear();
+    return true;
+}
+
+bool SceneReader::key(json::string_t& key)
+{
+    if (m_section == Section::Settings)
+        return m_settingsParser->key(key);
+
+    if (m_depth == 1)
+        m_rootKey = std::move(key);
+    else if (m_depth == 3)
+        m_field = std::move(key);
+    else if (m_depth == 4)
+        m_subField = std::move(key);
+    return true;
+}
+
+bool SceneReader::end_object()
+{
+    m_depth--;
+    if (m_section == Section::Settings)
+    {
+        bool result = m_settingsParser->end_object();
+        if (m_depth == 1)
+        {
+            m_section = Section::None;
+            m_settingsParser.reset();
+        }
+        return result;
+    }
+
+    if (m_depth == 2)
+        FinishShape();
+    return true;
+}
+
+bool SceneReader::start_array(std::size_t size)
+{
+    m_depth++;
+    if (m_section == Section::Settings)
+        return m_settingsParser->start_array(size);
+
+    if (m_depth == 2)
+    {
+        if (m_rootKey == "tokens")
+            m_section = Section::Tokens;
+        else if (m_rootKey == "images")
+            m_section = Section::Images;
+        else
+        {
+            // Cameras, views
+            m_section = Section::Settings;
+            m_settingsParser = std::make_unique<nlohmann::detail::json_sax_dom_parser<json>>(m_settings[m_rootKey]);
+            return m_settingsParser->start_array(size);
+        }
+    }
+    m_index = 0;
+    return true;
+}
+
+bool SceneReader::end_array()
+{
+    m_depth--;
+    if (m_section == Section::Settings)
+    {
+        bool result = m_settingsParser->end_array();
+        if (m_depth == 1)
+        {
+            m_section = Section::None;
+            m_settingsParser.reset();
+        }
+        return result;
+    }
+
+    if (m_depth == 1)
+        m_section = Section::None;
+    return true;
+}
+
+bool SceneReader::parse_error(std::size_t position, const std::string& token, const nlohmann::detail::exception& error)
+{
+    m_error = error.what();
+    return false;
+}
+
+// Shapes
+bool SceneReader::Number(double value, uint64_t integer)
+{
+    if (m_depth == 3)
+    {
+        if (m_field == "id")
+        {
+            m_shape.hasID = true;
+            m_shape.id = integer;
+        }
+        else if (m_field == "borderWidth")
+            m_shape.borderWidth = value;
+        else if (m_field == "opacity")
+            m_shape.opacity = value;
+        else if (m_field == "height")
+            m_shape.height = value;
+        else if (m_field == "heightScale")
+            m_shape.heightScale = value;
+    }
+    else if (m_depth == 4)
+    {
+        if (m_field == "borderColour" && m_index < 4)
+            m_shape.borderColour[m_index++] = value;
+        else if (m_field == "matrix2D" && m_subField == "rotation")
+            m_shape.rotation = value;
+    }
+    else if (m_depth == 5 && m_field == "matrix2D" && m_index < 2)
+    {
+        if (m_subField == "pos")
+            m_shape.pos[m_index++] = value;
+        else if (m_subField == "scale")
+            m_shape.scale[m_index++] = value;
+    }
+    return true;
+}
+
+void SceneReader::FinishShape()
+{
+    const std::shared_ptr<Resources>& resources = m_serializer.GetResources();
+    auto model = std::make_shared<Matrix2D>(m_shape.pos, m_shape.scale, m_shape.rotation);
+    if (m_section == Section::Tokens)
+    {
+        auto token = std::make_shared<Token>(resources->GetTexture(m_shape.texture), m_shape.name, model);
+        if (m_shape.hasID)
+            token->SetID(m_shape.id);
+        token->SetBorderWidth(m_shape.borderWidth);
+        token->SetBorderColor(m_shape.borderColour);
+        // Status properties added together
+        if (m_shape.hasStatuses)
+        {
+            token->SetStatuses(TokenStatuses(m_shape.statuses));
+            token->SetOpacity(m_shape.opacity);
+            token->SetXStatus(m_shape.xstatus);
+        }
+        token->SetNameHidden(m_shape.hideName);
+        token->SetHeight(m_shape.height);
+        m_scene.AddToken(token);
+    }
+    else if (m_section == Section::Images)
+    {
+        auto image = std::make_shared<BGImage>(resources->GetTexture(m_shape.texture), model);
+        // Older scenes have no IDs, keep the generated one
+        if (m_shape.hasID)
+            image->SetID(m_shape.id);
+        if (m_shape.hasLockRatio)
+            image->SetLockRatio(m_shape.lockRatio);
+        if (m_shape.hasVisible)
+            image->SetVisible(m_shape.visible);
+        if (!m_shape.heightmap.empty())
+        {
+            image->SetHeightmap(resources->GetTexture(m_shape.heightmap));
+            image->SetHeightScale(m_shape.heightScale);
+        }
+        m_scene.AddImage(image);
+    }
+}
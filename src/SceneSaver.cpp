@@ -0,0 +1,154 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <SceneSnapshot.h>
+
+#include <SceneSaver.h>
+
+
+SceneSaver::SceneSaver()
+{
+    m_worker = std::thread(&SceneSaver::WorkerLoop, this);
+}
+
+SceneSaver::~SceneSaver()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+}
+
+SceneSaver::SaveID SceneSaver::Save(std::shared_ptr<const SceneSnapshot> snapshot, const std::string& path)
+{
+    SaveID id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextID++;
+        m_queue.push_back({id, std::move(snapshot), nullptr, nullptr, path});
+    }
+    m_wake.notify_one();
+    return id;
+}
+
+SceneSaver::SaveID SceneSaver::Save(std::shared_ptr<const std::string> data, const std::string& path)
+{
+    SaveID id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextID++;
+        m_queue.push_back({id, nullptr, std::move(data), nullptr, path});
+    }
+    m_wake.notify_one();
+    return id;
+}
+
+SceneSaver::SaveID SceneSaver::Save(std::function<bool()> write, const std::string& path)
+{
+    SaveID id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextID++;
+        m_queue.push_back({id, nullptr, nullptr, std::move(write), path});
+    }
+    m_wake.notify_one();
+    return id;
+}
+
+std::vector<SceneSaver::Result> SceneSaver::TakeResults()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Result> results;
+    std::swap(results, m_results);
+    return results;
+}
+
+bool SceneSaver::IsBusy()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writing || !m_queue.empty();
+}
+
+void SceneSaver::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return !m_writing && m_queue.empty(); });
+}
+
+void SceneSaver::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+            break;
+
+        Request request = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_writing = true;
+        lock.unlock();
+
+        bool success = Write(request);
+
+        lock.lock();
+        m_writing = false;
+        m_results.push_back({request.id, request.path, success});
+        m_idle.notify_all();
+    }
+}
+
+bool SceneSaver::Write(const Request& request)
+{
+    if (request.write)
+        return request.write();
+
+    const std::string& path = request.path;
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Unable to open file " << tmpPath << std::endl;
+            return false;
+        }
+        if (request.snapshot)
+            request.snapshot->Write(file);
+        else
+            file.write(request.data->data(), request.data->size());
+        file.close();
+        if (file.fail())
+        {
+            std::cerr << "Failed to write " << tmpPath << std::endl;
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    // Make sure the data is on disk before it replaces the old file
+    int fd = open(tmpPath.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Unable to replace " << path << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::cerr << "Saved " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,147 @@
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <JSONSerializer.h>
+#include <JSONWriter.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Walls.h>
+
+#include <SceneSnapshot.h>
+
+
+static void WriteArray(JSONWriter& writer, const std::vector<std::shared_ptr<const std::string>>& texts)
+{
+    writer.StartArray();
+    for (const auto& text: texts)
+        writer.Raw(*text);
+    writer.EndArray();
+}
+
+void SceneSnapshot::Write(std::ostream& stream) const
+{
+    JSONWriter writer(stream);
+    writer.StartObject();
+    writer.Key("cameras");
+    writer.Raw(cameras);
+    writer.Key("fog");
+    writer.Raw(fog);
+    writer.Key("grid");
+    writer.Raw(grid);
+    writer.Key("images");
+    WriteArray(writer, images);
+    writer.Key("imagesLocked");
+    writer.Bool(imagesLocked);
+    writer.Key("tokens");
+    WriteArray(writer, tokens);
+    writer.Key("tokensLocked");
+    writer.Bool(tokensLocked);
+    writer.Key("views");
+    writer.Raw(views);
+    writer.Key("walls");
+    writer.Raw(*walls);
+    writer.EndObject();
+}
+
+std::string SceneSnapshot::ToString() const
+{
+    std::ostringstream stream;
+    Write(stream);
+    return stream.str();
+}
+
+static void WriteShape(JSONSerializer& serializer, JSONWriter& writer, const std::shared_ptr<Token>& token) { serializer.WriteToken(writer, token); }
+static void WriteShape(JSONSerializer& serializer, JSONWriter& writer, const std::shared_ptr<BGImage>& image) { serializer.WriteImage(writer, image); }
+
+template <typename T>
+void SceneSnapshotter::SnapshotShapes(const std::vector<std::shared_ptr<T>>& shapes, std::vector<std::shared_ptr<const std::string>>& texts)
+{
+    texts.reserve(shapes.size());
+    for (const auto& shape: shapes)
+    {
+        CacheEntry& entry = m_cache[shape->GetID()];
+        uint64_t transformVersion = shape->GetModel()->Version();
+        if (!entry.text || entry.version != shape->GetVersion() || entry.transformVersion != transformVersion)
+        {
+            std::string text;
+            {
+                JSONWriter writer(text);
+                WriteShape(m_serializer, writer, shape);
+            }
+            entry.text = std::make_shared<const std::string>(std::move(text));
+            entry.version = shape->GetVersion();
+            entry.transformVersion = transformVersion;
+            m_numSerialized++;
+        }
+        entry.generation = m_generation;
+        texts.push_back(entry.text);
+    }
+}
+
+std::shared_ptr<const SceneSnapshot> SceneSnapshotter::Take(const std::shared_ptr<Scene>& scene)
+{
+    m_generation++;
+    m_numSerialized = 0;
+
+    auto snapshot = std::make_shared<SceneSnapshot>();
+    SnapshotShapes(scene->images, snapshot->images);
+    SnapshotShapes(scene->tokens, snapshot->tokens);
+
+    // Small enough to serialize every time
+    {
+        JSONWriter writer(snapshot->cameras);
+        m_serializer.WriteCameras(writer, scene);
+    }
+    {
+        JSONWriter writer(snapshot->fog);
+        m_serializer.WriteFog(writer, scene->fog);
+    }
+    {
+        JSONWriter writer(snapshot->grid);
+        m_serializer.WriteGrid(writer, scene->grid);
+    }
+    {
+        JSONWriter writer(snapshot->views);
+        m_serializer.WriteViews(writer, scene);
+    }
+
+    // Walls can run to thousands but rarely change
+    const Walls& walls = scene->fog->walls;
+    if (!m_wallsText || m_walls != &walls || m_wallsVersion != walls.Version())
+    {
+        std::string text;
+        {
+            JSONWriter writer(text);
+            m_serializer.WriteWalls(writer, walls);
+        }
+        m_wallsText = std::make_shared<const std::string>(std::move(text));
+        m_walls = &walls;
+        m_wallsVersion = walls.Version();
+    }
+    snapshot->walls = m_wallsText;
+
+    snapshot->imagesLocked = scene->GetImagesLocked();
+    snapshot->tokensLocked = scene->GetTokensLocked();
+    snapshot->sourceFile = scene->sourceFile;
+
+    // Removed shapes are dropped once a snapshot doesn't see them
+    for (auto it = m_cache.begin(); it != m_cache.end();)
+    {
+        if (it->second.generation != m_generation)
+            it = m_cache.erase(it);
+        else
+            ++it;
+    }
+    return snapshot;
+}
+
+void SceneSnapshotter::Clear()
+{
+    m_cache.clear();
+    m_wallsText = nullptr;
+}
@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Actions.hpp>
+#include <JSONSerializer.h>
+
+#include <UndoHistory.h>
+
+
+UndoHistory::UndoHistory(JSONSerializer& serializer, size_t byteBudget, size_t hotActions, bool spillToDisk) :
+    m_serializer(serializer), m_byteBudget(byteBudget), m_hotActions(hotActions), m_spillToDisk(spillToDisk) {}
+
+UndoHistory::~UndoHistory()
+{
+    if (m_spillFile)
+        std::fclose(m_spillFile);
+}
+
+void UndoHistory::Push(const std::shared_ptr<Action>& action)
+{
+    ClearRedo();
+
+    Entry entry;
+    entry.action = action;
+    Measure(entry);
+    m_undo.push_back(std::move(entry));
+    Enforce();
+}
+
+bool UndoHistory::Merge(const std::shared_ptr<Action>& action)
+{
+    // The most recent action is always hot so can be merged into directly
+    if (m_undo.empty() || !m_undo.back().action->CanMerge(action))
+        return false;
+
+    m_undo.back().action->Merge(action);
+    Measure(m_undo.back());
+    ClearRedo();
+    Enforce();
+    return true;
+}
+
+std::shared_ptr<Action> UndoHistory::Undo()
+{
+    if (m_undo.empty())
+        return nullptr;
+
+    Entry entry = std::move(m_undo.back());
+    m_undo.pop_back();
+    Restore(entry);
+    entry.action->Undo();
+    // Undoing expands a compacted action
+    entry.compacted = false;
+    Measure(entry);
+    m_redo.push_back(std::move(entry));
+    return m_redo.back().action;
+}
+
+std::shared_ptr<Action> UndoHistory::Redo()
+{
+    if (m_redo.empty())
+        return nullptr;
+
+    Entry entry = std::move(m_redo.back());
+    m_redo.pop_back();
+    Restore(entry);
+    entry.action->Redo();
+    entry.compacted = false;
+    Measure(entry);
+    m_undo.push_back(std::move(entry));
+    Enforce();
+    return m_undo.back().action;
+}
+
+void UndoHistory::Clear()
+{
+    m_undo.clear();
+    m_redo.clear();
+    m_bytes = 0;
+    m_numSpilled = 0;
+    m_spillEnd = 0;
+}
+
+void UndoHistory::SetByteBudget(size_t byteBudget)
+{
+    m_byteBudget = byteBudget;
+    Enforce();
+}
+
+size_t UndoHistory::NumCompacted() const
+{
+    size_t count = 0;
+    for (const Entry& entry: m_undo)
+        count += entry.compacted;
+    return count;
+}
+
+void UndoHistory::Measure(Entry& entry)
+{
+    m_bytes -= entry.bytes;
+    entry.bytes = entry.action->ByteSize();
+    m_bytes += entry.bytes;
+}
+
+void UndoHistory::Enforce()
+{
+    // Cold actions are always compacted so they don't keep textures alive
+    size_t cold = m_undo.size() > m_hotActions ? m_undo.size() - m_hotActions : 0;
+    for (size_t i = cold; i-- > 0 && !m_undo[i].compacted;)
+        Compact(m_undo[i]);
+
+    // Over budget, compact the hot actions too (but not the one just pushed)
+    for (size_t i = cold; i + 1 < m_undo.size() && m_bytes > m_byteBudget; i++)
+        Compact(m_undo[i]);
+
+    // Then spill, oldest first
+    for (size_t i = 0; i < m_undo.size() && m_bytes > m_byteBudget && m_spillToDisk; i++)
+    {
+        if (m_undo[i].compacted && !m_undo[i].spilled && !Spill(m_undo[i]))
+            break;
+    }
+
+    // Always keep the most recent action, even if it alone is over budget
+    while (m_bytes > m_byteBudget && m_undo.size() > 1)
+    {
+        m_bytes -= m_undo.front().bytes;
+        Forget(m_undo.front());
+        m_undo.pop_front();
+    }
+}
+
+void UndoHistory::Compact(Entry& entry)
+{
+    if (entry.compacted)
+        return;
+    entry.action->Compact(m_serializer);
+    entry.compacted = true;
+    Measure(entry);
+}
+
+bool UndoHistory::Spill(Entry& entry)
+{
+    if (!m_spillFile)
+    {
+        // Removed automatically when closed
+        m_spillFile = std::tmpfile();
+        if (!m_spillFile)
+        {
+            std::cerr << "Failed to create undo spill file, keeping history in memory" << std::endl;
+            m_spillToDisk = false;
+            return false;
+        }
+    }
+
+    std::vector<std::string*> payloads;
+    entry.action->Payloads(payloads);
+    if (payloads.empty())
+    {
+        // Nothing to spill but don't check it again
+        entry.spilled = true;
+        m_numSpilled++;
+        return true;
+    }
+
+    std::fseek(m_spillFile, m_spillEnd, SEEK_SET);
+    for (std::string* payload: payloads)
+    {
+        if (std::fwrite(payload->data(), 1, payload->size(), m_spillFile) != payload->size())
+        {
+            std::cerr << "Failed to write undo spill file" << std::endl;
+            entry.spans.clear();
+            return false;
+        }
+        entry.spans.emplace_back(m_spillEnd, payload->size());
+        m_spillEnd += payload->size();
+    }
+    for (std::string* payload: payloads)
+        std::string().swap(*payload);
+
+    entry.spilled = true;
+    m_numSpilled++;
+    Measure(entry);
+    return true;
+}
+
+void UndoHistory::Restore(Entry& entry)
+{
+    if (!entry.spilled)
+        return;
+
+    std::vector<std::string*> payloads;
+    entry.action->Payloads(payloads);
+    for (size_t i = 0; i < entry.spans.size() && i < payloads.size(); i++)
+    {
+        auto [offset, size] = entry.spans[i];
+        payloads[i]->resize(size);
+        std::fseek(m_spillFile, offset, SEEK_SET);
+        if (std::fread(payloads[i]->data(), 1, size, m_spillFile) != size)
+            std::cerr << "Failed to read undo spill file" << std::endl;
+    }
+    Forget(entry);
+    Measure(entry);
+}
+
+void UndoHistory::ClearRedo()
+{
+    for (Entry& entry: m_redo)
+    {
+        m_bytes -= entry.bytes;
+        Forget(entry);
+    }
+    m_redo.clear();
+}
+
+// Releases any spilled space held by the entry
+void UndoHistory::Forget(Entry& entry)
+{
+    if (entry.spilled)
+    {
+        entry.spilled = false;
+        entry.spans.clear();
+        // The file is only appended to, reuse it once nothing refers to it
+        if (--m_numSpilled == 0)
+            m_spillEnd = 0;
+    }
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <WorkerPool.h>
+
+
+size_t WorkerPool::DefaultThreads()
+{
+    size_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? std::min(cores - 1, MAX_THREADS) : 0;
+}
+
+WorkerPool::WorkerPool(size_t numThreads)
+{
+    for (size_t i = 0; i < numThreads; i++)
+        m_threads.emplace_back(&WorkerPool::WorkerLoop, this, i + 1);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread: m_threads)
+        thread.join();
+}
+
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t, size_t)>& func)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        for (size_t i = 0; i < count; i++)
+            func(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_threads.size();
+        m_batch++;
+    }
+    m_wake.notify_all();
+    Run(0);
+
+    // Threads that woke too late find nothing left, but still have to be
+    // waited for as they may be reading the loop
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_busy == 0; });
+    m_func = nullptr;
+}
+
+void WorkerPool::WorkerLoop(size_t worker)
+{
+    uint64_t batch = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [&]() { return m_stop || m_batch != batch; });
+        if (m_stop)
+            return;
+        batch = m_batch;
+
+        lock.unlock();
+        Run(worker);
+        lock.lock();
+        if (--m_busy == 0)
+            m_done.notify_one();
+    }
+}
+
+void WorkerPool::Run(size_t worker)
+{
+    // Indices are handed out one at a time, the work per index varies a lot
+    for (size_t i = m_next++; i < m_count; i = m_next++)
+        (*m_func)(i, worker);
+}
@@ -1,14 +1,19 @@
 #include <stdio.h>
 #include <chrono>
+#include <memory>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include <Resources.h>
+#include <SceneMirror.h>
 #include <glutil/Texture.h>
 #include <model/Scene.h>
+#include <view/Renderer.h>
 #include <view/UIWindow.h>
 #include <view/Window.h>
 
@@ -16,6 +21,10 @@
 
 
 const int GRID_SHADER = 1;
+const std::chrono::seconds TEXTURE_RELEASE_INTERVAL{5};
+// A display that hasn't had a frame for this long looks for the region
+// again, the app sharing it may have restarted
+const std::chrono::seconds MIRROR_REOPEN_INTERVAL{1};
 
 void glfw_error_callback(int error, const char* description)
 {
@@ -24,32 +33,65 @@ void glfw_error_callback(int error, const char* description)
 
 Application::Application() : m_resources(std::make_shared<Resources>())
 {
-    // Setup window
-    glfwSetErrorCallback(glfw_error_callback);
-    if (!glfwInit())
+    if (!InitGLFW())
         return;
 
-    m_glfw_initialised = true;
-
     // Initialises GL contexts
     m_uiWindow = std::make_shared<UIWindow>(480, 640, m_resources);
     m_viewport = std::make_shared<Viewport>(1280, 720, static_cast<std::shared_ptr<Window>>(m_uiWindow));
 
-    // Resources must be loaded after the GL context is created by the window.
+    // GPU resources must be loaded after the GL context is created by the window.
+    m_renderer = std::make_shared<Renderer>(m_resources);
+    m_viewport->SetRenderer(m_renderer);
     LoadDefaultResources();
     controller = std::make_shared<Controller>(m_resources, m_viewport, m_uiWindow);
 }
 
+Application::Application(const std::string& mirrorName) : m_resources(std::make_shared<Resources>()), m_mirrorName(mirrorName)
+{
+    if (!InitGLFW())
+        return;
+
+    m_viewport = std::make_shared<Viewport>(1280, 720);
+    m_renderer = std::make_shared<Renderer>(m_resources);
+    m_viewport->SetRenderer(m_renderer);
+    LoadDefaultResources();
+
+    m_mirrorScene = std::make_shared<Scene>(m_resources);
+    m_mirrorScene->AddDefaultCamera();
+    m_viewport->SetScene(m_mirrorScene);
+    // There's no controller, the display only closes and goes fullscreen
+    m_viewport->closeRequested.connect([this]() { m_viewport->Close(); });
+    m_viewport->keyChanged.connect([this](int key, int scancode, int action, int mods) {
+        if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+            m_viewport->SetFullscreen(!m_viewport->IsFullscreen());
+        else if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+            m_viewport->Close();
+    });
+}
+
 Application::~Application()
 {
     m_viewport.reset();
     m_uiWindow.reset();
     controller.reset();
+    m_renderer.reset();
     m_resources.reset();
     if (m_glfw_initialised)
         glfwTerminate();
 }
 
+bool Application::InitGLFW()
+{
+    // Setup window
+    glfwSetErrorCallback(glfw_error_callback);
+    if (!glfwInit())
+        return false;
+
+    m_glfw_initialised = true;
+    return true;
+}
+
 void Application::LoadDefaultResources()
 {
     auto vertices = std::vector<Vertex>{
@@ -62,7 +104,7 @@ void Application::LoadDefaultResources()
         0, 1, 2,
         2, 3, 0,
     };
-    m_resources->CreateMesh(Resources::MeshType::Quad, vertices, indices);
+    m_renderer->CreateMesh(Renderer::MeshType::Quad, vertices, indices);
 
     vertices = std::vector<Vertex>{
         {{-1.0f, -1.0f,  0.0f}, { 0.0f,  0.0f,  1.0f}, {0.0f, 0.0f}},
@@ -70,13 +112,15 @@ void Application::LoadDefaultResources()
         {{ 1.0f,  1.0f,  0.0f}, { 0.0f,  0.0f,  1.0f}, {1.0f, 1.0f}},
         {{-1.0f,  1.0f,  0.0f}, { 0.0f,  0.0f,  1.0f}, {0.0f, 1.0f}},
     };
-    m_resources->CreateMesh(Resources::MeshType::Quad2, vertices, indices);
+    m_renderer->CreateMesh(Renderer::MeshType::Quad2, vertices, indices);
 
-    m_resources->CreateShader(Resources::ShaderType::Grid, "resources/shaders/Grid.vs", "resources/shaders/Grid.fs");
-    m_resources->CreateShader(Resources::ShaderType::ScreenRect, "resources/shaders/Grid.vs", "resources/shaders/Rect.fs");
-    m_resources->CreateShader(Resources::ShaderType::Image, "resources/shaders/SimpleTexture.vs", "resources/shaders/SimpleTexture.fs");
-    m_resources->CreateShader(Resources::ShaderType::Status, "resources/shaders/SimpleTexture.vs", "resources/shaders/Status.fs");
-    m_resources->CreateShader(Resources::ShaderType::Token, "resources/shaders/SimpleTexture.vs", "resources/shaders/Token.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Flat, "resources/shaders/Flat.vs", "resources/shaders/Flat.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Fog, "resources/shaders/Grid.vs", "resources/shaders/Fog.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Grid, "resources/shaders/Grid.vs", "resources/shaders/Grid.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::ScreenRect, "resources/shaders/Grid.vs", "resources/shaders/Rect.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Image, "resources/shaders/SimpleTexture.vs", "resources/shaders/SimpleTexture.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Status, "resources/shaders/SimpleTexture.vs", "resources/shaders/Status.fs");
+    m_renderer->CreateShader(Renderer::ShaderType::Token, "resources/shaders/SimpleTexture.vs", "resources/shaders/Token.fs");
 
     m_resources->CreateTexture(Resources::TextureType::Default, "resources/images/QuestionMark.jpg");
     m_resources->CreateTexture(Resources::TextureType::Status, "resources/images/StatusDot.png");
@@ -85,7 +129,7 @@ void Application::LoadDefaultResources()
 
 bool Application::IsInitialised()
 {
-    return m_glfw_initialised && m_viewport->IsInitialised() && m_uiWindow->IsInitialised();
+    return m_glfw_initialised && m_viewport->IsInitialised() && (!m_uiWindow || m_uiWindow->IsInitialised());
 }
 
 void Application::Exec()
@@ -94,15 +138,47 @@ void Application::Exec()
     glEnable(GL_BLEND);
 
     // Main loop
+    auto lastRelease = std::chrono::steady_clock::now();
     while (!m_viewport->IsClosed())
     {
         glfwPollEvents();
     
+        if (controller)
+            controller->Update();
+        else
+            UpdateMirror();
         m_viewport->Render();
         if (m_uiWindow)
             m_uiWindow->Render();
 
+        // Textures only kept alive by compacted undo history don't need to
+        // stay on the GPU
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRelease > TEXTURE_RELEASE_INTERVAL)
+        {
+            m_renderer->ReleaseUnusedTextures();
+            lastRelease = now;
+        }
+
         // Lazy hack to limit frame rate for now
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 }
+
+void Application::UpdateMirror()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (m_mirror && m_mirror->Read())
+    {
+        m_mirror->Apply(*m_mirrorScene, *m_resources);
+        m_mirror->ApplyCamera(*m_viewport->GetCamera());
+        m_viewport->RefreshCamera();
+        m_lastMirrorFrame = now;
+    }
+    else if (now - m_lastMirrorFrame > MIRROR_REOPEN_INTERVAL)
+    {
+        m_lastMirrorFrame = now;
+        if (std::unique_ptr<SceneMirrorReader> mirror = SceneMirrorReader::Open(m_mirrorName))
+            m_mirror = std::move(mirror);
+    }
+}
@@ -1,4 +1,5 @@
-#include <fstream>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <variant>
@@ -16,8 +17,19 @@
 #include <controller/Controller.h>
 
 
+// Scenes that have been saved to a file are saved again periodically
+const std::chrono::seconds AUTOSAVE_INTERVAL{120};
+// Drags are previewed to other users every other frame at 60Hz, a little
+// under two frames so timing noise doesn't skip to every third
+const std::chrono::milliseconds MOTION_INTERVAL{30};
+// How close in pixels the cursor has to be to snap to or pick a wall
+const float WALL_PICK_PIXELS = 8.0f;
+// The host sees through the fog to the map underneath
+const float HOST_FOG_OPACITY = 0.6f;
+
+
 Controller::Controller(std::shared_ptr<Resources> resources, std::shared_ptr<Viewport> viewport, std::shared_ptr<UIWindow> uiWindow) :
-    m_resources(resources), m_viewport(viewport), m_uiWindow(uiWindow), m_serializer(m_resources)
+    m_resources(resources), m_viewport(viewport), m_uiWindow(uiWindow), m_serializer(m_resources), m_history(m_serializer), m_document(m_resources, m_serializer), m_clipboard(m_serializer), m_host(m_resources), m_client(m_resources)
 {
     m_viewport->cursorMoved.connect(this, &Controller::OnViewportMouseMove);
     m_viewport->keyChanged.connect(this, &Controller::OnViewportKey);
@@ -25,6 +37,7 @@ Controller::Controller(std::shared_ptr<Resources> resources, std::shared_ptr<Vie
     m_viewport->mouseScrolled.connect(this, &Controller::OnViewportMouseScroll);
     m_viewport->sizeChanged.connect(this, &Controller::OnViewportSizeChanged);
     m_viewport->closeRequested.connect(this, &Controller::OnCloseRequested);
+    m_viewport->focusChanged.connect(this, &Controller::OnViewportFocusChanged);
 
     m_uiWindow->saveClicked.connect(this, &Controller::Save);
     m_uiWindow->loadClicked.connect(this, &Controller::Load);
@@ -35,6 +48,7 @@ Controller::Controller(std::shared_ptr<Resources> resources, std::shared_ptr<Vie
     m_uiWindow->tokenPropertyChanged.connect(this, &Controller::OnTokenPropertyChanged);
     m_uiWindow->imagePropertyChanged.connect(this, &Controller::OnImagePropertyChanged);
     m_uiWindow->gridPropertyChanged.connect(this, &Controller::OnGridPropertyChanged);
+    m_uiWindow->fogPropertyChanged.connect(this, &Controller::OnFogPropertyChanged);
     m_uiWindow->cameraPropertyChanged.connect(this, &Controller::OnCameraPropertyChanged);
     m_uiWindow->addTokenClicked.connect(this, &Controller::OnUIAddTokenClicked);
     m_uiWindow->addImageClicked.connect(this, &Controller::OnUIAddImageClicked);
@@ -44,14 +58,24 @@ Controller::Controller(std::shared_ptr<Resources> resources, std::shared_ptr<Vie
     m_uiWindow->cameraSelectionChanged.connect(this, &Controller::SetHostCamera);
     m_uiWindow->cloneCameraClicked.connect(this, &Controller::CloneCamera);
     m_uiWindow->deleteCameraClicked.connect(this, &Controller::DeleteCamera);
+    m_uiWindow->hostClicked.connect(this, &Controller::Host);
+    m_uiWindow->joinClicked.connect(this, &Controller::Join);
+    m_uiWindow->disconnectClicked.connect(this, &Controller::Disconnect);
+    m_uiWindow->assignOwnerClicked.connect(this, &Controller::AssignSelectedTokens);
+    m_uiWindow->visionRangeChanged.connect(this, &Controller::SetVisionRange);
+    m_uiWindow->mirrorChanged.connect(this, &Controller::SetMirrored);
+    m_uiWindow->wallToolChanged.connect(this, &Controller::SetWallTool);
+    m_uiWindow->clearWallsClicked.connect(this, &Controller::ClearWalls);
 
     SetScene(std::make_shared<Scene>(m_resources));
 }
 
 Controller::~Controller()
 {
-    undoQueue.clear();
-    redoQueue.clear();
+    m_history.Clear();
+    m_document.Finish(m_scene);
+    // Clean exit, nothing to recover
+    m_document.Discard();
 }
 
 // Scene Management
@@ -66,48 +90,58 @@ void Controller::SetScene(std::shared_ptr<Scene> scene)
     m_scene = scene;
     m_viewport->SetScene(scene);
     m_uiWindow->SetScene(scene);
-    undoQueue.clear();
-    redoQueue.clear();
+    moveTransaction = MoveTransaction();
+    m_history.Clear();
+    m_document.Start(scene);
+    m_host.Resync();
+    m_motion.Clear();
 }
 
 void Controller::Save(std::string path)
 {
-    std::cerr << "Saving to " << path << std::endl;
-    std::ofstream myfile (path);
-    if (myfile.is_open())
-    {
-        myfile << m_serializer.SerializeScene(m_scene);
-        myfile.close();
-        m_scene->sourceFile = path;
-    }
-    else
-        std::cerr << "Unable to open file" << std::endl;
+    m_document.Save(m_scene, path);
 }
 
 void Controller::Load(std::string path, bool merge)
 {
-    std::cerr << "Loading Scene from " << path << std::endl;
-    nlohmann::json j;
-    std::ifstream myfile (path);
-    if (myfile.is_open())
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(m_resources);
+    if (!m_document.Read(path, *scene))
+        return;
+
+    // Cloned in case the file holds shapes already in the scene
+    if (merge)
+        Merge(Clipboard::Clone(m_resources, scene->tokens, scene->images));
+    else
     {
-        myfile >> j;
-        myfile.close();
-        std::shared_ptr<Scene> scene = std::make_shared<Scene>(m_resources);
-        if (merge)
-        {
-            m_serializer.DeserializeScene(j, *scene);
-            Merge(scene);
-        }
-        else
-        {
-            m_serializer.DeserializeScene(j, *scene);
-            scene->sourceFile = path;
-            SetScene(scene);
-        }
+        scene->sourceFile = path;
+        SetScene(scene);
+        Recover();
     }
-    else
-        std::cerr << "Unable to open file" << std::endl;
+}
+
+bool Controller::Recover()
+{
+    std::shared_ptr<Scene> scene = m_scene;
+    if (!m_document.Replay(scene))
+        return false;
+
+    SetScene(scene);
+    m_document.Recovered(m_scene);
+    return true;
+}
+
+void Controller::Update()
+{
+    // Everything below sees the real positions of tokens others are dragging
+    m_motion.Restore(*m_scene);
+    UpdateSync();
+    m_document.Update(m_scene);
+    m_document.Autosave(m_scene, AUTOSAVE_INTERVAL);
+    m_motion.Apply(*m_scene);
+    UpdateFog();
+    // Drags in progress included, as they're shown here
+    if (m_mirror)
+        m_mirror->Write(*m_scene);
 }
 
 void Controller::Merge(const std::shared_ptr<Scene>& scene)
@@ -131,7 +165,7 @@ void Controller::Merge(const std::shared_ptr<Scene>& scene)
 
     if (!actionGroup->IsEmpty())
     {
-        actionGroup->Add(std::make_shared<SelectShapesAction>(SelectedShapes(), shapes));
+        actionGroup->Add(std::make_shared<SelectShapesAction>(m_scene, shapes));
         PerformAction(actionGroup);
     }
 }
@@ -145,11 +179,9 @@ void Controller::SetImagesLocked(bool locked)
     // Deselect images
     if (HasSelectedImages())
     {
-        auto selectedShapes = SelectedShapes();
-        std::vector<std::shared_ptr<Shape2D>> newSelectedShapes;
-        std::copy_if(selectedShapes.begin(), selectedShapes.end(), std::back_inserter(newSelectedShapes),
-                     [](const auto& shape){ return !std::dynamic_pointer_cast<BGImage>(shape);});
-        actionGroup->Add(std::make_shared<SelectShapesAction>(selectedShapes, newSelectedShapes));
+        auto selectedTokens = SelectedTokens();
+        std::vector<std::shared_ptr<Shape2D>> newSelectedShapes(selectedTokens.begin(), selectedTokens.end());
+        actionGroup->Add(std::make_shared<SelectShapesAction>(m_scene, newSelectedShapes));
     }
     PerformAction(actionGroup);
 }
@@ -162,11 +194,9 @@ void Controller::SetTokensLocked(bool locked)
     // Deselect tokens
     if (HasSelectedTokens())
     {
-        auto selectedShapes = SelectedShapes();
-        std::vector<std::shared_ptr<Shape2D>> newSelectedShapes;
-        std::copy_if(selectedShapes.begin(), selectedShapes.end(), std::back_inserter(newSelectedShapes),
-                     [](const auto& shape){ return !std::dynamic_pointer_cast<Token>(shape);});
-        actionGroup->Add(std::make_shared<SelectShapesAction>(selectedShapes, newSelectedShapes));
+        auto selectedImages = SelectedImages();
+        std::vector<std::shared_ptr<Shape2D>> newSelectedShapes(selectedImages.begin(), selectedImages.end());
+        actionGroup->Add(std::make_shared<SelectShapesAction>(m_scene, newSelectedShapes));
     }
     PerformAction(actionGroup);
 }
@@ -174,67 +204,46 @@ void Controller::SetTokensLocked(bool locked)
 // Selection
 std::vector<std::shared_ptr<Shape2D>> Controller::SelectedShapes()
 {
-    // TODO: Could this return an iterator? would be nicer.
     std::vector<std::shared_ptr<Shape2D>> selectedShapes;
-    for (const auto& token : m_scene->tokens)
-    {
-        if (token->isSelected)
-            selectedShapes.push_back(static_cast<std::shared_ptr<Shape2D>>(token));
-    }
-
-    for (const auto& image : m_scene->images)
-    {
-        if (image->isSelected)
-            selectedShapes.push_back(static_cast<std::shared_ptr<Shape2D>>(image));
-    }
+    selectedShapes.reserve(m_scene->NumSelected());
+    for (const auto& token : SelectedTokens())
+        selectedShapes.push_back(static_cast<std::shared_ptr<Shape2D>>(token));
+    for (const auto& image : SelectedImages())
+        selectedShapes.push_back(static_cast<std::shared_ptr<Shape2D>>(image));
 
     return selectedShapes;
 }
 
 std::vector<std::shared_ptr<Token>> Controller::SelectedTokens()
 {
-    // TODO: Could this return an iterator? would be nicer.
+    const std::vector<ShapeID>& members = m_scene->GetTokenSelection().Members();
     std::vector<std::shared_ptr<Token>> selectedTokens;
-    for (const auto& token : m_scene->tokens)
-    {
-        if (token->isSelected)
-            selectedTokens.push_back(token);
-    }
+    selectedTokens.reserve(members.size());
+    for (ShapeID id : members)
+        selectedTokens.push_back(m_scene->GetToken(id));
 
     return selectedTokens;
 }
 
 std::vector<std::shared_ptr<BGImage>> Controller::SelectedImages()
 {
-    // TODO: Could this return an iterator? would be nicer.
+    const std::vector<ShapeID>& members = m_scene->GetImageSelection().Members();
     std::vector<std::shared_ptr<BGImage>> selectedImages;
-    for (const auto& image : m_scene->images)
-    {
-        if (image->isSelected)
-            selectedImages.push_back(image);
-    }
+    selectedImages.reserve(members.size());
+    for (ShapeID id : members)
+        selectedImages.push_back(m_scene->GetImage(id));
 
     return selectedImages;
 }
 
 bool Controller::HasSelectedTokens()
 {
-    for (const auto& token : m_scene->tokens)
-    {
-        if (token->isSelected)
-            return true;
-    }
-    return false;
+    return !m_scene->GetTokenSelection().IsEmpty();
 }
 
 bool Controller::HasSelectedImages()
 {
-    for (const auto& image : m_scene->images)
-    {
-        if (image->isSelected)
-            return true;
-    }
-    return false;
+    return !m_scene->GetImageSelection().IsEmpty();
 }
 
 bool Controller::HasSelectedShapes()
@@ -244,7 +253,37 @@ bool Controller::HasSelectedShapes()
 
 void Controller::ClearSelection()
 {
-    PerformAction(std::make_shared<SelectShapesAction>(SelectedShapes()));
+    PerformAction(std::make_shared<SelectShapesAction>(m_scene));
+}
+
+void Controller::SelectAll()
+{
+    std::vector<std::shared_ptr<Shape2D>> shapes;
+    if (!m_scene->GetTokensLocked())
+        shapes.insert(shapes.end(), m_scene->tokens.begin(), m_scene->tokens.end());
+    if (!m_scene->GetImagesLocked())
+        shapes.insert(shapes.end(), m_scene->images.begin(), m_scene->images.end());
+    PerformAction(std::make_shared<SelectShapesAction>(m_scene, shapes));
+}
+
+void Controller::InvertSelection()
+{
+    std::vector<std::shared_ptr<Shape2D>> shapes;
+    if (!m_scene->GetTokensLocked())
+    {
+        const Selection& selection = m_scene->GetTokenSelection();
+        for (size_t i = 0; i < m_scene->tokens.size(); i++)
+            if (!selection.IsSelected(i))
+                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(m_scene->tokens[i]));
+    }
+    if (!m_scene->GetImagesLocked())
+    {
+        const Selection& selection = m_scene->GetImageSelection();
+        for (size_t i = 0; i < m_scene->images.size(); i++)
+            if (!selection.IsSelected(i))
+                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(m_scene->images[i]));
+    }
+    PerformAction(std::make_shared<SelectShapesAction>(m_scene, shapes));
 }
 
 void Controller::SelectShape(std::shared_ptr<Shape2D> shape, bool additive)
@@ -266,17 +305,17 @@ void Controller::SelectShape(std::shared_ptr<Shape2D> shape, bool additive)
             return;
     }
 
-    PerformAction(std::make_shared<SelectShapesAction>(SelectedShapes(), shape, additive));
+    PerformAction(std::make_shared<SelectShapesAction>(m_scene, shape, additive));
 }
 
 // void Controller::SelectShape(const std::shared_ptr<Shape2D>& shape, bool additive)
 // {
-//     PerformAction(std::make_shared<SelectShapesAction>(SelectedShapes(), shape, additive));
+//     PerformAction(std::make_shared<SelectShapesAction>(m_scene, shape, additive));
 // }
 
 void Controller::SelectShapes(const std::vector<std::shared_ptr<Shape2D>>& shapes, bool additive)
 {
-    PerformAction(std::make_shared<SelectShapesAction>(SelectedShapes(), shapes, additive));
+    PerformAction(std::make_shared<SelectShapesAction>(m_scene, shapes, additive));
     for (const auto& shape: shapes)
     {
         auto token = std::dynamic_pointer_cast<Token>(shape);
@@ -298,8 +337,8 @@ bool Controller::CopySelected()
     if (!HasSelectedShapes())
         return false;
 
-    std::string string = m_serializer.SerializeScene(m_scene, SerializeFlag::Image |SerializeFlag::Token | SerializeFlag::Selected).dump();
-    m_viewport->CopyToClipboard(string);
+    // The system clipboard is only given text once focus leaves the app
+    m_clipboard.Copy(SelectedTokens(), SelectedImages());
     return true;
 }
 
@@ -311,18 +350,30 @@ void Controller::CutSelected()
 
 void Controller::PasteSelected()
 {
+    // Once exported, anything else on the system clipboard was copied later
+    // by another application
+    if (!m_clipboard.IsEmpty() && (!m_clipboard.IsExported() || m_viewport->GetClipboard() == m_clipboard.Text(m_resources)))
+    {
+        Merge(m_clipboard.Paste(m_resources));
+        return;
+    }
+
     std::string text = m_viewport->GetClipboard();
     if (text.empty())
         return;
     
-    std::shared_ptr<Scene> scene = m_serializer.DeserializeScene(text);
-    Merge(scene);
+    // Anything else on the clipboard is ignored. The text keeps the IDs of the
+    // shapes it was copied from, so it's cloned.
+    std::shared_ptr<Scene> scene = m_serializer.ReadScene(text);
+    if (scene)
+        Merge(Clipboard::Clone(m_resources, scene->tokens, scene->images));
 }
 
 void Controller::DuplicateSelected()
 {
-    if (CopySelected())
-        PasteSelected();
+    // Leaves the clipboard as it was
+    if (HasSelectedShapes())
+        Merge(Clipboard::Clone(m_resources, SelectedTokens(), SelectedImages()));
 }
 
 void Controller::DeleteSelected()
@@ -405,37 +456,7 @@ std::vector<std::shared_ptr<Shape2D>> Controller::ShapesInScreenRect(float minx,
     glm::vec2 lo = m_viewport->ScreenToWorldPos(minx, miny);
     glm::vec2 hi = m_viewport->ScreenToWorldPos(maxx, maxy);
 
-    std::vector<std::shared_ptr<Shape2D>> shapes;
-
-    if (!m_scene->GetTokensLocked())
-    {
-        for (const std::shared_ptr<Token>& token: m_scene->tokens)
-        {
-            float radius = token->GetModel()->GetScalef() * 0.5f;
-            glm::vec2 tokenPos = token->GetModel()->GetPos();
-            if (tokenPos.x + radius > lo.x && tokenPos.x - radius < hi.x
-                && tokenPos.y + radius > lo.y && tokenPos.y - radius < hi.y)
-            {
-                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(token));
-            }
-        }
-    }
-
-    if (!m_scene->GetImagesLocked())
-    {
-        for (const std::shared_ptr<BGImage>& image: m_scene->images)
-        {
-            glm::vec2 scale = image->GetModel()->GetScale() * 0.5f;
-            glm::vec2 imageMin = image->GetModel()->GetPos() - scale;
-            glm::vec2 imageMax = image->GetModel()->GetPos() + scale;
-            if (imageMax.x > lo.x && imageMin.x < hi.x && imageMax.y > lo.y && imageMin.y < hi.y)
-            {
-                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(image));
-            }
-        }
-    }
-
-    return shapes;
+    return m_scene->ShapesInRect(lo, hi);
 }
 
 std::shared_ptr<Shape2D> Controller::GetShapeAtScreenPos(glm::vec2 screenPos)
@@ -476,11 +497,7 @@ bool Controller::IsDragSelecting()
 
 void Controller::StartDragSelection(float xpos, float ypos)
 {
-    dragSelectRect = std::make_shared<RectOverlay>(
-        m_resources->GetMesh(Resources::MeshType::Quad2),
-        m_resources->GetShader(Resources::ShaderType::ScreenRect),
-        glm::vec4(SELECTION_COLOR, OVERLAY_OPACITY)
-    );
+    dragSelectRect = std::make_shared<RectOverlay>(glm::vec4(SELECTION_COLOR, OVERLAY_OPACITY));
     // GL uses inverted Y-axis
     dragSelectRect->startCorner = dragSelectRect->endCorner = glm::vec2(xpos, m_viewport->Height() - ypos);
     m_scene->overlays.push_back(static_cast<std::shared_ptr<Overlay>>(dragSelectRect));
@@ -538,6 +555,10 @@ void Controller::OnViewportMouseMove(double xpos, double ypos)
     lastMouseY = ypos;
 
     glm::vec2 worldPos = m_viewport->ScreenToWorldPos(xpos, ypos);
+    // The last point of the wall being drawn follows the cursor
+    if (!m_scene->fog->draft.empty())
+        m_scene->fog->draft.back() = SnapWallPoint(worldPos);
+
     // TODO: Change this.
     //   Can be optimised to track what's highlighted and explicitly clear it.
     //   Also shouldn't rely on the `lock` options in mouse move
@@ -568,31 +589,18 @@ void Controller::OnViewportMouseMove(double xpos, double ypos)
         m_viewport->GetCamera()->Pan(m_viewport->ScreenToWorldOffset(xoffset, yoffset));
         m_viewport->RefreshCamera();
     }
-    else if (leftMouseHeld && shapeUnderCursor)
+    else if (leftMouseHeld && InMoveTransaction())
     {
         if (m_scene->grid->GetSnapEnabled())
         {
+            // Offset is relative to where the shape under the cursor started
+            size_t anchor = moveTransaction.anchor;
             glm::vec2 newPos = m_scene->grid->ShapeSnapPosition(shapeUnderCursor, m_viewport->ScreenToWorldPos(xpos, ypos));
-            glm::vec2 currPos = shapeUnderCursor->GetModel()->GetPos();
-            if (newPos != currPos)
-            {
-                std::shared_ptr<ActionGroup> actionGroup = std::make_shared<ActionGroup>();
-                glm::vec2 offset = newPos - currPos;
-                for (const std::shared_ptr<Shape2D>& shape : SelectedShapes())
-                    actionGroup->Add(std::make_shared<ModifyMatrix2DVec2>(shape->GetModel(), &Matrix2D::SetPos, shape->GetModel()->GetPos(), shape->GetModel()->GetPos() + offset));
-
-                PerformAction(actionGroup);
-            }
+            if (anchor < moveTransaction.ids.size())
+                UpdateMoveTransaction(newPos - moveTransaction.startPositions[anchor]);
         }
         else
-        {
-            std::shared_ptr<ActionGroup> actionGroup = std::make_shared<ActionGroup>();
-            glm::vec2 offset = m_viewport->ScreenToWorldOffset(xoffset, yoffset);
-            for (std::shared_ptr<Shape2D> shape : SelectedShapes())
-                actionGroup->Add(std::make_shared<ModifyMatrix2DVec2>(shape->GetModel(), &Matrix2D::SetPos, shape->GetModel()->GetPos(), shape->GetModel()->GetPos() + offset));
-
-            PerformAction(actionGroup);
-        }
+            UpdateMoveTransaction(moveTransaction.offset + m_viewport->ScreenToWorldOffset(xoffset, yoffset));
     }
     else if (leftMouseHeld && IsDragSelecting())
         UpdateDragSelection(xpos, ypos);
@@ -602,6 +610,17 @@ void Controller::OnViewportMouseButton(int button, int action, int mods)
 {
     if (button == GLFW_MOUSE_BUTTON_MIDDLE)
         middleMouseHeld = action == GLFW_PRESS;
+    if (m_scene->fog->showWalls && action == GLFW_PRESS && button != GLFW_MOUSE_BUTTON_MIDDLE)
+    {
+        glm::vec2 worldPos = m_viewport->ScreenToWorldPos(m_viewport->CursorPos().x, m_viewport->CursorPos().y);
+        if (button == GLFW_MOUSE_BUTTON_RIGHT)
+            FinishWall();
+        else if (button == GLFW_MOUSE_BUTTON_LEFT && mods & GLFW_MOD_CONTROL)
+            RemoveWallAt(worldPos);
+        else if (button == GLFW_MOUSE_BUTTON_LEFT)
+            AddWallPoint(worldPos);
+        return;
+    }
     if (button == GLFW_MOUSE_BUTTON_LEFT)
     {
         if (action == GLFW_PRESS)
@@ -609,14 +628,18 @@ void Controller::OnViewportMouseButton(int button, int action, int mods)
             // TODO: Selection action should be combined with move action, ie, undo undoes the selection and the movement
             glm::vec2 cursorPos = m_viewport->CursorPos();
             shapeUnderCursor = GetShapeAtScreenPos(cursorPos);
-            if (shapeUnderCursor && !shapeUnderCursor->isSelected)
+            if (shapeUnderCursor && !m_scene->IsSelected(shapeUnderCursor->GetID()))
                 SelectShape(shapeUnderCursor, mods & (GLFW_MOD_SHIFT | GLFW_MOD_CONTROL));
             // If nothing was immediately selected/being modified, start a drag select
             else if (!shapeUnderCursor)
                 StartDragSelection(cursorPos.x, cursorPos.y);
+
+            if (shapeUnderCursor)
+                BeginMoveTransaction();
         }
         else if (action == GLFW_RELEASE)
         {
+            CommitMoveTransaction();
             shapeUnderCursor = nullptr;
             if (IsDragSelecting())
                 FinishDragSelection(mods & GLFW_MOD_SHIFT);
@@ -631,26 +654,28 @@ void Controller::OnViewportMouseScroll(double xoffset, double yoffset)
     m_viewport->RefreshCamera();
 }
 
+void Controller::StepSelectedGridSize(int step)
+{
+    auto action = std::make_shared<BatchPropertyAction<ShapeProperty::Scale>>(m_scene);
+    for (const std::shared_ptr<Shape2D>& shape: SelectedShapes())
+    {
+        ShapeGridSize gridSize = static_cast<ShapeGridSize>(m_scene->grid->GetShapeGridSize(shape) + step);
+        action->Add(shape->GetID(), shape->GetModel()->GetScale(), glm::vec2(m_scene->grid->SnapGridSize(gridSize)));
+    }
+    if (!action->IsEmpty())
+        PerformAction(action);
+}
+
 void Controller::OnViewportKey(int key, int scancode, int action, int mods)
 {
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
         m_viewport->SetFullscreen(!m_viewport->IsFullscreen());
     if (key == GLFW_KEY_KP_ADD && action == GLFW_RELEASE && HasSelectedShapes())
-    {
-        for (std::shared_ptr<Shape2D> shape : SelectedShapes())
-        {
-            ShapeGridSize gridSize = static_cast<ShapeGridSize>(m_scene->grid->GetShapeGridSize(shape) + 1);
-            shape->GetModel()->SetScalef(m_scene->grid->SnapGridSize(gridSize));
-        }
-    }
+        StepSelectedGridSize(1);
     if (key == GLFW_KEY_KP_SUBTRACT && action == GLFW_RELEASE && HasSelectedShapes())
-    {
-        for (std::shared_ptr<Shape2D> shape : SelectedShapes())
-        {
-            ShapeGridSize gridSize = static_cast<ShapeGridSize>(m_scene->grid->GetShapeGridSize(shape) - 1);
-            shape->GetModel()->SetScalef(m_scene->grid->SnapGridSize(gridSize));
-        }
-    }
+        StepSelectedGridSize(-1);
+    if (key == GLFW_KEY_ENTER && action == GLFW_PRESS)
+        FinishWall();
     if (key == GLFW_KEY_DELETE && HasSelectedShapes())
         DeleteSelected();
     if (key == GLFW_KEY_D && action == GLFW_PRESS && mods & GLFW_MOD_CONTROL)
@@ -661,6 +686,10 @@ void Controller::OnViewportKey(int key, int scancode, int action, int mods)
         CutSelected();
     if (key == GLFW_KEY_V && action == GLFW_PRESS && mods & GLFW_MOD_CONTROL)
         PasteSelected();
+    if (key == GLFW_KEY_A && action == GLFW_PRESS && mods & GLFW_MOD_CONTROL)
+        SelectAll();
+    if (key == GLFW_KEY_I && action == GLFW_PRESS && mods & GLFW_MOD_CONTROL)
+        InvertSelection();
     OnKeyChanged(key, scancode, action, mods);
 }
 
@@ -669,12 +698,19 @@ void Controller::OnViewportSizeChanged(int width, int height)
     m_viewport->RefreshCamera();
 }
 
+void Controller::OnViewportFocusChanged(bool focused)
+{
+    // Another application may be about to paste
+    if (!focused && !m_clipboard.IsEmpty() && !m_clipboard.IsExported())
+    {
+        m_viewport->CopyToClipboard(m_clipboard.Text(m_resources));
+        m_clipboard.SetExported();
+    }
+}
+
 void Controller::OnUIAddTokenClicked()
 {
-    auto token = std::make_shared<Token>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(Resources::TextureType::Default)
-    );
+    auto token = std::make_shared<Token>(m_resources->GetTexture(Resources::TextureType::Default));
     // Centers it on the camera view
     token->GetModel()->SetPos(glm::vec2(m_viewport->GetCamera()->Position.x, m_viewport->GetCamera()->Position.y));
     std::shared_ptr<AddTokensAction> action = std::make_shared<AddTokensAction>(m_scene, token);
@@ -685,7 +721,6 @@ void Controller::OnUIAddTokenClicked()
 void Controller::OnUIAddImageClicked()
 {
     PerformAction(std::make_shared<AddImagesAction>(m_scene, std::make_shared<BGImage>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
         m_resources->GetTexture(Resources::TextureType::Default)
     )));
 }
@@ -702,26 +737,146 @@ void Controller::OnUIKeyChanged(int key, int scancode, int action, int mods)
 
 void Controller::PerformAction(const std::shared_ptr<Action>& action)
 {
+    // A client's scene only changes through the host, selection aside
+    if (m_client.IsConnected() && !std::dynamic_pointer_cast<SelectShapesAction>(action))
+    {
+        PredictAction(action);
+        return;
+    }
     action->Redo();
-    if (undoQueue.size() > 0 && undoQueue.back()->CanMerge(action))
-        undoQueue.back()->Merge(action);
+    if (m_history.Merge(action))
+    {
+        ActionEffects effects;
+        action->Effects(effects);
+        m_document.Defer(effects);
+        m_host.Record(effects);
+    }
     else
+        CommitAction(action);
+}
+
+void Controller::CommitAction(const std::shared_ptr<Action>& action)
+{
+    m_history.Push(action);
+    JournalAction(action);
+}
+
+void Controller::JournalAction(const std::shared_ptr<Action>& action)
+{
+    ActionEffects effects;
+    action->Effects(effects);
+    m_document.Record(m_scene, effects);
+    m_host.Record(effects);
+}
+
+// Move Transactions
+void Controller::BeginMoveTransaction()
+{
+    CancelMoveTransaction();
+    moveTransaction.active = true;
+    for (const auto& shape: SelectedShapes())
+    {
+        if (shape == shapeUnderCursor)
+            moveTransaction.anchor = moveTransaction.ids.size();
+        moveTransaction.ids.push_back(shape->GetID());
+        moveTransaction.models.push_back(shape->GetModel());
+        moveTransaction.startPositions.push_back(shape->GetModel()->GetPos());
+    }
+}
+
+void Controller::UpdateMoveTransaction(glm::vec2 offset)
+{
+    if (!moveTransaction.active || offset == moveTransaction.offset)
+        return;
+
+    moveTransaction.offset = offset;
+    for (size_t i = 0; i < moveTransaction.models.size(); i++)
+        moveTransaction.models[i]->SetPos(moveTransaction.startPositions[i] + offset);
+}
+
+void Controller::CommitMoveTransaction()
+{
+    if (m_client.IsConnected())
+    {
+        // Owned tokens move as predicted and the rest snap back
+        std::vector<ShapeID> owned;
+        std::vector<glm::vec2> ownedStarts;
+        for (size_t i = 0; i < moveTransaction.ids.size(); i++)
+        {
+            if (m_client.Owns(moveTransaction.ids[i]))
+            {
+                owned.push_back(moveTransaction.ids[i]);
+                ownedStarts.push_back(moveTransaction.startPositions[i]);
+            }
+        }
+        glm::vec2 offset = moveTransaction.offset;
+        bool moved = moveTransaction.active && offset != glm::vec2(0) && !owned.empty();
+        // Others hold the requested position until the host's arrives
+        StreamMoveTransaction(true);
+        moveTransaction.streamed = false;
+        CancelMoveTransaction();
+        if (moved)
+            PerformAction(std::make_shared<MoveShapesAction>(m_scene, std::move(owned), std::move(ownedStarts), offset));
+        return;
+    }
+    StreamMoveTransaction(true);
+    if (moveTransaction.active && moveTransaction.offset != glm::vec2(0))
+        CommitAction(std::make_shared<MoveShapesAction>(m_scene, std::move(moveTransaction.ids), std::move(moveTransaction.startPositions),
+                                                       moveTransaction.offset));
+    moveTransaction = MoveTransaction();
+}
+
+// Restores the start positions without adding an action
+void Controller::CancelMoveTransaction()
+{
+    UpdateMoveTransaction(glm::vec2(0));
+    StreamMoveTransaction(true);
+    moveTransaction = MoveTransaction();
+}
+
+void Controller::StreamMoveTransaction(bool final)
+{
+    if (!moveTransaction.active || (!m_host.IsListening() && !m_client.IsConnected()))
+        return;
+    // Nothing to end if the drag was never previewed
+    auto now = std::chrono::steady_clock::now();
+    if (final ? !moveTransaction.streamed
+              : moveTransaction.offset == moveTransaction.streamedOffset || now - moveTransaction.lastStreamed < MOTION_INTERVAL)
+        return;
+
+    std::vector<MotionSample> samples;
+    for (size_t i = 0; i < moveTransaction.ids.size(); i++)
     {
-        undoQueue.push_back(std::move(action));
-        if (undoQueue.size() > MAX_UNDO_SIZE)
-            undoQueue.pop_front();
-        redoQueue.clear();
+        // Images aren't previewed
+        if (m_scene->GetTokenIndex(moveTransaction.ids[i]) != NO_INDEX)
+            samples.push_back({moveTransaction.ids[i], QuantizePosition(moveTransaction.startPositions[i] + moveTransaction.offset)});
     }
+    if (m_client.IsConnected())
+        m_client.StreamMotion(samples, final);
+    else
+        m_host.StreamMotion(samples, final);
+    moveTransaction.streamed = true;
+    moveTransaction.streamedOffset = moveTransaction.offset;
+    moveTransaction.lastStreamed = now;
+}
+
+bool Controller::InMoveTransaction() { return moveTransaction.active; }
+
+// Returns a function setting every shape to the same value
+template <typename T>
+static auto SetTo(T value)
+{
+    return [value](const T&) { return value; };
 }
 
 void Controller::OnTokenPropertyChanged(const std::shared_ptr<Token>& token, TokenProperty property, TokenPropertyValue value)
 {
-    auto actionGroup = std::make_shared<ActionGroup>();
+    std::shared_ptr<Action> action;
+    auto selectedTokens = SelectedTokens();
     switch (property)
     {
     case Token_Name:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenString>(selectedToken, &Token::SetName, selectedToken->GetName(), std::get<std::string>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Name>>(m_scene, selectedTokens, SetTo(std::get<std::string>(value)));
         break;
     case Token_Position:
     {
@@ -729,80 +884,88 @@ void Controller::OnTokenPropertyChanged(const std::shared_ptr<Token>& token, Tok
         if (m_scene->grid->GetSnapEnabled())
             pos = m_scene->grid->ShapeSnapPosition(token, pos);
         glm::vec2 offset = pos - token->GetModel()->GetPos();
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyMatrix2DVec2>(selectedToken->GetModel(), &Matrix2D::SetPos, selectedToken->GetModel()->GetPos(), selectedToken->GetModel()->GetPos() + offset));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Position>>(m_scene, selectedTokens, [offset](glm::vec2 oldPos) { return oldPos + offset; });
         break;
     }
     case Token_Rotation:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyMatrix2DFloat>(selectedToken->GetModel(), &Matrix2D::SetRotation, selectedToken->GetModel()->GetRotation(), std::get<float>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Rotation>>(m_scene, selectedTokens, SetTo(std::get<float>(value)));
         break;
     case Token_Scale:
-        for (const auto& selectedToken: SelectedTokens())
+    {
+        glm::vec2 scale = std::get<glm::vec2>(value);
+        if (m_scene->grid->GetSnapEnabled())
         {
-            glm::vec2 scale = std::get<glm::vec2>(value);
-            if (m_scene->grid->GetSnapEnabled())
-            {
-                ShapeGridSize gridSize = static_cast<ShapeGridSize>(m_scene->grid->GetShapeGridSize(scale.x));
-                scale = glm::vec2(m_scene->grid->SnapGridSize(gridSize));
-            }
-            actionGroup->Add(std::make_shared<ModifyMatrix2DVec2>(selectedToken->GetModel(), &Matrix2D::SetScale, selectedToken->GetModel()->GetScale(), scale));
+            ShapeGridSize gridSize = static_cast<ShapeGridSize>(m_scene->grid->GetShapeGridSize(scale.x));
+            scale = glm::vec2(m_scene->grid->SnapGridSize(gridSize));
         }
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Scale>>(m_scene, selectedTokens, SetTo(scale));
         break;
+    }
     case Token_BorderWidth:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenFloat>(selectedToken, &Token::SetBorderWidth, selectedToken->GetBorderWidth(), std::get<float>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::BorderWidth>>(m_scene, selectedTokens, SetTo(std::get<float>(value)));
         break;
     case Token_BorderColor:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenVec4>(selectedToken, &Token::SetBorderColor, selectedToken->GetBorderColor(), std::get<glm::vec4>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::BorderColor>>(m_scene, selectedTokens, SetTo(std::get<glm::vec4>(value)));
         break;
     case Token_Texture:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenTexture>(selectedToken, &Token::SetIcon, selectedToken->GetIcon(), m_resources->GetTexture(std::get<std::string>(value))));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Icon>>(m_scene, selectedTokens, SetTo(m_resources->GetTexture(std::get<std::string>(value))));
         break;
     case Token_Statuses:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenStatuses>(selectedToken, &Token::SetStatuses, selectedToken->GetStatuses(), std::get<TokenStatuses>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Statuses>>(m_scene, selectedTokens, SetTo(std::get<TokenStatuses>(value)));
         break;
     case Token_XStatus:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenBool>(selectedToken, &Token::SetXStatus, selectedToken->GetXStatus(), std::get<bool>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::XStatus>>(m_scene, selectedTokens, SetTo(std::get<bool>(value)));
         break;
     case Token_Opacity:
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenFloat>(selectedToken, &Token::SetOpacity, selectedToken->GetOpacity(), std::get<float>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Opacity>>(m_scene, selectedTokens, SetTo(std::get<float>(value)));
+        break;
+    case Token_NameHidden:
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::NameHidden>>(m_scene, selectedTokens, SetTo(std::get<bool>(value)));
+        break;
+    case Token_Height:
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Height>>(m_scene, selectedTokens, SetTo(std::get<float>(value)));
         break;
     
     default:
         std::cerr << "Unknown TokenProperty: " << property << std::endl;
-        actionGroup.reset();
         break;
     }
     
-    if (!actionGroup->IsEmpty())
-        PerformAction(actionGroup);
+    if (action && !selectedTokens.empty())
+        PerformAction(action);
 }
 
 void Controller::OnImagePropertyChanged(const std::shared_ptr<BGImage>& image, ImageProperty property, ImagePropertyValue value)
 {
     std::shared_ptr<Action> action;
+    std::vector<std::shared_ptr<BGImage>> images{image};
     switch (property)
     {
     case Image_Texture:
-        action = std::make_shared<ModifyImageTexture>(image, &BGImage::SetImage, image->GetImage(), m_resources->GetTexture(std::get<std::string>(value)));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::ImageTexture>>(m_scene, images, SetTo(m_resources->GetTexture(std::get<std::string>(value))));
         break;
     case Image_LockRatio:
-        action = std::make_shared<ModifyImageBool>(image, &BGImage::SetLockRatio, image->GetLockRatio(), std::get<bool>(value));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::LockRatio>>(m_scene, images, SetTo(std::get<bool>(value)));
+        break;
+    case Image_Heightmap:
+    {
+        // An empty path removes it
+        const std::string& path = std::get<std::string>(value);
+        std::shared_ptr<Texture> heightmap = path.empty() ? nullptr : m_resources->GetTexture(path);
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Heightmap>>(m_scene, images, SetTo(heightmap));
+        break;
+    }
+    case Image_HeightScale:
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::HeightScale>>(m_scene, images, SetTo(std::get<float>(value)));
         break;
     case Image_Position:
-        action = std::make_shared<ModifyMatrix2DVec2>(image->GetModel(), &Matrix2D::SetPos, image->GetModel()->GetPos(), std::get<glm::vec2>(value));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Position>>(m_scene, images, SetTo(std::get<glm::vec2>(value)));
         break;
     case Image_Rotation:
-        action = std::make_shared<ModifyMatrix2DFloat>(image->GetModel(), &Matrix2D::SetRotation, image->GetModel()->GetRotation(), std::get<float>(value));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Rotation>>(m_scene, images, SetTo(std::get<float>(value)));
         break;
     case Image_Scale:
-        action = std::make_shared<ModifyMatrix2DVec2>(image->GetModel(), &Matrix2D::SetScale, image->GetModel()->GetScale(), std::get<glm::vec2>(value));
+        action = std::make_shared<BatchPropertyAction<ShapeProperty::Scale>>(m_scene, images, SetTo(std::get<glm::vec2>(value)));
         break;
     
     default:
@@ -814,6 +977,27 @@ void Controller::OnImagePropertyChanged(const std::shared_ptr<BGImage>& image, I
         PerformAction(action);
 }
 
+void Controller::OnFogPropertyChanged(const std::shared_ptr<FogOfWar>& fog, FogProperty property, FogPropertyValue value)
+{
+    std::shared_ptr<Action> action;
+    switch (property)
+    {
+    case Fog_Enabled:
+        action = std::make_shared<ModifyFogBool>(fog, &FogOfWar::SetEnabled, fog->IsEnabled(), std::get<bool>(value));
+        break;
+    case Fog_Range:
+        action = std::make_shared<ModifyFogFloat>(fog, &FogOfWar::SetRange, fog->GetRange(), std::get<float>(value));
+        break;
+
+    default:
+        std::cerr << "Unknown FogProperty: " << property << std::endl;
+        break;
+    }
+
+    if (action)
+        PerformAction(action);
+}
+
 void Controller::OnGridPropertyChanged(const std::shared_ptr<Grid>& grid, GridProperty property, GridPropertyValue value)
 {
     std::shared_ptr<Action> action;
@@ -868,28 +1052,260 @@ void Controller::OnCameraPropertyChanged(const std::shared_ptr<Camera>& camera,
 
 bool Controller::Undo()
 {
-    if (undoQueue.size() == 0)
+    // Undoing mid drag undoes the drag
+    CommitMoveTransaction();
+    std::shared_ptr<Action> action = m_history.Undo();
+    if (!action)
         return false;
-    
-    auto action = undoQueue.back();
-    action->Undo();
-    redoQueue.push_back(action);
-    undoQueue.pop_back();
+    JournalAction(action);
     return true;
 }
 
 bool Controller::Redo()
 {
-    if (redoQueue.size() == 0)
+    CommitMoveTransaction();
+    std::shared_ptr<Action> action = m_history.Redo();
+    if (!action)
         return false;
-    
-    auto action = redoQueue.back();
-    action->Redo();
-    undoQueue.push_back(action);
-    redoQueue.pop_back();
+    JournalAction(action);
     return true;
 }
 
+// Network
+void Controller::Host(int port)
+{
+    Disconnect();
+    // SceneHost logs the port it's listening on
+    m_host.Listen(port);
+}
+
+void Controller::Join(std::string address, int port)
+{
+    Disconnect();
+    CommitMoveTransaction();
+    if (m_client.Connect(address, port))
+        std::cerr << "Connected to " << address << ":" << port << std::endl;
+}
+
+void Controller::Disconnect()
+{
+    m_host.Stop();
+    // The mirrored scene is kept as a local copy
+    m_client.Disconnect();
+    m_motion.Restore(*m_scene);
+    m_motion.Clear();
+}
+
+void Controller::AssignSelectedTokens(ClientID client)
+{
+    for (const auto& token: SelectedTokens())
+        m_host.SetOwner(token->GetID(), client);
+}
+
+void Controller::SetVisionRange(float range)
+{
+    m_host.SetVisionRange(range);
+}
+
+void Controller::SetMirrored(bool mirrored)
+{
+    if (!mirrored)
+        m_mirror.reset();
+    else if (!m_mirror && (m_mirror = SceneMirrorWriter::Create()))
+        std::cerr << "Sharing the scene as " << m_mirror->Name() << std::endl;
+}
+
+// Walls
+void Controller::SetWallTool(bool enabled)
+{
+    m_scene->fog->showWalls = enabled;
+    m_scene->fog->draft.clear();
+}
+
+glm::vec2 Controller::SnapWallPoint(glm::vec2 worldPos)
+{
+    const FogOfWar& fog = *m_scene->fog;
+    float distance = glm::length(m_viewport->ScreenToWorldOffset(WALL_PICK_PIXELS, 0.0f));
+    glm::vec2 snapped = worldPos;
+    if (fog.walls.NearestEndpoint(worldPos, distance, snapped))
+        return snapped;
+    // Closing a loop back to where the polyline started
+    if (fog.draft.size() > 2 && glm::length(fog.draft.front() - worldPos) <= distance)
+        return fog.draft.front();
+    return worldPos;
+}
+
+void Controller::AddWallPoint(glm::vec2 worldPos)
+{
+    std::vector<glm::vec2>& draft = m_scene->fog->draft;
+    glm::vec2 point = SnapWallPoint(worldPos);
+    if (draft.empty())
+    {
+        // Started with a second point to follow the cursor
+        draft = {point, point};
+        return;
+    }
+
+    glm::vec2 start = draft[draft.size() - 2];
+    if (point == start)
+        return;
+    // Each segment is its own action so undo steps back along the polyline
+    PerformAction(std::make_shared<AddWallsAction>(m_scene->fog, std::vector<Wall>{{NULL_WALL_ID, start, point}}));
+    draft.back() = point;
+    if (point == draft.front())
+        FinishWall();
+    else
+        draft.push_back(point);
+}
+
+void Controller::FinishWall()
+{
+    m_scene->fog->draft.clear();
+}
+
+void Controller::RemoveWallAt(glm::vec2 worldPos)
+{
+    const Walls& walls = m_scene->fog->walls;
+    float distance = glm::length(m_viewport->ScreenToWorldOffset(WALL_PICK_PIXELS, 0.0f));
+    WallID id = walls.Nearest(worldPos, distance);
+    if (id != NULL_WALL_ID)
+        PerformAction(std::make_shared<RemoveWallsAction>(m_scene->fog, std::vector<Wall>{*walls.Get(id)}));
+}
+
+void Controller::ClearWalls()
+{
+    FinishWall();
+    if (!m_scene->fog->walls.IsEmpty())
+        PerformAction(std::make_shared<RemoveWallsAction>(m_scene->fog, m_scene->fog->walls.All()));
+}
+
+void Controller::UpdateFog()
+{
+    FogOfWar& fog = *m_scene->fog;
+    if (!fog.IsEnabled())
+        return;
+
+    // Clients see what their own tokens see, the host what the selected
+    // tokens see, dimmed, or everything when nothing's selected
+    std::vector<FogViewer> viewers;
+    if (m_client.IsConnected())
+    {
+        fog.maskOpacity = 1.0f;
+        for (const auto& token: m_scene->tokens)
+        {
+            if (m_client.Owns(token->GetID()))
+                viewers.push_back({token->GetID(), token->GetModel()->GetPos(), token->GetHeight()});
+        }
+    }
+    else
+    {
+        fog.maskOpacity = HOST_FOG_OPACITY;
+        for (const auto& token: SelectedTokens())
+            viewers.push_back({token->GetID(), token->GetModel()->GetPos(), token->GetHeight()});
+        if (viewers.empty())
+        {
+            fog.Reveal();
+            return;
+        }
+    }
+    fog.SetTerrain(m_scene->images);
+    fog.Update(viewers);
+}
+
+void Controller::ApplyEdit(const SceneHost::Edit& edit)
+{
+    if (std::shared_ptr<Action> action = m_document.EditAction(m_scene, edit))
+        PerformAction(action);
+}
+
+void Controller::PredictAction(const std::shared_ptr<Action>& action)
+{
+    ActionEffects effects;
+    action->Effects(effects);
+    std::sort(effects.shapes.begin(), effects.shapes.end());
+    effects.shapes.erase(std::unique(effects.shapes.begin(), effects.shapes.end()), effects.shapes.end());
+
+    if (effects.walls)
+    {
+        std::cerr << "Only the host can change walls" << std::endl;
+        return;
+    }
+
+    std::vector<std::shared_ptr<Token>> tokens;
+    std::vector<ShapeState> before;
+    for (ShapeID id: effects.shapes)
+    {
+        std::shared_ptr<Token> token = m_scene->GetToken(id);
+        if (effects.settings || !token || !m_client.Owns(id))
+        {
+            std::cerr << "Only your own tokens can be changed while connected to a host" << std::endl;
+            return;
+        }
+        tokens.push_back(token);
+        before.push_back(CaptureToken(*token));
+    }
+
+    action->Redo();
+    std::vector<ShapeState> after;
+    std::vector<SyncField> fields;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        after.push_back(CaptureToken(*tokens[i]));
+        fields.push_back(DiffFields(before[i], after[i]));
+        if ((fields[i] & ~CLIENT_EDITABLE_FIELDS) != SyncField::None)
+        {
+            action->Undo();
+            std::cerr << "Only a token's position, rotation, statuses, name visibility, opacity and height can be changed while connected to a host" << std::endl;
+            return;
+        }
+    }
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        if (fields[i] == SyncField::None)
+            continue;
+        // Shown at the precision it's sent so the host's copy matches
+        ApplyToken(after[i], fields[i], *tokens[i], *m_resources);
+        m_client.RequestEdit(tokens[i]->GetID(), fields[i], after[i]);
+    }
+}
+
+void Controller::UpdateSync()
+{
+    SyncStatus status;
+    if (m_client.IsConnected())
+    {
+        std::shared_ptr<Scene> scene = m_scene;
+        if (m_client.Update(scene))
+            SetScene(scene);
+        for (const MotionPacket& packet: m_client.TakeMotion())
+            m_motion.Add(packet);
+        // Screen corners, y is flipped
+        m_client.SetViewRegion(Bounds2D(m_viewport->ScreenToWorldPos(0, m_viewport->Height()),
+                                        m_viewport->ScreenToWorldPos(m_viewport->Width(), 0)));
+        status.mode = SyncStatus::Mode::Client;
+        status.id = m_client.ID();
+        status.stats = m_client.Stats();
+    }
+    else if (m_host.IsListening())
+    {
+        // Edits taken last frame go out with this frame's delta
+        for (const SceneHost::Edit& edit: m_host.TakeEdits())
+            ApplyEdit(edit);
+        m_host.Update(m_scene);
+        for (const MotionPacket& packet: m_host.TakeMotion())
+            m_motion.Add(packet);
+        status.mode = SyncStatus::Mode::Hosting;
+        status.port = m_host.Port();
+        status.clients = m_host.Clients();
+        status.visionRange = m_host.GetVisionRange();
+        status.stats = m_host.Stats();
+    }
+    StreamMoveTransaction(false);
+    status.motion = m_motion.Stats();
+    status.mirrored = bool(m_mirror);
+    m_uiWindow->SetSyncStatus(status);
+}
+
 void Controller::OnPromptResponse(int promptType, bool response)
 {
     switch (promptType)
@@ -926,9 +1342,6 @@ void Controller::OnKeyChanged(int key, int scancode, int action, int mods)
         HasSelectedShapes() ? FocusSelected() : Focus();
     if (key == GLFW_KEY_X && action == GLFW_RELEASE && HasSelectedShapes())
     {
-        auto actionGroup = std::make_shared<ActionGroup>();
-        for (const auto& selectedToken: SelectedTokens())
-            actionGroup->Add(std::make_shared<ModifyTokenBool>(selectedToken, &Token::SetXStatus, selectedToken->GetXStatus(), !selectedToken->GetXStatus()));
-        PerformAction(actionGroup);
+        PerformAction(std::make_shared<BatchPropertyAction<ShapeProperty::XStatus>>(m_scene, SelectedTokens(), [](bool xStatus) { return !xStatus; }));
     }
 }
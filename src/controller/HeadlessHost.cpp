@@ -0,0 +1,191 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Actions.hpp>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <SceneDocument.h>
+#include <model/Scene.h>
+#include <net/SceneHost.h>
+
+#include <controller/HeadlessHost.h>
+
+
+// Set from the signal handler, checked once per frame
+static std::atomic<bool> s_stopRequested{false};
+
+static void OnStopSignal(int) { s_stopRequested = true; }
+
+// User and system time the whole process has used
+static double CPUMs()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+    auto ms = [](const timeval& time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+    return ms(usage.ru_utime) + ms(usage.ru_stime);
+}
+
+static size_t ResidentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+
+HeadlessHost::HeadlessHost(const HeadlessOptions& options) :
+    m_options(options), m_resources(std::make_shared<Resources>()), m_serializer(m_resources), m_document(m_resources, m_serializer),
+    m_host(m_resources) {}
+
+HeadlessHost::~HeadlessHost()
+{
+    m_host.Stop();
+    if (!m_scene)
+        return;
+    if (m_document.IsUnsaved())
+        m_document.Save(m_scene, m_scene->sourceFile);
+    m_document.Finish(m_scene);
+    // Kept for recovery unless everything made it into the file
+    if (!m_document.IsUnsaved())
+        m_document.Discard();
+}
+
+bool HeadlessHost::Start()
+{
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>(m_resources);
+    if (!m_document.Read(m_options.sceneFile, *scene))
+        return false;
+    scene->sourceFile = m_options.sceneFile;
+    m_scene = scene;
+    // Same as the app, so the file is saved the way it would save it
+    if (m_scene->cameras.empty())
+        m_scene->AddDefaultCamera();
+    else if (m_scene->views.empty())
+        m_scene->SetViewCamera(PRIMARY, m_scene->cameras[0]);
+
+    m_document.Start(m_scene);
+    if (m_document.Replay(m_scene))
+        m_document.Recovered(m_scene);
+
+    m_host.SetVisionRange(m_options.visionRange);
+    if (!m_host.Listen(m_options.port))
+    {
+        std::cerr << "Unable to listen on port " << m_options.port << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void HeadlessHost::Exec()
+{
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+
+    auto now = std::chrono::steady_clock::now();
+    m_lastReport = now;
+    m_lastCPUMs = CPUMs();
+    m_idleResidentBytes = ResidentBytes();
+    while (!s_stopRequested)
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        // Edits taken last frame go out with this frame's delta
+        ApplyEdits();
+        m_host.Update(m_scene);
+        AssignTokens();
+        // Relayed to the other clients by the host, there's nothing to show
+        // them on here
+        m_host.TakeMotion();
+        m_document.Update(m_scene);
+        m_document.Autosave(m_scene, m_options.autosaveInterval);
+
+        now = std::chrono::steady_clock::now();
+        if (m_options.reportInterval.count() > 0 && now - m_lastReport > m_options.reportInterval)
+            Report();
+        std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(m_options.frameMs));
+    }
+    std::cerr << "Stopping" << std::endl;
+}
+
+void HeadlessHost::ApplyEdits()
+{
+    ActionEffects effects;
+    for (const SceneHost::Edit& edit: m_host.TakeEdits())
+    {
+        // No undo history to keep, so the action is only applied
+        std::shared_ptr<Action> action = m_document.EditAction(m_scene, edit);
+        if (!action)
+            continue;
+        action->Redo();
+        action->Effects(effects);
+    }
+    if (effects.shapes.empty())
+        return;
+    m_document.Record(m_scene, effects);
+    m_host.Record(effects);
+}
+
+void HeadlessHost::AssignTokens()
+{
+    if (!m_options.assignTokens)
+        return;
+    std::vector<ClientID> clients = m_host.Clients();
+    for (auto it = m_assigned.begin(); it != m_assigned.end();)
+    {
+        if (std::find(clients.begin(), clients.end(), it->first) == clients.end())
+        {
+            m_host.SetOwner(it->second, HOST_CLIENT_ID);
+            it = m_assigned.erase(it);
+        }
+        else
+            ++it;
+    }
+    for (ClientID client: clients)
+    {
+        if (m_assigned.count(client))
+            continue;
+        auto token = std::find_if(m_scene->tokens.begin(), m_scene->tokens.end(),
+                                  [this](const auto& token) { return m_host.GetOwner(token->GetID()) == HOST_CLIENT_ID; });
+        if (token == m_scene->tokens.end())
+            break;
+        m_host.SetOwner((*token)->GetID(), client);
+        m_assigned[client] = (*token)->GetID();
+        std::cerr << "Client " << client << " given " << (*token)->GetName() << std::endl;
+    }
+}
+
+void HeadlessHost::Report()
+{
+    auto now = std::chrono::steady_clock::now();
+    double cpuMs = CPUMs();
+    double elapsedMs = std::chrono::duration<double, std::milli>(now - m_lastReport).count();
+    double cpuPercent = 100.0 * (cpuMs - m_lastCPUMs) / std::max(elapsedMs, 1.0);
+    m_lastCPUMs = cpuMs;
+    m_lastReport = now;
+
+    size_t resident = ResidentBytes();
+    double residentMB = resident / (1024.0 * 1024.0);
+    size_t numClients = m_host.NumClients();
+    std::cerr << numClients << " clients, " << cpuPercent << "% CPU, " << residentMB << " MB resident";
+    // What each costs on top of the scene being served to nobody
+    if (numClients > 0)
+    {
+        double perClientMB = (std::max(resident, m_idleResidentBytes) - m_idleResidentBytes) / (1024.0 * 1024.0) / numClients;
+        std::cerr << ", " << cpuPercent / numClients << "% CPU and " << perClientMB << " MB per client";
+    }
+    SyncStats stats = m_host.Stats();
+    std::cerr << ", " << stats.editsAccepted << " edits accepted, " << stats.editsRejected << " rejected" << std::endl;
+}
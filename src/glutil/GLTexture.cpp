@@ -0,0 +1,118 @@
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <glutil/Texture.h>
+#include <glutil/GLTexture.h>
+
+
+static GLenum FormatFor(int numChannels)
+{
+    if (numChannels == 1)
+        return GL_RED;
+    if (numChannels == 3)
+        return GL_RGB;
+    return GL_RGBA;
+}
+
+// Pre-decoded levels, eg, from a bundle, are uploaded as they are
+static bool UploadMips(Texture& texture)
+{
+    GLenum format = FormatFor(texture.numChannels);
+    const std::vector<MipLevel>& mips = texture.data->mips;
+
+    GLuint ID;
+    glGenTextures(1, &ID);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    // Rows are tightly packed whatever the channel count
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < mips.size(); level++)
+        glTexImage2D(GL_TEXTURE_2D, level, format, mips[level].width, mips[level].height, 0, format, GL_UNSIGNED_BYTE, mips[level].pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips.size() - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    std::cerr << "Loaded: " << texture.filename << " from " << mips.size() << " levels as ID " << ID << std::endl;
+
+    texture.ID = ID;
+    return true;
+}
+
+// Textures sharing another's contents use its GPU copy
+static Texture& Resolve(Texture& texture) { return texture.source ? *texture.source : texture; }
+
+bool UploadTexture(Texture& texture)
+{
+    if (texture.source)
+        return UploadTexture(*texture.source);
+    if (texture.IsUploaded())
+        return true;
+    if (!texture.IsValid())
+        return false;
+    if (texture.data && !texture.data->mips.empty())
+        return UploadMips(texture);
+
+    int width, height, numChannels;
+    unsigned char* data;
+    if (texture.data)
+        data = stbi_load_from_memory(texture.data->bytes, texture.data->size, &width, &height, &numChannels, 0);
+    else
+        data = stbi_load(texture.filename.c_str(), &width, &height, &numChannels, 0);
+    if (!data)
+    {
+        // Mark as invalid so the load isn't retried every frame
+        std::cerr << "Failed to decode texture: " << texture.filename << std::endl;
+        texture.width = texture.height = 0;
+        return false;
+    }
+
+    GLenum format = FormatFor(numChannels);
+
+    GLuint ID;
+    glGenTextures(1, &ID);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // set the texture wrapping parameters
+    // TODO: Might want different modes, eg, GL_CLAMP_TO_EDGE
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    std::cerr << "Loaded: " << texture.filename << " as ID " << ID << std::endl;
+
+    stbi_image_free(data);
+
+    texture.ID = ID;
+    texture.width = width;
+    texture.height = height;
+    texture.numChannels = numChannels;
+    return true;
+}
+
+void BindTexture(Texture& texture, GLenum textureUnit)
+{
+    UploadTexture(texture);
+    glActiveTexture(textureUnit);
+    glBindTexture(GL_TEXTURE_2D, Resolve(texture).ID);
+}
+
+void ReleaseTexture(Texture& texture)
+{
+    // The source is released on its own once nothing uses it
+    if (!texture.IsUploaded())
+        return;
+
+    GLuint ID = texture.ID;
+    glDeleteTextures(1, &ID);
+    texture.ID = 0;
+    std::cerr << "Released: " << texture.filename << std::endl;
+}
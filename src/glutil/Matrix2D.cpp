@@ -1,52 +1,44 @@
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
 #include <glutil/Matrix2D.h>
+#include <glutil/TransformStore.h>
 
 
-Matrix2D::Matrix2D() : m_pos(0), m_scale(1), m_rot(0) { Rebuild(); }
+Matrix2D::Matrix2D() : m_handle(TransformStore::Global().Allocate(glm::vec2(0), glm::vec2(1), 0)) {}
 
-Matrix2D::Matrix2D(glm::vec2 pos, glm::vec2 scale, float rot) : m_pos(pos), m_scale(scale), m_rot(rot) { Rebuild(); }
+Matrix2D::Matrix2D(glm::vec2 pos, glm::vec2 scale, float rot) : m_handle(TransformStore::Global().Allocate(pos, scale, rot)) {}
 
-void Matrix2D::Offset(glm::vec2 offset)
-{
-    m_pos += offset;
-    Rebuild();
-}
+Matrix2D::Matrix2D(TransformHandle handle) : m_handle(handle) {}
 
-void Matrix2D::SetPos(glm::vec2 pos)
-{
-    m_pos = pos;
-    Rebuild();
-}
+Matrix2D::Matrix2D(const Matrix2D& other) : Matrix2D(other.GetPos(), other.GetScale(), other.GetRotation()) {}
 
-void Matrix2D::SetRotation(float degrees)
+Matrix2D& Matrix2D::operator=(const Matrix2D& other)
 {
-    m_rot = degrees;
-    Rebuild();
+    SetPos(other.GetPos());
+    SetScale(other.GetScale());
+    SetRotation(other.GetRotation());
+    return *this;
 }
 
-void Matrix2D::SetScale(glm::vec2 scale)
-{
-    m_scale = scale;
-    Rebuild();
-}
-void Matrix2D::SetScalef(float scale)
+Matrix2D::~Matrix2D() { TransformStore::Global().Release(m_handle); }
+
+void Matrix2D::Offset(glm::vec2 offset)
 {
-    m_scale = glm::vec2(scale);
-    Rebuild();
+    TransformStore& store = TransformStore::Global();
+    store.SetPos(m_handle, store.GetPos(m_handle) + offset);
 }
 
-glm::vec2 Matrix2D::GetPos() const { return m_pos; }
-glm::vec2 Matrix2D::GetScale() const { return m_scale; }
-float Matrix2D::GetScalef() const { return m_scale.x; }
-float Matrix2D::GetRotation() const { return m_rot; }
-const glm::mat4* Matrix2D::Value() const { return &m_matrix; }
+void Matrix2D::SetPos(glm::vec2 pos) { TransformStore::Global().SetPos(m_handle, pos); }
+void Matrix2D::SetRotation(float degrees) { TransformStore::Global().SetRotation(m_handle, degrees); }
+void Matrix2D::SetScale(glm::vec2 scale) { TransformStore::Global().SetScale(m_handle, scale); }
+void Matrix2D::SetScalef(float scale) { TransformStore::Global().SetScale(m_handle, glm::vec2(scale)); }
 
-void Matrix2D::Rebuild()
-{
-    m_matrix = glm::mat4(1.0f);
-    m_matrix = glm::translate(m_matrix, glm::vec3(m_pos, 0.0f));
-    m_matrix = glm::rotate(m_matrix, glm::radians(-m_rot), glm::vec3(0, 0, 1));
-    m_matrix = glm::scale(m_matrix, glm::vec3(m_scale, 1.0f));
-}
+glm::vec2 Matrix2D::GetPos() const { return TransformStore::Global().GetPos(m_handle); }
+glm::vec2 Matrix2D::GetScale() const { return TransformStore::Global().GetScale(m_handle); }
+float Matrix2D::GetScalef() const { return TransformStore::Global().GetScale(m_handle).x; }
+float Matrix2D::GetRotation() const { return TransformStore::Global().GetRotation(m_handle); }
+const glm::mat4* Matrix2D::Value() const { return TransformStore::Global().GetMatrix(m_handle); }
+TransformHandle Matrix2D::Handle() const { return m_handle; }
+uint64_t Matrix2D::Version() const { return TransformStore::Global().GetVersion(m_handle); }
+
+void Matrix2D::Rebuild() { TransformStore::Global().Rebuild(m_handle); }
@@ -1,56 +1,57 @@
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <vector>
 
 #include <stb_image.h>
-#include <glad/glad.h>
 
 #include <glutil/Texture.h>
 
 
 Texture::Texture(const char *filename) : filename(filename)
 {
-    // Load data into the texture
-    unsigned char* data = stbi_load(filename, &width, &height, &numChannels, 0);
-    if (data)
+    // Only reads the header, decoding is deferred until upload
+    if (!stbi_info(filename, &width, &height, &numChannels))
     {
-        glGenTextures(1, &ID);
-
-        GLenum format;
-        if (numChannels == 1)
-            format = GL_RED;
-        else if (numChannels == 3)
-            format = GL_RGB;
-        else if (numChannels == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, ID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        // set the texture wrapping parameters
-        // TODO: Might want different modes, eg, GL_CLAMP_TO_EDGE
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        std::cerr << "Loaded: " << filename << " as ID " << ID << std::endl;
-    }
-    else
+        width = height = numChannels = 0;
         std::cerr << "Failed to load texture: " << filename << std::endl;
-    
-    // Cleanup
-    stbi_image_free(data);
-
+    }
 }
 
-void Texture::activate(GLuint textureID) const
+Texture::Texture(const std::string& filename, std::shared_ptr<const TextureData> data) : filename(filename), data(data)
 {
-    glActiveTexture(textureID);
-    glBindTexture(GL_TEXTURE_2D, ID);
+    if (!stbi_info_from_memory(data->bytes, data->size, &width, &height, &numChannels))
+    {
+        width = height = numChannels = 0;
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+    }
 }
 
-bool Texture::IsValid() const { return ID > 0; }
+bool Texture::IsValid() const { return width > 0 && height > 0; }
+
+bool Texture::IsUploaded() const { return ID > 0; }
+
+size_t Texture::ByteSize() const { return (size_t)width * height * numChannels; }
 
 std::string Texture::Name() const { return std::filesystem::path(filename).stem(); }
+
+void HalveImage(const std::vector<unsigned char>& pixels, int width, int height, int numChannels, std::vector<unsigned char>& half)
+{
+    int halfWidth = std::max(width / 2, 1);
+    int halfHeight = std::max(height / 2, 1);
+    half.resize(size_t(halfWidth) * halfHeight * numChannels);
+    for (int y = 0; y < halfHeight; y++)
+    {
+        int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < halfWidth; x++)
+        {
+            int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < numChannels; c++)
+            {
+                int sum = pixels[(size_t(y0) * width + x0) * numChannels + c] + pixels[(size_t(y0) * width + x1) * numChannels + c] +
+                          pixels[(size_t(y1) * width + x0) * numChannels + c] + pixels[(size_t(y1) * width + x1) * numChannels + c];
+                half[(size_t(y) * halfWidth + x) * numChannels + c] = (sum + 2) / 4;
+            }
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include <glutil/TransformStore.h>
+
+
+TransformStore TransformStore::s_global;
+
+TransformHandle TransformStore::Allocate(glm::vec2 pos, glm::vec2 scale, float rot)
+{
+    TransformHandle handle;
+    if (!m_freeSlots.empty())
+    {
+        handle = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_pos[handle] = pos;
+        m_scale[handle] = scale;
+        m_rot[handle] = rot;
+        m_versions[handle] = ++m_clock;
+    }
+    else
+    {
+        handle = m_pos.size();
+        m_pos.push_back(pos);
+        m_scale.push_back(scale);
+        m_rot.push_back(rot);
+        m_matrices.emplace_back(1.0f);
+        m_dirty.push_back(0);
+        m_versions.push_back(++m_clock);
+    }
+    MarkDirty(handle);
+    return handle;
+}
+
+void TransformStore::AllocateRange(size_t count, const glm::vec2* pos, const glm::vec2* scale, const float* rot, TransformHandle* handles)
+{
+    size_t i = 0;
+    for (; i < count && !m_freeSlots.empty(); i++)
+        handles[i] = Allocate(pos[i], scale[i], rot[i]);
+    if (i == count)
+        return;
+
+    size_t remaining = count - i;
+    TransformHandle first = m_pos.size();
+    m_pos.insert(m_pos.end(), pos + i, pos + count);
+    m_scale.insert(m_scale.end(), scale + i, scale + count);
+    m_rot.insert(m_rot.end(), rot + i, rot + count);
+    m_matrices.resize(first + remaining, glm::mat4(1.0f));
+    m_dirty.resize(first + remaining, 0);
+    m_versions.reserve(first + remaining);
+    m_dirtySlots.reserve(m_dirtySlots.size() + remaining);
+    for (TransformHandle handle = first; handle < first + remaining; handle++)
+    {
+        m_versions.push_back(++m_clock);
+        MarkDirty(handle);
+        handles[i++] = handle;
+    }
+}
+
+void TransformStore::Release(TransformHandle handle)
+{
+    // Stale entries in the dirty list are harmless, the slot is rebuilt from
+    // whatever it holds when reused.
+    m_freeSlots.push_back(handle);
+}
+
+void TransformStore::SetPos(TransformHandle handle, glm::vec2 pos)
+{
+    m_pos[handle] = pos;
+    m_versions[handle] = ++m_clock;
+    MarkDirty(handle);
+}
+
+void TransformStore::SetScale(TransformHandle handle, glm::vec2 scale)
+{
+    m_scale[handle] = scale;
+    m_versions[handle] = ++m_clock;
+    MarkDirty(handle);
+}
+
+void TransformStore::SetRotation(TransformHandle handle, float degrees)
+{
+    m_rot[handle] = degrees;
+    m_versions[handle] = ++m_clock;
+    MarkDirty(handle);
+}
+
+const glm::mat4* TransformStore::GetMatrix(TransformHandle handle)
+{
+    if (m_dirty[handle])
+        Rebuild(handle);
+    return &m_matrices[handle];
+}
+
+void TransformStore::MarkDirty(TransformHandle handle)
+{
+    if (m_dirty[handle])
+        return;
+    m_dirty[handle] = 1;
+    // Slots rebuilt individually stay in the list, drop them if nothing is
+    // calling RebuildDirty (eg, headless) so it can't grow without bound
+    if (m_dirtySlots.size() >= 2 * m_pos.size())
+    {
+        size_t count = 0;
+        for (TransformHandle slot: m_dirtySlots)
+            if (m_dirty[slot])
+                m_dirtySlots[count++] = slot;
+        m_dirtySlots.resize(count);
+    }
+    m_dirtySlots.push_back(handle);
+}
+
+// Equivalent to translate(pos) * rotate(-rot) * scale(scale), written out so
+// the batch loop has no matrix multiplies.
+static inline void BuildMatrix(glm::mat4& m, glm::vec2 pos, glm::vec2 scale, float rot)
+{
+    float radians = glm::radians(rot);
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    m[0] = glm::vec4(c * scale.x, -s * scale.x, 0.0f, 0.0f);
+    m[1] = glm::vec4(s * scale.y, c * scale.y, 0.0f, 0.0f);
+    m[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    m[3] = glm::vec4(pos.x, pos.y, 0.0f, 1.0f);
+}
+
+void TransformStore::Rebuild(TransformHandle handle)
+{
+    BuildMatrix(m_matrices[handle], m_pos[handle], m_scale[handle], m_rot[handle]);
+    // Left in the dirty list, RebuildDirty skips it
+    m_dirty[handle] = 0;
+}
+
+void TransformStore::RebuildDirty()
+{
+    for (TransformHandle handle: m_dirtySlots)
+    {
+        if (!m_dirty[handle])
+            continue;
+        BuildMatrix(m_matrices[handle], m_pos[handle], m_scale[handle], m_rot[handle]);
+        m_dirty[handle] = 0;
+    }
+    m_dirtySlots.clear();
+}
@@ -1,18 +1,94 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
 #include <glad/glad.h>
+#include <stb_image.h>
 
 #include <controller/Application.h>
+#include <controller/HeadlessHost.h>
 
 
+// Shows the scene an app on this machine shares, see SceneMirror:
+//   mapmaker --display [/battlematt_mirror]
+static int RunDisplay(int numArgs, char* args[])
+{
+    stbi_set_flip_vertically_on_load(true);
+
+    Application app(numArgs > 2 ? args[2] : DEFAULT_MIRROR_NAME);
+    if (!app.IsInitialised())
+        return 1;
+    app.Exec();
+    return 0;
+}
+
+// Serves a scene without a window:
+//   mapmaker --headless --host [--port 5000] [--vision 20] [--autosave 120] [--report 60] [--assign] scene.json
+static int RunHeadless(int numArgs, char* args[])
+{
+    HeadlessOptions options;
+    bool host = false;
+    for (int i = 1; i < numArgs; i++)
+    {
+        std::string arg = args[i];
+        if (arg == "--headless")
+            continue;
+        else if (arg == "--host")
+            host = true;
+        else if (arg == "--port" && i + 1 < numArgs)
+            options.port = std::atoi(args[++i]);
+        else if (arg == "--vision" && i + 1 < numArgs)
+            options.visionRange = std::atof(args[++i]);
+        else if (arg == "--autosave" && i + 1 < numArgs)
+            options.autosaveInterval = std::chrono::seconds(std::atoi(args[++i]));
+        else if (arg == "--report" && i + 1 < numArgs)
+            options.reportInterval = std::chrono::seconds(std::atoi(args[++i]));
+        else if (arg == "--assign")
+            options.assignTokens = true;
+        else if (options.sceneFile.empty() && arg.rfind("--", 0) != 0)
+            options.sceneFile = arg;
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    // Nothing else runs without a window yet
+    if (!host || options.sceneFile.empty())
+    {
+        std::cerr << "Headless mode needs --host and a scene file" << std::endl;
+        return 2;
+    }
+
+    HeadlessHost headless(options);
+    if (!headless.Start())
+        return 1;
+    headless.Exec();
+    return 0;
+}
+
 int main(int numArgs, char* args[])
 {
+    if (numArgs > 1 && std::string(args[1]) == "--display")
+        return RunDisplay(numArgs, args);
+    for (int i = 1; i < numArgs; i++)
+    {
+        if (std::string(args[i]) == "--headless")
+            return RunHeadless(numArgs, args);
+    }
+
     stbi_set_flip_vertically_on_load(true);
 
     Application app = Application();
     if (!app.IsInitialised())
         return 1;
 
+    // Loading a scene recovers its own journal
     if (numArgs > 1)
         app.controller->Load(args[1]);
+    else
+        app.controller->Recover();
 
     app.Exec();
 
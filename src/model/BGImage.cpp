@@ -1,41 +1,30 @@
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
 #include <Constants.h>
 #include <glutil/Matrix2D.h>
-#include <glutil/Mesh.h>
 #include <glutil/Texture.h>
 #include <model/Shape2D.h>
 
 #include <model/BGImage.h>
 
-BGImage::BGImage(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture) : Rect(mesh), m_texture(texture)
+BGImage::BGImage(std::shared_ptr<Texture> texture) : m_texture(texture)
 {
     if (m_texture->IsValid())
         m_model->SetScale(glm::vec2(m_texture->height / DEFAULT_PIXELS_PER_UNIT, m_texture->width / DEFAULT_PIXELS_PER_UNIT));
 }
 
-void BGImage::Draw(Shader &shader)
-{
-    if (!m_visible)
-        return;
-
-    shader.setMat4("model", *m_model->Value());
+BGImage::BGImage(std::shared_ptr<Texture> texture, const std::shared_ptr<Matrix2D>& model) : Rect(model), m_texture(texture) {}
 
-    glm::vec4 colour = m_tintColour;
-    if (isSelected)
-        colour = glm::vec4(SELECTION_COLOR, m_tintColour.w);
-    else if (isHighlighted)
-        colour = glm::vec4(HIGHLIGHT_COLOR, m_tintColour.w);
-    shader.setFloat4("color", colour.x, colour.y, colour.z, colour.w);
-
-    if (m_texture && m_texture->IsValid())
-    {
-        m_texture->activate(GL_TEXTURE0);
-        shader.setInt("diffuse", 0);
-        glBindTexture(GL_TEXTURE_2D, m_texture->ID);
-    }
-    Rect::Draw(shader);
+// Copies share the texture but get their own transform
+BGImage::BGImage(const BGImage& image) : Rect(image)
+{
+    m_texture = image.m_texture;
+    m_model = std::make_shared<Matrix2D>(*image.m_model);
+    m_tintColour = image.m_tintColour;
+    m_lockRatio = image.m_lockRatio;
+    m_visible = image.m_visible;
+    m_heightmap = image.m_heightmap;
+    m_heightScale = image.m_heightScale;
 }
 
 std::shared_ptr<Texture> BGImage::GetImage()
@@ -57,12 +46,32 @@ void BGImage::SetImage(std::shared_ptr<Texture> texture)
         m_texture = texture;
         m_model->Rebuild();
     }
+    Touch();
 }
 
 void BGImage::SetTint(glm::vec4 colour)
 {
     m_tintColour = colour;
+    Touch();
 }
 
+glm::vec4 BGImage::GetTint() { return m_tintColour; }
+
 bool BGImage::GetLockRatio() { return m_lockRatio; }
-void BGImage::SetLockRatio(bool lockRatio) { m_lockRatio = lockRatio; }
+void BGImage::SetLockRatio(bool lockRatio)
+{
+    m_lockRatio = lockRatio;
+    Touch();
+}
+
+void BGImage::SetHeightmap(std::shared_ptr<Texture> heightmap)
+{
+    m_heightmap = heightmap;
+    Touch();
+}
+
+void BGImage::SetHeightScale(float scale)
+{
+    m_heightScale = scale;
+    Touch();
+}
@@ -0,0 +1,219 @@
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Constants.h>
+#include <WorkerPool.h>
+#include <glutil/Texture.h>
+#include <model/BGImage.h>
+#include <model/Bounds.h>
+#include <model/HeightField.h>
+#include <model/SpatialGrid.h>
+#include <model/Visibility.h>
+#include <model/Walls.h>
+
+#include <model/FogOfWar.h>
+
+
+// A client's heightmap is linked to its download once it arrives
+static const std::shared_ptr<Texture>& Resolve(const std::shared_ptr<Texture>& texture)
+{
+    return texture->source ? texture->source : texture;
+}
+
+// Shared by every instance, see PolygonsVersion
+uint64_t FogOfWar::NewPolygonsVersion()
+{
+    static uint64_t version = 0;
+    return ++version;
+}
+
+static float Cross(glm::vec2 a, glm::vec2 b) { return a.x * b.y - a.y * b.x; }
+
+// Edges included, points are on either side of a shared one
+static bool InTriangle(glm::vec2 point, glm::vec2 a, glm::vec2 b, glm::vec2 c)
+{
+    float ab = Cross(b - a, point - a);
+    float bc = Cross(c - b, point - b);
+    float ca = Cross(a - c, point - c);
+    return (ab >= 0.0f && bc >= 0.0f && ca >= 0.0f) || (ab <= 0.0f && bc <= 0.0f && ca <= 0.0f);
+}
+
+// Drawn the same way, see Renderer::DrawFog
+static bool InPolygon(glm::vec2 point, const VisionPolygon& polygon)
+{
+    glm::vec2 offset = point - polygon.origin;
+    if (glm::dot(offset, offset) > polygon.range * polygon.range)
+        return false;
+    if (!polygon.triangles.empty())
+    {
+        for (size_t i = 0; i + 2 < polygon.triangles.size(); i += 3)
+        {
+            if (InTriangle(point, polygon.triangles[i], polygon.triangles[i + 1], polygon.triangles[i + 2]))
+                return true;
+        }
+        return false;
+    }
+    const std::vector<glm::vec2>& points = polygon.points;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        if (InTriangle(point, polygon.origin, points[i], points[(i + 1) % points.size()]))
+            return true;
+    }
+    return false;
+}
+
+void FogOfWar::SetEnabled(bool enabled) { m_enabled = enabled; }
+void FogOfWar::SetRange(float range) { m_range = range; }
+
+void FogOfWar::SetTerrain(const std::vector<std::shared_ptr<BGImage>>& images)
+{
+    // Compared in place as this runs every frame
+    size_t count = 0;
+    bool changed = false;
+    for (const std::shared_ptr<BGImage>& image: images)
+    {
+        if (!image->GetHeightmap() || !image->IsVisible())
+            continue;
+        TerrainSource source{image.get(), image->GetVersion(), image->GetModel()->Version(), Resolve(image->GetHeightmap()).get()};
+        changed |= count >= m_terrainSources.size() || !(m_terrainSources[count] == source);
+        count++;
+    }
+    if (!changed && count == m_terrainSources.size())
+        return;
+
+    m_terrainSources.clear();
+    m_layers.clear();
+    std::unordered_map<std::shared_ptr<Texture>, std::shared_ptr<const HeightField>> fields;
+    for (const std::shared_ptr<BGImage>& image: images)
+    {
+        if (!image->GetHeightmap() || !image->IsVisible())
+            continue;
+        std::shared_ptr<Texture> heightmap = Resolve(image->GetHeightmap());
+        m_terrainSources.push_back({image.get(), image->GetVersion(), image->GetModel()->Version(), heightmap.get()});
+        auto it = m_fields.find(heightmap);
+        std::shared_ptr<const HeightField> field = it != m_fields.end() ? it->second : HeightField::Decode(*heightmap);
+        fields[heightmap] = field;
+        if (field)
+            m_layers.emplace_back(field, *image->GetModel()->Value(), image->GetHeightScale());
+    }
+    m_fields = std::move(fields);
+    m_terrainVersion++;
+}
+
+void FogOfWar::Update(const std::vector<FogViewer>& viewers)
+{
+    m_generation++;
+    bool changed = !m_masking || viewers.size() != m_polygons.size();
+    m_stale.clear();
+    m_masking = true;
+
+    // Walls changed since the last update only affect those seeing them
+    m_changes.clear();
+    bool changesKnown = walls.ChangedSince(m_wallsVersion, m_changes);
+    m_wallsVersion = walls.Version();
+
+    for (size_t i = 0; i < viewers.size(); i++)
+    {
+        const FogViewer& viewer = viewers[i];
+        VisionPolygon& polygon = m_cache[viewer.id];
+        if (IsStale(polygon, viewer, changesKnown))
+        {
+            polygon.viewer = viewer.id;
+            polygon.origin = viewer.origin;
+            polygon.height = viewer.height;
+            polygon.range = m_range;
+            polygon.terrainVersion = m_terrainVersion;
+            m_stale.push_back(&polygon);
+            changed = true;
+        }
+        polygon.generation = m_generation;
+        if (i < m_polygons.size())
+        {
+            changed |= m_polygons[i] != &polygon;
+            m_polygons[i] = &polygon;
+        }
+        else
+            m_polygons.push_back(&polygon);
+    }
+    m_polygons.resize(viewers.size());
+
+    m_numComputed = m_stale.size();
+    if (m_stale.size() > 1 && !m_pool)
+        m_pool = std::make_unique<WorkerPool>();
+    m_workers.resize(m_pool ? m_pool->NumWorkers() : 1);
+    if (m_pool)
+        m_pool->ParallelFor(m_stale.size(), [this](size_t i, size_t worker) { Compute(*m_stale[i], m_workers[worker]); });
+    else if (!m_stale.empty())
+        Compute(*m_stale[0], m_workers[0]);
+    m_stale.clear();
+
+    for (auto it = m_cache.begin(); it != m_cache.end();)
+    {
+        if (it->second.generation != m_generation)
+            it = m_cache.erase(it);
+        else
+            ++it;
+    }
+    if (changed)
+        m_polygonsVersion = NewPolygonsVersion();
+}
+
+void FogOfWar::Show(std::vector<VisionPolygon> polygons)
+{
+    m_shown = std::move(polygons);
+    m_polygons.clear();
+    for (const VisionPolygon& polygon: m_shown)
+        m_polygons.push_back(&polygon);
+    m_masking = true;
+    m_polygonsVersion = NewPolygonsVersion();
+}
+
+bool FogOfWar::IsVisible(glm::vec2 point) const
+{
+    if (!IsMasking())
+        return true;
+    for (const VisionPolygon* polygon: m_polygons)
+    {
+        if (InPolygon(point, *polygon))
+            return true;
+    }
+    return false;
+}
+
+void FogOfWar::Compute(VisionPolygon& polygon, Worker& worker) const
+{
+    worker.sweep.Compute(walls, polygon.origin, polygon.range, polygon.points);
+    polygon.triangles.clear();
+    Bounds2D region(polygon.origin - polygon.range, polygon.origin + polygon.range);
+    for (auto it = m_layers.rbegin(); it != m_layers.rend(); ++it)
+    {
+        if (SpatialGrid::Overlaps(region, it->bounds))
+        {
+            float eyeHeight = it->HeightAt(polygon.origin) + polygon.height + EYE_LEVEL;
+            worker.viewshed.Compute(*it, polygon.origin, eyeHeight, polygon.range, polygon.points, polygon.triangles);
+            break;
+        }
+    }
+    polygon.valid = true;
+}
+
+bool FogOfWar::IsStale(const VisionPolygon& polygon, const FogViewer& viewer, bool changesKnown) const
+{
+    if (!polygon.valid || polygon.origin != viewer.origin || polygon.height != viewer.height || polygon.range != m_range)
+        return true;
+    if (polygon.terrainVersion != m_terrainVersion)
+        return true;
+    if (!changesKnown)
+        return true;
+    Bounds2D region(polygon.origin - polygon.range, polygon.origin + polygon.range);
+    for (const Bounds2D& change: m_changes)
+    {
+        if (SpatialGrid::Overlaps(region, change))
+            return true;
+    }
+    return false;
+}
@@ -1,39 +1,17 @@
+#include <cmath>
+
 #include <glm/glm.hpp>
 
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
 #include <model/Token.h>
 #include <model/Grid.h>
 
 
-Grid::Grid(std::shared_ptr<Mesh> mesh, std::shared_ptr<Shader> shader) : m_mesh(mesh), m_shader(shader)
-{
-    shader->use();
-    shader->setFloat("gridScale", m_scale);
-    shader->setFloat3("gridColour", m_colour.x, m_colour.y, m_colour.z);
-}
-
-void Grid::Draw()
-{
-    m_shader->use();
-    m_mesh->Draw(*m_shader);
-}
-
-void Grid::SetScale(float scale)
-{
-    m_scale = scale;
-    m_shader->use();
-    m_shader->setFloat("gridScale", m_scale);
-}
+Grid::Grid() {}
 
+void Grid::SetScale(float scale) { m_scale = scale; }
 float Grid::GetScale() { return m_scale; }
 
-void Grid::SetColour(glm::vec3 colour)
-{
-    m_colour = colour;
-    m_shader->use();
-    m_shader->setFloat3("gridColour", m_colour.x, m_colour.y, m_colour.z);
-}
+void Grid::SetColour(glm::vec3 colour) { m_colour = colour; }
 
 glm::vec3 Grid::GetColour() { return m_colour; }
 
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <glutil/Texture.h>
+#include <model/Bounds.h>
+
+#include <model/HeightField.h>
+
+
+HeightField::HeightField(int width, int height, std::vector<uint8_t> heights)
+{
+    m_levels.push_back({width, height, std::move(heights)});
+    while (width > 1 || height > 1)
+    {
+        const Level& below = m_levels.back();
+        // Rounds up so the odd texel at an edge is still covered
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        Level level{width, height, std::vector<uint8_t>(size_t(width) * height)};
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint8_t highest = 0;
+                for (int dy = 0; dy < 2; dy++)
+                {
+                    for (int dx = 0; dx < 2; dx++)
+                    {
+                        int bx = x * 2 + dx, by = y * 2 + dy;
+                        if (bx < below.width && by < below.height)
+                            highest = std::max(highest, below.heights[size_t(by) * below.width + bx]);
+                    }
+                }
+                level.heights[size_t(y) * width + x] = highest;
+            }
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+std::shared_ptr<const HeightField> HeightField::Decode(const Texture& texture)
+{
+    if (!texture.IsValid())
+        return nullptr;
+
+    int width, height, numChannels;
+    unsigned char* pixels;
+    if (texture.data && !texture.data->mips.empty())
+    {
+        // Already decoded, only the first channel is wanted
+        const MipLevel& mip = texture.data->mips[0];
+        std::vector<uint8_t> heights(size_t(mip.width) * mip.height);
+        for (size_t i = 0; i < heights.size(); i++)
+            heights[i] = mip.pixels[i * texture.numChannels];
+        return std::make_shared<HeightField>(mip.width, mip.height, std::move(heights));
+    }
+    if (texture.data)
+        pixels = stbi_load_from_memory(texture.data->bytes, texture.data->size, &width, &height, &numChannels, 1);
+    else
+        pixels = stbi_load(texture.filename.c_str(), &width, &height, &numChannels, 1);
+    if (!pixels)
+        return nullptr;
+
+    std::vector<uint8_t> heights(pixels, pixels + size_t(width) * height);
+    stbi_image_free(pixels);
+    return std::make_shared<HeightField>(width, height, std::move(heights));
+}
+
+TerrainLayer::TerrainLayer(std::shared_ptr<const HeightField> field, const glm::mat4& model, float heightScale)
+    : field(field), heightScale(heightScale)
+{
+    // The quad spans -0.5 to 0.5, its UVs 0 to 1
+    glm::mat4 inverse = glm::inverse(model);
+    glm::vec2 size(field->Width(), field->Height());
+    axisX = glm::vec2(inverse[0].x, inverse[0].y) * size;
+    axisY = glm::vec2(inverse[1].x, inverse[1].y) * size;
+    origin = (glm::vec2(inverse[3].x, inverse[3].y) + 0.5f) * size;
+
+    glm::vec2 lo(0), hi(0);
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec4 corner = model * glm::vec4(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, 0.0f, 1.0f);
+        glm::vec2 point(corner.x, corner.y);
+        lo = i == 0 ? point : glm::min(lo, point);
+        hi = i == 0 ? point : glm::max(hi, point);
+    }
+    bounds = Bounds2D(lo, hi);
+}
+
+float TerrainLayer::HeightAt(glm::vec2 pos) const
+{
+    glm::vec2 texel = glm::floor(ToTexel(pos));
+    return heightScale * field->Max(0, int(texel.x), int(texel.y)) / 255.0f;
+}
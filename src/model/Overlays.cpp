@@ -1,34 +1,15 @@
-#include <iostream>
+#include <algorithm>
 #include <memory>
 
 #include <glm/glm.hpp>
 
-#include <glutil/Mesh.h>
-#include <glutil/Shader.h>
-
 #include <model/Overlays.h>
 
 
-Overlay::Overlay(std::shared_ptr<Shader> shader) : shader(shader) {}
-
-RectOverlay::RectOverlay(std::shared_ptr<Mesh> mesh, std::shared_ptr<Shader> shader, glm::vec4 colour) : Overlay(shader), m_mesh(mesh)
-{
-    SetColour(colour);
-}
-
-void RectOverlay::Draw()
-{
-    shader->use();
-    shader->setFloat4("coords", MinX(), MinY(), MaxX(), MaxY());
-    m_mesh->Draw(*shader);
-}
+RectOverlay::RectOverlay(glm::vec4 colour) : m_colour(colour) {}
 
-void RectOverlay::SetColour(glm::vec4 col)
-{
-    m_colour = col;
-    shader->use();
-    shader->setFloat4("colour", m_colour.x, m_colour.y, m_colour.z, m_colour.w);
-}
+void RectOverlay::SetColour(glm::vec4 col) { m_colour = col; }
+glm::vec4 RectOverlay::GetColour() { return m_colour; }
 
 float RectOverlay::MinX() { return std::min(startCorner.x, endCorner.x); }
 float RectOverlay::MaxX() { return std::max(startCorner.x, endCorner.x); }
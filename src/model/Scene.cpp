@@ -1,25 +1,27 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include <Resources.h>
 #include <glutil/Camera.h>
-#include <glutil/Shader.h>
 #include <model/BGImage.h>
+#include <model/FogOfWar.h>
 #include <model/Grid.h>
 #include <model/Overlays.h>
+#include <model/Selection.h>
 #include <model/Token.h>
 #include <model/Scene.h>
 
 
 Scene::Scene(std::shared_ptr<Resources> resources) : m_resources(resources)
 {
-    grid = std::make_shared<Grid>(
-        m_resources->GetMesh(Resources::MeshType::Quad2),
-        m_resources->GetShader(Resources::ShaderType::Grid)
-    );
+    grid = std::make_shared<Grid>();
+    fog = std::make_shared<FogOfWar>();
 }
 
 void Scene::AddCamera(const std::shared_ptr<Camera>& camera)
@@ -34,46 +36,140 @@ void Scene::AddDefaultCamera()
     AddCamera(std::make_shared<Camera>(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f), true, 10.0f));
 }
 
+// Index helpers shared by tokens and images, the selection bitset is kept
+// aligned with the shape list.
+template <typename T>
+static void AppendShape(std::vector<std::shared_ptr<T>>& shapes, std::unordered_map<ShapeID, size_t>& indices, Selection& selection, const std::shared_ptr<T>& shape)
+{
+    indices[shape->GetID()] = shapes.size();
+    shapes.push_back(shape);
+    selection.Resize(shapes.size());
+}
+
+template <typename T>
+static void ReindexShapes(const std::vector<std::shared_ptr<T>>& shapes, std::unordered_map<ShapeID, size_t>& indices, size_t first)
+{
+    for (size_t i = first; i < shapes.size(); i++)
+        indices[shapes[i]->GetID()] = i;
+}
+
+template <typename T>
+static RemovedShapes<T> RemoveShapes(std::vector<std::shared_ptr<T>>& shapes, std::unordered_map<ShapeID, size_t>& indices, Selection& selection, const std::vector<ShapeID>& toRemove)
+{
+    // Mark by index rather than searching toRemove for every shape
+    std::vector<bool> remove(shapes.size(), false);
+    size_t first = shapes.size();
+    for (ShapeID id: toRemove)
+    {
+        auto it = indices.find(id);
+        if (it == indices.end())
+            continue;
+        remove[it->second] = true;
+        first = std::min(first, it->second);
+        indices.erase(it);
+    }
+
+    RemovedShapes<T> removed;
+    size_t count = first;
+    for (size_t i = first; i < shapes.size(); i++)
+    {
+        if (remove[i])
+        {
+            bool selected = selection.Set(i, shapes[i]->GetID(), false);
+            removed.push_back({i, std::move(shapes[i]), selected});
+        }
+        else
+        {
+            selection.Move(i, count);
+            shapes[count++] = std::move(shapes[i]);
+        }
+    }
+    shapes.resize(count);
+    selection.Resize(count);
+    ReindexShapes(shapes, indices, first);
+    return removed;
+}
+
+template <typename T>
+static void InsertShapes(std::vector<std::shared_ptr<T>>& shapes, std::unordered_map<ShapeID, size_t>& indices, Selection& selection, const RemovedShapes<T>& toInsert)
+{
+    if (toInsert.empty())
+        return;
+
+    // Merge in place from the back, toInsert is sorted by the index each shape
+    // should end up at
+    size_t src = shapes.size();
+    size_t dst = shapes.size() + toInsert.size();
+    shapes.resize(dst);
+    selection.Resize(dst);
+    for (size_t remaining = toInsert.size(); remaining > 0;)
+    {
+        dst--;
+        if (toInsert[remaining - 1].index == dst)
+            shapes[dst] = toInsert[--remaining].shape;
+        else
+        {
+            src--;
+            selection.Move(src, dst);
+            shapes[dst] = std::move(shapes[src]);
+        }
+    }
+
+    for (const RemovedShape<T>& inserted: toInsert)
+        selection.Set(inserted.index, inserted.shape->GetID(), inserted.selected);
+    ReindexShapes(shapes, indices, toInsert.front().index);
+}
+
+void Scene::EnsureUniqueID(Shape2D& shape)
+{
+    while (shape.GetID() == NULL_SHAPE_ID || m_tokenIndices.count(shape.GetID()) || m_imageIndices.count(shape.GetID()))
+        shape.SetID(NewShapeID());
+}
+
 void Scene::AddImage()
 {
-    images.push_back(std::make_shared<BGImage>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(Resources::TextureType::Default)
-    ));
+    AddImage(std::make_shared<BGImage>(m_resources->GetTexture(Resources::TextureType::Default)));
 }
 
 void Scene::AddImage(std::string path)
 {
-    images.push_back(std::make_shared<BGImage>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(path)
-    ));
+    AddImage(std::make_shared<BGImage>(m_resources->GetTexture(path)));
 }
 
 void Scene::AddImage(const std::shared_ptr<BGImage>& image)
 {
-    images.push_back(image);
+    EnsureUniqueID(*image);
+    AppendShape(images, m_imageIndices, m_imageSelection, image);
+}
+
+void Scene::AddImages(const std::vector<std::shared_ptr<BGImage>>& toAdd)
+{
+    images.reserve(images.size() + toAdd.size());
+    for (const auto& image: toAdd)
+        AddImage(image);
 }
 
 void Scene::AddToken()
 {
-    tokens.push_back(std::make_shared<Token>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(Resources::TextureType::Default)
-    ));
+    AddToken(std::make_shared<Token>(m_resources->GetTexture(Resources::TextureType::Default)));
 }
 
 void Scene::AddToken(std::string path)
 {
-    tokens.push_back(std::make_shared<Token>(
-        m_resources->GetMesh(Resources::MeshType::Quad),
-        m_resources->GetTexture(path)
-    ));
+    AddToken(std::make_shared<Token>(m_resources->GetTexture(path)));
 }
 
 void Scene::AddToken(const std::shared_ptr<Token>& token)
 {
-    tokens.push_back(token);
+    EnsureUniqueID(*token);
+    AppendShape(tokens, m_tokenIndices, m_tokenSelection, token);
+}
+
+void Scene::AddTokens(const std::vector<std::shared_ptr<Token>>& toAdd)
+{
+    tokens.reserve(tokens.size() + toAdd.size());
+    for (const auto& token: toAdd)
+        AddToken(token);
 }
 
 void Scene::RemoveOverlay(std::shared_ptr<Overlay> overlay)
@@ -83,23 +179,102 @@ void Scene::RemoveOverlay(std::shared_ptr<Overlay> overlay)
         overlays.erase(it);
 }
 
-void Scene::RemoveTokens(std::vector<std::shared_ptr<Token>> toRemove)
+RemovedShapes<Token> Scene::RemoveTokens(const std::vector<ShapeID>& toRemove)
 {
-    auto pred = [&toRemove](const std::shared_ptr<Token>& t) ->bool
-    {
-        return std::find(toRemove.begin(), toRemove.end(), t) != toRemove.end();
-    };
+    return RemoveShapes(tokens, m_tokenIndices, m_tokenSelection, toRemove);
+}
 
-    tokens.erase(std::remove_if(tokens.begin(), tokens.end(), pred), tokens.end());
+RemovedShapes<BGImage> Scene::RemoveImages(const std::vector<ShapeID>& toRemove)
+{
+    return RemoveShapes(images, m_imageIndices, m_imageSelection, toRemove);
 }
 
-void Scene::RemoveImages(std::vector<std::shared_ptr<BGImage>> toRemove)
+void Scene::InsertTokens(const RemovedShapes<Token>& toInsert)
 {
-    auto pred = [&toRemove](const std::shared_ptr<BGImage>& t) ->bool
-    {
-        return std::find(toRemove.begin(), toRemove.end(), t) != toRemove.end();
-    };
-    images.erase(std::remove_if(images.begin(), images.end(), pred), images.end());
+    InsertShapes(tokens, m_tokenIndices, m_tokenSelection, toInsert);
+}
+
+void Scene::InsertImages(const RemovedShapes<BGImage>& toInsert)
+{
+    InsertShapes(images, m_imageIndices, m_imageSelection, toInsert);
+}
+
+std::shared_ptr<Token> Scene::GetToken(ShapeID id)
+{
+    auto it = m_tokenIndices.find(id);
+    return it == m_tokenIndices.end() ? nullptr : tokens[it->second];
+}
+
+std::shared_ptr<BGImage> Scene::GetImage(ShapeID id)
+{
+    auto it = m_imageIndices.find(id);
+    return it == m_imageIndices.end() ? nullptr : images[it->second];
+}
+
+size_t Scene::GetTokenIndex(ShapeID id) const
+{
+    auto it = m_tokenIndices.find(id);
+    return it == m_tokenIndices.end() ? NO_INDEX : it->second;
+}
+
+size_t Scene::GetImageIndex(ShapeID id) const
+{
+    auto it = m_imageIndices.find(id);
+    return it == m_imageIndices.end() ? NO_INDEX : it->second;
+}
+
+std::shared_ptr<Shape2D> Scene::GetShape(ShapeID id)
+{
+    std::shared_ptr<Shape2D> shape = GetToken(id);
+    if (!shape)
+        shape = GetImage(id);
+    return shape;
+}
+
+// Selection
+const Selection& Scene::GetTokenSelection() const { return m_tokenSelection; }
+const Selection& Scene::GetImageSelection() const { return m_imageSelection; }
+
+bool Scene::IsSelected(ShapeID id) const
+{
+    return m_tokenSelection.Contains(id) || m_imageSelection.Contains(id);
+}
+
+bool Scene::SetSelected(ShapeID id, bool selected)
+{
+    auto it = m_tokenIndices.find(id);
+    if (it != m_tokenIndices.end())
+        return m_tokenSelection.Set(it->second, id, selected);
+
+    it = m_imageIndices.find(id);
+    if (it != m_imageIndices.end())
+        return m_imageSelection.Set(it->second, id, selected);
+
+    return false;
+}
+
+size_t Scene::NumSelected() const { return m_tokenSelection.Count() + m_imageSelection.Count(); }
+
+void Scene::ClearSelection()
+{
+    m_tokenSelection.Clear();
+    m_imageSelection.Clear();
+}
+
+void Scene::SelectAll()
+{
+    if (!m_lockTokens)
+        m_tokenSelection.SelectAll(tokens);
+    if (!m_lockImages)
+        m_imageSelection.SelectAll(images);
+}
+
+void Scene::InvertSelection()
+{
+    if (!m_lockTokens)
+        m_tokenSelection.Invert(tokens);
+    if (!m_lockImages)
+        m_imageSelection.Invert(images);
 }
 
 bool Scene::RemoveCamera(const std::shared_ptr<Camera>& camera)
@@ -157,73 +332,42 @@ Bounds2D Scene::GetBounds()
     return Bounds2D::BoundsForShapes(shapes);
 }
 
-bool Scene::GetImagesLocked() { return m_lockImages; }
-void Scene::SetImagesLocked(bool locked) { m_lockImages = locked; }
-bool Scene::GetTokensLocked() { return m_lockTokens; }
-void Scene::SetTokensLocked(bool locked) { m_lockTokens = locked; }
-
-// TODO: Move to renderer class
-void Scene::Draw()
+std::vector<std::shared_ptr<Shape2D>> Scene::ShapesInRect(glm::vec2 lo, glm::vec2 hi)
 {
-    glClearColor(bgColor.x * bgColor.w, bgColor.y * bgColor.w, bgColor.z * bgColor.w, bgColor.w);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    std::shared_ptr<Shader> imageShader = m_resources->GetShader(Resources::ShaderType::Image);
-    imageShader->use();
-    for (const std::shared_ptr<BGImage>& image: images)
-        image->Draw(*imageShader);
-
-    grid->Draw();
+    std::vector<std::shared_ptr<Shape2D>> shapes;
 
-    auto quad = m_resources->GetMesh(Resources::MeshType::Quad);
-    auto statusTexture = m_resources->GetTexture(Resources::TextureType::Status);
-    auto xStatusTexture = m_resources->GetTexture(Resources::TextureType::XStatus);
-    std::shared_ptr<Shader> tokenShader = m_resources->GetShader(Resources::ShaderType::Token);
-    std::shared_ptr<Shader> statusShader = m_resources->GetShader(Resources::ShaderType::Status);
-    tokenShader->use();
-    for (const std::shared_ptr<Token>& token : tokens)
+    if (!m_lockTokens)
     {
-        tokenShader->use();
-        token->Draw(*tokenShader);
-
-        auto statuses = token->GetStatuses();
-        if (statuses.any())
+        for (const std::shared_ptr<Token>& token: tokens)
         {
-            statusShader->use();
-            statusTexture->activate(GL_TEXTURE0);
-            statusShader->setInt("diffuse", 0);
-            glBindTexture(GL_TEXTURE_2D, statusTexture->ID);
-
-            for (unsigned int i=0; i < statuses.size(); i++)
+            float radius = token->GetModel()->GetScalef() * 0.5f;
+            glm::vec2 tokenPos = token->GetModel()->GetPos();
+            if (tokenPos.x + radius > lo.x && tokenPos.x - radius < hi.x
+                && tokenPos.y + radius > lo.y && tokenPos.y - radius < hi.y)
             {
-                if (!statuses[i])
-                    continue;
-
-                float degree = glm::radians(90 - 360.0f * i / statuses.size());
-                
-                glm::mat4 matrix = glm::mat4(1.0f);
-                matrix = glm::translate(matrix, glm::vec3(token->GetModel()->GetPos() + glm::vec2(glm::cos(degree), glm::sin(degree)) * token->GetModel()->GetScale() * 0.35f, 0.0f));
-                matrix = glm::scale(matrix, glm::vec3(token->GetModel()->GetScalef() * 0.15f));
-                statusShader->setMat4("model", matrix);
-                statusShader->setFloat4("color", statusColors[i].x, statusColors[i].y, statusColors[i].z, token->GetOpacity());
-
-                quad->Draw(*statusShader);
+                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(token));
             }
         }
+    }
 
-        if (token->GetXStatus())
+    if (!m_lockImages)
+    {
+        for (const std::shared_ptr<BGImage>& image: images)
         {
-            statusShader->use();
-            statusShader->setMat4("model", *token->GetModel()->Value());
-            xStatusTexture->activate(GL_TEXTURE0);
-            statusShader->setInt("diffuse", 0);
-            statusShader->setFloat4("color", 1.0f, 1.0f, 1.0f, token->GetOpacity());
-            glBindTexture(GL_TEXTURE_2D, xStatusTexture->ID);
-            quad->Draw(*statusShader);
+            glm::vec2 scale = image->GetModel()->GetScale() * 0.5f;
+            glm::vec2 imageMin = image->GetModel()->GetPos() - scale;
+            glm::vec2 imageMax = image->GetModel()->GetPos() + scale;
+            if (imageMax.x > lo.x && imageMin.x < hi.x && imageMax.y > lo.y && imageMin.y < hi.y)
+            {
+                shapes.push_back(static_cast<std::shared_ptr<Shape2D>>(image));
+            }
         }
     }
 
-    // Overlays have their own shaders
-    for (const std::shared_ptr<Overlay>& overlay : overlays)
-        overlay->Draw();
+    return shapes;
 }
+
+bool Scene::GetImagesLocked() { return m_lockImages; }
+void Scene::SetImagesLocked(bool locked) { m_lockImages = locked; }
+bool Scene::GetTokensLocked() { return m_lockTokens; }
+void Scene::SetTokensLocked(bool locked) { m_lockTokens = locked; }
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cstdint>
+
+#include <model/Selection.h>
+
+
+bool Selection::Set(size_t index, ShapeID id, bool selected)
+{
+    if (IsSelected(index) == selected)
+        return false;
+
+    SetBit(index, selected);
+    if (selected)
+        AddMember(id);
+    else
+        RemoveMember(id);
+    return true;
+}
+
+void Selection::Clear()
+{
+    std::fill(m_bits.begin(), m_bits.end(), 0);
+    m_members.clear();
+    m_positions.clear();
+}
+
+void Selection::Resize(size_t size)
+{
+    m_size = size;
+    m_bits.resize((size + 63) / 64, 0);
+    MaskTail();
+}
+
+void Selection::Move(size_t from, size_t to)
+{
+    bool value = IsSelected(from);
+    SetBit(from, false);
+    SetBit(to, value);
+}
+
+void Selection::SetBit(size_t index, bool value)
+{
+    uint64_t mask = uint64_t(1) << (index & 63);
+    if (value)
+        m_bits[index >> 6] |= mask;
+    else
+        m_bits[index >> 6] &= ~mask;
+}
+
+void Selection::AddMember(ShapeID id)
+{
+    m_positions[id] = m_members.size();
+    m_members.push_back(id);
+}
+
+void Selection::RemoveMember(ShapeID id)
+{
+    auto it = m_positions.find(id);
+    if (it == m_positions.end())
+        return;
+
+    // Swap with the last member to keep the list compact
+    size_t position = it->second;
+    m_positions.erase(it);
+    ShapeID last = m_members.back();
+    m_members.pop_back();
+    if (position < m_members.size())
+    {
+        m_members[position] = last;
+        m_positions[last] = position;
+    }
+}
+
+// Bits past the end of the list must stay clear for select all/invert
+void Selection::MaskTail()
+{
+    if (m_size & 63)
+        m_bits.back() &= (uint64_t(1) << (m_size & 63)) - 1;
+}
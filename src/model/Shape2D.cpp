@@ -1,17 +1,42 @@
+#include <random>
+
 #include <glm/glm.hpp>
 
 #include <glutil/Matrix2D.h>
-#include <glutil/Shader.h>
 #include <model/Shape2D.h>
 
 
+ShapeID NewShapeID()
+{
+    static std::mt19937_64 rng(std::random_device{}());
+    ShapeID id;
+    do
+        id = rng();
+    while (id == NULL_SHAPE_ID);
+    return id;
+}
+
+uint64_t NewShapeVersion()
+{
+    static uint64_t version = 0;
+    return ++version;
+}
+
 // Shape2D
+ShapeID Shape2D::GetID() const { return m_id; }
+void Shape2D::SetID(ShapeID id)
+{
+    m_id = id;
+    Touch();
+}
 std::shared_ptr<Matrix2D> Shape2D::GetModel() { return m_model; }
-void Shape2D::SetModel(const std::shared_ptr<Matrix2D>& matrix) { m_model = matrix; }
+void Shape2D::SetModel(const std::shared_ptr<Matrix2D>& matrix)
+{
+    m_model = matrix;
+    Touch();
+}
 
 // Rect
-Rect::Rect(std::shared_ptr<Mesh> mesh) : m_mesh(mesh) {}
-
 bool Rect::Contains(glm::vec2 pt)
 {
     // TODO: Account for rotation, being lazy atm
@@ -19,8 +44,3 @@ bool Rect::Contains(glm::vec2 pt)
     glm::vec2 hi = m_model->GetPos() + m_model->GetScale() * 0.5f;
     return lo.x <= pt.x && hi.x >= pt.x && lo.y <= pt.y && hi.y >= pt.y;
 }
-
-void Rect::Draw(Shader& shader)
-{
-    m_mesh->Draw(shader);
-}
\ No newline at end of file
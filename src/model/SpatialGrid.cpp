@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/Shape2D.h>
+
+#include <model/SpatialGrid.h>
+
+
+SpatialGrid::SpatialGrid(float cellSize) : m_cellSize(cellSize) {}
+
+void SpatialGrid::Insert(ShapeID id, const Bounds2D& bounds)
+{
+    glm::ivec2 lo = CellOf(bounds.min);
+    glm::ivec2 hi = CellOf(bounds.max);
+    bool large = (int64_t(hi.x) - lo.x + 1) * (int64_t(hi.y) - lo.y + 1) > MAX_CELLS;
+    auto [it, inserted] = m_entries.try_emplace(id, Entry{bounds, lo, hi, large});
+    Entry& entry = it->second;
+    if (!inserted)
+    {
+        entry.bounds = bounds;
+        // Most moves stay within the same cells
+        if (entry.lo == lo && entry.hi == hi)
+            return;
+        RemoveFromCells(id, entry);
+        entry.lo = lo;
+        entry.hi = hi;
+        entry.large = large;
+    }
+    AddToCells(id, entry);
+}
+
+void SpatialGrid::Remove(ShapeID id)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end())
+        return;
+    RemoveFromCells(id, it->second);
+    m_entries.erase(it);
+}
+
+void SpatialGrid::Clear()
+{
+    m_entries.clear();
+    m_cells.clear();
+    m_large.clear();
+}
+
+void SpatialGrid::Query(const Bounds2D& region, std::vector<ShapeID>& found) const
+{
+    glm::ivec2 lo = CellOf(region.min);
+    glm::ivec2 hi = CellOf(region.max);
+    // A shape spanning several cells is only reported from the first one the
+    // region also covers
+    auto visit = [&](int x, int y, const std::vector<ShapeID>& ids) {
+        for (ShapeID id: ids)
+        {
+            const Entry& entry = m_entries.at(id);
+            if (x == std::max(entry.lo.x, lo.x) && y == std::max(entry.lo.y, lo.y) && Overlaps(entry.bounds, region))
+                found.push_back(id);
+        }
+    };
+
+    for (ShapeID id: m_large)
+    {
+        if (Overlaps(m_entries.at(id).bounds, region))
+            found.push_back(id);
+    }
+
+    // Huge regions visit the occupied cells rather than every cell covered
+    uint64_t numCells = uint64_t(int64_t(hi.x) - lo.x + 1) * uint64_t(int64_t(hi.y) - lo.y + 1);
+    if (numCells > m_cells.size())
+    {
+        for (const auto& [key, ids]: m_cells)
+        {
+            int x = int32_t(key >> 32);
+            int y = int32_t(key & 0xFFFFFFFF);
+            if (x >= lo.x && x <= hi.x && y >= lo.y && y <= hi.y)
+                visit(x, y, ids);
+        }
+        return;
+    }
+    for (int x = lo.x; x <= hi.x; x++)
+    {
+        for (int y = lo.y; y <= hi.y; y++)
+        {
+            auto it = m_cells.find(Key(x, y));
+            if (it != m_cells.end())
+                visit(x, y, it->second);
+        }
+    }
+}
+
+Bounds2D SpatialGrid::ShapeBounds(glm::vec2 pos, glm::vec2 scale, float rotation)
+{
+    glm::vec2 extent = glm::abs(scale) * 0.5f;
+    // Any rotation fits within the half diagonal
+    if (std::fmod(rotation, 360.0f) != 0.0f)
+        extent = glm::vec2(glm::length(extent));
+    return Bounds2D(pos - extent, pos + extent);
+}
+
+bool SpatialGrid::Overlaps(const Bounds2D& a, const Bounds2D& b)
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+glm::ivec2 SpatialGrid::CellOf(glm::vec2 pos) const
+{
+    // Clamped so far away or infinite positions still map to a cell
+    const float limit = 1 << 30;
+    glm::vec2 cell = glm::clamp(glm::floor(pos / m_cellSize), -limit, limit);
+    return glm::ivec2(cell);
+}
+
+void SpatialGrid::AddToCells(ShapeID id, const Entry& entry)
+{
+    if (entry.large)
+    {
+        m_large.push_back(id);
+        return;
+    }
+    for (int x = entry.lo.x; x <= entry.hi.x; x++)
+    {
+        for (int y = entry.lo.y; y <= entry.hi.y; y++)
+            m_cells[Key(x, y)].push_back(id);
+    }
+}
+
+void SpatialGrid::RemoveFromCells(ShapeID id, const Entry& entry)
+{
+    if (entry.large)
+    {
+        m_large.erase(std::find(m_large.begin(), m_large.end(), id));
+        return;
+    }
+    for (int x = entry.lo.x; x <= entry.hi.x; x++)
+    {
+        for (int y = entry.lo.y; y <= entry.hi.y; y++)
+        {
+            auto it = m_cells.find(Key(x, y));
+            if (it == m_cells.end())
+                continue;
+            std::vector<ShapeID>& ids = it->second;
+            auto found = std::find(ids.begin(), ids.end(), id);
+            if (found != ids.end())
+            {
+                *found = ids.back();
+                ids.pop_back();
+            }
+            if (ids.empty())
+                m_cells.erase(it);
+        }
+    }
+}
@@ -2,17 +2,16 @@
 #include <string>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
-#include <Constants.h>
 #include <glutil/Matrix2D.h>
-#include <glutil/Mesh.h>
 #include <model/Token.h>
 
 
-Token::Token(std::shared_ptr<Mesh> mesh) : Rect(mesh), m_name("") {}
-Token::Token(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture) : Token(mesh, texture, texture->Name()) {}
-Token::Token(std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture, std::string name) : Rect(mesh), m_name(name), m_texture(texture) {}
+Token::Token() : m_name("") {}
+Token::Token(std::shared_ptr<Texture> texture) : Token(texture, texture->Name()) {}
+Token::Token(std::shared_ptr<Texture> texture, std::string name) : m_name(name), m_texture(texture) {}
+Token::Token(std::shared_ptr<Texture> texture, std::string name, const std::shared_ptr<Matrix2D>& model) :
+    Rect(model), m_name(name), m_texture(texture) {}
 // TODO: Rule of five
 Token::Token(const Token& token) : Rect(token)
 {
@@ -24,50 +23,70 @@ Token::Token(const Token& token) : Rect(token)
     m_statuses = token.m_statuses;
     m_opacity = token.m_opacity;
     m_xStatus = token.m_xStatus;
+    m_nameHidden = token.m_nameHidden;
+    m_height = token.m_height;
 }
 
-void Token::SetIcon(std::shared_ptr<Texture> texture) { m_texture = texture; }
+void Token::SetIcon(std::shared_ptr<Texture> texture)
+{
+    m_texture = texture;
+    Touch();
+}
 std::shared_ptr<Texture> Token::GetIcon() { return m_texture; }
-void Token::SetBorderWidth(float width) { m_borderWidth = width; }
+void Token::SetBorderWidth(float width)
+{
+    m_borderWidth = width;
+    Touch();
+}
 float Token::GetBorderWidth() { return m_borderWidth; }
-void Token::SetBorderColor(glm::vec4 color) { m_borderColor = color; }
+void Token::SetBorderColor(glm::vec4 color)
+{
+    m_borderColor = color;
+    Touch();
+}
 glm::vec4 Token::GetBorderColor() { return m_borderColor; }
-void Token::SetName(std::string name) { m_name = name; }
+void Token::SetName(std::string name)
+{
+    m_name = name;
+    Touch();
+}
 std::string Token::GetName() { return m_name; }
-void Token::SetStatuses(TokenStatuses statuses) { m_statuses = statuses; }
+void Token::SetStatuses(TokenStatuses statuses)
+{
+    m_statuses = statuses;
+    Touch();
+}
 TokenStatuses Token::GetStatuses() { return m_statuses; }
-void Token::SetStatusEnabled(int status, bool enabled) { m_statuses[status] = enabled; }
+void Token::SetStatusEnabled(int status, bool enabled)
+{
+    m_statuses[status] = enabled;
+    Touch();
+}
 bool Token::IsStatusEnabled(int status) { return m_statuses[status]; }
-void Token::SetXStatus(bool enabled) { m_xStatus = enabled; }
+void Token::SetXStatus(bool enabled)
+{
+    m_xStatus = enabled;
+    Touch();
+}
 bool Token::GetXStatus() { return m_xStatus; }
-void Token::SetOpacity(float opacity) { m_opacity = opacity; }
+void Token::SetNameHidden(bool hidden)
+{
+    m_nameHidden = hidden;
+    Touch();
+}
+bool Token::IsNameHidden() { return m_nameHidden; }
+void Token::SetOpacity(float opacity)
+{
+    m_opacity = opacity;
+    Touch();
+}
 float Token::GetOpacity() { return m_opacity; }
-
-void Token::Draw(Shader &shader)
+void Token::SetHeight(float height)
 {
-    shader.setMat4("model", *m_model->Value());
-
-    glm::vec4 highlight;
-    if (isSelected)
-        highlight = SELECTION_COLOR_ALPHA;
-    else if (isHighlighted)
-        highlight = HIGHLIGHT_COLOR_ALPHA;
-    else
-        highlight = BLACK_RGBA;
-
-    if (m_texture && m_texture->IsValid())
-    {
-        m_texture->activate(GL_TEXTURE0);
-        shader.setInt("diffuse", 0);
-        glBindTexture(GL_TEXTURE_2D, m_texture->ID);
-    }
-
-    shader.setFloat4("highlightColor", highlight.x, highlight.y, highlight.z, highlight.w);
-    shader.setFloat4("borderColor", m_borderColor.x, m_borderColor.y, m_borderColor.z, m_borderColor.w);
-    shader.setFloat("borderWidth", m_borderWidth);
-    shader.setFloat("opacity", m_opacity);
-    Rect::Draw(shader);
+    m_height = height;
+    Touch();
 }
+float Token::GetHeight() { return m_height; }
 
 bool Token::Contains(glm::vec2 pt) const
 {
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <model/Bounds.h>
+#include <model/HeightField.h>
+#include <model/Walls.h>
+
+#include <model/Visibility.h>
+
+
+void VisibilitySweep::Compute(const Walls& walls, glm::vec2 origin, float range, std::vector<glm::vec2>& polygon)
+{
+    polygon.clear();
+    m_pieces.clear();
+    m_events.clear();
+    m_active.clear();
+    if (!(range > 0.0f))
+        return;
+
+    m_walls.clear();
+    walls.Query(Bounds2D(origin - range, origin + range), m_walls, m_ids);
+    for (const Wall* wall: m_walls)
+    {
+        // The box query also finds walls in its corners
+        if (Walls::DistanceTo(*wall, origin) < range)
+            AddSegment(wall->start - origin, wall->end - origin);
+    }
+
+    const float pi = glm::pi<float>();
+    glm::vec2 previous = range * glm::vec2(-1.0f, 0.0f);
+    for (int i = 1; i <= NUM_RANGE_SEGMENTS; i++)
+    {
+        float angle = -pi + 2.0f * pi * i / NUM_RANGE_SEGMENTS;
+        glm::vec2 next = range * glm::vec2(std::cos(angle), std::sin(angle));
+        AddSegment(previous, next);
+        previous = next;
+    }
+
+    for (uint32_t i = 0; i < m_pieces.size(); i++)
+    {
+        m_events.push_back({m_pieces[i].start, i, true});
+        m_events.push_back({m_pieces[i].end, i, false});
+    }
+    std::sort(m_events.begin(), m_events.end(), [](const Event& a, const Event& b) { return a.angle < b.angle; });
+
+    // Points closer together than this are the same point
+    float epsilon = range * 1e-5f;
+    for (size_t i = 0; i < m_events.size();)
+    {
+        float angle = m_events[i].angle;
+        glm::vec2 direction(std::cos(angle), std::sin(angle));
+
+        // Nearest hit before the walls ending here are dropped and after the
+        // walls starting here are added, the same point unless an edge is
+        // being passed
+        float before = Nearest(direction);
+        if (before >= 0.0f)
+            polygon.push_back(origin + direction * before);
+        for (; i < m_events.size() && m_events[i].angle == angle; i++)
+        {
+            if (m_events[i].starts)
+                m_active.push_back(m_events[i].piece);
+            else
+            {
+                auto it = std::find(m_active.begin(), m_active.end(), m_events[i].piece);
+                *it = m_active.back();
+                m_active.pop_back();
+            }
+        }
+        float after = Nearest(direction);
+        if (after >= 0.0f && (before < 0.0f || std::abs(after - before) > epsilon))
+            polygon.push_back(origin + direction * after);
+    }
+}
+
+void VisibilitySweep::AddSegment(glm::vec2 a, glm::vec2 b)
+{
+    float cross = a.x * b.y - a.y * b.x;
+    // In line with the origin, it hides nothing
+    if (std::abs(cross) <= 1e-9f * (glm::dot(a, a) + glm::dot(b, b)))
+        return;
+    if (cross < 0.0f)
+        std::swap(a, b);
+
+    float start = std::atan2(a.y, a.x);
+    float end = std::atan2(b.y, b.x);
+    if (end >= start)
+    {
+        AddPiece(a, b, start, end);
+        return;
+    }
+    // Wraps past pi, split where it crosses the negative x axis
+    const float pi = glm::pi<float>();
+    glm::vec2 crossing = a + (b - a) * (a.y / (a.y - b.y));
+    AddPiece(a, crossing, start, pi);
+    AddPiece(crossing, b, -pi, end);
+}
+
+void VisibilitySweep::AddPiece(glm::vec2 a, glm::vec2 b, float start, float end)
+{
+    if (end > start)
+        m_pieces.push_back({a, b, start, end});
+}
+
+float VisibilitySweep::Nearest(glm::vec2 direction) const
+{
+    float nearest = -1.0f;
+    for (uint32_t index: m_active)
+    {
+        const Piece& piece = m_pieces[index];
+        glm::vec2 edge = piece.b - piece.a;
+        float denominator = direction.x * edge.y - direction.y * edge.x;
+        // Only when the ray runs along the piece, its nearer end is then hit
+        float distance = std::abs(denominator) > 1e-12f
+                       ? (piece.a.x * edge.y - piece.a.y * edge.x) / denominator
+                       : std::min(glm::length(piece.a), glm::length(piece.b));
+        distance = std::max(distance, 0.0f);
+        if (nearest < 0.0f || distance < nearest)
+            nearest = distance;
+    }
+    return nearest;
+}
+
+void TerrainViewshed::Compute(const TerrainLayer& layer, glm::vec2 origin, float eyeHeight, float range,
+                              const std::vector<glm::vec2>& polygon, std::vector<glm::vec2>& triangles)
+{
+    triangles.clear();
+    if (polygon.empty() || !(range > 0.0f))
+        return;
+    // The sweep starts at -pi, which atan2 may round to pi, and points at the
+    // same event may round out of order
+    const float pi = glm::pi<float>();
+    m_angles.resize(polygon.size());
+    m_angles[0] = -pi;
+    for (size_t i = 1; i < polygon.size(); i++)
+        m_angles[i] = std::max(std::atan2(polygon[i].y - origin.y, polygon[i].x - origin.x), m_angles[i - 1]);
+
+    const HeightField& field = *layer.field;
+    // Texels per world unit, averaged over directions for stretched images
+    float texelScale = std::sqrt(std::abs(layer.axisX.x * layer.axisY.y - layer.axisX.y * layer.axisY.x));
+    float rangeTexels = range * texelScale;
+    int numRays = glm::clamp(int(2.0f * pi * rangeTexels), MIN_RAYS, MAX_RAYS);
+    int numSteps = glm::clamp(int(rangeTexels), 1, MAX_STEPS);
+    float step = range / numSteps;
+    int topLevel = field.NumLevels() - 1;
+    int baseLevel = std::min(int(std::log2(std::max(rangeTexels / numSteps, 1.0f))), topLevel);
+    float heightScale = layer.heightScale / 255.0f;
+    float wedge = 2.0f * pi / numRays;
+    glm::vec2 start = layer.ToTexel(origin);
+
+    size_t next = 0;
+    glm::vec2 left(std::cos(-pi), std::sin(-pi));
+    for (int ray = 0; ray < numRays; ray++)
+    {
+        float angle = -pi + (ray + 0.5f) * wedge;
+        glm::vec2 direction(std::cos(angle), std::sin(angle));
+        glm::vec2 right(std::cos(angle + 0.5f * wedge), std::sin(angle + 0.5f * wedge));
+        float end = std::min(WallDistance(polygon, origin, angle, next), range);
+        glm::vec2 velocity = layer.axisX * direction.x + layer.axisY * direction.y;
+
+        float horizon = -std::numeric_limits<float>::infinity();
+        // Stretch being seen, the ground under the eye always is
+        float seenFrom = 0.0f, seenTo = 0.0f;
+        bool seeing = true;
+        int level = baseLevel;
+        for (float t = 0.5f * step; t < end;)
+        {
+            glm::vec2 texel = start + velocity * t;
+            if (level > baseLevel)
+            {
+                float size = float(1 << level);
+                glm::vec2 cell = glm::floor(texel / size);
+                float exit = std::numeric_limits<float>::infinity();
+                if (velocity.x != 0.0f)
+                    exit = ((cell.x + (velocity.x > 0.0f ? 1.0f : 0.0f)) * size - start.x) / velocity.x;
+                if (velocity.y != 0.0f)
+                    exit = std::min(exit, ((cell.y + (velocity.y > 0.0f ? 1.0f : 0.0f)) * size - start.y) / velocity.y);
+                // The horizon is a straight line, so lowest at one end of the cell
+                float lowest = eyeHeight + std::min(horizon * t, horizon * exit);
+                if (heightScale * (field.Max(level, int(cell.x), int(cell.y)) + 1) < lowest)
+                {
+                    if (seeing)
+                        AddWedge(origin, left, right, seenFrom, seenTo, triangles);
+                    seeing = false;
+                    t = std::max(exit, t) + 0.01f * step;
+                    level = std::min(level + 1, topLevel);
+                }
+                else
+                    level--;
+                continue;
+            }
+
+            float size = float(1 << level);
+            float height = heightScale * field.Max(level, int(std::floor(texel.x / size)), int(std::floor(texel.y / size)));
+            float slope = (height - eyeHeight) / t;
+            // Ground within a level of the horizon is seen, so ground sloping
+            // away at it isn't broken into stripes by the levels' steps
+            if (slope + heightScale / t >= horizon)
+            {
+                horizon = std::max(horizon, slope);
+                if (!seeing)
+                    seenFrom = t - 0.5f * step;
+                seenTo = std::min(t + 0.5f * step, end);
+                seeing = true;
+            }
+            else
+            {
+                if (seeing)
+                    AddWedge(origin, left, right, seenFrom, seenTo, triangles);
+                seeing = false;
+                level = std::min(level + 1, topLevel);
+            }
+            t += step;
+        }
+        if (seeing)
+            AddWedge(origin, left, right, seenFrom, std::max(seenTo, end), triangles);
+        left = right;
+    }
+}
+
+float TerrainViewshed::WallDistance(const std::vector<glm::vec2>& polygon, glm::vec2 origin, float angle, size_t& next) const
+{
+    // Rays come in angle order, as do the points
+    while (next < m_angles.size() && m_angles[next] <= angle)
+        next++;
+    glm::vec2 a = polygon[(next + polygon.size() - 1) % polygon.size()] - origin;
+    glm::vec2 b = polygon[next % polygon.size()] - origin;
+    glm::vec2 direction(std::cos(angle), std::sin(angle));
+    glm::vec2 edge = b - a;
+    float denominator = direction.x * edge.y - direction.y * edge.x;
+    float distance = std::abs(denominator) > 1e-12f
+                   ? (a.x * edge.y - a.y * edge.x) / denominator
+                   : std::min(glm::length(a), glm::length(b));
+    return std::max(distance, 0.0f);
+}
+
+void TerrainViewshed::AddWedge(glm::vec2 origin, glm::vec2 left, glm::vec2 right, float start, float end, std::vector<glm::vec2>& triangles)
+{
+    if (!(end > start))
+        return;
+    glm::vec2 farLeft = origin + left * end, farRight = origin + right * end;
+    if (start <= 0.0f)
+    {
+        triangles.insert(triangles.end(), {origin, farRight, farLeft});
+        return;
+    }
+    glm::vec2 nearLeft = origin + left * start, nearRight = origin + right * start;
+    triangles.insert(triangles.end(), {nearLeft, nearRight, farRight, farRight, farLeft, nearLeft});
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/SpatialGrid.h>
+
+#include <model/Walls.h>
+
+
+// Shared by every instance, see Version
+static uint64_t NewVersion()
+{
+    static uint64_t version = 0;
+    return ++version;
+}
+
+Walls::Walls() : m_version(NewVersion()), m_oldestVersion(m_version) {}
+
+WallID Walls::Add(glm::vec2 start, glm::vec2 end)
+{
+    Wall wall{NULL_WALL_ID, start, end};
+    Add(wall);
+    return m_walls.back().id;
+}
+
+void Walls::Add(const Wall& wall)
+{
+    Wall added = wall;
+    if (added.id == NULL_WALL_ID || m_indices.count(added.id))
+        added.id = m_nextID;
+    m_nextID = std::max(m_nextID, added.id + 1);
+
+    m_indices[added.id] = m_walls.size();
+    m_walls.push_back(added);
+    Bounds2D bounds = WallBounds(added);
+    m_grid.Insert(added.id, bounds);
+    Changed(bounds);
+}
+
+bool Walls::Remove(WallID id)
+{
+    auto it = m_indices.find(id);
+    if (it == m_indices.end())
+        return false;
+    size_t index = it->second;
+    Bounds2D bounds = WallBounds(m_walls[index]);
+    m_indices.erase(it);
+    m_grid.Remove(id);
+    if (index != m_walls.size() - 1)
+    {
+        m_walls[index] = m_walls.back();
+        m_indices[m_walls[index].id] = index;
+    }
+    m_walls.pop_back();
+    Changed(bounds);
+    return true;
+}
+
+void Walls::Clear()
+{
+    m_walls.clear();
+    m_indices.clear();
+    m_grid.Clear();
+    // Too much may have changed to be worth logging
+    m_version = NewVersion();
+    m_changes.clear();
+    m_oldestVersion = m_version;
+}
+
+const Wall* Walls::Get(WallID id) const
+{
+    auto it = m_indices.find(id);
+    return it == m_indices.end() ? nullptr : &m_walls[it->second];
+}
+
+void Walls::Query(const Bounds2D& region, std::vector<const Wall*>& found) const
+{
+    Query(region, found, m_found);
+}
+
+void Walls::Query(const Bounds2D& region, std::vector<const Wall*>& found, std::vector<ShapeID>& ids) const
+{
+    ids.clear();
+    m_grid.Query(region, ids);
+    found.reserve(found.size() + ids.size());
+    for (ShapeID id: ids)
+        found.push_back(&m_walls[m_indices.at(id)]);
+}
+
+WallID Walls::Nearest(glm::vec2 pos, float distance) const
+{
+    m_found.clear();
+    m_grid.Query(Bounds2D(pos - distance, pos + distance), m_found);
+    WallID nearest = NULL_WALL_ID;
+    for (ShapeID id: m_found)
+    {
+        float wallDistance = DistanceTo(m_walls[m_indices.at(id)], pos);
+        if (wallDistance <= distance)
+        {
+            distance = wallDistance;
+            nearest = id;
+        }
+    }
+    return nearest;
+}
+
+bool Walls::NearestEndpoint(glm::vec2 pos, float distance, glm::vec2& endpoint) const
+{
+    m_found.clear();
+    m_grid.Query(Bounds2D(pos - distance, pos + distance), m_found);
+    bool found = false;
+    for (ShapeID id: m_found)
+    {
+        const Wall& wall = m_walls[m_indices.at(id)];
+        for (glm::vec2 point: {wall.start, wall.end})
+        {
+            float pointDistance = glm::length(point - pos);
+            if (pointDistance <= distance)
+            {
+                distance = pointDistance;
+                endpoint = point;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool Walls::ChangedSince(uint64_t version, std::vector<Bounds2D>& changed) const
+{
+    if (version >= m_version)
+        return true;
+    if (version < m_oldestVersion)
+        return false;
+    auto it = std::upper_bound(m_changes.begin(), m_changes.end(), version,
+                               [](uint64_t version, const Change& change) { return version < change.version; });
+    for (; it != m_changes.end(); ++it)
+        changed.push_back(it->bounds);
+    return true;
+}
+
+Bounds2D Walls::WallBounds(const Wall& wall)
+{
+    return Bounds2D(glm::min(wall.start, wall.end), glm::max(wall.start, wall.end));
+}
+
+float Walls::DistanceTo(const Wall& wall, glm::vec2 pos)
+{
+    glm::vec2 direction = wall.end - wall.start;
+    float lengthSquared = glm::dot(direction, direction);
+    float t = lengthSquared > 0.0f ? glm::clamp(glm::dot(pos - wall.start, direction) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+    return glm::length(wall.start + direction * t - pos);
+}
+
+void Walls::Changed(const Bounds2D& bounds)
+{
+    m_version = NewVersion();
+    m_changes.push_back({m_version, bounds});
+    if (m_changes.size() > MAX_LOGGED_CHANGES)
+    {
+        m_oldestVersion = m_changes.front().version;
+        m_changes.pop_front();
+    }
+}
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <stb_image.h>
+
+#include <ContentHash.h>
+#include <Resources.h>
+#include <glutil/Texture.h>
+#include <net/NetworkThread.h>
+#include <net/Protocol.h>
+
+#include <net/AssetTransfer.h>
+
+
+static const size_t PREVIEW_HEADER_SIZE = 3 * sizeof(uint32_t);
+
+static bool ReadFile(const std::string& path, std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    contents.assign(std::istreambuf_iterator<char>(file), {});
+    return !file.bad();
+}
+
+// Server
+
+std::vector<AssetEntry> AssetServer::Announce(const std::vector<std::shared_ptr<Texture>>& textures, std::unordered_set<std::string>& announced)
+{
+    std::vector<AssetEntry> entries;
+    for (const auto& texture: textures)
+    {
+        if (!texture || !announced.insert(texture->filename).second)
+            continue;
+        if (const ContentHash* hash = Describe(texture))
+            entries.push_back({texture->filename, *hash, m_assets[*hash].bytes->size()});
+    }
+    return entries;
+}
+
+bool AssetServer::Request(Queue& queue, const ContentHash& hash, uint64_t offset, bool preview)
+{
+    auto it = m_assets.find(hash);
+    if (it == m_assets.end() || offset > it->second.bytes->size())
+        return false;
+
+    if (preview && it->second.bytes->size() - offset > PREVIEW_THRESHOLD && Bytes(hash, AssetPart::Preview))
+    {
+        // Previews go ahead of full files so every image shows something soon
+        auto full = std::find_if(queue.transfers.begin(), queue.transfers.end(),
+                                 [](const Transfer& transfer) { return transfer.part == AssetPart::Full; });
+        queue.transfers.insert(full, {hash, AssetPart::Preview, 0});
+    }
+    queue.transfers.push_back({hash, AssetPart::Full, offset});
+    return true;
+}
+
+void AssetServer::Send(ThreadedConnection& connection, Queue& queue, AssetStats& stats)
+{
+    if (queue.transfers.empty() || !connection.IsOpen())
+        return;
+
+    // What's still queued from the last frame shows whether the link kept up
+    connection.Flush();
+    size_t queued = connection.Queued();
+    if (queued <= queue.window / 4)
+        queue.window = std::min(queue.window * 2, MAX_ASSET_WINDOW);
+    else if (queued >= queue.window / 2)
+        queue.window = std::max(queue.window / 2, MIN_ASSET_WINDOW);
+
+    size_t sent = 0;
+    while (!queue.transfers.empty() && connection.IsOpen() && queued < queue.window && sent < MAX_ASSET_WINDOW)
+    {
+        Transfer& transfer = queue.transfers.front();
+        const std::string* bytes = Bytes(transfer.hash, transfer.part);
+        if (!bytes)
+        {
+            queue.transfers.pop_front();
+            continue;
+        }
+
+        // Always at least one chunk, even for an empty file
+        size_t size = std::min<uint64_t>(ASSET_CHUNK_SIZE, bytes->size() - transfer.offset);
+        std::string payload;
+        payload.reserve(64 + size);
+        ByteWriter writer(payload);
+        writer.Write(transfer.hash);
+        writer.Write(transfer.part);
+        writer.Write<uint64_t>(transfer.offset);
+        writer.Write<uint64_t>(bytes->size());
+        payload.append(*bytes, transfer.offset, size);
+        connection.Send(uint8_t(SyncMessage::AssetChunk), payload);
+        stats.bytes += size;
+        sent += size;
+
+        // Written straight away, what the link can't take yet stays queued
+        // and holds back further chunks
+        connection.Flush();
+        queued = connection.Queued();
+
+        transfer.offset += size;
+        if (transfer.offset >= bytes->size())
+        {
+            if (transfer.part == AssetPart::Preview)
+                stats.previews++;
+            else
+                stats.completed++;
+            queue.transfers.pop_front();
+        }
+    }
+}
+
+const ContentHash* AssetServer::Describe(const std::shared_ptr<Texture>& texture)
+{
+    auto [it, inserted] = m_paths.try_emplace(texture->filename, nullptr);
+    if (!inserted)
+        return it->second.get();
+
+    // Aliases have the same contents as their source, which may be in memory
+    const Texture& content = texture->source ? *texture->source : *texture;
+    auto bytes = std::make_shared<std::string>();
+    ContentHash hash;
+    if (content.data)
+    {
+        bytes->assign(reinterpret_cast<const char*>(content.data->bytes), content.data->size);
+        hash = content.data->hash;
+    }
+    else if (ReadFile(content.filename, *bytes))
+        hash = HashContent(bytes->data(), bytes->size());
+    else
+        return nullptr;
+
+    Asset& asset = m_assets[hash];
+    if (!asset.bytes)
+        asset.bytes = bytes;
+    it->second = std::make_unique<ContentHash>(hash);
+    return it->second.get();
+}
+
+const std::string* AssetServer::Bytes(const ContentHash& hash, AssetPart part)
+{
+    auto it = m_assets.find(hash);
+    if (it == m_assets.end())
+        return nullptr;
+    Asset& asset = it->second;
+    if (part == AssetPart::Full)
+        return asset.bytes.get();
+    if (asset.previewBuilt)
+        return asset.preview.get();
+    asset.previewBuilt = true;
+
+    int width, height, numChannels;
+    unsigned char* pixels = stbi_load_from_memory(reinterpret_cast<const unsigned char*>(asset.bytes->data()), asset.bytes->size(),
+                                                  &width, &height, &numChannels, 0);
+    if (!pixels)
+        return nullptr;
+    std::vector<unsigned char> level(pixels, pixels + size_t(width) * height * numChannels);
+    stbi_image_free(pixels);
+    std::vector<unsigned char> half;
+    while (width > PREVIEW_SIZE || height > PREVIEW_SIZE)
+    {
+        HalveImage(level, width, height, numChannels, half);
+        std::swap(level, half);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    auto preview = std::make_shared<std::string>();
+    ByteWriter writer(*preview);
+    writer.Write<uint32_t>(width);
+    writer.Write<uint32_t>(height);
+    writer.Write<uint32_t>(numChannels);
+    preview->append(reinterpret_cast<const char*>(level.data()), level.size());
+    asset.preview = preview;
+    return asset.preview.get();
+}
+
+// Cache
+
+AssetCache::AssetCache(std::shared_ptr<Resources> resources) : m_resources(resources), m_directory(DefaultDirectory()) {}
+
+std::string AssetCache::DefaultDirectory()
+{
+    std::filesystem::path base;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"))
+        base = cache;
+    else if (const char* home = std::getenv("HOME"))
+        base = std::filesystem::path(home) / ".cache";
+    else
+        base = std::filesystem::temp_directory_path();
+    return (base / "battlematt" / "assets").string();
+}
+
+std::vector<AssetCache::Request> AssetCache::Announce(const std::vector<AssetEntry>& entries)
+{
+    std::vector<Request> requests;
+    for (const AssetEntry& entry: entries)
+    {
+        if (HasLocally(entry))
+        {
+            m_stats.cached++;
+            continue;
+        }
+
+        auto it = m_downloads.find(entry.hash);
+        if (it != m_downloads.end())
+        {
+            it->second.paths.push_back(entry.path);
+            continue;
+        }
+
+        std::string path = PathFor(entry.hash);
+        std::error_code error;
+        if (std::filesystem::exists(path, error))
+        {
+            Link({entry.path}, m_resources->GetTexture(path));
+            m_stats.cached++;
+            continue;
+        }
+
+        // Picks up after whatever an earlier session received
+        Download download;
+        download.size = entry.size;
+        download.paths.push_back(entry.path);
+        std::string partPath = path + ".part";
+        uint64_t partSize = std::filesystem::file_size(partPath, error);
+        download.received = (!error && partSize <= entry.size) ? partSize : 0;
+        if (download.received == 0)
+            std::filesystem::remove(partPath, error);
+        download.wantsPreview = entry.size - download.received > PREVIEW_THRESHOLD;
+
+        it = m_downloads.emplace(entry.hash, std::move(download)).first;
+        if (it->second.received == entry.size)
+            Complete(entry.hash, it->second);
+        else
+            requests.push_back({entry.hash, it->second.received, it->second.wantsPreview});
+    }
+    return requests;
+}
+
+bool AssetCache::Receive(const ContentHash& hash, AssetPart part, uint64_t offset, uint64_t total, const char* data, size_t size)
+{
+    // The rest of a download given up on
+    auto it = m_downloads.find(hash);
+    if (it == m_downloads.end())
+        return true;
+    Download& download = it->second;
+    m_stats.bytes += size;
+    if (part == AssetPart::Preview)
+        return ReceivePreview(hash, download, offset, total, data, size);
+
+    if (total != download.size || offset != download.received || size > total - offset)
+        return false;
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    std::ofstream file(PathFor(hash) + ".part", std::ios::binary | std::ios::app);
+    file.write(data, size);
+    if (!file.good())
+    {
+        std::cerr << "Unable to write to the asset cache " << m_directory << std::endl;
+        m_downloads.erase(it);
+        return true;
+    }
+    download.received += size;
+    if (download.received == download.size)
+    {
+        file.close();
+        Complete(hash, download);
+    }
+    return true;
+}
+
+void AssetCache::Reset()
+{
+    m_downloads.clear();
+}
+
+std::string AssetCache::PathFor(const ContentHash& hash) const
+{
+    return (std::filesystem::path(m_directory) / ToHex(hash)).string();
+}
+
+bool AssetCache::HasLocally(const AssetEntry& entry)
+{
+    // Same machine, or the same files under the same paths
+    auto it = m_localPaths.find(entry.path);
+    if (it == m_localPaths.end())
+    {
+        ContentHash hash{};
+        std::string contents;
+        if (ReadFile(entry.path, contents))
+            hash = HashContent(contents.data(), contents.size());
+        it = m_localPaths.emplace(entry.path, hash).first;
+    }
+    return it->second == entry.hash;
+}
+
+void AssetCache::Link(const std::vector<std::string>& paths, const std::shared_ptr<Texture>& texture)
+{
+    // The cached file may itself share another texture's contents
+    std::shared_ptr<Texture> source = texture->source ? texture->source : texture;
+    if (!source->IsValid())
+        return;
+    for (const std::string& path: paths)
+    {
+        std::shared_ptr<Texture> pathTexture = m_resources->GetTexture(path);
+        if (pathTexture != source)
+            pathTexture->source = source;
+    }
+}
+
+bool AssetCache::ReceivePreview(const ContentHash& hash, Download& download, uint64_t offset, uint64_t total, const char* data, size_t size)
+{
+    const uint64_t maxTotal = PREVIEW_HEADER_SIZE + uint64_t(PREVIEW_SIZE) * PREVIEW_SIZE * 4;
+    if (!download.wantsPreview || total > maxTotal || offset != download.preview.size() || size > total - offset ||
+        (download.previewSize && total != download.previewSize))
+        return false;
+    download.previewSize = total;
+    download.preview.append(data, size);
+    if (download.preview.size() < total)
+        return true;
+
+    uint32_t width, height, numChannels;
+    ByteReader reader(download.preview);
+    if (!reader.Read(width) || !reader.Read(height) || !reader.Read(numChannels) || width == 0 || height == 0 ||
+        width > uint32_t(PREVIEW_SIZE) || height > uint32_t(PREVIEW_SIZE) || numChannels == 0 || numChannels > 4 ||
+        total != PREVIEW_HEADER_SIZE + uint64_t(width) * height * numChannels)
+        return false;
+
+    auto pixels = std::make_shared<std::string>(download.preview, PREVIEW_HEADER_SIZE);
+    auto textureData = std::make_shared<TextureData>();
+    textureData->owner = pixels;
+    textureData->hash = HashContent(pixels->data(), pixels->size());
+    textureData->mips.push_back({int(width), int(height), reinterpret_cast<const unsigned char*>(pixels->data())});
+
+    // Shown through the paths until the file replaces it
+    auto texture = std::make_shared<Texture>();
+    texture->filename = PathFor(hash) + ".preview";
+    texture->width = width;
+    texture->height = height;
+    texture->numChannels = numChannels;
+    texture->data = textureData;
+    m_resources->AddTexture(texture);
+    Link(download.paths, texture);
+    download.preview.clear();
+    download.wantsPreview = false;
+    m_stats.previews++;
+    return true;
+}
+
+bool AssetCache::Complete(const ContentHash& hash, Download& download)
+{
+    std::string path = PathFor(hash);
+    std::string partPath = path + ".part";
+    std::string contents;
+    std::error_code error;
+    bool valid = ReadFile(partPath, contents) && HashContent(contents.data(), contents.size()) == hash;
+    if (valid)
+        std::filesystem::rename(partPath, path, error);
+    else
+    {
+        std::cerr << "Discarding asset " << ToHex(hash) << " which doesn't match its hash" << std::endl;
+        std::filesystem::remove(partPath, error);
+    }
+
+    if (valid && !error)
+    {
+        Link(download.paths, m_resources->GetTexture(path));
+        m_stats.completed++;
+    }
+    m_downloads.erase(hash);
+    return valid && !error;
+}
@@ -0,0 +1,254 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <linux/sockios.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <net/Connection.h>
+
+
+static void Configure(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    // Deltas are small and latency matters more than packet count
+    int enabled = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+Connection::Connection(int fd) : m_fd(fd) { Configure(fd); }
+
+Connection::~Connection() { Close(); }
+
+std::unique_ptr<Connection> Connection::Connect(const std::string& host, uint16_t port)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+    {
+        std::cerr << "Unable to resolve host " << host << std::endl;
+        return nullptr;
+    }
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to connect to " << host << ":" << port << std::endl;
+        return nullptr;
+    }
+    return std::make_unique<Connection>(fd);
+}
+
+void Connection::Send(uint8_t type, const std::string& payload)
+{
+    if (!IsOpen())
+        return;
+    uint32_t size = payload.size();
+    if (m_latencyMs > 0.0f)
+    {
+        Held held;
+        held.due = std::chrono::steady_clock::now() + std::chrono::microseconds(int64_t(m_latencyMs * 1000.0f));
+        held.frame.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        held.frame.push_back(char(type));
+        held.frame.append(payload);
+        m_heldBytes += held.frame.size();
+        m_held.push_back(std::move(held));
+        return;
+    }
+    m_outgoing.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    m_outgoing.push_back(char(type));
+    m_outgoing.append(payload);
+}
+
+bool Connection::Flush()
+{
+    // Stops at the first that isn't due so the order is kept
+    auto now = std::chrono::steady_clock::now();
+    while (!m_held.empty() && m_held.front().due <= now)
+    {
+        m_outgoing.append(m_held.front().frame);
+        m_heldBytes -= m_held.front().frame.size();
+        m_held.pop_front();
+    }
+
+    while (IsOpen() && m_outgoingOffset < m_outgoing.size())
+    {
+        ssize_t count = send(m_fd, m_outgoing.data() + m_outgoingOffset, m_outgoing.size() - m_outgoingOffset, MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            Close();
+            return false;
+        }
+        m_outgoingOffset += count;
+        m_bytesSent += count;
+    }
+
+    // Only compact once the sent prefix is worth the copy
+    if (m_outgoingOffset == m_outgoing.size())
+    {
+        m_outgoing.clear();
+        m_outgoingOffset = 0;
+    }
+    else if (m_outgoingOffset > 64 * 1024 && m_outgoingOffset > m_outgoing.size() / 2)
+    {
+        m_outgoing.erase(0, m_outgoingOffset);
+        m_outgoingOffset = 0;
+    }
+    return IsOpen();
+}
+
+bool Connection::Receive()
+{
+    char buffer[64 * 1024];
+    while (IsOpen())
+    {
+        ssize_t count = recv(m_fd, buffer, sizeof(buffer), 0);
+        if (count > 0)
+        {
+            m_incoming.append(buffer, count);
+            m_bytesReceived += count;
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (count < 0 && errno == EINTR)
+            continue;
+        // Closed by the peer or failed
+        Close();
+        return false;
+    }
+    return IsOpen();
+}
+
+bool Connection::Next(Message& message)
+{
+    size_t available = m_incoming.size() - m_incomingOffset;
+    if (available < FRAME_HEADER_SIZE)
+        return false;
+
+    uint32_t size;
+    std::memcpy(&size, m_incoming.data() + m_incomingOffset, sizeof(size));
+    if (size > MAX_MESSAGE_SIZE)
+    {
+        std::cerr << "Dropping connection sending a " << size << " byte message" << std::endl;
+        Close();
+        m_incoming.clear();
+        m_incomingOffset = 0;
+        return false;
+    }
+    if (available < FRAME_HEADER_SIZE + size)
+        return false;
+
+    message.type = uint8_t(m_incoming[m_incomingOffset + sizeof(size)]);
+    message.payload.assign(m_incoming, m_incomingOffset + FRAME_HEADER_SIZE, size);
+    m_incomingOffset += FRAME_HEADER_SIZE + size;
+    if (m_incomingOffset == m_incoming.size())
+    {
+        m_incoming.clear();
+        m_incomingOffset = 0;
+    }
+    else if (m_incomingOffset > 64 * 1024 && m_incomingOffset > m_incoming.size() / 2)
+    {
+        m_incoming.erase(0, m_incomingOffset);
+        m_incomingOffset = 0;
+    }
+    return true;
+}
+
+size_t Connection::Queued() const
+{
+    return Pending() + (IsOpen() ? Unacknowledged(m_fd) : 0);
+}
+
+size_t Connection::Unacknowledged(int fd)
+{
+    int unacknowledged = 0;
+    if (ioctl(fd, SIOCOUTQ, &unacknowledged) != 0)
+        return 0;
+    return size_t(unacknowledged);
+}
+
+bool Connection::NextDue(std::chrono::steady_clock::time_point& due) const
+{
+    if (m_held.empty())
+        return false;
+    due = m_held.front().due;
+    return true;
+}
+
+void Connection::Close()
+{
+    if (m_fd < 0)
+        return;
+    // Ends the connection even while a duplicate of the socket is open
+    shutdown(m_fd, SHUT_RDWR);
+    close(m_fd);
+    m_fd = -1;
+}
+
+// Listener
+
+Listener::~Listener()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+std::unique_ptr<Listener> Listener::Listen(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return nullptr;
+    int enabled = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t size = sizeof(address);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), size) != 0 || listen(fd, SOMAXCONN) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+    {
+        std::cerr << "Unable to listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return std::unique_ptr<Listener>(new Listener(fd, ntohs(address.sin_port)));
+}
+
+std::unique_ptr<Connection> Listener::Accept()
+{
+    int fd = accept(m_fd, nullptr, nullptr);
+    if (fd < 0)
+        return nullptr;
+    return std::make_unique<Connection>(fd);
+}
@@ -0,0 +1,163 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <net/Datagram.h>
+
+
+// Address
+
+DatagramAddress DatagramAddress::OfPeer(int fd)
+{
+    DatagramAddress address;
+    address.length = sizeof(address.storage);
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&address.storage), &address.length) != 0)
+        address.length = 0;
+    return address;
+}
+
+bool DatagramAddress::operator==(const DatagramAddress& other) const
+{
+    if (storage.ss_family != other.storage.ss_family)
+        return false;
+    if (storage.ss_family == AF_INET)
+    {
+        const sockaddr_in& a = reinterpret_cast<const sockaddr_in&>(storage);
+        const sockaddr_in& b = reinterpret_cast<const sockaddr_in&>(other.storage);
+        return a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+    }
+    if (storage.ss_family == AF_INET6)
+    {
+        const sockaddr_in6& a = reinterpret_cast<const sockaddr_in6&>(storage);
+        const sockaddr_in6& b = reinterpret_cast<const sockaddr_in6&>(other.storage);
+        return a.sin6_port == b.sin6_port && std::memcmp(&a.sin6_addr, &b.sin6_addr, sizeof(a.sin6_addr)) == 0;
+    }
+    return length == other.length && std::memcmp(&storage, &other.storage, length) == 0;
+}
+
+DatagramAddress DatagramAddress::WithPort(uint16_t port) const
+{
+    DatagramAddress address = *this;
+    if (storage.ss_family == AF_INET)
+        reinterpret_cast<sockaddr_in&>(address.storage).sin_port = htons(port);
+    else if (storage.ss_family == AF_INET6)
+        reinterpret_cast<sockaddr_in6&>(address.storage).sin6_port = htons(port);
+    return address;
+}
+
+// Socket
+
+DatagramSocket::~DatagramSocket()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+std::unique_ptr<DatagramSocket> DatagramSocket::Bind(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return nullptr;
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        std::cerr << "Unable to bind datagram port " << port << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return std::unique_ptr<DatagramSocket>(new DatagramSocket(fd, ntohs(address.sin_port)));
+}
+
+void DatagramSocket::SendTo(const DatagramAddress& address, const std::string& payload)
+{
+    if (!address.IsValid() || payload.size() > MAX_DATAGRAM_SIZE)
+        return;
+    if (m_conditions.lossRate <= 0.0f && m_conditions.latencyMs <= 0.0f && m_conditions.jitterMs <= 0.0f)
+    {
+        Write(address, payload);
+        return;
+    }
+
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    if (uniform(m_rng) < m_conditions.lossRate)
+    {
+        m_datagramsDropped++;
+        return;
+    }
+    float delayMs = m_conditions.latencyMs + m_conditions.jitterMs * uniform(m_rng);
+    auto due = std::chrono::steady_clock::now() + std::chrono::microseconds(int64_t(delayMs * 1000.0f));
+    m_held.push_back({due, address, payload});
+    Flush();
+}
+
+void DatagramSocket::Flush()
+{
+    if (m_held.empty())
+        return;
+    auto now = std::chrono::steady_clock::now();
+    auto due = std::stable_partition(m_held.begin(), m_held.end(), [now](const Held& held) { return held.due > now; });
+    // Sent in the order they fall due, which is how jitter reorders them
+    std::sort(due, m_held.end(), [](const Held& a, const Held& b) { return a.due < b.due; });
+    for (auto it = due; it != m_held.end(); ++it)
+        Write(it->address, it->payload);
+    m_held.erase(due, m_held.end());
+}
+
+bool DatagramSocket::Receive(DatagramAddress& address, std::string& payload)
+{
+    char buffer[MAX_DATAGRAM_SIZE];
+    while (true)
+    {
+        address.length = sizeof(address.storage);
+        ssize_t count = recvfrom(m_fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&address.storage), &address.length);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // Nothing waiting, or an error reported for an earlier send
+            // which doesn't affect later datagrams
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            continue;
+        }
+        payload.assign(buffer, count);
+        m_bytesReceived += count;
+        m_datagramsReceived++;
+        return true;
+    }
+}
+
+void DatagramSocket::SetConditions(const NetworkConditions& conditions, unsigned int seed)
+{
+    m_conditions = conditions;
+    m_rng.seed(seed);
+}
+
+void DatagramSocket::Write(const DatagramAddress& address, const std::string& payload)
+{
+    ssize_t count = sendto(m_fd, payload.data(), payload.size(), 0, reinterpret_cast<const sockaddr*>(&address.storage), address.length);
+    // A full socket buffer drops the datagram, same as the network would
+    if (count < 0)
+        return;
+    m_bytesSent += count;
+    m_datagramsSent++;
+}
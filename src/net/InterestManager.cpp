@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <model/Bounds.h>
+#include <model/SpatialGrid.h>
+#include <net/Protocol.h>
+
+#include <net/InterestManager.h>
+
+
+void InterestManager::SetVisionRange(float range)
+{
+    range = std::max(range, 0.0f);
+    if (range == m_visionRange)
+        return;
+    m_visionRange = range;
+    for (auto& [client, viewer]: m_viewers)
+        viewer.dirty = true;
+}
+
+void InterestManager::UpdateShape(ShapeID id, const ShapeState& state)
+{
+    Shape shape;
+    shape.type = state.type;
+    glm::vec2 pos = DequantizePosition(state.position);
+    shape.bounds = SpatialGrid::ShapeBounds(pos, state.scale, state.rotation);
+    shape.center = pos;
+    shape.radius = glm::length(shape.bounds.Size()) * 0.5f;
+    shape.owner = state.type == SyncShapeType::Token ? state.owner : HOST_CLIENT_ID;
+    shape.hidden = !IsShownToClients(state);
+
+    auto [it, inserted] = m_shapes.try_emplace(id, shape);
+    if (!inserted)
+    {
+        const Shape& old = it->second;
+        if (old.owner != shape.owner)
+        {
+            auto viewer = m_viewers.find(old.owner);
+            if (viewer != m_viewers.end())
+            {
+                viewer->second.owned.erase(id);
+                viewer->second.dirty = true;
+            }
+        }
+        // What a client's tokens can see moves with them
+        else if (m_visionRange > 0.0f && old.center != shape.center)
+        {
+            auto viewer = m_viewers.find(shape.owner);
+            if (viewer != m_viewers.end())
+                viewer->second.dirty = true;
+        }
+        it->second = shape;
+    }
+    auto viewer = m_viewers.find(shape.owner);
+    if (viewer != m_viewers.end() && viewer->second.owned.insert(id).second)
+        viewer->second.dirty = true;
+
+    if (shape.type == SyncShapeType::Token)
+    {
+        if (shape.hidden)
+            m_tokens.Remove(id);
+        else
+            m_tokens.Insert(id, shape.bounds);
+    }
+    else if (shape.hidden)
+        m_images.erase(id);
+    else
+        m_images.insert(id);
+    m_dirtyShapes.insert(id);
+}
+
+void InterestManager::RemoveShape(ShapeID id)
+{
+    auto it = m_shapes.find(id);
+    if (it == m_shapes.end())
+        return;
+    auto owner = m_viewers.find(it->second.owner);
+    if (owner != m_viewers.end() && owner->second.owned.erase(id))
+        owner->second.dirty = true;
+    m_shapes.erase(it);
+    m_tokens.Remove(id);
+    m_images.erase(id);
+    m_dirtyShapes.erase(id);
+    for (auto& [client, viewer]: m_viewers)
+        SetVisible(viewer, id, false);
+}
+
+void InterestManager::ClearShapes()
+{
+    m_shapes.clear();
+    m_tokens.Clear();
+    m_images.clear();
+    m_dirtyShapes.clear();
+    for (auto& [client, viewer]: m_viewers)
+    {
+        viewer.owned.clear();
+        viewer.visible.clear();
+        viewer.entered.clear();
+        viewer.left.clear();
+        viewer.dirty = true;
+    }
+}
+
+void InterestManager::AddClient(ClientID client)
+{
+    m_viewers.try_emplace(client);
+}
+
+void InterestManager::RemoveClient(ClientID client)
+{
+    m_viewers.erase(client);
+}
+
+void InterestManager::SetViewRegion(ClientID client, const Bounds2D& region)
+{
+    auto it = m_viewers.find(client);
+    if (it == m_viewers.end())
+        return;
+    glm::vec2 margin = glm::abs(region.Size()) * VIEW_MARGIN;
+    it->second.hasRegion = true;
+    it->second.region = Bounds2D(glm::min(region.min, region.max) - margin, glm::max(region.min, region.max) + margin);
+    it->second.dirty = true;
+}
+
+void InterestManager::ResetClient(ClientID client)
+{
+    auto it = m_viewers.find(client);
+    if (it == m_viewers.end())
+        return;
+    Viewer& viewer = it->second;
+    viewer.visible.clear();
+    viewer.entered.clear();
+    viewer.left.clear();
+    viewer.dirty = true;
+}
+
+void InterestManager::Update()
+{
+    for (auto& [client, viewer]: m_viewers)
+    {
+        if (viewer.dirty)
+            Recompute(viewer, client);
+    }
+    for (ShapeID id: m_dirtyShapes)
+    {
+        const Shape& shape = m_shapes.at(id);
+        for (auto& [client, viewer]: m_viewers)
+            SetVisible(viewer, id, Sees(viewer, client, shape));
+    }
+    m_dirtyShapes.clear();
+}
+
+InterestManager::Changes InterestManager::TakeChanges(ClientID client)
+{
+    Changes changes;
+    auto it = m_viewers.find(client);
+    if (it == m_viewers.end())
+        return changes;
+    Viewer& viewer = it->second;
+    changes.entered.assign(viewer.entered.begin(), viewer.entered.end());
+    changes.left.assign(viewer.left.begin(), viewer.left.end());
+    viewer.entered.clear();
+    viewer.left.clear();
+    return changes;
+}
+
+bool InterestManager::IsVisible(ClientID client, ShapeID id) const
+{
+    auto it = m_viewers.find(client);
+    return it != m_viewers.end() && it->second.visible.count(id) > 0;
+}
+
+size_t InterestManager::NumVisible(ClientID client) const
+{
+    auto it = m_viewers.find(client);
+    return it != m_viewers.end() ? it->second.visible.size() : 0;
+}
+
+bool InterestManager::Sees(const Viewer& viewer, ClientID client, const Shape& shape) const
+{
+    if (shape.hidden)
+        return false;
+    if (shape.type == SyncShapeType::Token && shape.owner == client)
+        return true;
+    if (viewer.hasRegion && !SpatialGrid::Overlaps(viewer.region, shape.bounds))
+        return false;
+    if (shape.type != SyncShapeType::Token || m_visionRange <= 0.0f)
+        return true;
+    for (ShapeID id: viewer.owned)
+    {
+        const Shape& own = m_shapes.at(id);
+        if (glm::length(own.center - shape.center) <= m_visionRange + shape.radius)
+            return true;
+    }
+    return false;
+}
+
+void InterestManager::Recompute(Viewer& viewer, ClientID client)
+{
+    // Only the shapes the client might see are looked at
+    std::vector<ShapeID> candidates(viewer.owned.begin(), viewer.owned.end());
+    candidates.insert(candidates.end(), m_images.begin(), m_images.end());
+    if (m_visionRange > 0.0f)
+    {
+        for (ShapeID id: viewer.owned)
+        {
+            glm::vec2 center = m_shapes.at(id).center;
+            m_tokens.Query(Bounds2D(center - m_visionRange, center + m_visionRange), candidates);
+        }
+    }
+    else if (viewer.hasRegion)
+        m_tokens.Query(viewer.region, candidates);
+    else
+    {
+        for (const auto& [id, shape]: m_shapes)
+        {
+            if (shape.type == SyncShapeType::Token)
+                candidates.push_back(id);
+        }
+    }
+
+    std::unordered_set<ShapeID> visible;
+    for (ShapeID id: candidates)
+    {
+        if (Sees(viewer, client, m_shapes.at(id)))
+            visible.insert(id);
+    }
+    std::vector<ShapeID> left;
+    for (ShapeID id: viewer.visible)
+    {
+        if (!visible.count(id))
+            left.push_back(id);
+    }
+    for (ShapeID id: left)
+        SetVisible(viewer, id, false);
+    for (ShapeID id: visible)
+        SetVisible(viewer, id, true);
+    viewer.dirty = false;
+}
+
+void InterestManager::SetVisible(Viewer& viewer, ShapeID id, bool visible)
+{
+    // A shape leaving and coming back before the changes are taken never
+    // changed as far as the client knows
+    if (visible && viewer.visible.insert(id).second)
+    {
+        if (!viewer.left.erase(id))
+            viewer.entered.insert(id);
+    }
+    else if (!visible && viewer.visible.erase(id))
+    {
+        if (!viewer.entered.erase(id))
+            viewer.left.insert(id);
+    }
+}
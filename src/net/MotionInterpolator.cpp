@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <net/Protocol.h>
+
+#include <net/MotionInterpolator.h>
+
+
+// How often the clock offset may be raised again, in case the route got
+// slower or the clocks drift apart
+const double OFFSET_WINDOW_MS = 2000.0;
+
+// Wrapping comparison of clock and sequence values
+static int32_t Difference(uint32_t a, uint32_t b) { return int32_t(a - b); }
+
+double MotionInterpolator::ToMs(Clock::time_point time)
+{
+    return std::chrono::duration<double, std::milli>(time.time_since_epoch()).count();
+}
+
+bool MotionInterpolator::Add(const MotionPacket& packet, Clock::time_point now)
+{
+    double nowMs = ToMs(now);
+    uint32_t now32 = uint32_t(int64_t(nowMs));
+    uint32_t offset = now32 - packet.timeMs;
+
+    auto it = m_origins.find(packet.origin);
+    if (it == m_origins.end())
+        it = m_origins.emplace(packet.origin, Origin{packet.sequence - 1, offset, offset, nowMs}).first;
+    Origin& origin = it->second;
+
+    int32_t gap = Difference(packet.sequence, origin.lastSequence);
+    if (gap <= 0)
+    {
+        m_stats.packetsLate++;
+        return false;
+    }
+    m_stats.packetsReceived++;
+    m_stats.packetsMissed += gap - 1;
+    origin.lastSequence = packet.sequence;
+
+    // Packets delayed on the way only ever make the offset look larger
+    if (Difference(offset, origin.offset) < 0)
+        origin.offset = offset;
+    if (Difference(offset, origin.windowMinimum) < 0)
+        origin.windowMinimum = offset;
+    if (nowMs - origin.windowStartMs > OFFSET_WINDOW_MS)
+    {
+        origin.offset = origin.windowMinimum;
+        origin.windowMinimum = offset;
+        origin.windowStartMs = nowMs;
+    }
+
+    // When the packet would have arrived with no delay, in local time
+    double timeMs = nowMs - Difference(now32, packet.timeMs + origin.offset);
+    for (const MotionSample& sample: packet.samples)
+    {
+        Track& track = m_tracks[sample.id];
+        // A new drag of a token whose last one is still being held
+        if (track.final && !packet.final)
+        {
+            track.final = false;
+            track.samples.clear();
+        }
+        if (track.samples.empty() || timeMs > track.samples.back().timeMs)
+            track.samples.push_back({timeMs, sample.position});
+        track.lastReceivedMs = nowMs;
+        if (packet.final && !track.final)
+        {
+            track.final = true;
+            track.finalMs = nowMs;
+        }
+    }
+    return true;
+}
+
+void MotionInterpolator::Restore(Scene& scene)
+{
+    for (auto& [id, track]: m_tracks)
+    {
+        if (!track.applied)
+            continue;
+        if (std::shared_ptr<Token> token = scene.GetToken(id))
+            token->GetModel()->SetPos(track.authoritative);
+        track.applied = false;
+    }
+}
+
+void MotionInterpolator::Apply(Scene& scene, Clock::time_point now)
+{
+    double nowMs = ToMs(now);
+    double renderMs = nowMs - m_delayMs;
+    for (auto it = m_tracks.begin(); it != m_tracks.end();)
+    {
+        Track& track = it->second;
+        std::shared_ptr<Token> token = scene.GetToken(it->first);
+        if (!token || track.samples.empty())
+        {
+            it = m_tracks.erase(it);
+            continue;
+        }
+
+        auto model = token->GetModel();
+        if (!track.applied)
+            track.authoritative = model->GetPos();
+
+        // Only the newest sample at or before the render time is needed
+        while (track.samples.size() > 1 && track.samples[1].timeMs <= renderMs)
+            track.samples.pop_front();
+
+        const Sample& last = track.samples.back();
+        bool caughtUp = QuantizePosition(track.authoritative) == last.position;
+        bool released = track.final ? (renderMs >= last.timeMs && (caughtUp || nowMs - track.finalMs > FINAL_HOLD_MS))
+                                    : nowMs - track.lastReceivedMs > TIMEOUT_MS;
+        if (released)
+        {
+            if (track.applied)
+                model->SetPos(track.authoritative);
+            it = m_tracks.erase(it);
+            continue;
+        }
+
+        glm::vec2 position;
+        const Sample& first = track.samples.front();
+        if (track.samples.size() == 1 || renderMs <= first.timeMs)
+            position = DequantizePosition(first.position);
+        else
+        {
+            const Sample& next = track.samples[1];
+            float t = float((renderMs - first.timeMs) / (next.timeMs - first.timeMs));
+            position = glm::mix(DequantizePosition(first.position), DequantizePosition(next.position), t);
+        }
+        model->SetPos(position);
+        track.applied = true;
+        ++it;
+    }
+}
+
+void MotionInterpolator::Clear()
+{
+    m_origins.clear();
+    m_tracks.clear();
+}
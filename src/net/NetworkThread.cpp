@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <SPSCQueue.hpp>
+#include <net/Connection.h>
+
+#include <net/NetworkThread.h>
+
+
+// IDs in epoll events, connections are numbered after these
+const uint64_t WAKE_ID = 0;
+const uint64_t LISTENER_ID = 1;
+const int MAX_EVENTS = 64;
+
+
+ConnectionChannel::~ConnectionChannel()
+{
+    if (socket >= 0)
+        close(socket);
+}
+
+
+ThreadedConnection::ThreadedConnection(std::shared_ptr<ConnectionChannel> channel, NetworkThread& thread) :
+    m_channel(std::move(channel)), m_thread(thread) {}
+
+ThreadedConnection::~ThreadedConnection() { Close(); }
+
+void ThreadedConnection::Send(uint8_t type, const std::string& payload)
+{
+    if (!IsOpen())
+        return;
+    m_channel->unsent += Connection::FRAME_HEADER_SIZE + payload.size();
+    m_channel->outgoing.Push({type, payload});
+    m_unflushed = true;
+}
+
+bool ThreadedConnection::Flush()
+{
+    if (m_unflushed)
+    {
+        m_thread.Wake();
+        m_unflushed = false;
+    }
+    return IsOpen();
+}
+
+size_t ThreadedConnection::Queued() const
+{
+    size_t queued = m_channel->unsent + m_channel->pending;
+    if (IsOpen())
+        queued += Connection::Unacknowledged(m_channel->socket);
+    return queued;
+}
+
+void ThreadedConnection::Close()
+{
+    if (m_closed)
+        return;
+    // What was already handed over gets one last flush
+    m_closed = true;
+    m_channel->closing = true;
+    m_thread.Wake();
+}
+
+
+std::unique_ptr<NetworkThread> NetworkThread::Listen(uint16_t port)
+{
+    std::unique_ptr<Listener> listener = Listener::Listen(port);
+    if (!listener)
+        return nullptr;
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || wake < 0)
+    {
+        if (epoll >= 0)
+            close(epoll);
+        if (wake >= 0)
+            close(wake);
+        return nullptr;
+    }
+    return std::unique_ptr<NetworkThread>(new NetworkThread(std::move(listener), epoll, wake));
+}
+
+NetworkThread::NetworkThread(std::unique_ptr<Listener> listener, int epoll, int wake) :
+    m_listener(std::move(listener)), m_port(m_listener->Port()), m_epoll(epoll), m_wake(wake), m_nextID(LISTENER_ID + 1)
+{
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &event);
+    event.data.u64 = LISTENER_ID;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener->FileDescriptor(), &event);
+    m_thread = std::thread(&NetworkThread::Loop, this);
+}
+
+NetworkThread::~NetworkThread()
+{
+    m_stop = true;
+    Wake();
+    m_thread.join();
+    close(m_epoll);
+    close(m_wake);
+}
+
+std::unique_ptr<ThreadedConnection> NetworkThread::Accept()
+{
+    std::shared_ptr<ConnectionChannel> channel;
+    if (!m_accepted.Pop(channel))
+        return nullptr;
+    return std::make_unique<ThreadedConnection>(std::move(channel), *this);
+}
+
+void NetworkThread::Wake()
+{
+    uint64_t value = 1;
+    // Only fails when the counter is about to overflow, ie, already woken
+    ssize_t written = write(m_wake, &value, sizeof(value));
+    (void)written;
+}
+
+void NetworkThread::Loop()
+{
+    epoll_event events[MAX_EVENTS];
+    // Only set while a connection holds messages back to simulate latency
+    int timeoutMs = -1;
+    while (!m_stop)
+    {
+        int count = epoll_wait(m_epoll, events, MAX_EVENTS, timeoutMs);
+        if (count < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < count; i++)
+        {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID)
+            {
+                uint64_t value;
+                ssize_t read = ::read(m_wake, &value, sizeof(value));
+                (void)read;
+            }
+            else if (id == LISTENER_ID)
+                AcceptAll();
+            else
+            {
+                auto it = m_entries.find(id);
+                if (it != m_entries.end() && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                    Read(it->second);
+            }
+        }
+
+        // Every connection is written each pass, it's what the main thread
+        // handed over that usually woke the loop
+        timeoutMs = -1;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = m_entries.begin(); it != m_entries.end();)
+        {
+            if (!Write(it->first, it->second))
+            {
+                it = m_entries.erase(it);
+                continue;
+            }
+            std::chrono::steady_clock::time_point due;
+            if (it->second.connection->NextDue(due))
+            {
+                // Rounded up, waking early would find nothing due
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(due - now).count();
+                int ms = int(std::max<decltype(wait)>(wait, 0));
+                timeoutMs = timeoutMs < 0 ? ms : std::min(timeoutMs, ms);
+            }
+            ++it;
+        }
+    }
+
+    for (auto& [id, entry]: m_entries)
+    {
+        entry.connection->Close();
+        entry.channel->open.store(false, std::memory_order_release);
+    }
+    m_entries.clear();
+}
+
+void NetworkThread::AcceptAll()
+{
+    while (std::unique_ptr<Connection> connection = m_listener->Accept())
+    {
+        auto channel = std::make_shared<ConnectionChannel>();
+        channel->socket = fcntl(connection->FileDescriptor(), F_DUPFD_CLOEXEC, 0);
+        if (channel->socket < 0)
+            continue;
+        // Watched through the duplicate, so it can be taken out of the epoll
+        // set after the connection closes its own
+        uint64_t id = m_nextID++;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, channel->socket, &event) != 0)
+            continue;
+        Entry& entry = m_entries[id];
+        entry.connection = std::move(connection);
+        entry.channel = std::move(channel);
+        m_accepted.Push(entry.channel);
+    }
+}
+
+void NetworkThread::Read(Entry& entry)
+{
+    entry.connection->Receive();
+    Connection::Message message;
+    while (entry.connection->Next(message))
+        entry.channel->incoming.Push(std::move(message));
+    entry.channel->bytesReceived = entry.connection->BytesReceived();
+}
+
+bool NetworkThread::Write(uint64_t id, Entry& entry)
+{
+    Connection& connection = *entry.connection;
+    ConnectionChannel& channel = *entry.channel;
+    connection.SetLatency(channel.latencyMs);
+    Connection::Message message;
+    while (channel.outgoing.Pop(message))
+    {
+        channel.unsent -= Connection::FRAME_HEADER_SIZE + message.payload.size();
+        connection.Send(message.type, message.payload);
+    }
+    connection.Flush();
+    if (channel.closing)
+        connection.Close();
+    channel.bytesSent = connection.BytesSent();
+    channel.pending = connection.Pending();
+    if (!connection.IsOpen())
+    {
+        // The duplicate keeps the socket in the epoll set until removed
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, channel.socket, nullptr);
+        channel.pending = 0;
+        channel.open.store(false, std::memory_order_release);
+        return false;
+    }
+
+    // Only watched for writability while the socket is full
+    bool blocked = connection.Unwritten() > 0;
+    if (blocked != entry.blocked)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | (blocked ? EPOLLOUT : 0);
+        event.data.u64 = id;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, channel.socket, &event);
+        entry.blocked = blocked;
+    }
+    return true;
+}
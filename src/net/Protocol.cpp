@@ -0,0 +1,278 @@
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/Token.h>
+
+#include <net/Protocol.h>
+
+
+static const uint8_t X_STATUS_FLAG = 1 << NUM_TOKEN_STATUSES;
+static const uint8_t NAME_HIDDEN_FLAG = 1 << (NUM_TOKEN_STATUSES + 1);
+static_assert(NUM_TOKEN_STATUSES + 2 <= 8, "Token flags are sent as a byte");
+static const uint8_t LOCK_RATIO_FLAG = 1 << 0;
+static const uint8_t VISIBLE_FLAG = 1 << 1;
+
+static void CaptureTransform(Shape2D& shape, ShapeState& state)
+{
+    auto model = shape.GetModel();
+    state.position = QuantizePosition(model->GetPos());
+    state.scale = model->GetScale();
+    state.rotation = model->GetRotation();
+}
+
+static void ApplyTransform(const ShapeState& state, SyncField fields, Shape2D& shape)
+{
+    auto model = shape.GetModel();
+    if (HasField(fields, SyncField::Position))
+        model->SetPos(DequantizePosition(state.position));
+    if (HasField(fields, SyncField::Scale))
+        model->SetScale(state.scale);
+    if (HasField(fields, SyncField::Rotation))
+        model->SetRotation(state.rotation);
+}
+
+ShapeState CaptureToken(Token& token)
+{
+    ShapeState state;
+    state.type = SyncShapeType::Token;
+    CaptureTransform(token, state);
+    state.texture = token.GetIcon()->filename;
+    state.name = token.GetName();
+    state.color = token.GetBorderColor();
+    state.borderWidth = token.GetBorderWidth();
+    state.flags = uint8_t(token.GetStatuses().to_ulong()) | (token.GetXStatus() ? X_STATUS_FLAG : 0) |
+                  (token.IsNameHidden() ? NAME_HIDDEN_FLAG : 0);
+    state.opacity = token.GetOpacity();
+    state.height = token.GetHeight();
+    return state;
+}
+
+ShapeState CaptureImage(BGImage& image)
+{
+    ShapeState state;
+    state.type = SyncShapeType::Image;
+    CaptureTransform(image, state);
+    state.texture = image.GetImage()->filename;
+    state.color = image.GetTint();
+    state.flags = (image.GetLockRatio() ? LOCK_RATIO_FLAG : 0) | (image.IsVisible() ? VISIBLE_FLAG : 0);
+    state.height = image.GetHeightScale();
+    if (image.GetHeightmap())
+        state.heightmap = image.GetHeightmap()->filename;
+    return state;
+}
+
+void HideFields(ShapeState& state, ClientID client)
+{
+    if (state.type == SyncShapeType::Token && (state.flags & NAME_HIDDEN_FLAG) && state.owner != client)
+        state.name.clear();
+}
+
+bool IsShownToClients(const ShapeState& state)
+{
+    return state.type != SyncShapeType::Image || (state.flags & VISIBLE_FLAG);
+}
+
+SyncField DiffFields(const ShapeState& a, const ShapeState& b)
+{
+    SyncField fields = SyncField::None;
+    if (a.position != b.position)
+        fields |= SyncField::Position;
+    if (a.scale != b.scale)
+        fields |= SyncField::Scale;
+    if (a.rotation != b.rotation)
+        fields |= SyncField::Rotation;
+    if (a.texture != b.texture)
+        fields |= SyncField::Texture;
+    if (a.name != b.name)
+        fields |= SyncField::Name;
+    if (a.color != b.color)
+        fields |= SyncField::Color;
+    if (a.borderWidth != b.borderWidth)
+        fields |= SyncField::BorderWidth;
+    if (a.flags != b.flags)
+        fields |= SyncField::Flags;
+    if (a.opacity != b.opacity)
+        fields |= SyncField::Opacity;
+    if (a.owner != b.owner)
+        fields |= SyncField::Owner;
+    if (a.height != b.height || a.heightmap != b.heightmap)
+        fields |= SyncField::Height;
+    return fields;
+}
+
+void ApplyToken(const ShapeState& state, SyncField fields, Token& token, Resources& resources)
+{
+    ApplyTransform(state, fields, token);
+    if (HasField(fields, SyncField::Texture))
+        token.SetIcon(resources.GetTexture(state.texture));
+    if (HasField(fields, SyncField::Name))
+        token.SetName(state.name);
+    if (HasField(fields, SyncField::Color))
+        token.SetBorderColor(state.color);
+    if (HasField(fields, SyncField::BorderWidth))
+        token.SetBorderWidth(state.borderWidth);
+    if (HasField(fields, SyncField::Flags))
+    {
+        token.SetStatuses(TokenStatuses(state.flags & ~(X_STATUS_FLAG | NAME_HIDDEN_FLAG)));
+        token.SetXStatus(state.flags & X_STATUS_FLAG);
+        token.SetNameHidden(state.flags & NAME_HIDDEN_FLAG);
+    }
+    if (HasField(fields, SyncField::Opacity))
+        token.SetOpacity(state.opacity);
+    if (HasField(fields, SyncField::Height))
+        token.SetHeight(state.height);
+}
+
+void ApplyImage(const ShapeState& state, SyncField fields, BGImage& image, Resources& resources)
+{
+    ApplyTransform(state, fields, image);
+    if (HasField(fields, SyncField::Texture))
+        image.SetImage(resources.GetTexture(state.texture));
+    if (HasField(fields, SyncField::Color))
+        image.SetTint(state.color);
+    if (HasField(fields, SyncField::Flags))
+    {
+        image.SetLockRatio(state.flags & LOCK_RATIO_FLAG);
+        image.SetVisible(state.flags & VISIBLE_FLAG);
+    }
+    if (HasField(fields, SyncField::Height))
+    {
+        image.SetHeightmap(state.heightmap.empty() ? nullptr : resources.GetTexture(state.heightmap));
+        image.SetHeightScale(state.height);
+    }
+}
+
+// Encoding
+
+void ByteWriter::WriteShape(ShapeID id, SyncField fields, const ShapeState& state)
+{
+    Write(id);
+    Write(state.type);
+    Write(fields);
+    if (HasField(fields, SyncField::Index))
+        Write(state.index);
+    if (HasField(fields, SyncField::Position))
+        Write(state.position);
+    if (HasField(fields, SyncField::Scale))
+        Write(state.scale);
+    if (HasField(fields, SyncField::Rotation))
+        Write(state.rotation);
+    if (HasField(fields, SyncField::Texture))
+        WriteString(state.texture);
+    if (HasField(fields, SyncField::Name))
+        WriteString(state.name);
+    if (HasField(fields, SyncField::Color))
+        Write(state.color);
+    if (HasField(fields, SyncField::BorderWidth))
+        Write(state.borderWidth);
+    if (HasField(fields, SyncField::Flags))
+        Write(state.flags);
+    if (HasField(fields, SyncField::Opacity))
+        Write(state.opacity);
+    if (HasField(fields, SyncField::Owner))
+        Write(state.owner);
+    if (HasField(fields, SyncField::Height))
+    {
+        if (state.type == SyncShapeType::Image)
+            WriteString(state.heightmap);
+        Write(state.height);
+    }
+}
+
+bool ByteReader::ReadString(std::string& value)
+{
+    uint32_t size;
+    if (!Read(size) || m_size - m_offset < size)
+        return false;
+    value.assign(m_data + m_offset, size);
+    m_offset += size;
+    return true;
+}
+
+bool ByteReader::ReadShape(ShapeID& id, SyncField& fields, ShapeState& state)
+{
+    if (!Read(id) || !Read(state.type) || !Read(fields))
+        return false;
+    if (state.type > SyncShapeType::Removed || (uint16_t(fields) & ~uint16_t(SyncField::All)))
+        return false;
+    return (!HasField(fields, SyncField::Index) || Read(state.index)) &&
+           (!HasField(fields, SyncField::Position) || Read(state.position)) &&
+           (!HasField(fields, SyncField::Scale) || Read(state.scale)) &&
+           (!HasField(fields, SyncField::Rotation) || Read(state.rotation)) &&
+           (!HasField(fields, SyncField::Texture) || ReadString(state.texture)) &&
+           (!HasField(fields, SyncField::Name) || ReadString(state.name)) &&
+           (!HasField(fields, SyncField::Color) || Read(state.color)) &&
+           (!HasField(fields, SyncField::BorderWidth) || Read(state.borderWidth)) &&
+           (!HasField(fields, SyncField::Flags) || Read(state.flags)) &&
+           (!HasField(fields, SyncField::Opacity) || Read(state.opacity)) &&
+           (!HasField(fields, SyncField::Owner) || Read(state.owner)) &&
+           (!HasField(fields, SyncField::Height) ||
+            ((state.type != SyncShapeType::Image || ReadString(state.heightmap)) && Read(state.height)));
+}
+
+// Datagrams
+
+uint32_t MotionClockMs()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+std::string EncodeHello(uint32_t key)
+{
+    std::string bytes;
+    ByteWriter writer(bytes);
+    writer.Write(SyncDatagram::Hello);
+    writer.Write(key);
+    return bytes;
+}
+
+std::string EncodeMotion(uint32_t key, const MotionPacket& packet)
+{
+    std::string bytes;
+    bytes.reserve(20 + packet.samples.size() * (sizeof(ShapeID) + sizeof(glm::ivec2)));
+    ByteWriter writer(bytes);
+    writer.Write(SyncDatagram::Motion);
+    writer.Write(key);
+    writer.Write(packet.origin);
+    writer.Write(packet.sequence);
+    writer.Write(packet.timeMs);
+    writer.Write<uint8_t>(packet.final);
+    writer.Write<uint16_t>(packet.samples.size());
+    for (const MotionSample& sample: packet.samples)
+    {
+        writer.Write(sample.id);
+        writer.Write(sample.position);
+    }
+    return bytes;
+}
+
+bool DecodeDatagram(const std::string& bytes, SyncDatagram& type, uint32_t& key, MotionPacket& packet)
+{
+    ByteReader reader(bytes);
+    if (!reader.Read(type) || !reader.Read(key))
+        return false;
+    if (type == SyncDatagram::Hello)
+        return reader.AtEnd();
+    if (type != SyncDatagram::Motion)
+        return false;
+
+    uint8_t final;
+    uint16_t count;
+    if (!reader.Read(packet.origin) || !reader.Read(packet.sequence) || !reader.Read(packet.timeMs) ||
+        !reader.Read(final) || !reader.Read(count))
+        return false;
+    packet.final = final;
+    packet.samples.resize(count);
+    for (MotionSample& sample: packet.samples)
+    {
+        if (!reader.Read(sample.id) || !reader.Read(sample.position))
+            return false;
+    }
+    return reader.AtEnd();
+}
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+
+#include <BinarySerializer.h>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <net/AssetTransfer.h>
+#include <net/Connection.h>
+#include <net/Datagram.h>
+#include <net/InterestManager.h>
+#include <net/Protocol.h>
+
+#include <net/SceneClient.h>
+
+
+// Hellos are repeated in case one is lost
+const std::chrono::seconds HELLO_INTERVAL{1};
+
+
+SceneClient::SceneClient(std::shared_ptr<Resources> resources) :
+    m_resources(resources), m_serializer(resources), m_binarySerializer(resources), m_assets(resources) {}
+
+bool SceneClient::Connect(const std::string& host, uint16_t port)
+{
+    Disconnect();
+    m_connection = Connection::Connect(host, port);
+    if (m_connection)
+        m_connection->SetLatency(m_conditions.latencyMs);
+    return bool(m_connection);
+}
+
+void SceneClient::Disconnect()
+{
+    if (m_connection)
+    {
+        m_stats.bytesSent += m_connection->BytesSent();
+        m_stats.bytesReceived += m_connection->BytesReceived();
+    }
+    if (m_datagrams)
+    {
+        m_stats.datagramBytesSent += m_datagrams->BytesSent();
+        m_stats.datagramBytesReceived += m_datagrams->BytesReceived();
+    }
+    m_connection = nullptr;
+    m_datagrams = nullptr;
+    m_hostAddress = DatagramAddress();
+    m_motion.clear();
+    m_assets.Reset();
+    m_id = HOST_CLIENT_ID;
+    m_hasScene = false;
+    m_owners.clear();
+    m_hasViewRegion = false;
+    m_pendingEdits.clear();
+    m_confirmed.clear();
+    m_shown.clear();
+}
+
+bool SceneClient::Update(std::shared_ptr<Scene>& scene)
+{
+    if (!m_connection)
+        return false;
+
+    m_connection->Flush();
+    bool open = m_connection->Receive();
+    // The host's messages apply to its own state, predictions go back on top
+    RestorePredictions(*scene);
+    bool replaced = false;
+    Connection::Message message;
+    while (m_connection->Next(message))
+    {
+        m_stats.messagesReceived++;
+        bool valid = false;
+        switch (SyncMessage(message.type))
+        {
+        case SyncMessage::Welcome:
+            valid = ApplyWelcome(message.payload);
+            break;
+        case SyncMessage::Snapshot:
+            valid = ApplySnapshot(message.payload, scene);
+            replaced |= valid;
+            break;
+        case SyncMessage::Delta:
+            valid = m_hasScene && ApplyDelta(message.payload, *scene);
+            break;
+        case SyncMessage::Ack:
+            valid = ApplyAck(message.payload);
+            break;
+        case SyncMessage::Assets:
+            valid = ApplyAssets(message.payload);
+            break;
+        case SyncMessage::AssetChunk:
+            valid = ApplyAssetChunk(message.payload);
+            break;
+        default:
+            break;
+        }
+        if (!valid)
+        {
+            std::cerr << "Disconnecting after invalid message " << int(message.type) << " from host" << std::endl;
+            m_connection->Close();
+            ReplayPredictions(*scene);
+            return replaced;
+        }
+    }
+    ReplayPredictions(*scene);
+    if (!open)
+        std::cerr << "Disconnected from host" << std::endl;
+    else
+        ReadDatagrams();
+    return replaced;
+}
+
+uint32_t SceneClient::RequestEdit(ShapeID id, SyncField fields, const ShapeState& state)
+{
+    if (!IsConnected())
+        return 0;
+    uint32_t sequence = m_nextSequence++;
+    std::string payload;
+    ByteWriter writer(payload);
+    writer.Write(sequence);
+    writer.WriteShape(id, fields, state);
+    m_connection->Send(uint8_t(SyncMessage::Edit), payload);
+    m_stats.messagesSent++;
+    m_pendingEdits[sequence] = {id, fields, state, std::chrono::steady_clock::now()};
+    return sequence;
+}
+
+bool SceneClient::Owns(ShapeID id) const
+{
+    auto it = m_owners.find(id);
+    return it != m_owners.end() && it->second == m_id;
+}
+
+void SceneClient::SetViewRegion(const Bounds2D& region)
+{
+    if (!IsConnected())
+        return;
+    if (m_hasViewRegion)
+    {
+        glm::vec2 tolerance = glm::abs(m_viewRegion.Size()) * (VIEW_MARGIN * 0.5f);
+        glm::vec2 moved = glm::max(glm::abs(region.min - m_viewRegion.min), glm::abs(region.max - m_viewRegion.max));
+        if (moved.x <= tolerance.x && moved.y <= tolerance.y)
+            return;
+    }
+    std::string payload;
+    ByteWriter writer(payload);
+    writer.Write(region.min);
+    writer.Write(region.max);
+    m_connection->Send(uint8_t(SyncMessage::ViewRegion), payload);
+    m_stats.messagesSent++;
+    m_hasViewRegion = true;
+    m_viewRegion = region;
+}
+
+void SceneClient::StreamMotion(const std::vector<MotionSample>& samples, bool final)
+{
+    if (!m_datagrams || !m_hostAddress.IsValid())
+        return;
+    MotionPacket packet;
+    packet.origin = m_id;
+    packet.timeMs = MotionClockMs();
+    packet.final = final;
+    for (const MotionSample& sample: samples)
+    {
+        if (Owns(sample.id))
+            packet.samples.push_back(sample);
+    }
+
+    // Split to fit a datagram, each part stands alone
+    for (size_t start = 0; start < packet.samples.size(); start += MAX_MOTION_SAMPLES)
+    {
+        size_t end = std::min(packet.samples.size(), start + MAX_MOTION_SAMPLES);
+        MotionPacket part = packet;
+        part.sequence = ++m_motionSequence;
+        part.samples.assign(packet.samples.begin() + start, packet.samples.begin() + end);
+        m_datagrams->SendTo(m_hostAddress, EncodeMotion(m_key, part));
+    }
+}
+
+std::vector<MotionPacket> SceneClient::TakeMotion()
+{
+    std::vector<MotionPacket> motion;
+    std::swap(motion, m_motion);
+    return motion;
+}
+
+void SceneClient::SetNetworkConditions(const NetworkConditions& conditions)
+{
+    m_conditions = conditions;
+    if (m_connection)
+        m_connection->SetLatency(conditions.latencyMs);
+    if (m_datagrams)
+        m_datagrams->SetConditions(conditions, m_id);
+}
+
+SyncStats SceneClient::Stats() const
+{
+    SyncStats stats = m_stats;
+    if (m_connection)
+    {
+        stats.bytesSent += m_connection->BytesSent();
+        stats.bytesReceived += m_connection->BytesReceived();
+    }
+    if (m_datagrams)
+    {
+        stats.datagramBytesSent += m_datagrams->BytesSent();
+        stats.datagramBytesReceived += m_datagrams->BytesReceived();
+    }
+    stats.assets = m_assets.Stats();
+    return stats;
+}
+
+bool SceneClient::ApplyWelcome(const std::string& payload)
+{
+    ByteReader reader(payload);
+    uint32_t version;
+    uint16_t port;
+    if (!reader.Read(version) || version != SYNC_PROTOCOL_VERSION || !reader.Read(m_id) ||
+        !reader.Read(port) || !reader.Read(m_key) || !reader.AtEnd())
+        return false;
+
+    // Motion previews are optional, the scene syncs without them
+    if (port == 0)
+        return true;
+    m_hostAddress = DatagramAddress::OfPeer(m_connection->FileDescriptor()).WithPort(port);
+    m_datagrams = DatagramSocket::Bind(0);
+    if (m_datagrams)
+        m_datagrams->SetConditions(m_conditions, m_id);
+    m_lastHello = std::chrono::steady_clock::time_point();
+    return true;
+}
+
+bool SceneClient::ApplyAssets(const std::string& payload)
+{
+    ByteReader reader(payload);
+    uint32_t count;
+    if (!reader.Read(count))
+        return false;
+    std::vector<AssetEntry> entries;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        AssetEntry entry;
+        if (!reader.ReadString(entry.path) || !reader.Read(entry.hash) || !reader.Read(entry.size))
+            return false;
+        entries.push_back(std::move(entry));
+    }
+    if (!reader.AtEnd())
+        return false;
+
+    for (const AssetCache::Request& request: m_assets.Announce(entries))
+    {
+        std::string requestPayload;
+        ByteWriter writer(requestPayload);
+        writer.Write(request.hash);
+        writer.Write(request.offset);
+        writer.Write<uint8_t>(request.preview);
+        m_connection->Send(uint8_t(SyncMessage::AssetRequest), requestPayload);
+        m_stats.messagesSent++;
+    }
+    return true;
+}
+
+bool SceneClient::ApplyAssetChunk(const std::string& payload)
+{
+    ByteReader reader(payload);
+    ContentHash hash;
+    AssetPart part;
+    uint64_t offset, total;
+    if (!reader.Read(hash) || !reader.Read(part) || part > AssetPart::Full || !reader.Read(offset) || !reader.Read(total))
+        return false;
+    size_t headerSize = sizeof(hash) + sizeof(part) + sizeof(offset) + sizeof(total);
+    return m_assets.Receive(hash, part, offset, total, payload.data() + headerSize, payload.size() - headerSize);
+}
+
+void SceneClient::ReadDatagrams()
+{
+    if (!m_datagrams)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastHello >= HELLO_INTERVAL)
+    {
+        m_datagrams->SendTo(m_hostAddress, EncodeHello(m_key));
+        m_lastHello = now;
+    }
+    m_datagrams->Flush();
+
+    DatagramAddress address;
+    std::string bytes;
+    SyncDatagram type;
+    uint32_t key;
+    MotionPacket packet;
+    while (m_datagrams->Receive(address, bytes))
+    {
+        // Only the host's motion is trusted
+        if (address != m_hostAddress || !DecodeDatagram(bytes, type, key, packet) ||
+            type != SyncDatagram::Motion || key != m_key)
+            continue;
+        m_motion.push_back(std::move(packet));
+    }
+}
+
+bool SceneClient::ApplySnapshot(const std::string& payload, std::shared_ptr<Scene>& scene)
+{
+    // Decoding reads records in place so needs aligned data
+    std::vector<uint64_t> aligned((payload.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    std::memcpy(aligned.data(), payload.data(), payload.size());
+    auto snapshot = std::make_shared<Scene>(m_resources);
+    if (!m_binarySerializer.Decode(reinterpret_cast<const char*>(aligned.data()), payload.size(), *snapshot))
+        return false;
+    scene = snapshot;
+    m_owners.clear();
+    m_confirmed.clear();
+    m_hasScene = true;
+    return true;
+}
+
+template <typename T>
+static void InsertShapes(RemovedShapes<T>& toInsert, size_t size)
+{
+    // Indices are from the host's list, clamp in case they've drifted
+    std::sort(toInsert.begin(), toInsert.end(), [](const auto& a, const auto& b) { return a.index < b.index; });
+    for (size_t i = 0; i < toInsert.size(); i++)
+        toInsert[i].index = std::min(toInsert[i].index, size + i);
+}
+
+bool SceneClient::ApplyDelta(const std::string& payload, Scene& scene)
+{
+    ByteReader reader(payload);
+    uint32_t frame, count;
+    if (!reader.Read(frame) || !reader.Read(count))
+        return false;
+
+    std::vector<ShapeID> removed;
+    RemovedShapes<Token> newTokens;
+    RemovedShapes<BGImage> newImages;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ShapeID id;
+        SyncField fields;
+        ShapeState state;
+        if (!reader.ReadShape(id, fields, state))
+            return false;
+
+        if (HasField(fields, SyncField::Owner))
+        {
+            if (state.owner == HOST_CLIENT_ID)
+                m_owners.erase(id);
+            else
+                m_owners[id] = state.owner;
+        }
+
+        if (state.type == SyncShapeType::Removed)
+        {
+            removed.push_back(id);
+            m_owners.erase(id);
+            m_confirmed.erase(id);
+        }
+        else if (HasField(fields, SyncField::Index))
+        {
+            if (state.type == SyncShapeType::Token)
+            {
+                auto token = std::make_shared<Token>(m_resources->GetTexture(state.texture), state.name);
+                ApplyToken(state, fields, *token, *m_resources);
+                token->SetID(id);
+                Confirm(id, *token);
+                newTokens.push_back({state.index, token, false});
+            }
+            else
+            {
+                auto image = std::make_shared<BGImage>(m_resources->GetTexture(state.texture));
+                ApplyImage(state, fields, *image, *m_resources);
+                image->SetID(id);
+                newImages.push_back({state.index, image, false});
+            }
+            // Replaces any stale copy
+            removed.push_back(id);
+        }
+        else if (state.type == SyncShapeType::Token)
+        {
+            auto token = scene.GetToken(id);
+            if (token)
+            {
+                ApplyToken(state, fields, *token, *m_resources);
+                Confirm(id, *token);
+            }
+        }
+        else
+        {
+            auto image = scene.GetImage(id);
+            if (image)
+                ApplyImage(state, fields, *image, *m_resources);
+        }
+    }
+
+    uint8_t hasSettings;
+    if (!reader.Read(hasSettings))
+        return false;
+    if (hasSettings)
+    {
+        std::string text;
+        if (!reader.ReadString(text))
+            return false;
+        nlohmann::json settings = nlohmann::json::parse(text, nullptr, false);
+        if (settings.is_discarded())
+            return false;
+        if (settings.contains("grid"))
+            scene.grid = m_serializer.DeserializeGrid(settings["grid"]);
+        if (settings.contains("fog"))
+            m_serializer.DeserializeFog(settings["fog"], *scene.fog);
+        if (settings.contains("walls"))
+            m_serializer.DeserializeWalls(settings["walls"], scene.fog->walls);
+        scene.SetImagesLocked(settings.value("imagesLocked", scene.GetImagesLocked()));
+        scene.SetTokensLocked(settings.value("tokensLocked", scene.GetTokensLocked()));
+    }
+    if (!reader.AtEnd())
+        return false;
+
+    if (!removed.empty())
+    {
+        scene.RemoveTokens(removed);
+        scene.RemoveImages(removed);
+    }
+    if (!newTokens.empty())
+    {
+        InsertShapes(newTokens, scene.tokens.size());
+        scene.InsertTokens(newTokens);
+    }
+    if (!newImages.empty())
+    {
+        InsertShapes(newImages, scene.images.size());
+        scene.InsertImages(newImages);
+    }
+    m_frame = frame;
+    return true;
+}
+
+void SceneClient::Confirm(ShapeID id, Token& token)
+{
+    if (Owns(id))
+        m_confirmed[id] = CaptureToken(token);
+    else
+        m_confirmed.erase(id);
+}
+
+void SceneClient::RestorePredictions(Scene& scene)
+{
+    m_shown.clear();
+    for (const auto& [sequence, edit]: m_pendingEdits)
+    {
+        auto confirmed = m_confirmed.find(edit.id);
+        auto token = scene.GetToken(edit.id);
+        if (confirmed == m_confirmed.end() || !token)
+            continue;
+        m_shown.try_emplace(edit.id, CaptureToken(*token));
+        ApplyToken(confirmed->second, edit.fields, *token, *m_resources);
+    }
+}
+
+void SceneClient::ReplayPredictions(Scene& scene)
+{
+    // Only on tokens whose host state is known, so they can be put back
+    for (const auto& [sequence, edit]: m_pendingEdits)
+    {
+        auto token = scene.GetToken(edit.id);
+        if (token && m_confirmed.count(edit.id))
+            ApplyToken(edit.state, edit.fields, *token, *m_resources);
+    }
+    for (const auto& [id, shown]: m_shown)
+    {
+        auto token = scene.GetToken(id);
+        if (token && DiffFields(shown, CaptureToken(*token)) != SyncField::None)
+            m_stats.corrections++;
+    }
+    m_shown.clear();
+}
+
+bool SceneClient::ApplyAck(const std::string& payload)
+{
+    ByteReader reader(payload);
+    uint32_t sequence;
+    uint8_t accepted;
+    if (!reader.Read(sequence) || !reader.Read(accepted) || !reader.AtEnd())
+        return false;
+
+    auto it = m_pendingEdits.find(sequence);
+    if (it == m_pendingEdits.end())
+        return true;
+    // Accepted edits are in the host's state by now, rejected ones are
+    // simply no longer replayed
+    double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - it->second.sent).count();
+    m_pendingEdits.erase(it);
+
+    uint64_t& total = accepted ? m_stats.editsAccepted : m_stats.editsRejected;
+    total++;
+    uint64_t numAcks = m_stats.editsAccepted + m_stats.editsRejected;
+    m_stats.lastLatencyMs = latency;
+    m_stats.averageLatencyMs += (latency - m_stats.averageLatencyMs) / numAcks;
+    m_stats.maxLatencyMs = std::max(m_stats.maxLatencyMs, latency);
+    m_stats.latencies.Add(latency);
+    return true;
+}
@@ -0,0 +1,634 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <json.hpp>
+
+#include <Actions.hpp>
+#include <BinarySerializer.h>
+#include <JSONSerializer.h>
+#include <Resources.h>
+#include <model/Scene.h>
+#include <net/AssetTransfer.h>
+#include <net/Datagram.h>
+#include <net/NetworkThread.h>
+#include <net/Protocol.h>
+
+#include <net/SceneHost.h>
+
+
+void LatencyHistogram::Add(double latencyMs)
+{
+    size_t bucket = latencyMs > 0.0 ? size_t(latencyMs) : 0;
+    counts[std::min(bucket, NUM_BUCKETS - 1)]++;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < NUM_BUCKETS; i++)
+        counts[i] += other.counts[i];
+}
+
+uint64_t LatencyHistogram::Total() const
+{
+    uint64_t total = 0;
+    for (uint32_t count: counts)
+        total += count;
+    return total;
+}
+
+double LatencyHistogram::Percentile(double fraction) const
+{
+    uint64_t total = Total();
+    if (total == 0)
+        return 0.0;
+    uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= target)
+            return double(i + 1);
+    }
+    return double(NUM_BUCKETS);
+}
+
+
+SceneHost::SceneHost(std::shared_ptr<Resources> resources) :
+    m_resources(resources), m_serializer(resources), m_binarySerializer(resources) {}
+
+bool SceneHost::Listen(uint16_t port)
+{
+    Stop();
+    m_network = NetworkThread::Listen(port);
+    if (!m_network)
+        return false;
+    // Same port number when it's free, clients are told which in any case
+    m_datagrams = DatagramSocket::Bind(m_network->Port());
+    if (!m_datagrams)
+        m_datagrams = DatagramSocket::Bind(0);
+    if (m_datagrams)
+        m_datagrams->SetConditions(m_conditions);
+    std::cerr << "Hosting on port " << m_network->Port() << std::endl;
+    m_resync = true;
+    return true;
+}
+
+void SceneHost::Stop()
+{
+    for (Client& client: m_clients)
+        Disconnect(client);
+    m_clients.clear();
+    if (m_datagrams)
+    {
+        m_closedStats.datagramBytesSent += m_datagrams->BytesSent();
+        m_closedStats.datagramBytesReceived += m_datagrams->BytesReceived();
+    }
+    m_network = nullptr;
+    m_datagrams = nullptr;
+    m_edits.clear();
+    m_applying.clear();
+    m_motion.clear();
+}
+
+uint16_t SceneHost::Port() const { return m_network ? m_network->Port() : 0; }
+
+void SceneHost::SetOwner(ShapeID id, ClientID client)
+{
+    if (client == HOST_CLIENT_ID)
+        m_owners.erase(id);
+    else
+        m_owners[id] = client;
+    // Clients learn about it with the next delta
+    m_pending.shapes.push_back(id);
+}
+
+ClientID SceneHost::GetOwner(ShapeID id) const
+{
+    auto it = m_owners.find(id);
+    return it != m_owners.end() ? it->second : HOST_CLIENT_ID;
+}
+
+void SceneHost::Record(const ActionEffects& effects)
+{
+    if (!m_network)
+        return;
+    m_pending.shapes.insert(m_pending.shapes.end(), effects.shapes.begin(), effects.shapes.end());
+    m_pending.settings |= effects.settings;
+    m_pending.walls |= effects.walls;
+}
+
+void SceneHost::Update(const std::shared_ptr<Scene>& scene)
+{
+    if (!m_network)
+        return;
+
+    if (m_resync)
+    {
+        // Everyone starts again from a snapshot of the current scene
+        m_sent.clear();
+        m_interest.ClearShapes();
+        for (const auto& token: scene->tokens)
+        {
+            ShapeState& state = m_sent[token->GetID()] = CaptureToken(*token);
+            state.owner = GetOwner(token->GetID());
+            m_interest.UpdateShape(token->GetID(), state);
+        }
+        for (const auto& image: scene->images)
+        {
+            ShapeState& state = m_sent[image->GetID()] = CaptureImage(*image);
+            m_interest.UpdateShape(image->GetID(), state);
+        }
+        for (Client& client: m_clients)
+            client.needsSnapshot = true;
+        m_pending = ActionEffects();
+        m_resync = false;
+    }
+    else
+        SendDelta(scene);
+
+    // The delta just sent holds the result of the edits applied since the
+    // last frame
+    for (const Edit& edit: m_applying)
+    {
+        auto it = std::find_if(m_clients.begin(), m_clients.end(), [&edit](const Client& client) { return client.id == edit.client; });
+        if (it == m_clients.end())
+            continue;
+        std::string payload;
+        ByteWriter writer(payload);
+        writer.Write(edit.sequence);
+        writer.Write<uint8_t>(1);
+        Send(*it, SyncMessage::Ack, payload);
+        m_closedStats.editsAccepted++;
+    }
+    m_applying.clear();
+
+    while (std::unique_ptr<ThreadedConnection> connection = m_network->Accept())
+    {
+        Client client;
+        client.id = m_nextClient++;
+        client.connection = std::move(connection);
+        client.connection->SetLatency(m_conditions.latencyMs);
+        std::string payload;
+        ByteWriter writer(payload);
+        client.key = m_keys();
+        writer.Write(SYNC_PROTOCOL_VERSION);
+        writer.Write(client.id);
+        writer.Write<uint16_t>(m_datagrams ? m_datagrams->Port() : 0);
+        writer.Write(client.key);
+        Send(client, SyncMessage::Welcome, payload);
+        std::cerr << "Client " << client.id << " connected" << std::endl;
+        m_interest.AddClient(client.id);
+        m_clients.push_back(std::move(client));
+    }
+
+    for (Client& client: m_clients)
+    {
+        // A view region sent on connecting already limits the first shapes
+        ReadRequests(client, scene);
+        if (client.needsSnapshot)
+            SendSnapshot(client, scene);
+        // After this frame's delta, so deltas only wait on a bounded amount
+        m_assets.Send(*client.connection, client.assetQueue, m_assetStats);
+        client.connection->Flush();
+        if (client.connection->Queued() > MAX_CLIENT_BACKLOG)
+        {
+            std::cerr << "Client " << client.id << " has fallen too far behind" << std::endl;
+            client.connection->Close();
+        }
+    }
+    ReadDatagrams();
+
+    for (Client& client: m_clients)
+    {
+        if (!client.connection->IsOpen())
+        {
+            std::cerr << "Client " << client.id << " disconnected" << std::endl;
+            Disconnect(client);
+        }
+    }
+    m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(), [](const Client& client) { return !client.connection; }),
+                    m_clients.end());
+}
+
+std::vector<SceneHost::Edit> SceneHost::TakeEdits()
+{
+    m_applying.insert(m_applying.end(), m_edits.begin(), m_edits.end());
+    std::vector<Edit> edits;
+    std::swap(edits, m_edits);
+    return edits;
+}
+
+void SceneHost::StreamMotion(const std::vector<MotionSample>& samples, bool final)
+{
+    if (!m_datagrams)
+        return;
+    // Split to fit a datagram, each part stands alone
+    MotionPacket packet;
+    packet.origin = HOST_CLIENT_ID;
+    packet.timeMs = MotionClockMs();
+    packet.final = final;
+    for (size_t start = 0; start < samples.size(); start += MAX_MOTION_SAMPLES)
+    {
+        size_t end = std::min(samples.size(), start + MAX_MOTION_SAMPLES);
+        packet.sequence = ++m_motionSequence;
+        packet.samples.assign(samples.begin() + start, samples.begin() + end);
+        SendMotion(packet);
+    }
+}
+
+std::vector<MotionPacket> SceneHost::TakeMotion()
+{
+    std::vector<MotionPacket> motion;
+    std::swap(motion, m_motion);
+    return motion;
+}
+
+void SceneHost::SetNetworkConditions(const NetworkConditions& conditions)
+{
+    m_conditions = conditions;
+    if (m_datagrams)
+        m_datagrams->SetConditions(conditions);
+    for (Client& client: m_clients)
+        client.connection->SetLatency(conditions.latencyMs);
+}
+
+std::vector<ClientID> SceneHost::Clients() const
+{
+    std::vector<ClientID> clients;
+    for (const Client& client: m_clients)
+        clients.push_back(client.id);
+    return clients;
+}
+
+SyncStats SceneHost::Stats() const
+{
+    SyncStats stats = m_closedStats;
+    for (const Client& client: m_clients)
+    {
+        stats.bytesSent += client.connection->BytesSent();
+        stats.bytesReceived += client.connection->BytesReceived();
+        stats.messagesSent += client.messagesSent;
+        stats.messagesReceived += client.messagesReceived;
+    }
+    if (m_datagrams)
+    {
+        stats.datagramBytesSent += m_datagrams->BytesSent();
+        stats.datagramBytesReceived += m_datagrams->BytesReceived();
+    }
+    stats.assets = m_assetStats;
+    return stats;
+}
+
+void SceneHost::Send(Client& client, SyncMessage type, const std::string& payload)
+{
+    client.connection->Send(uint8_t(type), payload);
+    client.messagesSent++;
+}
+
+void SceneHost::SendSnapshot(Client& client, const std::shared_ptr<Scene>& scene)
+{
+    // Only the settings, the shapes the client sees follow in a delta
+    auto settings = std::make_shared<Scene>(m_resources);
+    settings->bgColor = scene->bgColor;
+    settings->grid = scene->grid;
+    settings->fog = scene->fog;
+    settings->cameras = scene->cameras;
+    settings->views = scene->views;
+    settings->SetImagesLocked(scene->GetImagesLocked());
+    settings->SetTokensLocked(scene->GetTokensLocked());
+    Send(client, SyncMessage::Snapshot, m_binarySerializer.Encode(settings));
+
+    client.known.clear();
+    m_interest.ResetClient(client.id);
+    m_interest.Update();
+    SendShapes(client, scene, {}, nullptr);
+    client.needsSnapshot = false;
+}
+
+void SceneHost::AnnounceAssets(Client& client, const std::vector<std::shared_ptr<Texture>>& textures)
+{
+    std::vector<AssetEntry> entries = m_assets.Announce(textures, client.announcedAssets);
+    if (entries.empty())
+        return;
+    std::string payload;
+    ByteWriter writer(payload);
+    writer.Write<uint32_t>(entries.size());
+    for (const AssetEntry& entry: entries)
+    {
+        writer.WriteString(entry.path);
+        writer.Write(entry.hash);
+        writer.Write(entry.size);
+    }
+    Send(client, SyncMessage::Assets, payload);
+}
+
+void SceneHost::SendDelta(const std::shared_ptr<Scene>& scene)
+{
+    // Brings the host's copy and what each client sees up to date
+    std::vector<ShapeID> changed;
+    std::unordered_set<ShapeID> seen;
+    for (ShapeID id: m_pending.shapes)
+    {
+        if (!seen.insert(id).second)
+            continue;
+
+        ShapeState state;
+        size_t index;
+        if ((index = scene->GetTokenIndex(id)) != NO_INDEX)
+        {
+            state = CaptureToken(*scene->tokens[index]);
+            state.owner = GetOwner(id);
+        }
+        else if ((index = scene->GetImageIndex(id)) != NO_INDEX)
+            state = CaptureImage(*scene->images[index]);
+        else
+        {
+            // Removed, or added and removed again within the frame. Clients
+            // that had it see it leave.
+            if (m_sent.erase(id))
+                m_interest.RemoveShape(id);
+            continue;
+        }
+
+        auto it = m_sent.find(id);
+        if (it != m_sent.end() && it->second.type == state.type && DiffFields(it->second, state) == SyncField::None)
+            continue;
+        m_interest.UpdateShape(id, state);
+        m_sent[id] = std::move(state);
+        changed.push_back(id);
+    }
+
+    std::string settings;
+    if (m_pending.settings || m_pending.walls)
+    {
+        // Every wall is sent again, edits are rare and usually a few walls
+        SerializeFlag flags = SerializeFlag::Fog | SerializeFlag::Grid;
+        if (m_pending.walls)
+            flags |= SerializeFlag::Walls;
+        nlohmann::json json = m_serializer.SerializeScene(scene, flags);
+        json["imagesLocked"] = scene->GetImagesLocked();
+        json["tokensLocked"] = scene->GetTokensLocked();
+        settings = json.dump();
+    }
+    bool hasSettings = m_pending.settings || m_pending.walls;
+    m_pending = ActionEffects();
+
+    // Clients' views may have changed without anything in the scene changing
+    m_interest.Update();
+    bool sent = false;
+    for (Client& client: m_clients)
+    {
+        // Clients waiting on a snapshot get this frame's state with it
+        if (!client.needsSnapshot)
+            sent |= SendShapes(client, scene, changed, hasSettings ? &settings : nullptr);
+    }
+    if (sent)
+        m_frame++;
+}
+
+bool SceneHost::SendShapes(Client& client, const std::shared_ptr<Scene>& scene, const std::vector<ShapeID>& changed, const std::string* settings)
+{
+    InterestManager::Changes changes = m_interest.TakeChanges(client.id);
+    std::string shapes;
+    ByteWriter shapeWriter(shapes);
+    uint32_t count = 0;
+    for (ShapeID id: changes.left)
+    {
+        if (!client.known.erase(id))
+            continue;
+        ShapeState removed;
+        removed.type = SyncShapeType::Removed;
+        shapeWriter.WriteShape(id, SyncField::None, removed);
+        count++;
+    }
+
+    // New images the client may need to fetch
+    std::vector<std::shared_ptr<Texture>> textures;
+    auto write = [&](ShapeID id) {
+        auto it = m_sent.find(id);
+        if (it == m_sent.end())
+            return;
+        ShapeState state = it->second;
+        HideFields(state, client.id);
+
+        // Clients only need an index for shapes they don't have yet
+        SyncField fields;
+        auto known = client.known.find(id);
+        if (known == client.known.end() || known->second.type != state.type)
+        {
+            size_t index = scene->GetTokenIndex(id);
+            state.index = index != NO_INDEX ? index : scene->GetImageIndex(id);
+            fields = SyncField::All;
+        }
+        else
+            fields = DiffFields(known->second, state);
+        if (fields == SyncField::None)
+            return;
+        if (HasField(fields, SyncField::Texture))
+        {
+            if (state.type == SyncShapeType::Token)
+                textures.push_back(scene->GetToken(id)->GetIcon());
+            else
+                textures.push_back(scene->GetImage(id)->GetImage());
+        }
+        if (HasField(fields, SyncField::Height) && !state.heightmap.empty())
+            textures.push_back(scene->GetImage(id)->GetHeightmap());
+        shapeWriter.WriteShape(id, fields, state);
+        client.known[id] = std::move(state);
+        count++;
+    };
+    for (ShapeID id: changes.entered)
+        write(id);
+    for (ShapeID id: changed)
+    {
+        if (m_interest.IsVisible(client.id, id))
+            write(id);
+    }
+
+    if (count == 0 && !settings)
+        return false;
+    std::string payload;
+    ByteWriter writer(payload);
+    writer.Write(m_frame);
+    writer.Write(count);
+    payload += shapes;
+    writer.Write<uint8_t>(settings != nullptr);
+    if (settings)
+        writer.WriteString(*settings);
+    // Announced ahead of the delta that uses them
+    AnnounceAssets(client, textures);
+    Send(client, SyncMessage::Delta, payload);
+    return true;
+}
+
+void SceneHost::ReadRequests(Client& client, const std::shared_ptr<Scene>& scene)
+{
+    client.connection->Receive();
+    Connection::Message message;
+    while (client.connection->Next(message))
+    {
+        client.messagesReceived++;
+        if (message.type == uint8_t(SyncMessage::AssetRequest))
+        {
+            if (!ReadAssetRequest(client, message.payload))
+            {
+                std::cerr << "Client " << client.id << " requested an unknown asset" << std::endl;
+                client.connection->Close();
+                return;
+            }
+            continue;
+        }
+        if (message.type == uint8_t(SyncMessage::ViewRegion))
+        {
+            if (!ReadViewRegion(client, message.payload))
+            {
+                std::cerr << "Client " << client.id << " sent a malformed view region" << std::endl;
+                client.connection->Close();
+                return;
+            }
+            continue;
+        }
+        if (message.type != uint8_t(SyncMessage::Edit))
+        {
+            std::cerr << "Client " << client.id << " sent unexpected message " << int(message.type) << std::endl;
+            client.connection->Close();
+            return;
+        }
+
+        Edit edit;
+        edit.client = client.id;
+        ByteReader reader(message.payload);
+        if (!reader.Read(edit.sequence) || !reader.ReadShape(edit.id, edit.fields, edit.state) || !reader.AtEnd())
+        {
+            std::cerr << "Client " << client.id << " sent a malformed edit" << std::endl;
+            client.connection->Close();
+            return;
+        }
+
+        if (Validate(client, edit, scene))
+        {
+            m_edits.push_back(edit);
+            continue;
+        }
+        std::string payload;
+        ByteWriter writer(payload);
+        writer.Write(edit.sequence);
+        writer.Write<uint8_t>(0);
+        Send(client, SyncMessage::Ack, payload);
+        m_closedStats.editsRejected++;
+    }
+}
+
+void SceneHost::ReadDatagrams()
+{
+    if (!m_datagrams)
+        return;
+    m_datagrams->Flush();
+
+    DatagramAddress address;
+    std::string bytes;
+    SyncDatagram type;
+    uint32_t key;
+    MotionPacket packet;
+    while (m_datagrams->Receive(address, bytes))
+    {
+        // Anything unexpected is dropped quietly, datagrams are easily spoofed
+        if (!DecodeDatagram(bytes, type, key, packet))
+            continue;
+        auto it = std::find_if(m_clients.begin(), m_clients.end(), [key](const Client& client) { return client.key == key; });
+        if (it == m_clients.end())
+            continue;
+        if (type == SyncDatagram::Hello)
+        {
+            it->datagramAddress = address;
+            continue;
+        }
+        if (address != it->datagramAddress || packet.origin != it->id)
+            continue;
+
+        // Clients only preview moving their own tokens
+        ClientID client = it->id;
+        packet.samples.erase(std::remove_if(packet.samples.begin(), packet.samples.end(),
+                                            [this, client](const MotionSample& sample) { return GetOwner(sample.id) != client; }),
+                             packet.samples.end());
+        if (packet.samples.empty() && !packet.final)
+            continue;
+        SendMotion(packet);
+        m_motion.push_back(std::move(packet));
+    }
+}
+
+void SceneHost::SendMotion(const MotionPacket& packet)
+{
+    MotionPacket visible = packet;
+    for (const Client& client: m_clients)
+    {
+        // The sender shows its own drag directly
+        if (client.id == packet.origin || !client.datagramAddress.IsValid())
+            continue;
+        visible.samples.clear();
+        for (const MotionSample& sample: packet.samples)
+        {
+            if (m_interest.IsVisible(client.id, sample.id))
+                visible.samples.push_back(sample);
+        }
+        // Clients that see none of the drag have no preview to end either
+        if (!visible.samples.empty())
+            m_datagrams->SendTo(client.datagramAddress, EncodeMotion(client.key, visible));
+    }
+}
+
+bool SceneHost::ReadAssetRequest(Client& client, const std::string& payload)
+{
+    ByteReader reader(payload);
+    ContentHash hash;
+    uint64_t offset;
+    uint8_t preview;
+    return reader.Read(hash) && reader.Read(offset) && reader.Read(preview) && reader.AtEnd() &&
+           m_assets.Request(client.assetQueue, hash, offset, preview);
+}
+
+bool SceneHost::ReadViewRegion(Client& client, const std::string& payload)
+{
+    ByteReader reader(payload);
+    glm::vec2 lo, hi;
+    if (!reader.Read(lo) || !reader.Read(hi) || !reader.AtEnd())
+        return false;
+    if (!std::isfinite(lo.x) || !std::isfinite(lo.y) || !std::isfinite(hi.x) || !std::isfinite(hi.y))
+        return false;
+    m_interest.SetViewRegion(client.id, Bounds2D(lo, hi));
+    return true;
+}
+
+bool SceneHost::Validate(const Client& client, const Edit& edit, const std::shared_ptr<Scene>& scene) const
+{
+    if (edit.fields == SyncField::None || (edit.fields & ~CLIENT_EDITABLE_FIELDS) != SyncField::None)
+        return false;
+    if (scene->GetTokenIndex(edit.id) == NO_INDEX || GetOwner(edit.id) != client.id)
+        return false;
+    if (HasField(edit.fields, SyncField::Rotation) && !std::isfinite(edit.state.rotation))
+        return false;
+    if (HasField(edit.fields, SyncField::Opacity) && !(edit.state.opacity >= 0.0f && edit.state.opacity <= 1.0f))
+        return false;
+    if (HasField(edit.fields, SyncField::Height) && !std::isfinite(edit.state.height))
+        return false;
+    return true;
+}
+
+void SceneHost::Disconnect(Client& client)
+{
+    if (!client.connection)
+        return;
+    client.connection->Flush();
+    m_closedStats.bytesSent += client.connection->BytesSent();
+    m_closedStats.bytesReceived += client.connection->BytesReceived();
+    m_closedStats.messagesSent += client.messagesSent;
+    m_closedStats.messagesReceived += client.messagesReceived;
+    m_interest.RemoveClient(client.id);
+    client.connection = nullptr;
+}
@@ -0,0 +1,301 @@
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <Constants.h>
+#include <Resources.h>
+#include <glutil/Buffers.h>
+#include <glutil/GLTexture.h>
+#include <glutil/Mesh.h>
+#include <glutil/Shader.h>
+#include <glutil/TransformStore.h>
+#include <model/BGImage.h>
+#include <model/FogOfWar.h>
+#include <model/Grid.h>
+#include <model/Overlays.h>
+#include <model/Scene.h>
+#include <model/Token.h>
+#include <model/Walls.h>
+
+#include <view/Renderer.h>
+
+
+Renderer::Renderer(std::shared_ptr<Resources> resources) : m_resources(resources) {}
+
+void Renderer::CreateMesh(MeshType meshType, std::vector<Vertex> vertices, std::vector<uint> indices)
+{
+    m_meshes[meshType] = std::make_shared<Mesh>(vertices, indices);
+}
+
+std::shared_ptr<Mesh> Renderer::GetMesh(MeshType meshType)
+{
+    return m_meshes.at(meshType);
+}
+
+void Renderer::CreateShader(ShaderType shaderType, const char* vs, const char* fs)
+{
+    m_shaders[shaderType] = std::make_shared<Shader>(vs, fs);
+}
+
+std::shared_ptr<Shader> Renderer::GetShader(ShaderType shaderType)
+{
+    return m_shaders.at(shaderType);
+}
+
+void Renderer::Draw(Scene& scene)
+{
+    // Everything moved since the last frame is rebuilt in one pass before upload
+    TransformStore::Global().RebuildDirty();
+
+    glm::vec4 bgColor = scene.bgColor;
+    glClearColor(bgColor.x * bgColor.w, bgColor.y * bgColor.w, bgColor.z * bgColor.w, bgColor.w);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    std::shared_ptr<Shader> imageShader = GetShader(ShaderType::Image);
+    imageShader->use();
+    const Selection& imageSelection = scene.GetImageSelection();
+    for (size_t i = 0; i < scene.images.size(); i++)
+        DrawImage(*scene.images[i], *imageShader, imageSelection.IsSelected(i));
+
+    DrawGrid(*scene.grid);
+
+    std::shared_ptr<Shader> tokenShader = GetShader(ShaderType::Token);
+    const Selection& tokenSelection = scene.GetTokenSelection();
+    for (size_t i = 0; i < scene.tokens.size(); i++)
+    {
+        tokenShader->use();
+        DrawToken(*scene.tokens[i], *tokenShader, tokenSelection.IsSelected(i));
+        DrawTokenStatuses(*scene.tokens[i]);
+    }
+
+    DrawFog(*scene.fog);
+    DrawWalls(*scene.fog);
+
+    // Overlays have their own shaders
+    for (const std::shared_ptr<Overlay>& overlay : scene.overlays)
+        DrawOverlay(*overlay);
+}
+
+size_t Renderer::ReleaseUnusedTextures()
+{
+    std::vector<std::shared_ptr<Texture>> textures = m_resources->UnreferencedTextures();
+    for (const auto& texture: textures)
+        ReleaseTexture(*texture);
+    return textures.size();
+}
+
+void Renderer::DrawImage(BGImage& image, Shader& shader, bool selected)
+{
+    if (!image.IsVisible())
+        return;
+
+    shader.setMat4("model", *image.GetModel()->Value());
+
+    glm::vec4 colour = image.GetTint();
+    if (selected)
+        colour = glm::vec4(SELECTION_COLOR, colour.w);
+    else if (image.isHighlighted)
+        colour = glm::vec4(HIGHLIGHT_COLOR, colour.w);
+    shader.setFloat4("color", colour.x, colour.y, colour.z, colour.w);
+
+    auto texture = image.GetImage();
+    if (texture && UploadTexture(*texture))
+    {
+        BindTexture(*texture, GL_TEXTURE0);
+        shader.setInt("diffuse", 0);
+    }
+    GetMesh(MeshType::Quad)->Draw(shader);
+}
+
+void Renderer::DrawGrid(Grid& grid)
+{
+    std::shared_ptr<Shader> shader = GetShader(ShaderType::Grid);
+    shader->use();
+    shader->setFloat("gridScale", grid.GetScale());
+    glm::vec3 colour = grid.GetColour();
+    shader->setFloat3("gridColour", colour.x, colour.y, colour.z);
+    GetMesh(MeshType::Quad2)->Draw(*shader);
+}
+
+void Renderer::DrawToken(Token& token, Shader& shader, bool selected)
+{
+    shader.setMat4("model", *token.GetModel()->Value());
+
+    glm::vec4 highlight;
+    if (selected)
+        highlight = SELECTION_COLOR_ALPHA;
+    else if (token.isHighlighted)
+        highlight = HIGHLIGHT_COLOR_ALPHA;
+    else
+        highlight = BLACK_RGBA;
+
+    auto texture = token.GetIcon();
+    if (texture && UploadTexture(*texture))
+    {
+        BindTexture(*texture, GL_TEXTURE0);
+        shader.setInt("diffuse", 0);
+    }
+
+    glm::vec4 borderColor = token.GetBorderColor();
+    shader.setFloat4("highlightColor", highlight.x, highlight.y, highlight.z, highlight.w);
+    shader.setFloat4("borderColor", borderColor.x, borderColor.y, borderColor.z, borderColor.w);
+    shader.setFloat("borderWidth", token.GetBorderWidth());
+    shader.setFloat("opacity", token.GetOpacity());
+    GetMesh(MeshType::Quad)->Draw(shader);
+}
+
+void Renderer::DrawTokenStatuses(Token& token)
+{
+    auto quad = GetMesh(MeshType::Quad);
+    std::shared_ptr<Shader> statusShader = GetShader(ShaderType::Status);
+
+    auto statuses = token.GetStatuses();
+    if (statuses.any())
+    {
+        statusShader->use();
+        BindTexture(*m_resources->GetTexture(Resources::TextureType::Status), GL_TEXTURE0);
+        statusShader->setInt("diffuse", 0);
+
+        for (unsigned int i=0; i < statuses.size(); i++)
+        {
+            if (!statuses[i])
+                continue;
+
+            float degree = glm::radians(90 - 360.0f * i / statuses.size());
+
+            glm::mat4 matrix = glm::mat4(1.0f);
+            matrix = glm::translate(matrix, glm::vec3(token.GetModel()->GetPos() + glm::vec2(glm::cos(degree), glm::sin(degree)) * token.GetModel()->GetScale() * 0.35f, 0.0f));
+            matrix = glm::scale(matrix, glm::vec3(token.GetModel()->GetScalef() * 0.15f));
+            statusShader->setMat4("model", matrix);
+            statusShader->setFloat4("color", statusColors[i].x, statusColors[i].y, statusColors[i].z, token.GetOpacity());
+
+            quad->Draw(*statusShader);
+        }
+    }
+
+    if (token.GetXStatus())
+    {
+        statusShader->use();
+        statusShader->setMat4("model", *token.GetModel()->Value());
+        BindTexture(*m_resources->GetTexture(Resources::TextureType::XStatus), GL_TEXTURE0);
+        statusShader->setInt("diffuse", 0);
+        statusShader->setFloat4("color", 1.0f, 1.0f, 1.0f, token.GetOpacity());
+        quad->Draw(*statusShader);
+    }
+}
+
+void Renderer::DrawOverlay(Overlay& overlay)
+{
+    auto rect = dynamic_cast<RectOverlay*>(&overlay);
+    if (!rect)
+        return;
+
+    std::shared_ptr<Shader> shader = GetShader(ShaderType::ScreenRect);
+    shader->use();
+    glm::vec4 colour = rect->GetColour();
+    shader->setFloat4("colour", colour.x, colour.y, colour.z, colour.w);
+    shader->setFloat4("coords", rect->MinX(), rect->MinY(), rect->MaxX(), rect->MaxY());
+    GetMesh(MeshType::Quad2)->Draw(*shader);
+}
+
+void Renderer::DrawFog(FogOfWar& fog)
+{
+    if (!fog.IsMasking())
+        return;
+
+    if (!m_fogMask)
+    {
+        m_fogMask = std::make_unique<MaskTarget>();
+        m_fogFans = std::make_unique<VertexBuffer2D>();
+        m_fogTriangles = std::make_unique<VertexBuffer2D>();
+    }
+
+    // Each polygon is a fan from its origin, closed back to its first point,
+    // unless it's over terrain and comes as triangles
+    if (m_fog != &fog || m_polygonsVersion != fog.PolygonsVersion())
+    {
+        m_fog = &fog;
+        m_polygonsVersion = fog.PolygonsVersion();
+        m_points.clear();
+        m_fanFirsts.clear();
+        m_fanCounts.clear();
+        m_triangles.clear();
+        for (const VisionPolygon* polygon: fog.Polygons())
+        {
+            if (!polygon->triangles.empty())
+            {
+                m_triangles.insert(m_triangles.end(), polygon->triangles.begin(), polygon->triangles.end());
+                continue;
+            }
+            if (polygon->points.empty())
+                continue;
+            m_fanFirsts.push_back(m_points.size());
+            m_points.push_back(polygon->origin);
+            m_points.insert(m_points.end(), polygon->points.begin(), polygon->points.end());
+            m_points.push_back(polygon->points.front());
+            m_fanCounts.push_back(polygon->points.size() + 2);
+        }
+        m_fogFans->Upload(m_points);
+        m_fogTriangles->Upload(m_triangles);
+    }
+
+    std::shared_ptr<Shader> flatShader = GetShader(ShaderType::Flat);
+    m_fogMask->Begin();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    flatShader->use();
+    flatShader->setFloat4("colour", 1.0f, 1.0f, 1.0f, 1.0f);
+    if (!m_fanFirsts.empty())
+        m_fogFans->MultiDraw(GL_TRIANGLE_FAN, m_fanFirsts, m_fanCounts);
+    if (m_fogTriangles->Size() > 0)
+        m_fogTriangles->Draw(GL_TRIANGLES, 0, m_fogTriangles->Size());
+    m_fogMask->End();
+
+    std::shared_ptr<Shader> fogShader = GetShader(ShaderType::Fog);
+    fogShader->use();
+    m_fogMask->Bind(GL_TEXTURE0);
+    fogShader->setInt("mask", 0);
+    fogShader->setFloat4("colour", FOG_COLOR.x, FOG_COLOR.y, FOG_COLOR.z, fog.maskOpacity);
+    GetMesh(MeshType::Quad2)->Draw(*fogShader);
+}
+
+void Renderer::DrawWalls(FogOfWar& fog)
+{
+    if (!fog.showWalls)
+        return;
+
+    if (!m_wallLines)
+    {
+        m_wallLines = std::make_unique<VertexBuffer2D>();
+        m_draftLine = std::make_unique<VertexBuffer2D>();
+    }
+
+    if (m_walls != &fog.walls || m_wallsVersion != fog.walls.Version())
+    {
+        m_walls = &fog.walls;
+        m_wallsVersion = fog.walls.Version();
+        m_points.clear();
+        for (const Wall& wall: fog.walls.All())
+        {
+            m_points.push_back(wall.start);
+            m_points.push_back(wall.end);
+        }
+        m_wallLines->Upload(m_points);
+    }
+
+    std::shared_ptr<Shader> shader = GetShader(ShaderType::Flat);
+    shader->use();
+    shader->setFloat4("colour", WALL_COLOR.x, WALL_COLOR.y, WALL_COLOR.z, 1.0f);
+    if (m_wallLines->Size() > 0)
+        m_wallLines->Draw(GL_LINES, 0, m_wallLines->Size());
+
+    if (fog.draft.size() > 1)
+    {
+        m_draftLine->Upload(fog.draft);
+        shader->setFloat4("colour", SELECTION_COLOR.x, SELECTION_COLOR.y, SELECTION_COLOR.z, 1.0f);
+        m_draftLine->Draw(GL_LINE_STRIP, 0, fog.draft.size());
+    }
+}
@@ -1,5 +1,6 @@
 #include <vector>
 
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -7,6 +8,7 @@
 #include <ImGuiFileDialog.h>
 
 #include <glutil/Matrix2D.h>
+#include <model/FogOfWar.h>
 #include <model/Shape2D.h>
 #include <model/Scene.h>
 #include <model/Token.h>
@@ -134,6 +136,17 @@ void UIWindow::DrawImageOptions(const std::shared_ptr<BGImage> &image)
     if (ImGui::Checkbox("Lock Size Ratio", &lockRatio))
         imagePropertyChanged.emit(image, Image_LockRatio, ImagePropertyValue(lockRatio));
 
+    // Greyscale, blocks line of sight where it's higher than the viewer
+    std::string heightmapPath = image->GetHeightmap() ? image->GetHeightmap()->filename : "";
+    if (FileLine("ChooseHeightmap", "Heightmap", heightmapPath))
+        imagePropertyChanged.emit(image, Image_Heightmap, ImagePropertyValue(heightmapPath));
+    if (image->GetHeightmap())
+    {
+        float heightScale = image->GetHeightScale();
+        if (ImGui::SliderFloat("Height Scale", &heightScale, 0, 50, "%.2f"))
+            imagePropertyChanged.emit(image, Image_HeightScale, ImagePropertyValue(heightScale));
+    }
+
     const std::shared_ptr<Matrix2D> &matrix2D = image->GetModel();
 
     glm::vec2 pos = matrix2D->GetPos();
@@ -178,6 +191,10 @@ void UIWindow::DrawTokenOptions(const std::shared_ptr<Token> &token)
     std::string name = token->GetName();
     if (ImGui::InputText("Name", &name, ImGuiInputTextFlags_EnterReturnsTrue))
         tokenPropertyChanged.emit(token, Token_Name, TokenPropertyValue(name));
+    ImGui::SameLine();
+    bool nameHidden = token->IsNameHidden();
+    if (ImGui::Checkbox("Hide##TokenName", &nameHidden))
+        tokenPropertyChanged.emit(token, Token_NameHidden, TokenPropertyValue(nameHidden));
 
     std::string iconPath = token->GetIcon()->filename;
     if (FileLine("ChooseTokenIcon", "Icon", iconPath))
@@ -187,6 +204,11 @@ void UIWindow::DrawTokenOptions(const std::shared_ptr<Token> &token)
     if (ImGui::SliderFloat("Border Width", &borderWidth, 0, 1))
         tokenPropertyChanged.emit(token, Token_BorderWidth, TokenPropertyValue(borderWidth));
 
+    // Above the ground, lets it see over terrain
+    float height = token->GetHeight();
+    if (ImGui::DragFloat("Height", &height, 0.1f, 0.0f, 100.0f, "%.1f"))
+        tokenPropertyChanged.emit(token, Token_Height, TokenPropertyValue(height));
+
     glm::vec4 borderColor = token->GetBorderColor();
     if (ImGui::ColorEdit3("Border Colour", (float *)&borderColor))
         tokenPropertyChanged.emit(token, Token_BorderColor, TokenPropertyValue(borderColor));
@@ -263,6 +285,89 @@ void UIWindow::DrawCameraSection()
     }
 }
 
+void UIWindow::DrawNetworkSection()
+{
+    if (!ImGui::CollapsingHeader("Network"))
+        return;
+
+    // Read by `mapmaker --display` on the same machine, eg, on a TV
+    bool mirrored = m_syncStatus.mirrored;
+    if (ImGui::Checkbox("Share with player display", &mirrored))
+        mirrorChanged.emit(mirrored);
+
+    const SyncStats& stats = m_syncStatus.stats;
+    switch (m_syncStatus.mode)
+    {
+    case SyncStatus::Mode::Offline:
+        ImGui::InputInt("Port", &m_syncPort);
+        if (ImGui::Button("Host"))
+            hostClicked.emit(m_syncPort);
+        ImGui::InputText("Address", &m_joinAddress);
+        if (ImGui::Button("Join"))
+            joinClicked.emit(m_joinAddress, m_syncPort);
+        return;
+    case SyncStatus::Mode::Hosting:
+    {
+        ImGui::Text("Hosting on port %u, %zu clients", m_syncStatus.port, m_syncStatus.clients.size());
+        if (ImGui::Button("Give selected to host"))
+            assignOwnerClicked.emit(HOST_CLIENT_ID);
+        for (ClientID client: m_syncStatus.clients)
+        {
+            std::string label = "Give selected to client " + std::to_string(client);
+            if (ImGui::Button(label.c_str()))
+                assignOwnerClicked.emit(client);
+        }
+        float visionRange = m_syncStatus.visionRange;
+        if (ImGui::DragFloat("Client vision", &visionRange, 0.5f, 0.0f, 1000.0f, visionRange > 0.0f ? "%.1f" : "Unlimited"))
+            visionRangeChanged.emit(visionRange);
+        ImGui::Text("Edits: %llu accepted, %llu rejected", (unsigned long long)stats.editsAccepted, (unsigned long long)stats.editsRejected);
+        break;
+    }
+    case SyncStatus::Mode::Client:
+        ImGui::Text("Connected as client %u", m_syncStatus.id);
+        ImGui::Text("Edit latency: %.1f ms last, %.1f ms average, %.0f ms 99th percentile, %.1f ms max", stats.lastLatencyMs,
+                    stats.averageLatencyMs, stats.latencies.Percentile(0.99), stats.maxLatencyMs);
+        ImGui::Text("Edits: %llu accepted, %llu rejected, %llu corrected", (unsigned long long)stats.editsAccepted,
+                    (unsigned long long)stats.editsRejected, (unsigned long long)stats.corrections);
+        break;
+    }
+    ImGui::Text("Sent %.1f KB in %llu messages, received %.1f KB in %llu messages", stats.bytesSent / 1024.0,
+                (unsigned long long)stats.messagesSent, stats.bytesReceived / 1024.0, (unsigned long long)stats.messagesReceived);
+    const MotionStats& motion = m_syncStatus.motion;
+    ImGui::Text("Drag previews: sent %.1f KB, received %.1f KB in %llu packets, %llu missed, %llu late",
+                stats.datagramBytesSent / 1024.0, stats.datagramBytesReceived / 1024.0, (unsigned long long)motion.packetsReceived,
+                (unsigned long long)motion.packetsMissed, (unsigned long long)motion.packetsLate);
+    ImGui::Text("Images: %.1f KB transferred, %llu complete, %llu previews, %llu already cached", stats.assets.bytes / 1024.0,
+                (unsigned long long)stats.assets.completed, (unsigned long long)stats.assets.previews, (unsigned long long)stats.assets.cached);
+    if (ImGui::Button("Disconnect"))
+        disconnectClicked.emit();
+}
+
+void UIWindow::DrawFogSection()
+{
+    if (!ImGui::CollapsingHeader("Fog of War"))
+        return;
+
+    const std::shared_ptr<FogOfWar>& fog = m_scene->fog;
+    bool enabled = fog->IsEnabled();
+    if (ImGui::Checkbox("Enabled##Fog", &enabled))
+        fogPropertyChanged.emit(fog, Fog_Enabled, FogPropertyValue(enabled));
+
+    float range = fog->GetRange();
+    if (ImGui::SliderFloat("Range##Fog", &range, 1.0f, 500.0f, "%.1f", ImGuiSliderFlags_Logarithmic))
+        fogPropertyChanged.emit(fog, Fog_Range, FogPropertyValue(range));
+
+    bool drawWalls = fog->showWalls;
+    if (ImGui::Checkbox("Draw Walls", &drawWalls))
+        wallToolChanged.emit(drawWalls);
+    if (drawWalls)
+        ImGui::TextUnformatted("Click to add points, right click or Enter to finish, Ctrl+click removes a wall");
+
+    ImGui::Text("%zu walls, %zu of %zu tokens swept last frame", fog->walls.Size(), fog->NumComputed(), fog->Polygons().size());
+    if (ImGui::Button("Clear Walls"))
+        clearWallsClicked.emit();
+}
+
 void UIWindow::DrawGridSection()
 {
     if (ImGui::CollapsingHeader("Grid"))
@@ -288,7 +393,7 @@ void UIWindow::DrawImageSection()
                     ImGui::PushStyleColor(ImGuiCol_Header, SELECT_COLOR);
                     ImGui::PushStyleColor(ImGuiCol_HeaderHovered, SELECT_COLOR);
                 }
-                if (ImGui::Selectable((image->GetImage()->Name() + "##Item" + std::to_string(i++)).c_str(), image->isSelected || isUISelected))
+                if (ImGui::Selectable((image->GetImage()->Name() + "##Item" + std::to_string(i++)).c_str(), m_scene->IsSelected(image->GetID()) || isUISelected))
                     shapeSelectionChanged.emit(static_cast<std::shared_ptr<Shape2D>>(image), HasKeyPressed(GLFW_KEY_LEFT_CONTROL));
 
                 if (isUISelected)
@@ -300,7 +405,7 @@ void UIWindow::DrawImageSection()
         if (ImGui::Button("Add Image"))
             addImageClicked.emit();
 
-        if (std::find(m_scene->images.begin(), m_scene->images.end(), m_displayPropertiesImage) != m_scene->images.end())
+        if (m_displayPropertiesImage && m_scene->GetImage(m_displayPropertiesImage->GetID()) == m_displayPropertiesImage)
             DrawImageOptions(m_displayPropertiesImage);
         else
             m_displayPropertiesImage = nullptr;
@@ -326,7 +431,7 @@ void UIWindow::DrawTokenSection()
                     ImGui::PushStyleColor(ImGuiCol_Header, SELECT_COLOR);
                     ImGui::PushStyleColor(ImGuiCol_HeaderHovered, SELECT_COLOR);
                 }
-                if (ImGui::Selectable((token->GetName() + "##Item" + std::to_string(i++)).c_str(), token->isSelected || isUISelected))
+                if (ImGui::Selectable((token->GetName() + "##Item" + std::to_string(i++)).c_str(), m_scene->IsSelected(token->GetID()) || isUISelected))
                     shapeSelectionChanged.emit(static_cast<std::shared_ptr<Shape2D>>(token), HasKeyPressed(GLFW_KEY_LEFT_CONTROL));
 
                 if (isUISelected)
@@ -338,7 +443,7 @@ void UIWindow::DrawTokenSection()
         if (ImGui::Button("Add Token"))
             addTokenClicked.emit();
 
-        if (std::find(m_scene->tokens.begin(), m_scene->tokens.end(), m_displayPropertiesToken) != m_scene->tokens.end())
+        if (m_displayPropertiesToken && m_scene->GetToken(m_displayPropertiesToken->GetID()) == m_displayPropertiesToken)
             DrawTokenOptions(m_displayPropertiesToken);
         else
             m_displayPropertiesToken = nullptr;
@@ -368,8 +473,10 @@ void UIWindow::Draw()
 
         DrawCameraSection();
         DrawGridSection();
+        DrawFogSection();
         DrawImageSection();
         DrawTokenSection();
+        DrawNetworkSection();
 
         // Spacer
         ImGui::Dummy(ImVec2(0.0f, 20.0f));
@@ -384,11 +491,12 @@ void UIWindow::Draw()
         }
 
         ImGui::SameLine();
-        if (FilepathButton("Save As", "saveDialog", ".json", path))
+        // Saving with the other extension converts between JSON and binary
+        if (FilepathButton("Save As", "saveDialog", ".json,.bmscene,.bmbundle", path))
             saveClicked.emit(path);
 
         ImGui::SameLine();
-        if (FilepathButton("Load", "loadDialog", ".json", path))
+        if (FilepathButton("Load", "loadDialog", ".json,.bmscene,.bmbundle", path))
             loadClicked.emit(path, mergeLoad);
 
         ImGui::SameLine();
@@ -396,6 +504,19 @@ void UIWindow::Draw()
 
         // Debug
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        // Only gathered while open, it visits every shape
+        if (ImGui::TreeNode("Texture Sharing"))
+        {
+            std::vector<std::shared_ptr<Texture>> textures;
+            for (const auto& image: m_scene->images)
+                textures.push_back(image->GetImage());
+            for (const auto& token: m_scene->tokens)
+                textures.push_back(token->GetIcon());
+            Resources::TextureStats stats = Resources::Stats(textures);
+            ImGui::Text("%zu paths, %zu uploads, %.1f MB duplicate VRAM avoided", stats.numTextures, stats.numUploads,
+                        stats.bytesAvoided / (1024.0 * 1024.0));
+            ImGui::TreePop();
+        }
 
         ImGui::End();
     }
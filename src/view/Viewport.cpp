@@ -3,6 +3,7 @@
 
 #include <glutil/Buffers.h>
 #include <model/Scene.h>
+#include <view/Renderer.h>
 #include <view/Window.h>
 
 #include <view/Viewport.h>
@@ -32,6 +33,11 @@ glm::vec2 Viewport::ScreenToWorldOffset(float x, float y)
     );
 }
 
+void Viewport::SetRenderer(std::shared_ptr<Renderer> renderer)
+{
+    m_renderer = renderer;
+}
+
 void Viewport::SetScene(std::shared_ptr<Scene> scene, int cameraIndex)
 {
     m_scene = scene;
@@ -81,8 +87,7 @@ void Viewport::Draw()
         m_camera = m_scene->GetViewCamera(PRIMARY);
         RefreshCamera();
     }
-    // TODO: Move drawing logic out of scene/other classes and into this class.
-    m_scene->Draw();
+    m_renderer->Draw(*m_scene);
 }
 
 void Viewport::OnWindowResized(int width, int height)
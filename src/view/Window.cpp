@@ -45,6 +45,12 @@ void close_callback(GLFWwindow* window)
     window_->OnCloseRequested();
 }
 
+void focus_callback(GLFWwindow* window, int focused)
+{
+    Window* window_ = (Window*)glfwGetWindowUserPointer(window);
+    window_->OnFocusChanged(focused == GLFW_TRUE);
+}
+
 // =============================================================================
 
 Window::Window(unsigned int width, unsigned int height, const char* name, std::shared_ptr<Window> share) : m_width(width), m_height(height)
@@ -80,6 +86,7 @@ Window::Window(unsigned int width, unsigned int height, const char* name, std::s
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
     glfwSetWindowCloseCallback(window, close_callback);
+    glfwSetWindowFocusCallback(window, focus_callback);
 }
 
 Window::~Window()
@@ -167,6 +174,7 @@ void Window::DisconnectSignals()
     mouseScrolled.disconnect();
     keyChanged.disconnect();
     sizeChanged.disconnect();
+    focusChanged.disconnect();
 }
 
 bool Window::HasKeyPressed(int key) { return glfwGetKey(window, key) == GLFW_PRESS; }
@@ -188,3 +196,4 @@ void Window::OnCloseRequested()
     glfwSetWindowShouldClose(window, GLFW_FALSE);
     closeRequested.emit();
 }
+void Window::OnFocusChanged(bool focused) { focusChanged.emit(focused); }